@@ -1,16 +1,105 @@
-PKGCONFIG += gstreamer-1.0 gstreamer-app-1.0
+PKGCONFIG += gstreamer-1.0 gstreamer-base-1.0 gstreamer-app-1.0 gstreamer-pbutils-1.0 gstreamer-video-1.0 gstreamer-gl-1.0
 CONFIG += qt c++14 link_pkgconfig moc
 QT += core qml quick
 
 TARGET = qmlglsink-example
 
-SOURCES += src/main.cpp
-HEADERS += src/ScopeGuard.hpp
+SOURCES += \
+	src/main.cpp \
+	src/AdaptiveStreamingTuner.cpp \
+	src/AutoplugCache.cpp \
+	src/ClosedCaptions.cpp \
+	src/DecoderAutotune.cpp \
+	src/FrameMetadataController.cpp \
+	src/FramePusher.cpp \
+	src/IdleController.cpp \
+	src/Log.cpp \
+	src/MediaIndex.cpp \
+	src/Pipeline.cpp \
+	src/PlayerController.cpp \
+	src/Playlist.cpp \
+	src/PlaylistPlayer.cpp \
+	src/PositionStore.cpp \
+	src/PressureMonitor.cpp \
+	src/QosController.cpp \
+	src/RawFrameSource.cpp \
+	src/ReadAheadFileSrc.cpp \
+	src/ReconnectController.cpp \
+	src/ResolutionChangeMonitor.cpp \
+	src/ResourceScaler.cpp \
+	src/SoakTest.cpp \
+	src/StallMonitor.cpp \
+	src/StateChangeProfiler.cpp \
+	src/StillImageItem.cpp \
+	src/TextureCache.cpp \
+	src/ThroughputBenchmark.cpp \
+	src/Utils.cpp \
+	src/VideoConversion.cpp \
+	src/VideoScaler.cpp
+HEADERS += \
+	src/AdaptiveStreamingTuner.hpp \
+	src/AutoplugCache.hpp \
+	src/ClosedCaptions.hpp \
+	src/DecoderAutotune.hpp \
+	src/FrameMetadataController.hpp \
+	src/FramePusher.hpp \
+	src/IdleController.hpp \
+	src/Log.hpp \
+	src/MediaIndex.hpp \
+	src/Pipeline.hpp \
+	src/PlayerController.hpp \
+	src/Playlist.hpp \
+	src/PlaylistPlayer.hpp \
+	src/PositionStore.hpp \
+	src/PressureMonitor.hpp \
+	src/QosController.hpp \
+	src/RawFrameSource.hpp \
+	src/ReadAheadFileSrc.hpp \
+	src/ReconnectController.hpp \
+	src/ResolutionChangeMonitor.hpp \
+	src/ResourceScaler.hpp \
+	src/ScopeGuard.hpp \
+	src/SoakTest.hpp \
+	src/StallMonitor.hpp \
+	src/StateChangeProfiler.hpp \
+	src/StillImageItem.hpp \
+	src/TextureCache.hpp \
+	src/ThroughputBenchmark.hpp \
+	src/Utils.hpp \
+	src/VideoConversion.hpp \
+	src/VideoScaler.hpp
 OTHER_FILES += src/main.qml
 RESOURCES += src/main.qrc
 
 INCLUDEPATH += src
 
+# journald support for the logger is optional.
+packagesExist(libsystemd) {
+	PKGCONFIG += libsystemd
+	DEFINES += QMLGLSINK_EXAMPLE_HAVE_JOURNALD
+}
+
+# io_uring support for the read-ahead file source is optional.
+packagesExist(liburing) {
+	PKGCONFIG += liburing
+	DEFINES += QMLGLSINK_EXAMPLE_HAVE_LIBURING
+}
+
+# Bitmap subtitle support is optional, since it needs libavcodec.
+packagesExist(libavcodec) {
+	PKGCONFIG += libavcodec
+	DEFINES += QMLGLSINK_EXAMPLE_HAVE_LIBAVCODEC
+	SOURCES += src/BitmapSubtitleDecoder.cpp src/BitmapSubtitleItem.cpp
+	HEADERS += src/BitmapSubtitleDecoder.hpp src/BitmapSubtitleItem.hpp
+}
+
+# Log messages below this level are compiled out
+# (0 = trace, 1 = debug, 2 = info, 3 = warning, 4 = error).
+isEmpty(MIN_LOG_LEVEL) {
+	MIN_LOG_LEVEL = 0
+}
+DEFINES += QMLGLSINK_EXAMPLE_MIN_LOG_LEVEL=$$MIN_LOG_LEVEL
+
 QMAKE_CXXFLAGS += -Wextra -Wall -std=c++14 -pedantic -fPIC -DPIC -O0 -g3 -ggdb
 QMAKE_LFLAGS += -fPIC -DPIC
 
@@ -0,0 +1,144 @@
+#include <assert.h>
+
+#include "AdaptiveStreamingTuner.hpp"
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "Utils.hpp"
+
+
+namespace
+{
+
+
+bool isAdaptiveDemuxer(GstElement *element)
+{
+	GstElementFactory *factory = gst_element_get_factory(element);
+	if (factory == nullptr)
+		return false;
+
+	static char const * const adaptiveDemuxerNames[] = {
+		"hlsdemux", "hlsdemux2",
+		"dashdemux", "dashdemux2",
+		"mssdemux", "mssdemux2"
+	};
+
+	gchar const *factoryName = GST_OBJECT_NAME(factory);
+	for (char const *name : adaptiveDemuxerNames)
+	{
+		if (g_strcmp0(factoryName, name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+
+} // unnamed namespace end
+
+
+AdaptiveStreamingTuner::AdaptiveStreamingTuner(Config const &config)
+	: m_config(config)
+	, m_sourceSetupTime(-1)
+{
+}
+
+
+AdaptiveStreamingTuner::~AdaptiveStreamingTuner()
+{
+	releaseLegacyDemuxers(false);
+}
+
+
+void AdaptiveStreamingTuner::attach(Pipeline &pipeline)
+{
+	assert(m_pipeline == nullptr);
+
+	m_pipeline = &pipeline;
+
+	m_pipeline->addSourceSetupHandler([this](GstElement *) {
+		m_sourceSetupTime = g_get_monotonic_time();
+	});
+
+	m_pipeline->addElementSetupHandler([this](GstElement *element) {
+		onElementSetup(element);
+	});
+
+	m_pipeline->addBusMessageHandler([this](GstMessage *message) {
+		onBusMessage(message);
+	});
+}
+
+
+void AdaptiveStreamingTuner::onElementSetup(GstElement *element)
+{
+	// This is called in whatever thread created the element.
+
+	if (!isAdaptiveDemuxer(element))
+		return;
+
+	gchar const *name = GST_OBJECT_NAME(gst_element_get_factory(element));
+
+	if (m_config.m_startOnLowestVariant)
+	{
+		if (hasProperty(element, "start-bitrate"))
+		{
+			// The variant with the highest bitrate that does not exceed the
+			// start bitrate is picked, or the lowest one if all exceed it.
+			g_object_set(element, "start-bitrate", guint(1), nullptr);
+		}
+		else if (hasProperty(element, "connection-speed"))
+		{
+			g_object_set(element, "connection-speed", guint(1), nullptr);
+
+			std::lock_guard<std::mutex> lock(m_legacyDemuxersMutex);
+			m_legacyDemuxers.push_back(GST_ELEMENT(gst_object_ref(GST_OBJECT(element))));
+		}
+	}
+
+	if (m_config.m_bandwidthTargetRatio > 0)
+	{
+		if (hasProperty(element, "bandwidth-target-ratio"))
+			g_object_set(element, "bandwidth-target-ratio", gfloat(m_config.m_bandwidthTargetRatio), nullptr);
+		else if (hasProperty(element, "bitrate-limit"))
+			g_object_set(element, "bitrate-limit", gfloat(m_config.m_bandwidthTargetRatio), nullptr);
+	}
+
+	// Only the DASH demuxers can limit the resolution of the selected
+	// representations; HLS and MSS demuxers do not have such properties.
+	if ((m_config.m_maxVideoWidth > 0) && hasProperty(element, "max-video-width"))
+		g_object_set(element, "max-video-width", guint(m_config.m_maxVideoWidth), nullptr);
+	if ((m_config.m_maxVideoHeight > 0) && hasProperty(element, "max-video-height"))
+		g_object_set(element, "max-video-height", guint(m_config.m_maxVideoHeight), nullptr);
+
+	LOG_DEBUG("Tuned adaptive demuxer %s", name);
+}
+
+
+void AdaptiveStreamingTuner::onBusMessage(GstMessage *message)
+{
+	// Prerolling is finished once the first frame reached the video sink.
+	if ((GST_MESSAGE_TYPE(message) != GST_MESSAGE_ASYNC_DONE) || (GST_MESSAGE_SRC(message) != GST_OBJECT(m_pipeline->playbin())))
+		return;
+
+	gint64 sourceSetupTime = m_sourceSetupTime.exchange(-1);
+	if (sourceSetupTime >= 0)
+		LOG_INFO("Time to first frame: %lld ms", (long long)((g_get_monotonic_time() - sourceSetupTime) / 1000));
+
+	releaseLegacyDemuxers(true);
+}
+
+
+void AdaptiveStreamingTuner::releaseLegacyDemuxers(bool restoreConnectionSpeed)
+{
+	std::lock_guard<std::mutex> lock(m_legacyDemuxersMutex);
+
+	for (GstElement *demuxer : m_legacyDemuxers)
+	{
+		// 0 makes the demuxer measure the bandwidth again.
+		if (restoreConnectionSpeed)
+			g_object_set(demuxer, "connection-speed", guint(0), nullptr);
+		gst_object_unref(GST_OBJECT(demuxer));
+	}
+
+	m_legacyDemuxers.clear();
+}
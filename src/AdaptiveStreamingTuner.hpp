@@ -0,0 +1,72 @@
+#ifndef ADAPTIVE_STREAMING_TUNER_HPP
+#define ADAPTIVE_STREAMING_TUNER_HPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <gst/gst.h>
+
+
+class Pipeline;
+
+
+// Tunes the adaptive demuxers (HLS, DASH, MSS) that playbin creates.
+//
+// By default, adaptive demuxers start with a variant picked based on a
+// fixed initial bandwidth guess, which is often too high, so the first
+// fragments take a long time to download. The tuner can instead make the
+// demuxers start with the lowest variant, change how much of the estimated
+// bandwidth is used for picking variants, and cap the video resolution
+// to the size of the display.
+//
+// Both the newer adaptivedemux2 based demuxers (hlsdemux2, dashdemux2 ...)
+// and the older ones are supported. Settings are only applied if the
+// demuxer in question has a matching property. The time from the creation
+// of the source element to the first prerolled frame is logged as the
+// time to first frame.
+
+class AdaptiveStreamingTuner
+{
+public:
+	struct Config
+	{
+		// Start with the lowest variant, then switch based on the measured bandwidth.
+		bool m_startOnLowestVariant = false;
+		// Fraction of the measured bandwidth that may be used by the selected
+		// variant. Lower values switch up more conservatively. 0 keeps the
+		// demuxer's default.
+		double m_bandwidthTargetRatio = 0;
+		// Maximum video resolution. 0 means no limit.
+		int m_maxVideoWidth = 0;
+		int m_maxVideoHeight = 0;
+	};
+
+	explicit AdaptiveStreamingTuner(Config const &config);
+	~AdaptiveStreamingTuner();
+
+	// Attaches the tuner to a pipeline that has been set up already.
+	void attach(Pipeline &pipeline);
+
+
+private:
+	void onElementSetup(GstElement *element);
+	void onBusMessage(GstMessage *message);
+	void releaseLegacyDemuxers(bool restoreConnectionSpeed);
+
+	Config const m_config;
+	Pipeline *m_pipeline = nullptr;
+
+	// Older demuxers have no start bitrate property. For these, the
+	// connection speed is fixed to the lowest value until the first frame
+	// is shown, and then set back to 0 (= measure the bandwidth).
+	std::mutex m_legacyDemuxersMutex;
+	std::vector<GstElement *> m_legacyDemuxers;
+
+	// Monotonic time in microseconds when the current source element was
+	// set up. -1 if no time to first frame measurement is in progress.
+	std::atomic<gint64> m_sourceSetupTime;
+};
+
+
+#endif // ADAPTIVE_STREAMING_TUNER_HPP
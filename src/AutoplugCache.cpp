@@ -0,0 +1,435 @@
+#include <assert.h>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QStringList>
+
+#include "AutoplugCache.hpp"
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "Utils.hpp"
+
+
+namespace
+{
+
+
+QString settingsGroup(QString const &uri)
+{
+	return QCryptographicHash::hash(uri.toUtf8(), QCryptographicHash::Md5).toHex();
+}
+
+
+bool isFactory(GstElement *element, char const *factoryName)
+{
+	GstElementFactory *factory = gst_element_get_factory(element);
+	return (factory != nullptr) && (g_strcmp0(GST_OBJECT_NAME(factory), factoryName) == 0);
+}
+
+
+// Key under which the autoplugging decision for these caps is recorded.
+// Parsers and decoders accept the same media type; decodebin tells them
+// apart by the "parsed" field, which parsers set on their output.
+QString chainKey(GstCaps const *caps)
+{
+	if ((caps == nullptr) || (gst_caps_get_size(caps) == 0))
+		return QString();
+
+	GstStructure const *structure = gst_caps_get_structure(caps, 0);
+	QString key = gst_structure_get_name(structure);
+
+	gboolean parsed = FALSE;
+	if (gst_structure_get_boolean(structure, "parsed", &parsed) && parsed)
+		key += ",parsed";
+
+	return key;
+}
+
+
+} // unnamed namespace end
+
+
+AutoplugCache::AutoplugCache(QString filename)
+	: m_filename(std::move(filename))
+{
+}
+
+
+AutoplugCache::~AutoplugCache()
+{
+	if (m_numCachedStarts > 0)
+		LOG_INFO("Autoplug cache saved %lld ms over %d start(s)", (long long)(m_totalSavedTimeInMs), m_numCachedStarts);
+}
+
+
+void AutoplugCache::load()
+{
+	QSettings settings(m_filename, QSettings::IniFormat);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (QString const &group : settings.childGroups())
+	{
+		settings.beginGroup(group);
+
+		QString uri = settings.value("uri").toString();
+		Entry entry;
+		entry.m_modificationTime = settings.value("modificationTime").toLongLong();
+		entry.m_fileSize = settings.value("fileSize").toLongLong();
+		entry.m_containerCaps = settings.value("containerCaps").toString();
+		entry.m_uncachedStartupTimeInMs = settings.value("uncachedStartupTimeInMs", -1).toLongLong();
+		for (QString const &link : settings.value("chain").toStringList())
+		{
+			int separatorPos = link.lastIndexOf('=');
+			if (separatorPos > 0)
+				entry.m_chain[link.left(separatorPos)] = link.mid(separatorPos + 1);
+		}
+
+		settings.endGroup();
+
+		if (!uri.isEmpty())
+			m_entries.insert(uri, std::move(entry));
+	}
+
+	LOG_DEBUG("Loaded %d autoplug cache entries from %s", m_entries.size(), m_filename.toStdString().c_str());
+}
+
+
+void AutoplugCache::attach(Pipeline &pipeline)
+{
+	assert(m_pipeline == nullptr);
+
+	m_pipeline = &pipeline;
+
+	m_pipeline->addSourceSetupHandler([this](GstElement *) {
+		onSourceSetup();
+	});
+
+	m_pipeline->addElementSetupHandler([this](GstElement *element) {
+		onElementSetup(element);
+	});
+
+	m_pipeline->addBusMessageHandler([this](GstMessage *message) {
+		onBusMessage(message);
+	});
+}
+
+
+QString AutoplugCache::defaultFilename()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/autoplug-cache.ini";
+}
+
+
+G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+
+GValueArray * AutoplugCache::staticOnAutoplugSort(GstElement *, GstPad *, GstCaps *caps, GValueArray *factories, gpointer userData)
+{
+	AutoplugCache *self = reinterpret_cast<AutoplugCache *>(userData);
+
+	// NOTE: This is called in a streaming thread.
+
+	QString key = chainKey(caps);
+	std::string factoryName;
+
+	{
+		std::lock_guard<std::mutex> lock(self->m_mutex);
+		if (!self->m_currentUsesCache)
+			return nullptr;
+
+		auto iter = self->m_currentEntry.m_chain.find(key);
+		if (iter == self->m_currentEntry.m_chain.end())
+			return nullptr;
+
+		factoryName = iter->second.toStdString();
+	}
+
+	for (guint index = 0; index < factories->n_values; ++index)
+	{
+		GValue *value = g_value_array_get_nth(factories, index);
+		GstElementFactory *factory = GST_ELEMENT_FACTORY(g_value_get_object(value));
+		if (factoryName != GST_OBJECT_NAME(factory))
+			continue;
+
+		// Returning nullptr keeps the original order.
+		if (index == 0)
+			return nullptr;
+
+		GValueArray *sortedFactories = g_value_array_copy(factories);
+		g_value_array_remove(sortedFactories, index);
+		g_value_array_prepend(sortedFactories, value);
+		return sortedFactories;
+	}
+
+	LOG_DEBUG("Cached element %s is no candidate for %s anymore", factoryName.c_str(), key.toStdString().c_str());
+	return nullptr;
+}
+
+G_GNUC_END_IGNORE_DEPRECATIONS
+
+
+void AutoplugCache::onSourceSetup()
+{
+	// This is called in whatever thread created the source,
+	// once at the beginning of each start of an input.
+
+	gchar *uriString = nullptr;
+	g_object_get(m_pipeline->playbin(), "uri", &uriString, nullptr);
+	QString uri = uriString;
+	g_free(uriString);
+
+	qint64 modificationTime = 0, fileSize = 0;
+	bool isLocalFile = getLocalFileStamp(uri, modificationTime, fileSize);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_currentUri = isLocalFile ? uri : QString();
+	m_currentUsesCache = false;
+	m_currentIsRepeatedStart = false;
+	m_startupBeginTime = isLocalFile ? g_get_monotonic_time() : 0;
+
+	if (!isLocalFile)
+		return;
+
+	auto iter = m_entries.constFind(uri);
+	if ((iter == m_entries.constEnd()) || (iter->m_modificationTime != modificationTime) || (iter->m_fileSize != fileSize) || iter->m_chain.empty())
+		return;
+
+	m_currentIsRepeatedStart = true;
+
+	// Without a baseline, this start runs uncached to measure one.
+	if (iter->m_uncachedStartupTimeInMs < 0)
+		return;
+
+	m_currentEntry = *iter;
+	m_currentUsesCache = true;
+}
+
+
+void AutoplugCache::onElementSetup(GstElement *element)
+{
+	// This is called in whatever thread created the element.
+
+	bool isTypefind = isFactory(element, "typefind");
+	bool isDecodebin = isFactory(element, "decodebin");
+	if (!isTypefind && !isDecodebin)
+		return;
+
+	QString containerCaps;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_currentUsesCache)
+			return;
+		containerCaps = m_currentEntry.m_containerCaps;
+	}
+
+	if (isDecodebin)
+	{
+		g_signal_connect(element, "autoplug-sort", G_CALLBACK(&staticOnAutoplugSort), gpointer(this));
+		return;
+	}
+
+	forceTypefindCaps(element, containerCaps);
+}
+
+
+void AutoplugCache::onBusMessage(GstMessage *message)
+{
+	bool isFromPlaybin = (GST_MESSAGE_SRC(message) == GST_OBJECT(m_pipeline->playbin()));
+
+	switch (GST_MESSAGE_TYPE(message))
+	{
+		case GST_MESSAGE_ASYNC_DONE:
+		{
+			if (!isFromPlaybin)
+				break;
+
+			QString uri;
+			bool usedCache;
+			bool isRepeatedStart;
+			qint64 uncachedStartupTimeInMs;
+			qint64 startupTimeInMs;
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+
+				// Later ASYNC_DONE messages are caused by seeks.
+				if (m_startupBeginTime == 0)
+					break;
+
+				startupTimeInMs = (g_get_monotonic_time() - m_startupBeginTime) / 1000;
+				m_startupBeginTime = 0;
+				uri = m_currentUri;
+				usedCache = m_currentUsesCache;
+				isRepeatedStart = m_currentIsRepeatedStart;
+				uncachedStartupTimeInMs = m_currentEntry.m_uncachedStartupTimeInMs;
+			}
+
+			if (!usedCache && !isRepeatedStart)
+			{
+				LOG_INFO("Startup of %s took %lld ms (first start, not used as baseline)", uri.toStdString().c_str(), (long long)(startupTimeInMs));
+				recordCurrentInput(-1);
+			}
+			else if (!usedCache)
+			{
+				LOG_INFO("Startup of %s took %lld ms (uncached baseline)", uri.toStdString().c_str(), (long long)(startupTimeInMs));
+				recordCurrentInput(startupTimeInMs);
+			}
+			else if (uncachedStartupTimeInMs >= 0)
+			{
+				qint64 savedTimeInMs = uncachedStartupTimeInMs - startupTimeInMs;
+				m_totalSavedTimeInMs += savedTimeInMs;
+				++m_numCachedStarts;
+				LOG_INFO(
+					"Startup of %s took %lld ms with cached autoplugging (%lld ms without, %lld ms saved)",
+					uri.toStdString().c_str(),
+					(long long)(startupTimeInMs),
+					(long long)(uncachedStartupTimeInMs),
+					(long long)(savedTimeInMs)
+				);
+			}
+
+			break;
+		}
+
+		case GST_MESSAGE_ERROR:
+		{
+			QString uri;
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_currentUsesCache || (m_startupBeginTime == 0))
+					break;
+
+				uri = m_currentUri;
+				m_currentUsesCache = false;
+				m_startupBeginTime = 0;
+			}
+
+			// The recorded decisions may be what broke the start, so
+			// the next start of this input autoplugs from scratch.
+			LOG_WARNING("Start of %s with cached autoplugging failed; discarding its cache entry", uri.toStdString().c_str());
+			removeEntry(uri);
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+
+void AutoplugCache::recordCurrentInput(qint64 uncachedStartupTimeInMs)
+{
+	QString uri;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		uri = m_currentUri;
+	}
+
+	Entry entry;
+	if (uri.isEmpty() || !getLocalFileStamp(uri, entry.m_modificationTime, entry.m_fileSize))
+		return;
+	entry.m_uncachedStartupTimeInMs = uncachedStartupTimeInMs;
+
+	GstIterator *iterator = gst_bin_iterate_recurse(GST_BIN(m_pipeline->playbin()));
+	GValue item = G_VALUE_INIT;
+	bool done = false;
+
+	while (!done)
+	{
+		switch (gst_iterator_next(iterator, &item))
+		{
+			case GST_ITERATOR_OK:
+			{
+				GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+				GstElementFactory *factory = gst_element_get_factory(element);
+
+				if (isFactory(element, "typefind"))
+				{
+					GstCaps *caps = nullptr;
+					g_object_get(element, "caps", &caps, nullptr);
+					if (caps != nullptr)
+					{
+						gchar *capsString = gst_caps_to_string(caps);
+						entry.m_containerCaps = capsString;
+						g_free(capsString);
+						gst_caps_unref(caps);
+					}
+				}
+				else if ((factory != nullptr) && gst_element_factory_list_is_type(factory, GST_ELEMENT_FACTORY_TYPE_DEMUXER | GST_ELEMENT_FACTORY_TYPE_PARSER | GST_ELEMENT_FACTORY_TYPE_DECODER))
+				{
+					GstPad *sinkPad = gst_element_get_static_pad(element, "sink");
+					if (sinkPad != nullptr)
+					{
+						GstCaps *caps = gst_pad_get_current_caps(sinkPad);
+						QString key = chainKey(caps);
+						if (!key.isEmpty())
+							entry.m_chain[key] = GST_OBJECT_NAME(factory);
+						if (caps != nullptr)
+							gst_caps_unref(caps);
+						gst_object_unref(GST_OBJECT(sinkPad));
+					}
+				}
+
+				g_value_reset(&item);
+				break;
+			}
+
+			case GST_ITERATOR_RESYNC:
+				gst_iterator_resync(iterator);
+				entry.m_containerCaps.clear();
+				entry.m_chain.clear();
+				break;
+
+			default:
+				done = true;
+				break;
+		}
+	}
+
+	g_value_unset(&item);
+	gst_iterator_free(iterator);
+
+	if (entry.m_chain.empty())
+		return;
+
+	saveEntry(uri, entry);
+}
+
+
+void AutoplugCache::saveEntry(QString const &uri, Entry const &entry)
+{
+	QStringList chain;
+	for (auto const &link : entry.m_chain)
+		chain << (link.first + "=" + link.second);
+
+	QDir().mkpath(QFileInfo(m_filename).absolutePath());
+	QSettings settings(m_filename, QSettings::IniFormat);
+	settings.beginGroup(settingsGroup(uri));
+	settings.setValue("uri", uri);
+	settings.setValue("modificationTime", entry.m_modificationTime);
+	settings.setValue("fileSize", entry.m_fileSize);
+	settings.setValue("containerCaps", entry.m_containerCaps);
+	settings.setValue("uncachedStartupTimeInMs", entry.m_uncachedStartupTimeInMs);
+	settings.setValue("chain", chain);
+	settings.endGroup();
+
+	LOG_DEBUG("Recorded autoplugging of %s: %s", uri.toStdString().c_str(), chain.join(", ").toStdString().c_str());
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.insert(uri, entry);
+}
+
+
+void AutoplugCache::removeEntry(QString const &uri)
+{
+	QSettings settings(m_filename, QSettings::IniFormat);
+	settings.remove(settingsGroup(uri));
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.remove(uri);
+}
@@ -0,0 +1,101 @@
+#ifndef AUTOPLUG_CACHE_HPP
+#define AUTOPLUG_CACHE_HPP
+
+#include <map>
+#include <mutex>
+
+#include <gst/gst.h>
+
+#include <QHash>
+#include <QString>
+
+
+class Pipeline;
+
+
+// Remembers how playbin autoplugged each local input, and replays it.
+//
+// When an input starts for the first time, playbin typefinds it, and
+// then tries the available demuxers, parsers, and decoders by rank until
+// one accepts the stream. Once the input prerolled, the cache records
+// the container caps the typefinder detected, and which element was
+// chosen for which media type. At the next start of the same input
+// (same URI, modification time, and size), the typefinder is given the
+// recorded caps, so it does not read and analyze the file, and the
+// recorded elements are sorted first in decodebin's "autoplug-sort"
+// signal, so they are tried before any others. If a recorded element is
+// not among the candidates (because it was uninstalled, for example),
+// decodebin falls back to its regular ranking. If a cached start fails,
+// the entry is discarded.
+//
+// The startup time (from the creation of the source element until the
+// pipeline prerolled) is logged for each start, together with the time
+// saved compared to the recorded uncached start. The very first start
+// of a file also pays for reading it from disk, so it is not used as the
+// uncached baseline. Instead, the second start runs uncached as well,
+// with the file in the page cache just like at the later cached starts,
+// and its startup time is the baseline.
+//
+// Only local files are cached, since their modification time tells if
+// the recorded decisions are still valid. The cache is an INI file.
+
+class AutoplugCache
+{
+public:
+	explicit AutoplugCache(QString filename = defaultFilename());
+	~AutoplugCache();
+
+	void load();
+
+	// Attaches the cache to a pipeline that has been set up already.
+	void attach(Pipeline &pipeline);
+
+	static QString defaultFilename();
+
+
+private:
+	struct Entry
+	{
+		qint64 m_modificationTime = 0;
+		qint64 m_fileSize = 0;
+		QString m_containerCaps;
+		// Media type (like "video/x-h264") -> factory name of the
+		// element that was autoplugged for it.
+		std::map<QString, QString> m_chain;
+		// -1 until an uncached start measured it with a warm page cache.
+		qint64 m_uncachedStartupTimeInMs = -1;
+	};
+
+	// decodebin's autoplug-sort signal still uses the deprecated GValueArray.
+	G_GNUC_BEGIN_IGNORE_DEPRECATIONS
+	static GValueArray * staticOnAutoplugSort(GstElement *decodebin, GstPad *pad, GstCaps *caps, GValueArray *factories, gpointer userData);
+	G_GNUC_END_IGNORE_DEPRECATIONS
+	void onSourceSetup();
+	void onElementSetup(GstElement *element);
+	void onBusMessage(GstMessage *message);
+	void recordCurrentInput(qint64 uncachedStartupTimeInMs);
+	void saveEntry(QString const &uri, Entry const &entry);
+	void removeEntry(QString const &uri);
+
+	Pipeline *m_pipeline = nullptr;
+	QString m_filename;
+
+	// Accessed from streaming threads as well.
+	mutable std::mutex m_mutex;
+	QHash<QString, Entry> m_entries;
+	QString m_currentUri;
+	// Valid if m_currentUsesCache is true.
+	Entry m_currentEntry;
+	bool m_currentUsesCache = false;
+	// True if the current input was recorded before, so its file
+	// was read at least once already.
+	bool m_currentIsRepeatedStart = false;
+	// Monotonic time of the current start; 0 once prerolled.
+	gint64 m_startupBeginTime = 0;
+
+	qint64 m_totalSavedTimeInMs = 0;
+	int m_numCachedStarts = 0;
+};
+
+
+#endif // AUTOPLUG_CACHE_HPP
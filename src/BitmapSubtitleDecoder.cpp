@@ -0,0 +1,379 @@
+#include <assert.h>
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+
+#include <gst/video/video.h>
+
+#include <QImage>
+#include <QRect>
+#include <QStringList>
+
+#include "BitmapSubtitleDecoder.hpp"
+#include "BitmapSubtitleItem.hpp"
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "ScopeGuard.hpp"
+
+
+namespace
+{
+
+
+AVCodecID codecIdForMediaType(QString const &mediaType)
+{
+	if (mediaType == "subpicture/x-dvb")
+		return AV_CODEC_ID_DVB_SUBTITLE;
+	else if (mediaType == "subpicture/x-pgs")
+		return AV_CODEC_ID_HDMV_PGS_SUBTITLE;
+	else if (mediaType == "subpicture/x-dvd")
+		return AV_CODEC_ID_DVD_SUBTITLE;
+	else
+		return AV_CODEC_ID_NONE;
+}
+
+
+guint8 clampToByte(double value)
+{
+	return guint8(qBound(0.0, value + 0.5, 255.0));
+}
+
+
+} // unnamed namespace end
+
+
+BitmapSubtitleDecoder::~BitmapSubtitleDecoder()
+{
+	if (m_subtitleSinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_subtitleSinkPad, m_probeId);
+		gst_object_unref(GST_OBJECT(m_subtitleSinkPad));
+	}
+
+	closeCodec();
+}
+
+
+void BitmapSubtitleDecoder::attach(Pipeline &pipeline, BitmapSubtitleItem *item)
+{
+	assert(m_pipeline == nullptr);
+	assert(pipeline.subtitleSink() != nullptr);
+	assert(item != nullptr);
+
+	m_pipeline = &pipeline;
+	m_item = item;
+
+	m_pipeline->setSubpictureHandler([this](GstSample *sample) {
+		decodeSample(sample);
+	});
+
+	// The probe resets the decoder after seeks and stream
+	// changes, and picks up the VobSub palette.
+	m_subtitleSinkPad = gst_element_get_static_pad(m_pipeline->subtitleSink(), "sink");
+	assert(m_subtitleSinkPad != nullptr);
+	m_probeId = gst_pad_add_probe(
+		m_subtitleSinkPad,
+		GstPadProbeType(GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+		&staticOnSubtitleSinkProbe,
+		gpointer(this),
+		nullptr
+	);
+}
+
+
+GstPadProbeReturn BitmapSubtitleDecoder::staticOnSubtitleSinkProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	BitmapSubtitleDecoder *self = reinterpret_cast<BitmapSubtitleDecoder *>(userData);
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+	// NOTE: This is called in the streaming thread, except for the
+	// flush events, which are sent by the thread that issues the seek.
+
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_FLUSH_STOP:
+		case GST_EVENT_STREAM_START:
+			self->m_flushPending = true;
+			self->m_item->clearPage();
+			break;
+
+		case GST_EVENT_CUSTOM_DOWNSTREAM:
+		{
+			// Demuxers of VobSub streams send the palette in this
+			// event, since it is not part of the stream itself.
+			GstStructure const *structure = gst_event_get_structure(event);
+			if (gst_structure_has_name(structure, "application/x-gst-dvd")
+			 && (g_strcmp0(gst_structure_get_string(structure, "event"), "dvd-spu-clut-change") == 0))
+				self->setDvdPalette(structure);
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+void BitmapSubtitleDecoder::decodeSample(GstSample *sample)
+{
+	// NOTE: This is called in the streaming thread.
+
+	GstCaps *caps = gst_sample_get_caps(sample);
+	GstBuffer *buffer = gst_sample_get_buffer(sample);
+	if ((caps == nullptr) || (buffer == nullptr))
+		return;
+
+	QString mediaType = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+	if ((m_codecContext == nullptr) || (mediaType != m_codecMediaType))
+	{
+		closeCodec();
+		if (!openCodec(mediaType))
+			return;
+		m_flushPending = false;
+	}
+	else if (m_flushPending.exchange(false))
+		avcodec_flush_buffers(m_codecContext);
+
+	GstMapInfo mapInfo;
+	if (!gst_buffer_map(buffer, &mapInfo, GST_MAP_READ))
+		return;
+
+	guint8 const *data = mapInfo.data;
+	gsize size = mapInfo.size;
+
+	// DVB subtitle PES payloads start with a data identifier (0x20) and a
+	// stream ID (0x00), which libavcodec expects to be stripped already.
+	if ((m_codecContext->codec_id == AV_CODEC_ID_DVB_SUBTITLE) && (size >= 2) && (data[0] == 0x20) && (data[1] == 0x00))
+	{
+		data += 2;
+		size -= 2;
+	}
+
+	// libavcodec requires zeroed padding after the packet data.
+	m_packetData.assign(data, data + size);
+	m_packetData.resize(size + AV_INPUT_BUFFER_PADDING_SIZE, 0);
+
+	gst_buffer_unmap(buffer, &mapInfo);
+
+	AVPacket *packet = av_packet_alloc();
+	if (packet == nullptr)
+		return;
+	auto packetGuard = makeScopeGuard([&]() {
+		av_packet_free(&packet);
+	});
+
+	packet->data = m_packetData.data();
+	packet->size = int(size);
+
+	AVSubtitle subtitle;
+	int gotSubtitle = 0;
+	if (avcodec_decode_subtitle2(m_codecContext, &subtitle, &gotSubtitle, packet) < 0)
+	{
+		LOG_RATE_LIMITED(LogLevel::Warning, 1, 5000, "Could not decode %s subtitle packet", m_codecMediaType.toStdString().c_str());
+		return;
+	}
+
+	// Pages can span several packets; only
+	// the last one of them yields a subtitle.
+	if (!gotSubtitle)
+		return;
+	auto subtitleGuard = makeScopeGuard([&]() {
+		avsubtitle_free(&subtitle);
+	});
+
+	showSubtitle(subtitle, GST_BUFFER_DURATION(buffer));
+}
+
+
+void BitmapSubtitleDecoder::showSubtitle(AVSubtitle const &subtitle, GstClockTime bufferDuration)
+{
+	// NOTE: This is called in the streaming thread.
+
+	QRect pageRect;
+	for (unsigned int rectIndex = 0; rectIndex < subtitle.num_rects; ++rectIndex)
+	{
+		AVSubtitleRect const *rect = subtitle.rects[rectIndex];
+		if ((rect->type == SUBTITLE_BITMAP) && (rect->w > 0) && (rect->h > 0))
+			pageRect |= QRect(rect->x, rect->y, rect->w, rect->h);
+	}
+
+	// Empty pages clear the screen.
+	if (pageRect.isEmpty())
+	{
+		m_item->clearPage();
+		return;
+	}
+
+	// Combine all regions into one image. The regions are palette
+	// based; the palette entries are in the same format as QRgb.
+	QImage image(pageRect.size(), QImage::Format_ARGB32);
+	image.fill(Qt::transparent);
+
+	for (unsigned int rectIndex = 0; rectIndex < subtitle.num_rects; ++rectIndex)
+	{
+		AVSubtitleRect const *rect = subtitle.rects[rectIndex];
+		if ((rect->type != SUBTITLE_BITMAP) || (rect->w <= 0) || (rect->h <= 0))
+			continue;
+
+		quint32 const *palette = reinterpret_cast<quint32 const *>(rect->data[1]);
+
+		for (int y = 0; y < rect->h; ++y)
+		{
+			guint8 const *indices = rect->data[0] + y * rect->linesize[0];
+			QRgb *pixels = reinterpret_cast<QRgb *>(image.scanLine(rect->y - pageRect.y() + y)) + (rect->x - pageRect.x());
+
+			for (int x = 0; x < rect->w; ++x)
+				pixels[x] = (indices[x] < rect->nb_colors) ? palette[indices[x]] : 0;
+		}
+	}
+
+	// This is the format the scenegraph can upload without further conversion.
+	image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+	// The regions are positioned in a canvas that covers the video.
+	// PGS streams and DVB streams with a display definition specify its
+	// size; otherwise, DVB uses standard definition, and VobSub uses the
+	// size of the video frames.
+	GstVideoInfo videoInfo;
+	gst_video_info_init(&videoInfo);
+	{
+		GstPad *videoSinkPad = gst_element_get_static_pad(m_pipeline->videoSink(), "sink");
+		GstCaps *videoCaps = gst_pad_get_current_caps(videoSinkPad);
+		if (videoCaps != nullptr)
+		{
+			gst_video_info_from_caps(&videoInfo, videoCaps);
+			gst_caps_unref(videoCaps);
+		}
+		gst_object_unref(GST_OBJECT(videoSinkPad));
+	}
+
+	QSize canvasSize(m_codecContext->width, m_codecContext->height);
+	if (canvasSize.isEmpty())
+	{
+		if (m_codecContext->codec_id == AV_CODEC_ID_DVB_SUBTITLE)
+			canvasSize = QSize(720, 576);
+		else
+			canvasSize = QSize(GST_VIDEO_INFO_WIDTH(&videoInfo), GST_VIDEO_INFO_HEIGHT(&videoInfo));
+	}
+	if (canvasSize.isEmpty())
+	{
+		LOG_RATE_LIMITED(LogLevel::Warning, 1, 5000, "Cannot position bitmap subtitles without knowing the video size");
+		return;
+	}
+
+	QRectF rect(
+		double(pageRect.x()) / canvasSize.width(),
+		double(pageRect.y()) / canvasSize.height(),
+		double(pageRect.width()) / canvasSize.width(),
+		double(pageRect.height()) / canvasSize.height()
+	);
+
+	double videoAspectRatio = 0.0;
+	if ((GST_VIDEO_INFO_HEIGHT(&videoInfo) > 0) && (GST_VIDEO_INFO_PAR_D(&videoInfo) > 0))
+	{
+		videoAspectRatio = double(GST_VIDEO_INFO_WIDTH(&videoInfo)) * GST_VIDEO_INFO_PAR_N(&videoInfo)
+		                 / (double(GST_VIDEO_INFO_HEIGHT(&videoInfo)) * GST_VIDEO_INFO_PAR_D(&videoInfo));
+	}
+
+	// Prefer the display time of the page itself; an end time of
+	// UINT32_MAX means that the page is shown until the next one.
+	int durationInMs = 0;
+	if ((subtitle.end_display_time > subtitle.start_display_time) && (subtitle.end_display_time != UINT32_MAX))
+		durationInMs = int(subtitle.end_display_time - subtitle.start_display_time);
+	else if (GST_CLOCK_TIME_IS_VALID(bufferDuration))
+		durationInMs = int(GST_TIME_AS_MSECONDS(bufferDuration));
+
+	LOG_DEBUG(
+		"Bitmap subtitle page: %u region(s), %dx%d pixels, shown for %d ms",
+		subtitle.num_rects,
+		pageRect.width(), pageRect.height(),
+		durationInMs
+	);
+
+	m_item->showPage(std::move(image), rect, videoAspectRatio, durationInMs);
+}
+
+
+bool BitmapSubtitleDecoder::openCodec(QString const &mediaType)
+{
+	assert(m_codecContext == nullptr);
+
+	AVCodecID codecId = codecIdForMediaType(mediaType);
+	AVCodec const *codec = (codecId != AV_CODEC_ID_NONE) ? avcodec_find_decoder(codecId) : nullptr;
+	if (codec == nullptr)
+	{
+		LOG_RATE_LIMITED(LogLevel::Warning, 1, 5000, "No decoder for %s subtitles", mediaType.toStdString().c_str());
+		return false;
+	}
+
+	m_codecContext = avcodec_alloc_context3(codec);
+	if (m_codecContext == nullptr)
+		return false;
+
+	AVDictionary *options = nullptr;
+	if ((codecId == AV_CODEC_ID_DVD_SUBTITLE) && !m_dvdPalette.isEmpty())
+		av_dict_set(&options, "palette", m_dvdPalette.toUtf8().constData(), 0);
+
+	int result = avcodec_open2(m_codecContext, codec, &options);
+	av_dict_free(&options);
+	if (result < 0)
+	{
+		LOG_WARNING("Could not open decoder for %s subtitles", mediaType.toStdString().c_str());
+		avcodec_free_context(&m_codecContext);
+		return false;
+	}
+
+	m_codecMediaType = mediaType;
+	LOG_DEBUG("Decoding %s subtitles with %s", mediaType.toStdString().c_str(), codec->name);
+
+	return true;
+}
+
+
+void BitmapSubtitleDecoder::closeCodec()
+{
+	if (m_codecContext != nullptr)
+		avcodec_free_context(&m_codecContext);
+	m_codecMediaType.clear();
+}
+
+
+void BitmapSubtitleDecoder::setDvdPalette(GstStructure const *eventStructure)
+{
+	// NOTE: This is called in the streaming thread.
+
+	// The palette entries are YCbCr values (0x00YYCrCb). libavcodec
+	// expects RGB values in hexadecimal notation.
+	QStringList entries;
+	for (int index = 0; index < 16; ++index)
+	{
+		gint ycrcb;
+		QByteArray fieldName = QString("clut%1").arg(index, 2, 10, QChar('0')).toLatin1();
+		if (!gst_structure_get_int(eventStructure, fieldName.constData(), &ycrcb))
+			return;
+
+		double y = 1.164 * (((ycrcb >> 16) & 0xFF) - 16);
+		double cr = ((ycrcb >> 8) & 0xFF) - 128;
+		double cb = (ycrcb & 0xFF) - 128;
+
+		guint32 rgb = (guint32(clampToByte(y + 1.596 * cr)) << 16)
+		            | (guint32(clampToByte(y - 0.813 * cr - 0.391 * cb)) << 8)
+		            | guint32(clampToByte(y + 2.018 * cb));
+		entries << QString("%1").arg(rgb, 6, 16, QChar('0'));
+	}
+
+	QString palette = entries.join(", ");
+	if (palette == m_dvdPalette)
+		return;
+
+	m_dvdPalette = palette;
+
+	// The palette can only be set when the decoder is opened,
+	// so reopen it with the next sample.
+	if (m_codecMediaType == "subpicture/x-dvd")
+		closeCodec();
+}
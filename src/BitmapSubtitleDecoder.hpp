@@ -0,0 +1,66 @@
+#ifndef BITMAP_SUBTITLE_DECODER_HPP
+#define BITMAP_SUBTITLE_DECODER_HPP
+
+#include <atomic>
+#include <vector>
+
+#include <gst/gst.h>
+
+#include <QString>
+
+
+struct AVCodecContext;
+struct AVSubtitle;
+class BitmapSubtitleItem;
+class Pipeline;
+
+
+// Decodes bitmap subtitle streams (DVB, PGS, VobSub) for display in a
+// BitmapSubtitleItem.
+//
+// playbin passes these streams undecoded to its text sink, from where the
+// pipeline forwards them to this class (see Pipeline::SubpictureHandler).
+// Each page is decoded with libavcodec once, in the streaming thread and at
+// its presentation time, into a single image with the bounding box of all
+// of its regions. The item then keeps that image as a texture for as long
+// as the page is displayed.
+//
+// The object must outlive the pipeline, since the pipeline calls it until
+// it is shut down.
+
+class BitmapSubtitleDecoder
+{
+public:
+	~BitmapSubtitleDecoder();
+
+	void attach(Pipeline &pipeline, BitmapSubtitleItem *item);
+
+
+private:
+	static GstPadProbeReturn staticOnSubtitleSinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+
+	void decodeSample(GstSample *sample);
+	void showSubtitle(AVSubtitle const &subtitle, GstClockTime bufferDuration);
+	bool openCodec(QString const &mediaType);
+	void closeCodec();
+	void setDvdPalette(GstStructure const *eventStructure);
+
+	Pipeline *m_pipeline = nullptr;
+	BitmapSubtitleItem *m_item = nullptr;
+	GstPad *m_subtitleSinkPad = nullptr;
+	gulong m_probeId = 0;
+
+	// Set by flushing seeks; the decoder state is
+	// then reset before the next sample is decoded.
+	std::atomic<bool> m_flushPending{false};
+
+	// Only accessed in the streaming thread.
+	AVCodecContext *m_codecContext = nullptr;
+	QString m_codecMediaType;
+	// VobSub color palette, as expected by libavcodec's "palette" option.
+	QString m_dvdPalette;
+	std::vector<guint8> m_packetData;
+};
+
+
+#endif // BITMAP_SUBTITLE_DECODER_HPP
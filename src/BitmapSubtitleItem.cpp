@@ -0,0 +1,109 @@
+#include <QQuickWindow>
+#include <QSGSimpleTextureNode>
+
+#include "BitmapSubtitleItem.hpp"
+
+
+BitmapSubtitleItem::BitmapSubtitleItem(QQuickItem *parent)
+	: QQuickItem(parent)
+{
+	setFlag(ItemHasContents, true);
+
+	m_hideTimer.setSingleShot(true);
+	connect(&m_hideTimer, &QTimer::timeout, this, [this]() {
+		setPage(QImage(), QRectF(), 0.0, 0);
+	});
+}
+
+
+void BitmapSubtitleItem::showPage(QImage image, QRectF rect, double videoAspectRatio, int durationInMs)
+{
+	// Pending queued calls are discarded once the item is destroyed.
+	QMetaObject::invokeMethod(this, [this, image, rect, videoAspectRatio, durationInMs]() {
+		setPage(image, rect, videoAspectRatio, durationInMs);
+	}, Qt::QueuedConnection);
+}
+
+
+void BitmapSubtitleItem::clearPage()
+{
+	showPage(QImage(), QRectF(), 0.0, 0);
+}
+
+
+QSGNode * BitmapSubtitleItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+	// NOTE: This is called in the render thread while the GUI thread
+	// is blocked, so accessing the GUI thread side members is safe.
+
+	QSGSimpleTextureNode *node = static_cast<QSGSimpleTextureNode *>(oldNode);
+
+	if (m_pageChanged)
+	{
+		// The node owns the texture of the previous page,
+		// so deleting the node releases that texture as well.
+		delete node;
+		node = nullptr;
+
+		if (!m_pendingImage.isNull())
+		{
+			node = new QSGSimpleTextureNode;
+			node->setOwnsTexture(true);
+			node->setFiltering(QSGTexture::Linear);
+			node->setTexture(window()->createTextureFromImage(m_pendingImage));
+		}
+
+		m_pendingImage = QImage();
+		m_pageChanged = false;
+	}
+
+	if (node == nullptr)
+		return nullptr;
+
+	// Fit the video into the item, then place the page inside the video area.
+	QRectF videoRect = boundingRect();
+	if (m_videoAspectRatio > 0.0)
+	{
+		QSizeF videoSize(m_videoAspectRatio, 1.0);
+		videoSize.scale(boundingRect().size(), Qt::KeepAspectRatio);
+		videoRect.setSize(videoSize);
+		videoRect.moveCenter(boundingRect().center());
+	}
+
+	node->setRect(
+		videoRect.x() + m_rect.x() * videoRect.width(),
+		videoRect.y() + m_rect.y() * videoRect.height(),
+		m_rect.width() * videoRect.width(),
+		m_rect.height() * videoRect.height()
+	);
+
+	return node;
+}
+
+
+void BitmapSubtitleItem::geometryChanged(QRectF const &newGeometry, QRectF const &oldGeometry)
+{
+	QQuickItem::geometryChanged(newGeometry, oldGeometry);
+	update();
+}
+
+
+void BitmapSubtitleItem::setPage(QImage image, QRectF rect, double videoAspectRatio, int durationInMs)
+{
+	m_hideTimer.stop();
+
+	// Nothing to do if no page is shown and none is to be shown.
+	if (image.isNull() && !m_hasPage && !m_pageChanged)
+		return;
+
+	m_pendingImage = std::move(image);
+	m_pageChanged = true;
+	m_hasPage = !m_pendingImage.isNull();
+	m_rect = rect;
+	m_videoAspectRatio = videoAspectRatio;
+
+	if (m_hasPage && (durationInMs > 0))
+		m_hideTimer.start(durationInMs);
+
+	update();
+}
@@ -0,0 +1,58 @@
+#ifndef BITMAP_SUBTITLE_ITEM_HPP
+#define BITMAP_SUBTITLE_ITEM_HPP
+
+#include <QImage>
+#include <QQuickItem>
+#include <QRectF>
+#include <QTimer>
+
+
+// QML item for displaying bitmap subtitle pages over the video.
+//
+// Each page is uploaded into a texture once and then composed over the
+// video by the scenegraph for as long as the page is displayed, so the
+// video frames themselves are never blended with the subtitles on the
+// CPU. The CPU side copy of the page is released after the upload.
+//
+// The item is expected to cover the same area as the GstGLVideoItem.
+// Pages are positioned relative to the video, which is assumed to be
+// fitted into the item with its display aspect ratio preserved.
+
+class BitmapSubtitleItem
+	: public QQuickItem
+{
+	Q_OBJECT
+
+public:
+	explicit BitmapSubtitleItem(QQuickItem *parent = nullptr);
+
+	// Displays a page. rect is the area the page covers, normalized to
+	// the video (0,0 is the top left corner, 1,1 the bottom right one).
+	// The page is removed after the given duration, or when the next page
+	// is set if the duration is not positive. Can be called from any thread.
+	void showPage(QImage image, QRectF rect, double videoAspectRatio, int durationInMs);
+	// Removes the current page. Can be called from any thread.
+	void clearPage();
+
+
+protected:
+	QSGNode * updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *updatePaintNodeData) override;
+	void geometryChanged(QRectF const &newGeometry, QRectF const &oldGeometry) override;
+
+
+private:
+	void setPage(QImage image, QRectF rect, double videoAspectRatio, int durationInMs);
+
+	QTimer m_hideTimer;
+
+	// Accessed by the GUI thread, and by the render thread during
+	// updatePaintNode(), when the GUI thread is blocked.
+	QImage m_pendingImage;
+	bool m_pageChanged = false;
+	bool m_hasPage = false;
+	QRectF m_rect;
+	double m_videoAspectRatio = 0.0;
+};
+
+
+#endif // BITMAP_SUBTITLE_ITEM_HPP
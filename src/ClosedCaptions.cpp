@@ -0,0 +1,356 @@
+#include <assert.h>
+
+#include "ClosedCaptions.hpp"
+#include "Log.hpp"
+#include "Pipeline.hpp"
+
+
+namespace
+{
+
+
+// Characters of the basic set that differ from ASCII.
+QChar basicCharacter(guint8 code)
+{
+	switch (code)
+	{
+		case 0x2A: return QChar(0x00E1); // á
+		case 0x5C: return QChar(0x00E9); // é
+		case 0x5E: return QChar(0x00ED); // í
+		case 0x5F: return QChar(0x00F3); // ó
+		case 0x60: return QChar(0x00FA); // ú
+		case 0x7B: return QChar(0x00E7); // ç
+		case 0x7C: return QChar(0x00F7); // ÷
+		case 0x7D: return QChar(0x00D1); // Ñ
+		case 0x7E: return QChar(0x00F1); // ñ
+		case 0x7F: return QChar(0x2588); // solid block
+		default: return QChar(code);
+	}
+}
+
+
+// Special characters (codes 0x30 to 0x3F after the 0x11 prefix).
+ushort const specialCharacters[16] = {
+	0x00AE, 0x00B0, 0x00BD, 0x00BF, 0x2122, 0x00A2, 0x00A3, 0x266A,
+	0x00E0, 0x0020, 0x00E8, 0x00E2, 0x00EA, 0x00EE, 0x00F4, 0x00FB
+};
+
+
+} // unnamed namespace end
+
+
+bool Cea608Decoder::decode(guint8 byte1, guint8 byte2)
+{
+	// Strip the odd parity bits.
+	byte1 &= 0x7F;
+	byte2 &= 0x7F;
+
+	// Padding.
+	if ((byte1 == 0) && (byte2 == 0))
+		return false;
+
+	if ((byte1 >= 0x10) && (byte1 <= 0x1F))
+	{
+		bool isRepetition = (byte1 == m_lastControlByte1) && (byte2 == m_lastControlByte2);
+		m_lastControlByte1 = isRepetition ? 0 : byte1;
+		m_lastControlByte2 = isRepetition ? 0 : byte2;
+		if (isRepetition)
+			return false;
+
+		// Bit 3 selects data channel 2.
+		m_channel1Active = ((byte1 & 0x08) == 0);
+		if (!m_channel1Active)
+			return false;
+
+		return decodeControlCode(byte1, byte2);
+	}
+
+	m_lastControlByte1 = m_lastControlByte2 = 0;
+
+	if (!m_channel1Active)
+		return false;
+
+	bool changed = false;
+	if (byte1 >= 0x20)
+		changed = addCharacter(basicCharacter(byte1)) || changed;
+	if (byte2 >= 0x20)
+		changed = addCharacter(basicCharacter(byte2)) || changed;
+	return changed;
+}
+
+
+QString Cea608Decoder::text() const
+{
+	QStringList lines;
+	for (QString const &line : m_displayedMemory)
+	{
+		QString trimmedLine = line.trimmed();
+		if (!trimmedLine.isEmpty())
+			lines << trimmedLine.toHtmlEscaped();
+	}
+
+	return lines.join("<br>");
+}
+
+
+void Cea608Decoder::reset()
+{
+	m_mode = Mode::PopOn;
+	m_numRollUpRows = 2;
+	m_channel1Active = true;
+	m_lastControlByte1 = m_lastControlByte2 = 0;
+	m_displayedMemory.clear();
+	m_nonDisplayedMemory.clear();
+}
+
+
+bool Cea608Decoder::decodeControlCode(guint8 byte1, guint8 byte2)
+{
+	// Special characters.
+	if ((byte1 == 0x11) && (byte2 >= 0x30) && (byte2 <= 0x3F))
+		return addCharacter(QChar(specialCharacters[byte2 - 0x30]));
+
+	// Mid-row style codes are shown as a space.
+	if ((byte1 == 0x11) && (byte2 >= 0x20) && (byte2 <= 0x2F))
+		return addCharacter(QChar(' '));
+
+	// Extended characters follow a basic character that serves as
+	// their fallback; that fallback is simply kept.
+	if (((byte1 == 0x12) || (byte1 == 0x13)) && (byte2 >= 0x20) && (byte2 <= 0x3F))
+		return false;
+
+	// Preamble address codes position the cursor. Only the start
+	// of a new line is of interest here.
+	if ((byte1 <= 0x17) && (byte2 >= 0x40))
+	{
+		if (m_mode == Mode::RollUp)
+			return false;
+
+		QStringList &memory = targetMemory();
+		if (memory.isEmpty() || !memory.last().isEmpty())
+			memory.append(QString());
+		return false;
+	}
+
+	// Miscellaneous control codes (field 1 uses 0x14 as the first byte).
+	if (byte1 != 0x14)
+		return false;
+
+	switch (byte2)
+	{
+		case 0x20: // Resume caption loading
+			m_mode = Mode::PopOn;
+			return false;
+
+		case 0x21: // Backspace
+		{
+			QStringList &memory = targetMemory();
+			if (memory.isEmpty() || memory.last().isEmpty())
+				return false;
+			memory.last().chop(1);
+			return m_mode != Mode::PopOn;
+		}
+
+		case 0x25: // Roll-up with 2, 3, or 4 rows
+		case 0x26:
+		case 0x27:
+		{
+			bool changed = false;
+			if (m_mode != Mode::RollUp)
+			{
+				changed = !m_displayedMemory.isEmpty();
+				m_displayedMemory.clear();
+				m_nonDisplayedMemory.clear();
+			}
+			m_mode = Mode::RollUp;
+			m_numRollUpRows = byte2 - 0x23;
+			return changed;
+		}
+
+		case 0x29: // Resume direct captioning
+			m_mode = Mode::PaintOn;
+			return false;
+
+		case 0x2C: // Erase displayed memory
+		{
+			bool changed = !m_displayedMemory.isEmpty();
+			m_displayedMemory.clear();
+			return changed;
+		}
+
+		case 0x2D: // Carriage return
+			targetMemory().append(QString());
+			if (m_mode != Mode::RollUp)
+				return false;
+			while (m_displayedMemory.size() > m_numRollUpRows)
+				m_displayedMemory.removeFirst();
+			return true;
+
+		case 0x2E: // Erase non-displayed memory
+			m_nonDisplayedMemory.clear();
+			return false;
+
+		case 0x2F: // End of caption; flip the memories
+			m_displayedMemory.swap(m_nonDisplayedMemory);
+			m_mode = Mode::PopOn;
+			return true;
+
+		default:
+			return false;
+	}
+}
+
+
+bool Cea608Decoder::addCharacter(QChar character)
+{
+	QStringList &memory = targetMemory();
+	if (memory.isEmpty())
+		memory.append(QString());
+	memory.last().append(character);
+
+	return m_mode != Mode::PopOn;
+}
+
+
+QStringList & Cea608Decoder::targetMemory()
+{
+	return (m_mode == Mode::PopOn) ? m_nonDisplayedMemory : m_displayedMemory;
+}
+
+
+ClosedCaptionExtractor::~ClosedCaptionExtractor()
+{
+	if (m_videoSinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_videoSinkPad, m_probeId);
+		gst_object_unref(GST_OBJECT(m_videoSinkPad));
+	}
+}
+
+
+void ClosedCaptionExtractor::attach(Pipeline &pipeline)
+{
+	assert(m_pipeline == nullptr);
+	assert(pipeline.videoSink() != nullptr);
+
+	m_pipeline = &pipeline;
+
+	// The probe is placed in front of the glsinkbin, where the
+	// frames still carry the caption metas of the decoder. Flush
+	// events have to be requested explicitly.
+	m_videoSinkPad = gst_element_get_static_pad(m_pipeline->videoSink(), "sink");
+	assert(m_videoSinkPad != nullptr);
+	m_probeId = gst_pad_add_probe(
+		m_videoSinkPad,
+		GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+		&staticOnVideoSinkProbe,
+		gpointer(this),
+		nullptr
+	);
+}
+
+
+GstPadProbeReturn ClosedCaptionExtractor::staticOnVideoSinkProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	ClosedCaptionExtractor *self = reinterpret_cast<ClosedCaptionExtractor *>(userData);
+
+	// NOTE: This is called in the streaming thread.
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & (GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH))
+	{
+		GstEventType eventType = GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info));
+		if ((eventType == GST_EVENT_FLUSH_STOP) || (eventType == GST_EVENT_STREAM_START))
+		{
+			self->m_decoder.reset();
+			if (!self->m_lastText.isEmpty())
+			{
+				self->m_lastText.clear();
+				self->m_pipeline->showCaption(QString());
+			}
+		}
+
+		return GST_PAD_PROBE_OK;
+	}
+
+	GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+	bool textChanged = false;
+
+	gpointer state = nullptr;
+	GstMeta *meta;
+	while ((meta = gst_buffer_iterate_meta_filtered(buffer, &state, GST_VIDEO_CAPTION_META_API_TYPE)) != nullptr)
+	{
+		GstVideoCaptionMeta *captionMeta = reinterpret_cast<GstVideoCaptionMeta *>(meta);
+		self->processCaptionData(captionMeta->caption_type, captionMeta->data, captionMeta->size, textChanged);
+	}
+
+	if (textChanged)
+	{
+		QString text = self->m_decoder.text();
+		if (text != self->m_lastText)
+		{
+			LOG_TRACE("Closed caption: %s", text.toStdString().c_str());
+			self->m_lastText = text;
+			self->m_pipeline->showCaption(text);
+		}
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+void ClosedCaptionExtractor::processCaptionData(GstVideoCaptionType type, guint8 const *data, gsize size, bool &textChanged)
+{
+	switch (type)
+	{
+		case GST_VIDEO_CAPTION_TYPE_CEA608_RAW:
+			// Byte pairs of field 1.
+			for (gsize offset = 0; (offset + 1) < size; offset += 2)
+				textChanged = m_decoder.decode(data[offset], data[offset + 1]) || textChanged;
+			break;
+
+		case GST_VIDEO_CAPTION_TYPE_CEA608_S334_1A:
+			// Triplets; bit 7 of the first byte is set for field 1.
+			for (gsize offset = 0; (offset + 2) < size; offset += 3)
+			{
+				if (data[offset] & 0x80)
+					textChanged = m_decoder.decode(data[offset + 1], data[offset + 2]) || textChanged;
+			}
+			break;
+
+		case GST_VIDEO_CAPTION_TYPE_CEA708_CDP:
+		{
+			// Skip the CDP header (and the time code section, if present)
+			// to get to the cc_data section, then decode that like raw data.
+			if ((size < 7) || (data[0] != 0x96) || (data[1] != 0x69))
+				break;
+
+			bool hasTimeCode = (data[4] & 0x80) != 0;
+			gsize offset = 7 + (hasTimeCode ? 5 : 0);
+			if (((offset + 2) > size) || (data[offset] != 0x72))
+				break;
+
+			gsize ccDataSize = gsize(data[offset + 1] & 0x1F) * 3;
+			offset += 2;
+			if ((offset + ccDataSize) > size)
+				break;
+
+			processCaptionData(GST_VIDEO_CAPTION_TYPE_CEA708_RAW, data + offset, ccDataSize, textChanged);
+			break;
+		}
+
+		case GST_VIDEO_CAPTION_TYPE_CEA708_RAW:
+			// cc_data triplets. Only valid CEA-608 field 1 data (cc_type 0)
+			// is decoded; the DTVCC packets of CEA-708 services are not.
+			for (gsize offset = 0; (offset + 2) < size; offset += 3)
+			{
+				bool ccValid = (data[offset] & 0x04) != 0;
+				int ccType = data[offset] & 0x03;
+				if (ccValid && (ccType == 0))
+					textChanged = m_decoder.decode(data[offset + 1], data[offset + 2]) || textChanged;
+			}
+			break;
+
+		default:
+			break;
+	}
+}
@@ -0,0 +1,94 @@
+#ifndef CLOSED_CAPTIONS_HPP
+#define CLOSED_CAPTIONS_HPP
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <QString>
+#include <QStringList>
+
+
+class Pipeline;
+
+
+// Minimal CEA-608 caption decoder for the CC1 channel.
+//
+// This handles the pop-on, roll-up, and paint-on modes, preamble address
+// codes (as line breaks), backspace, and the special and basic North
+// American character sets. Positioning, colors, and styles are ignored,
+// since the captions are shown in the regular subtitle item.
+
+class Cea608Decoder
+{
+public:
+	// Decodes one byte pair of field 1. Returns true if the displayed
+	// text changed; the new text is then available via text().
+	bool decode(guint8 byte1, guint8 byte2);
+
+	// The displayed captions, with lines separated by "<br>".
+	QString text() const;
+
+	void reset();
+
+
+private:
+	enum class Mode
+	{
+		PopOn,
+		RollUp,
+		PaintOn
+	};
+
+	bool decodeControlCode(guint8 byte1, guint8 byte2);
+	bool addCharacter(QChar character);
+	QStringList & targetMemory();
+
+	Mode m_mode = Mode::PopOn;
+	int m_numRollUpRows = 2;
+	// Only data of channel 1 is decoded. The channel is selected by the
+	// most recent control code.
+	bool m_channel1Active = true;
+	// Control codes are typically sent twice in a row; the
+	// repetition must not be executed a second time.
+	guint8 m_lastControlByte1 = 0;
+	guint8 m_lastControlByte2 = 0;
+
+	QStringList m_displayedMemory;
+	QStringList m_nonDisplayedMemory;
+};
+
+
+// Shows closed captions that are carried inside the video stream.
+//
+// Decoders (and some parsers) attach the CEA-608/708 caption data they
+// find in SEI messages or MPEG-2 user data to the decoded frames as
+// GstVideoCaptionMeta. A probe at the video sink reads that meta, decodes
+// the CEA-608 data (which CEA-708 streams carry as well, for compatibility)
+// right in the streaming thread, and shows the result in the subtitle item.
+// Unlike regular subtitles, the captions are not hidden after a timeout;
+// they stay until the caption stream erases or replaces them. No additional
+// demuxing or parsing is necessary.
+
+class ClosedCaptionExtractor
+{
+public:
+	~ClosedCaptionExtractor();
+
+	void attach(Pipeline &pipeline);
+
+
+private:
+	static GstPadProbeReturn staticOnVideoSinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	void processCaptionData(GstVideoCaptionType type, guint8 const *data, gsize size, bool &textChanged);
+
+	Pipeline *m_pipeline = nullptr;
+	GstPad *m_videoSinkPad = nullptr;
+	gulong m_probeId = 0;
+
+	// Only accessed in the streaming thread.
+	Cea608Decoder m_decoder;
+	QString m_lastText;
+};
+
+
+#endif // CLOSED_CAPTIONS_HPP
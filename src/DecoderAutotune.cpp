@@ -0,0 +1,446 @@
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <gst/gst.h>
+
+#include <QDebug>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include "DecoderAutotune.hpp"
+#include "Log.hpp"
+#include "ScopeGuard.hpp"
+
+
+namespace
+{
+
+
+struct CodecInfo
+{
+	char const *m_name;
+	char const *m_caps;
+	// Parser between demuxer and decoder. nullptr if none is needed.
+	char const *m_parser;
+	// Encoders for producing the test clips, in order of preference.
+	// These are configured for speed, since only the decoding is measured.
+	std::vector<char const *> m_encoders;
+};
+
+
+std::vector<CodecInfo> const codecs = {
+	{ "h264", "video/x-h264", "h264parse", { "x264enc speed-preset=ultrafast key-int-max=30", "openh264enc" } },
+	{ "h265", "video/x-h265", "h265parse", { "x265enc speed-preset=ultrafast key-int-max=30" } },
+	{ "vp8", "video/x-vp8", nullptr, { "vp8enc deadline=1" } },
+	{ "vp9", "video/x-vp9", nullptr, { "vp9enc deadline=1 cpu-used=8" } },
+	{ "av1", "video/x-av1", "av1parse", { "svtav1enc", "rav1enc", "av1enc cpu-used=8" } }
+};
+
+
+struct Resolution
+{
+	int m_width;
+	int m_height;
+};
+
+
+Resolution const resolutions[] = {
+	{ 1280, 720 },
+	{ 1920, 1080 },
+	{ 3840, 2160 }
+};
+
+
+constexpr int NumTestFrames = 60;
+constexpr GstClockTime PipelineTimeout = 60 * GST_SECOND;
+
+
+struct FrameStats
+{
+	std::atomic<int> m_numFrames{0};
+	std::atomic<gint64> m_firstFrameTime{-1};
+	std::atomic<gint64> m_lastFrameTime{-1};
+};
+
+
+GstPadProbeReturn countFrame(GstPad *, GstPadProbeInfo *, gpointer userData)
+{
+	FrameStats *stats = reinterpret_cast<FrameStats *>(userData);
+
+	gint64 now = g_get_monotonic_time();
+	if (stats->m_numFrames++ == 0)
+		stats->m_firstFrameTime = now;
+	stats->m_lastFrameTime = now;
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+// Runs the pipeline until EOS. If the pipeline contains an element called
+// "sink", the frames arriving there are counted. Returns false if the
+// pipeline could not be created, failed, or did not finish in time.
+bool runPipeline(QString const &description, FrameStats &stats)
+{
+	GError *error = nullptr;
+	GstElement *pipeline = gst_parse_launch_full(description.toStdString().c_str(), nullptr, GST_PARSE_FLAG_FATAL_ERRORS, &error);
+	if (pipeline == nullptr)
+	{
+		LOG_DEBUG("Could not create pipeline \"%s\": %s", description.toStdString().c_str(), (error != nullptr) ? error->message : "unknown error");
+		g_clear_error(&error);
+		return false;
+	}
+	g_clear_error(&error);
+
+	auto pipelineGuard = makeScopeGuard([&]() {
+		gst_element_set_state(pipeline, GST_STATE_NULL);
+		gst_object_unref(GST_OBJECT(pipeline));
+	});
+
+	GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+	if (sink != nullptr)
+	{
+		GstPad *sinkPad = gst_element_get_static_pad(sink, "sink");
+		gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_BUFFER, &countFrame, &stats, nullptr);
+		gst_object_unref(GST_OBJECT(sinkPad));
+		gst_object_unref(GST_OBJECT(sink));
+	}
+
+	if (gst_element_set_state(pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+		return false;
+
+	GstBus *bus = gst_element_get_bus(pipeline);
+	GstMessage *message = gst_bus_timed_pop_filtered(bus, PipelineTimeout, GstMessageType(GST_MESSAGE_EOS | GST_MESSAGE_ERROR));
+	gst_object_unref(GST_OBJECT(bus));
+
+	if (message == nullptr)
+	{
+		LOG_DEBUG("Pipeline \"%s\" did not finish in time", description.toStdString().c_str());
+		return false;
+	}
+
+	bool succeeded = (GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS);
+	if (!succeeded)
+	{
+		gst_message_parse_error(message, &error, nullptr);
+		LOG_DEBUG("Pipeline \"%s\" failed: %s", description.toStdString().c_str(), error->message);
+		g_error_free(error);
+	}
+
+	gst_message_unref(message);
+	return succeeded;
+}
+
+
+// Encodes a test clip with the first encoder that works. Returns
+// false if none of the encoders of the codec is available.
+bool encodeTestClip(CodecInfo const &codec, Resolution const &resolution, QString const &filename)
+{
+	for (char const *encoder : codec.m_encoders)
+	{
+		// The moving test pattern makes sure the clip contains
+		// actual motion, and not only skipped blocks.
+		QString description = QString(
+			"videotestsrc num-buffers=%1 pattern=smpte horizontal-speed=4 "
+			"! video/x-raw,format=I420,width=%2,height=%3,framerate=30/1 "
+			"! %4 %5 ! matroskamux ! filesink location=\"%6\""
+		)
+			.arg(NumTestFrames)
+			.arg(resolution.m_width)
+			.arg(resolution.m_height)
+			.arg(encoder)
+			.arg((codec.m_parser != nullptr) ? (QString("! ") + codec.m_parser) : QString())
+			.arg(filename);
+
+		FrameStats stats;
+		if (runPipeline(description, stats))
+			return true;
+	}
+
+	return false;
+}
+
+
+// Returns the decoded frames per second, or 0 if decoding failed.
+double benchmarkDecoder(CodecInfo const &codec, QString const &decoder, QString const &clipFilename)
+{
+	QString description = QString("filesrc location=\"%1\" ! matroskademux %2 ! %3 ! fakesink name=sink sync=false")
+		.arg(clipFilename)
+		.arg((codec.m_parser != nullptr) ? (QString("! ") + codec.m_parser) : QString())
+		.arg(decoder);
+
+	FrameStats stats;
+	if (!runPipeline(description, stats) || (stats.m_numFrames < NumTestFrames))
+		return 0;
+
+	// Measure from the first to the last decoded frame. This leaves out
+	// the decoder initialization, which would dominate such short clips.
+	gint64 duration = stats.m_lastFrameTime - stats.m_firstFrameTime;
+	if (duration <= 0)
+		return 0;
+
+	return double(stats.m_numFrames - 1) * G_USEC_PER_SEC / duration;
+}
+
+
+GList * findDecoders(CodecInfo const &codec)
+{
+	GList *allDecoders = gst_element_factory_list_get_elements(GST_ELEMENT_FACTORY_TYPE_DECODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO, GST_RANK_MARGINAL);
+	GstCaps *caps = gst_caps_from_string(codec.m_caps);
+
+	GList *decoders = gst_element_factory_list_filter(allDecoders, caps, GST_PAD_SINK, FALSE);
+
+	gst_caps_unref(caps);
+	gst_plugin_feature_list_free(allDecoders);
+
+	return decoders;
+}
+
+
+QString pluginVersion(GstElementFactory *factory)
+{
+	GstPlugin *plugin = gst_plugin_feature_get_plugin(GST_PLUGIN_FEATURE(factory));
+	if (plugin == nullptr)
+		return QString();
+
+	QString version = gst_plugin_get_version(plugin);
+	gst_object_unref(GST_OBJECT(plugin));
+	return version;
+}
+
+
+bool parseRank(QString const &string, guint &rank)
+{
+	if (string == "none")
+		rank = GST_RANK_NONE;
+	else if (string == "marginal")
+		rank = GST_RANK_MARGINAL;
+	else if (string == "secondary")
+		rank = GST_RANK_SECONDARY;
+	else if (string == "primary")
+		rank = GST_RANK_PRIMARY;
+	else
+	{
+		bool ok;
+		rank = string.toUInt(&ok);
+		return ok;
+	}
+
+	return true;
+}
+
+
+} // unnamed namespace end
+
+
+DecoderAutotune::DecoderAutotune(QString cacheFilename)
+	: m_cacheFilename(std::move(cacheFilename))
+{
+}
+
+
+void DecoderAutotune::load()
+{
+	QSettings cache(m_cacheFilename, QSettings::IniFormat);
+	m_results.clear();
+
+	for (CodecInfo const &codec : codecs)
+	{
+		GList *decoders = findDecoders(codec);
+
+		for (Resolution const &resolution : resolutions)
+		{
+			for (GList *decoderIter = decoders; decoderIter != nullptr; decoderIter = decoderIter->next)
+			{
+				GstElementFactory *factory = GST_ELEMENT_FACTORY(decoderIter->data);
+
+				Result result;
+				result.m_codec = codec.m_name;
+				result.m_width = resolution.m_width;
+				result.m_height = resolution.m_height;
+				result.m_decoder = GST_OBJECT_NAME(factory);
+
+				QString key = QString("%1/%2x%3/%4").arg(result.m_codec).arg(result.m_width).arg(result.m_height).arg(result.m_decoder);
+				if ((cache.value(key + "/version").toString() != pluginVersion(factory)) || !cache.contains(key + "/fps"))
+					continue;
+
+				result.m_framesPerSecond = cache.value(key + "/fps").toDouble();
+				m_results.push_back(result);
+			}
+		}
+
+		gst_plugin_feature_list_free(decoders);
+	}
+}
+
+
+void DecoderAutotune::run(bool rerun)
+{
+	QSettings cache(m_cacheFilename, QSettings::IniFormat);
+	m_results.clear();
+
+	// The test clips are only encoded if there is something to benchmark.
+	std::unique_ptr<QTemporaryDir> clipDir;
+
+	for (CodecInfo const &codec : codecs)
+	{
+		GList *decoders = findDecoders(codec);
+		auto decodersGuard = makeScopeGuard([&]() {
+			gst_plugin_feature_list_free(decoders);
+		});
+
+		for (Resolution const &resolution : resolutions)
+		{
+			QString clipFilename;
+			bool clipEncoded = false;
+
+			for (GList *decoderIter = decoders; decoderIter != nullptr; decoderIter = decoderIter->next)
+			{
+				GstElementFactory *factory = GST_ELEMENT_FACTORY(decoderIter->data);
+
+				Result result;
+				result.m_codec = codec.m_name;
+				result.m_width = resolution.m_width;
+				result.m_height = resolution.m_height;
+				result.m_decoder = GST_OBJECT_NAME(factory);
+				result.m_framesPerSecond = 0;
+
+				QString key = QString("%1/%2x%3/%4").arg(result.m_codec).arg(result.m_width).arg(result.m_height).arg(result.m_decoder);
+				QString version = pluginVersion(factory);
+
+				// Cached results are only valid for the same plugin version.
+				if (!rerun && (cache.value(key + "/version").toString() == version) && cache.contains(key + "/fps"))
+				{
+					result.m_framesPerSecond = cache.value(key + "/fps").toDouble();
+					m_results.push_back(result);
+					continue;
+				}
+
+				if (!clipEncoded)
+				{
+					clipEncoded = true;
+
+					if (!clipDir)
+						clipDir.reset(new QTemporaryDir);
+
+					QString filename = clipDir->filePath(QString("%1-%2x%3.mkv").arg(codec.m_name).arg(resolution.m_width).arg(resolution.m_height));
+					LOG_INFO("Encoding %s test clip at %dx%d", codec.m_name, resolution.m_width, resolution.m_height);
+					if (encodeTestClip(codec, resolution, filename))
+						clipFilename = filename;
+					else
+						LOG_WARNING("No usable %s encoder found; cannot benchmark %s decoders at %dx%d", codec.m_name, codec.m_name, resolution.m_width, resolution.m_height);
+				}
+
+				// Without a clip, nothing is measured, and nothing is cached.
+				if (clipFilename.isEmpty())
+					continue;
+
+				LOG_INFO("Benchmarking decoder %s with %s at %dx%d", result.m_decoder.toStdString().c_str(), codec.m_name, resolution.m_width, resolution.m_height);
+				result.m_framesPerSecond = benchmarkDecoder(codec, result.m_decoder, clipFilename);
+				LOG_INFO("Decoder %s: %.1f fps with %s at %dx%d", result.m_decoder.toStdString().c_str(), result.m_framesPerSecond, codec.m_name, resolution.m_width, resolution.m_height);
+
+				cache.setValue(key + "/version", version);
+				cache.setValue(key + "/fps", result.m_framesPerSecond);
+				m_results.push_back(result);
+			}
+		}
+	}
+
+	cache.sync();
+}
+
+
+void DecoderAutotune::applyRanks()
+{
+	for (CodecInfo const &codec : codecs)
+	{
+		// Find the highest resolution that any decoder could handle,
+		// and the fastest decoder at that resolution.
+		Result const *best = nullptr;
+		for (Result const &result : m_results)
+		{
+			if ((result.m_codec != codec.m_name) || (result.m_framesPerSecond <= 0))
+				continue;
+
+			if (best == nullptr)
+			{
+				best = &result;
+				continue;
+			}
+
+			int numPixels = result.m_width * result.m_height;
+			int bestNumPixels = best->m_width * best->m_height;
+			if ((numPixels > bestNumPixels) || ((numPixels == bestNumPixels) && (result.m_framesPerSecond > best->m_framesPerSecond)))
+				best = &result;
+		}
+
+		if (best == nullptr)
+			continue;
+
+		// Raise the rank of the fastest decoder above all others.
+		GList *decoders = findDecoders(codec);
+		GstPluginFeature *bestFeature = nullptr;
+		guint maxOtherRank = 0;
+		for (GList *decoderIter = decoders; decoderIter != nullptr; decoderIter = decoderIter->next)
+		{
+			GstPluginFeature *feature = GST_PLUGIN_FEATURE(decoderIter->data);
+			if (best->m_decoder == GST_OBJECT_NAME(feature))
+				bestFeature = feature;
+			else
+				maxOtherRank = std::max(maxOtherRank, gst_plugin_feature_get_rank(feature));
+		}
+
+		if ((bestFeature != nullptr) && (gst_plugin_feature_get_rank(bestFeature) <= maxOtherRank))
+			gst_plugin_feature_set_rank(bestFeature, maxOtherRank + 1);
+
+		LOG_INFO(
+			"Using decoder %s for %s (%.1f fps at %dx%d)",
+			best->m_decoder.toStdString().c_str(),
+			codec.m_name,
+			best->m_framesPerSecond,
+			best->m_width,
+			best->m_height
+		);
+
+		gst_plugin_feature_list_free(decoders);
+	}
+}
+
+
+QString DecoderAutotune::defaultCacheFilename()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/decoder-autotune.ini";
+}
+
+
+bool applyRankOverrides(QString const &overrides)
+{
+	for (QString const &item : overrides.split(',', QString::SkipEmptyParts))
+	{
+		QStringList keyValue = item.split('=');
+		guint rank;
+		if ((keyValue.size() != 2) || !parseRank(keyValue[1].trimmed(), rank))
+		{
+			qCritical() << "Invalid rank override" << item;
+			return false;
+		}
+
+		QString featureName = keyValue[0].trimmed();
+		GstPluginFeature *feature = gst_registry_lookup_feature(gst_registry_get(), featureName.toStdString().c_str());
+		if (feature == nullptr)
+		{
+			qCritical() << "Cannot override rank of" << featureName << ": no such plugin feature";
+			return false;
+		}
+
+		gst_plugin_feature_set_rank(feature, rank);
+		gst_object_unref(GST_OBJECT(feature));
+
+		LOG_INFO("Rank of %s set to %u", featureName.toStdString().c_str(), rank);
+	}
+
+	return true;
+}
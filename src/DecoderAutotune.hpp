@@ -0,0 +1,75 @@
+#ifndef DECODER_AUTOTUNE_HPP
+#define DECODER_AUTOTUNE_HPP
+
+#include <vector>
+
+#include <QString>
+
+
+// Picks the fastest video decoder of the current device for each codec.
+//
+// Which decoder is fastest differs a lot between devices (hardware
+// decoders, dav1d vs. libaom, avdec vs. openh264 ...), and the plugin
+// ranks do not reflect that. The autotune benchmarks the decode throughput
+// of each available decoder, for each supported codec and a set of
+// resolutions. For this, a short test clip is encoded per codec and
+// resolution with whatever encoder is available, and decoded as fast as
+// possible by each decoder. The results are cached on disk, keyed by the
+// plugin versions, so only new or updated decoders are benchmarked again.
+// Benchmarking takes minutes, so it is meant to be run as a separate
+// command (see run()); normal starts only load() the cached results.
+//
+// playbin picks decoders by rank, and ranks cannot depend on the
+// resolution. The rank of the decoder that is fastest at the highest
+// resolution that was benchmarked successfully is therefore raised above
+// the ranks of all other decoders for that codec.
+
+class DecoderAutotune
+{
+public:
+	struct Result
+	{
+		QString m_codec;
+		int m_width;
+		int m_height;
+		QString m_decoder;
+		// 0 if the decoder failed to decode the test clip.
+		double m_framesPerSecond;
+	};
+
+	explicit DecoderAutotune(QString cacheFilename = defaultCacheFilename());
+
+	// Benchmarks all decoders that have no cached result yet, and caches
+	// the results. If rerun is true, cached results are ignored. This blocks
+	// until all benchmarks are done.
+	void run(bool rerun);
+
+	// Loads the cached results that are valid for the installed plugin
+	// versions, without benchmarking anything.
+	void load();
+
+	// Raises the rank of the fastest decoder for each codec.
+	void applyRanks();
+
+	std::vector<Result> const & results() const
+	{
+		return m_results;
+	}
+
+	static QString defaultCacheFilename();
+
+
+private:
+	QString m_cacheFilename;
+	std::vector<Result> m_results;
+};
+
+
+// Sets the ranks of decoders (or any other plugin features) explicitly.
+// The string has the form "<feature>=<rank>[,<feature>=<rank> ...]", where
+// the rank is a number or one of none, marginal, secondary, primary.
+// Returns false if the string is malformed or a feature does not exist.
+bool applyRankOverrides(QString const &overrides);
+
+
+#endif // DECODER_AUTOTUNE_HPP
@@ -0,0 +1,377 @@
+#include <assert.h>
+
+#include <gst/video/video.h>
+
+#include <QQuickWindow>
+#include <QVariantMap>
+
+#include "FrameMetadataController.hpp"
+#include "Log.hpp"
+#include "Pipeline.hpp"
+
+
+namespace
+{
+
+
+// Upper limit for metadata that is collected but not (yet) displayed,
+// for example while the scenegraph does not render.
+constexpr std::size_t MaxQueuedEntries = 64;
+
+
+} // unnamed namespace end
+
+
+bool FrameMetadataController::Batch::hasMetadata() const
+{
+	return !m_timecode.isEmpty() || !m_regionsOfInterest.isEmpty() || !m_seiMessages.isEmpty() || !m_klvPackets.isEmpty();
+}
+
+
+FrameMetadataController::FrameMetadataController(QObject *parent)
+	: QObject(parent)
+{
+}
+
+
+FrameMetadataController::~FrameMetadataController()
+{
+	if (m_videoSinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_videoSinkPad, m_probeId);
+		gst_object_unref(GST_OBJECT(m_videoSinkPad));
+	}
+
+	if (m_qmlglsinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_qmlglsinkPad, m_qmlglsinkProbeId);
+		gst_object_unref(GST_OBJECT(m_qmlglsinkPad));
+	}
+}
+
+
+void FrameMetadataController::start(Pipeline &pipeline, QQuickWindow *window)
+{
+	assert(m_pipeline == nullptr);
+	assert(pipeline.videoSink() != nullptr);
+	assert(window != nullptr);
+
+	m_pipeline = &pipeline;
+
+	// The probe sits in front of the glsinkbin, where the frames are
+	// still the ones the decoder produced, with all of their metas.
+	m_videoSinkPad = gst_element_get_static_pad(m_pipeline->videoSink(), "sink");
+	assert(m_videoSinkPad != nullptr);
+	m_probeId = gst_pad_add_probe(
+		m_videoSinkPad,
+		GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+		&staticOnVideoSinkProbe,
+		gpointer(this),
+		nullptr
+	);
+
+	// The frames the qmlglsink receives are the ones the video item
+	// picks up. Its last-sample property is not used for this, since
+	// it can already hold the next frame while the current one is
+	// still being shown.
+	m_qmlglsinkPad = gst_element_get_static_pad(m_pipeline->qmlglsink(), "sink");
+	assert(m_qmlglsinkPad != nullptr);
+	m_qmlglsinkProbeId = gst_pad_add_probe(
+		m_qmlglsinkPad,
+		GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+		&staticOnQmlglsinkProbe,
+		gpointer(this),
+		nullptr
+	);
+
+	// KLV streams are not decoded by playbin, so they are tapped at the demuxer.
+	m_pipeline->addElementSetupHandler([this](GstElement *element) {
+		onElementSetup(element);
+	});
+
+	// afterSynchronizing is emitted in the render thread, right
+	// after the video item picked up the frame it is going to render.
+	connect(window, &QQuickWindow::afterSynchronizing, this, &FrameMetadataController::onAfterSynchronizing, Qt::DirectConnection);
+}
+
+
+qint64 FrameMetadataController::timestamp() const
+{
+	return GST_CLOCK_TIME_IS_VALID(m_currentBatch.m_pts) ? qint64(m_currentBatch.m_pts / GST_MSECOND) : -1;
+}
+
+
+QString FrameMetadataController::timecode() const
+{
+	return m_currentBatch.m_timecode;
+}
+
+
+QVariantList FrameMetadataController::regionsOfInterest() const
+{
+	return m_currentBatch.m_regionsOfInterest;
+}
+
+
+QVariantList FrameMetadataController::seiMessages() const
+{
+	return m_currentBatch.m_seiMessages;
+}
+
+
+QVariantList FrameMetadataController::klvPackets() const
+{
+	return m_currentBatch.m_klvPackets;
+}
+
+
+GstPadProbeReturn FrameMetadataController::staticOnVideoSinkProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	FrameMetadataController *self = reinterpret_cast<FrameMetadataController *>(userData);
+
+	// NOTE: This is called in the streaming thread, except for the
+	// flush events, which are sent by the thread that issues the seek.
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER)
+	{
+		self->collectFrameMetadata(GST_PAD_PROBE_INFO_BUFFER(info));
+		return GST_PAD_PROBE_OK;
+	}
+
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_CAPS:
+		{
+			GstCaps *caps;
+			gst_event_parse_caps(event, &caps);
+
+			GstVideoInfo videoInfo;
+			if (gst_video_info_from_caps(&videoInfo, caps))
+			{
+				self->m_frameWidth = GST_VIDEO_INFO_WIDTH(&videoInfo);
+				self->m_frameHeight = GST_VIDEO_INFO_HEIGHT(&videoInfo);
+			}
+			break;
+		}
+
+		case GST_EVENT_FLUSH_STOP:
+		{
+			// Whatever was collected before the seek is never displayed.
+			std::lock_guard<std::mutex> lock(self->m_mutex);
+			self->m_collectedBatches.clear();
+			self->m_klvPackets.clear();
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+GstPadProbeReturn FrameMetadataController::staticOnQmlglsinkProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	FrameMetadataController *self = reinterpret_cast<FrameMetadataController *>(userData);
+
+	// NOTE: This is called in the streaming thread, except for the
+	// flush events, which are sent by the thread that issues the seek.
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER)
+	{
+		GstClockTime pts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+		if (GST_CLOCK_TIME_IS_VALID(pts))
+			self->m_sinkPts = pts;
+	}
+	else if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_FLUSH_STOP)
+		self->m_sinkPts = GST_CLOCK_TIME_NONE;
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+GstPadProbeReturn FrameMetadataController::staticOnKlvProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	FrameMetadataController *self = reinterpret_cast<FrameMetadataController *>(userData);
+	GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+	// NOTE: This is called in the streaming thread.
+
+	GstClockTime pts = GST_BUFFER_PTS(buffer);
+	if (!GST_CLOCK_TIME_IS_VALID(pts))
+		return GST_PAD_PROBE_OK;
+
+	GstMapInfo mapInfo;
+	if (!gst_buffer_map(buffer, &mapInfo, GST_MAP_READ))
+		return GST_PAD_PROBE_OK;
+	QByteArray packet(reinterpret_cast<char const *>(mapInfo.data), int(mapInfo.size));
+	gst_buffer_unmap(buffer, &mapInfo);
+
+	std::lock_guard<std::mutex> lock(self->m_mutex);
+	self->m_klvPackets.emplace_back(pts, std::move(packet));
+	if (self->m_klvPackets.size() > MaxQueuedEntries)
+		self->m_klvPackets.pop_front();
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+void FrameMetadataController::staticOnDemuxerPadAdded(GstElement *, GstPad *pad, gpointer userData)
+{
+	FrameMetadataController *self = reinterpret_cast<FrameMetadataController *>(userData);
+
+	// NOTE: This is called in the streaming thread.
+
+	GstCaps *caps = gst_pad_get_current_caps(pad);
+	if (caps == nullptr)
+		caps = gst_pad_query_caps(pad, nullptr);
+
+	bool isKlv = (caps != nullptr) && !gst_caps_is_empty(caps) && !gst_caps_is_any(caps)
+	          && gst_structure_has_name(gst_caps_get_structure(caps, 0), "meta/x-klv");
+	if (caps != nullptr)
+		gst_caps_unref(caps);
+
+	// The probe stays for the lifetime of the pad. It sees
+	// the packets even though nothing is linked to the pad.
+	if (isKlv)
+	{
+		LOG_DEBUG("Collecting KLV metadata from pad %s", GST_OBJECT_NAME(pad));
+		gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, &staticOnKlvProbe, userData, nullptr);
+	}
+}
+
+
+void FrameMetadataController::onElementSetup(GstElement *element)
+{
+	GstElementFactory *factory = gst_element_get_factory(element);
+	if ((factory != nullptr) && gst_element_factory_list_is_type(factory, GST_ELEMENT_FACTORY_TYPE_DEMUXER))
+		g_signal_connect(element, "pad-added", G_CALLBACK(&staticOnDemuxerPadAdded), gpointer(this));
+}
+
+
+void FrameMetadataController::collectFrameMetadata(GstBuffer *buffer)
+{
+	// NOTE: This is called in the streaming thread.
+
+	Batch batch;
+	batch.m_pts = GST_BUFFER_PTS(buffer);
+	if (!GST_CLOCK_TIME_IS_VALID(batch.m_pts))
+		return;
+
+	GstVideoTimeCodeMeta *timeCodeMeta = gst_buffer_get_video_time_code_meta(buffer);
+	if (timeCodeMeta != nullptr)
+	{
+		gchar *timeCodeString = gst_video_time_code_to_string(&timeCodeMeta->tc);
+		batch.m_timecode = timeCodeString;
+		g_free(timeCodeString);
+	}
+
+	double const widthScale = (m_frameWidth > 0) ? (1.0 / m_frameWidth) : 1.0;
+	double const heightScale = (m_frameHeight > 0) ? (1.0 / m_frameHeight) : 1.0;
+
+	gpointer state = nullptr;
+	GstMeta *meta;
+	while ((meta = gst_buffer_iterate_meta_filtered(buffer, &state, GST_VIDEO_REGION_OF_INTEREST_META_API_TYPE)) != nullptr)
+	{
+		GstVideoRegionOfInterestMeta *roiMeta = reinterpret_cast<GstVideoRegionOfInterestMeta *>(meta);
+
+		QVariantMap region;
+		region["type"] = QString(g_quark_to_string(roiMeta->roi_type));
+		region["id"] = roiMeta->id;
+		region["parentId"] = roiMeta->parent_id;
+		region["x"] = roiMeta->x * widthScale;
+		region["y"] = roiMeta->y * heightScale;
+		region["width"] = roiMeta->w * widthScale;
+		region["height"] = roiMeta->h * heightScale;
+		batch.m_regionsOfInterest << region;
+	}
+
+#if GST_CHECK_VERSION(1, 22, 0)
+	// Parsers attach these since GStreamer 1.22, and decoders pass them on.
+	state = nullptr;
+	while ((meta = gst_buffer_iterate_meta_filtered(buffer, &state, GST_VIDEO_SEI_USER_DATA_UNREGISTERED_META_API_TYPE)) != nullptr)
+	{
+		GstVideoSEIUserDataUnregisteredMeta *seiMeta = reinterpret_cast<GstVideoSEIUserDataUnregisteredMeta *>(meta);
+
+		QVariantMap message;
+		message["uuid"] = QString(QByteArray(reinterpret_cast<char const *>(seiMeta->uuid), sizeof(seiMeta->uuid)).toHex());
+		message["data"] = QByteArray(reinterpret_cast<char const *>(seiMeta->data), int(seiMeta->size));
+		batch.m_seiMessages << message;
+	}
+#endif
+
+	if (!batch.hasMetadata())
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_collectedBatches.emplace_back(std::move(batch));
+	if (m_collectedBatches.size() > MaxQueuedEntries)
+		m_collectedBatches.pop_front();
+}
+
+
+void FrameMetadataController::onAfterSynchronizing()
+{
+	// NOTE: This is called in the render thread while the GUI thread
+	// is blocked, once per scenegraph frame.
+
+	GstClockTime pts = m_sinkPts;
+	if (!GST_CLOCK_TIME_IS_VALID(pts) || (pts == m_lastDisplayedPts))
+		return;
+	m_lastDisplayedPts = pts;
+
+	Batch batch;
+	batch.m_pts = pts;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Metadata of frames that were skipped is discarded.
+	while (!m_collectedBatches.empty() && (m_collectedBatches.front().m_pts <= pts))
+	{
+		if (m_collectedBatches.front().m_pts == pts)
+			batch = std::move(m_collectedBatches.front());
+		m_collectedBatches.pop_front();
+	}
+
+	// KLV packets are not bound to individual frames. All packets
+	// up to this frame are delivered together with it.
+	while (!m_klvPackets.empty() && (m_klvPackets.front().first <= pts))
+	{
+		batch.m_klvPackets << m_klvPackets.front().second;
+		m_klvPackets.pop_front();
+	}
+
+	// Frames without metadata are only of interest if they replace one
+	// that had metadata, since that metadata is no longer valid then.
+	bool hasMetadata = batch.hasMetadata();
+	if (!hasMetadata && !m_lastFrameHadMetadata)
+		return;
+	m_lastFrameHadMetadata = hasMetadata;
+
+	// If the GUI thread did not pick up the previous batch yet,
+	// replace it, but keep its KLV packets.
+	if (m_deliveryPending)
+		batch.m_klvPackets = m_batchToDeliver.m_klvPackets + batch.m_klvPackets;
+	m_batchToDeliver = std::move(batch);
+
+	if (!m_deliveryPending)
+	{
+		m_deliveryPending = true;
+		QMetaObject::invokeMethod(this, &FrameMetadataController::deliverBatch, Qt::QueuedConnection);
+	}
+}
+
+
+void FrameMetadataController::deliverBatch()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_currentBatch = std::move(m_batchToDeliver);
+		m_batchToDeliver = Batch();
+		m_deliveryPending = false;
+	}
+
+	emit frameChanged();
+}
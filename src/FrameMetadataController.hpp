@@ -0,0 +1,125 @@
+#ifndef FRAME_METADATA_CONTROLLER_HPP
+#define FRAME_METADATA_CONTROLLER_HPP
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+#include <gst/gst.h>
+
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QVariantList>
+
+
+class QQuickWindow;
+class Pipeline;
+
+
+// Delivers the metadata of each displayed video frame to QML.
+//
+// A probe in front of the video sink collects the metadata of each frame
+// (time code, regions of interest, and unregistered user data SEI
+// messages) in the streaming thread. KLV packets, which arrive as a
+// separate stream (for example MISB ST 0601 telemetry in MPEG-TS), are
+// collected at the demuxer, and associated with the frames by timestamp.
+//
+// Nothing is sent to the GUI thread at that point. Instead, whenever the
+// scenegraph picks up a new frame from the video sink, the metadata that
+// belongs to exactly that frame is handed over as one batch, and all
+// properties are updated at once, followed by a single frameChanged()
+// signal. If the GUI thread falls behind, batches are merged instead of
+// queued (KLV packets are kept, the rest is replaced by the newest frame),
+// so it is woken up at most once per displayed frame, and only for frames
+// that have metadata or that end a run of frames with metadata.
+//
+// Region coordinates are normalized to the video frame (0,0 is the top
+// left corner, 1,1 the bottom right one).
+
+class FrameMetadataController
+	: public QObject
+{
+	Q_OBJECT
+	// Presentation timestamp of the frame in milliseconds, -1 if unknown.
+	Q_PROPERTY(qint64 timestamp READ timestamp NOTIFY frameChanged)
+	Q_PROPERTY(QString timecode READ timecode NOTIFY frameChanged)
+	// Maps with the keys "type", "id", "parentId", "x", "y", "width", "height".
+	Q_PROPERTY(QVariantList regionsOfInterest READ regionsOfInterest NOTIFY frameChanged)
+	// Maps with the keys "uuid" (hex string) and "data" (ArrayBuffer).
+	Q_PROPERTY(QVariantList seiMessages READ seiMessages NOTIFY frameChanged)
+	// ArrayBuffers with the KLV packets up to and including this frame.
+	Q_PROPERTY(QVariantList klvPackets READ klvPackets NOTIFY frameChanged)
+
+public:
+	explicit FrameMetadataController(QObject *parent = nullptr);
+	~FrameMetadataController() override;
+
+	// Starts the extraction. The pipeline must have been set up already,
+	// and the controller must outlive it.
+	void start(Pipeline &pipeline, QQuickWindow *window);
+
+	qint64 timestamp() const;
+	QString timecode() const;
+	QVariantList regionsOfInterest() const;
+	QVariantList seiMessages() const;
+	QVariantList klvPackets() const;
+
+signals:
+	void frameChanged();
+
+
+private:
+	struct Batch
+	{
+		GstClockTime m_pts = GST_CLOCK_TIME_NONE;
+		QString m_timecode;
+		QVariantList m_regionsOfInterest;
+		QVariantList m_seiMessages;
+		QVariantList m_klvPackets;
+
+		bool hasMetadata() const;
+	};
+
+	static GstPadProbeReturn staticOnVideoSinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	static GstPadProbeReturn staticOnQmlglsinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	static GstPadProbeReturn staticOnKlvProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	static void staticOnDemuxerPadAdded(GstElement *demuxer, GstPad *pad, gpointer userData);
+	void onElementSetup(GstElement *element);
+	void collectFrameMetadata(GstBuffer *buffer);
+	void onAfterSynchronizing();
+	void deliverBatch();
+
+	Pipeline *m_pipeline = nullptr;
+	GstPad *m_videoSinkPad = nullptr;
+	gulong m_probeId = 0;
+	GstPad *m_qmlglsinkPad = nullptr;
+	gulong m_qmlglsinkProbeId = 0;
+
+	// PTS of the newest frame that reached the qmlglsink. Written in
+	// its streaming thread, and read in the render thread.
+	std::atomic<GstClockTime> m_sinkPts{GST_CLOCK_TIME_NONE};
+
+	// Only accessed in the streaming thread of the video sink pad.
+	int m_frameWidth = 0;
+	int m_frameHeight = 0;
+
+	// Shared between the streaming threads, the render thread,
+	// and the GUI thread. The queues are ordered by timestamp.
+	std::mutex m_mutex;
+	std::deque<Batch> m_collectedBatches;
+	std::deque<std::pair<GstClockTime, QByteArray>> m_klvPackets;
+	Batch m_batchToDeliver;
+	bool m_deliveryPending = false;
+
+	// Only accessed in the render thread.
+	GstClockTime m_lastDisplayedPts = GST_CLOCK_TIME_NONE;
+	bool m_lastFrameHadMetadata = false;
+
+	// GUI thread side state (the properties).
+	Batch m_currentBatch;
+};
+
+
+#endif // FRAME_METADATA_CONTROLLER_HPP
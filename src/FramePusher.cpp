@@ -0,0 +1,319 @@
+#include <algorithm>
+#include <assert.h>
+
+#include <gst/gl/gl.h>
+
+#include "FramePusher.hpp"
+#include "Log.hpp"
+#include "Pipeline.hpp"
+
+
+namespace
+{
+
+
+char const PushUri[] = "appsrc://push";
+
+
+void releaseNotify(gpointer userData)
+{
+	FramePusher::ReleaseCallback *release = static_cast<FramePusher::ReleaseCallback *>(userData);
+	if (*release)
+		(*release)();
+	delete release;
+}
+
+
+} // unnamed namespace end
+
+
+FramePusher::FramePusher(std::size_t maxQueuedFrames)
+	: m_maxQueuedFrames(std::max(maxQueuedFrames, std::size_t(1)))
+{
+}
+
+
+FramePusher::~FramePusher()
+{
+	std::lock_guard<std::mutex> pushLock(m_pushMutex);
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_appsrc != nullptr)
+	{
+		// The appsrc might outlive this object.
+		GstAppSrcCallbacks callbacks = {};
+		gst_app_src_set_callbacks(GST_APP_SRC(m_appsrc), &callbacks, nullptr, nullptr);
+		gst_object_unref(GST_OBJECT(m_appsrc));
+	}
+
+	for (QueuedFrame &frame : m_queue)
+	{
+		gst_buffer_unref(frame.m_buffer);
+		gst_caps_unref(frame.m_caps);
+	}
+
+	if (m_currentCaps != nullptr)
+		gst_caps_unref(m_currentCaps);
+
+	if (m_numDroppedFrames > 0)
+		LOG_INFO("Frame pusher dropped %u frame(s)", m_numDroppedFrames);
+}
+
+
+QString FramePusher::uri()
+{
+	return PushUri;
+}
+
+
+void FramePusher::attach(Pipeline &pipeline)
+{
+	assert(m_pipeline == nullptr);
+	assert(pipeline.playbin() != nullptr);
+
+	m_pipeline = &pipeline;
+
+	GstElement *playbin = pipeline.playbin();
+	pipeline.addSourceSetupHandler([this, playbin](GstElement *source) {
+		if (GST_IS_APP_SRC(source))
+			setupAppsrc(playbin, source);
+	});
+}
+
+
+bool FramePusher::pushFrame(GstVideoInfo const &videoInfo, void *data, ReleaseCallback release)
+{
+	if ((data == nullptr) || (GST_VIDEO_INFO_FORMAT(&videoInfo) == GST_VIDEO_FORMAT_UNKNOWN))
+	{
+		if (release)
+			release();
+		return false;
+	}
+
+	GstVideoInfo liveVideoInfo = videoInfo;
+	GST_VIDEO_INFO_FPS_N(&liveVideoInfo) = 0;
+	GST_VIDEO_INFO_FPS_D(&liveVideoInfo) = 1;
+
+	GstBuffer *buffer = gst_buffer_new_wrapped_full(
+		GST_MEMORY_FLAG_READONLY,
+		data,
+		GST_VIDEO_INFO_SIZE(&liveVideoInfo),
+		0,
+		GST_VIDEO_INFO_SIZE(&liveVideoInfo),
+		new ReleaseCallback(std::move(release)),
+		&releaseNotify
+	);
+
+	gst_buffer_add_video_meta_full(
+		buffer,
+		GST_VIDEO_FRAME_FLAG_NONE,
+		GST_VIDEO_INFO_FORMAT(&liveVideoInfo),
+		GST_VIDEO_INFO_WIDTH(&liveVideoInfo),
+		GST_VIDEO_INFO_HEIGHT(&liveVideoInfo),
+		GST_VIDEO_INFO_N_PLANES(&liveVideoInfo),
+		liveVideoInfo.offset,
+		liveVideoInfo.stride
+	);
+
+	return enqueue(buffer, gst_video_info_to_caps(&liveVideoInfo));
+}
+
+
+bool FramePusher::pushTexture(guint textureId, int width, int height, ReleaseCallback release)
+{
+	GstGLContext *context = nullptr;
+	if (m_pipeline != nullptr)
+		g_object_get(m_pipeline->qmlglsink(), "context", &context, nullptr);
+
+	if (context == nullptr)
+	{
+		LOG_RATE_LIMITED(LogLevel::Warning, 1, 5000, "Cannot push textures before the video sink has a GL context");
+		if (release)
+			release();
+		return false;
+	}
+
+	GstVideoInfo videoInfo;
+	gst_video_info_set_format(&videoInfo, GST_VIDEO_FORMAT_RGBA, guint(width), guint(height));
+	GST_VIDEO_INFO_FPS_N(&videoInfo) = 0;
+	GST_VIDEO_INFO_FPS_D(&videoInfo) = 1;
+
+	// The texture is wrapped, not copied. The release callback is
+	// invoked once the GL memory that wraps it is freed.
+	ReleaseCallback *releaseCallback = new ReleaseCallback(std::move(release));
+	GstGLVideoAllocationParams *params = gst_gl_video_allocation_params_new_wrapped_texture(
+		context,
+		nullptr,
+		&videoInfo,
+		0,
+		nullptr,
+		GST_GL_TEXTURE_TARGET_2D,
+		GST_GL_RGBA,
+		textureId,
+		releaseCallback,
+		&releaseNotify
+	);
+	GstGLMemoryAllocator *allocator = gst_gl_memory_allocator_get_default(context);
+	GstGLBaseMemory *memory = gst_gl_base_memory_alloc(GST_GL_BASE_MEMORY_ALLOCATOR(allocator), reinterpret_cast<GstGLAllocationParams *>(params));
+	gst_gl_allocation_params_free(reinterpret_cast<GstGLAllocationParams *>(params));
+	gst_object_unref(GST_OBJECT(allocator));
+	gst_object_unref(GST_OBJECT(context));
+
+	if (memory == nullptr)
+	{
+		// Without a memory, nothing else would hand the texture back.
+		LOG_ERROR("Could not wrap texture %u", textureId);
+		releaseNotify(releaseCallback);
+		return false;
+	}
+
+	GstBuffer *buffer = gst_buffer_new();
+	gst_buffer_append_memory(buffer, GST_MEMORY_CAST(memory));
+	gst_buffer_add_video_meta(buffer, GST_VIDEO_FRAME_FLAG_NONE, GST_VIDEO_FORMAT_RGBA, guint(width), guint(height));
+
+	GstCaps *caps = gst_video_info_to_caps(&videoInfo);
+	gst_caps_set_features(caps, 0, gst_caps_features_new(GST_CAPS_FEATURE_MEMORY_GL_MEMORY, nullptr));
+	gst_caps_set_simple(caps, "texture-target", G_TYPE_STRING, "2D", nullptr);
+
+	return enqueue(buffer, caps);
+}
+
+
+unsigned int FramePusher::numDroppedFrames() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_numDroppedFrames;
+}
+
+
+void FramePusher::staticOnNeedData(GstAppSrc *, guint, gpointer userData)
+{
+	FramePusher *self = reinterpret_cast<FramePusher *>(userData);
+
+	// NOTE: This is called in the streaming thread.
+
+	{
+		std::lock_guard<std::mutex> lock(self->m_mutex);
+		self->m_needsData = true;
+	}
+
+	self->pushQueuedFrame();
+}
+
+
+void FramePusher::staticOnEnoughData(GstAppSrc *, gpointer userData)
+{
+	FramePusher *self = reinterpret_cast<FramePusher *>(userData);
+
+	std::lock_guard<std::mutex> lock(self->m_mutex);
+	self->m_needsData = false;
+}
+
+
+void FramePusher::setupAppsrc(GstElement *playbin, GstElement *appsrc)
+{
+	gchar *uri = nullptr;
+	g_object_get(playbin, "uri", &uri, nullptr);
+	bool isPushUri = (g_strcmp0(uri, PushUri) == 0);
+	g_free(uri);
+
+	if (!isPushUri)
+		return;
+
+	g_object_set(
+		appsrc,
+		"is-live", gboolean(TRUE),
+		"do-timestamp", gboolean(TRUE),
+		"format", GST_FORMAT_TIME,
+		"stream-type", GST_APP_STREAM_TYPE_STREAM,
+		nullptr
+	);
+
+	GstAppSrcCallbacks callbacks = {};
+	callbacks.need_data = &staticOnNeedData;
+	callbacks.enough_data = &staticOnEnoughData;
+	gst_app_src_set_callbacks(GST_APP_SRC(appsrc), &callbacks, gpointer(this), nullptr);
+
+	std::lock_guard<std::mutex> pushLock(m_pushMutex);
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_appsrc != nullptr)
+		gst_object_unref(GST_OBJECT(m_appsrc));
+	m_appsrc = GST_ELEMENT(gst_object_ref(GST_OBJECT(appsrc)));
+	m_needsData = false;
+
+	// The new appsrc has no caps yet.
+	if (m_currentCaps != nullptr)
+	{
+		gst_caps_unref(m_currentCaps);
+		m_currentCaps = nullptr;
+	}
+}
+
+
+bool FramePusher::enqueue(GstBuffer *buffer, GstCaps *caps)
+{
+	GstBuffer *droppedBuffer = nullptr;
+	GstCaps *droppedCaps = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (m_queue.size() >= m_maxQueuedFrames)
+		{
+			droppedBuffer = m_queue.front().m_buffer;
+			droppedCaps = m_queue.front().m_caps;
+			m_queue.pop_front();
+			++m_numDroppedFrames;
+		}
+
+		m_queue.push_back(QueuedFrame { buffer, caps });
+	}
+
+	// Unref'ing the dropped buffer calls its release callback,
+	// so this is done without holding the lock.
+	if (droppedBuffer != nullptr)
+	{
+		gst_buffer_unref(droppedBuffer);
+		gst_caps_unref(droppedCaps);
+	}
+
+	pushQueuedFrame();
+
+	return true;
+}
+
+
+void FramePusher::pushQueuedFrame()
+{
+	std::lock_guard<std::mutex> pushLock(m_pushMutex);
+
+	GstElement *appsrc;
+	QueuedFrame frame;
+	bool capsChanged;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (!m_needsData || m_queue.empty() || (m_appsrc == nullptr))
+			return;
+
+		frame = m_queue.front();
+		m_queue.pop_front();
+		m_needsData = false;
+
+		appsrc = GST_ELEMENT(gst_object_ref(GST_OBJECT(m_appsrc)));
+		capsChanged = (m_currentCaps == nullptr) || !gst_caps_is_equal(m_currentCaps, frame.m_caps);
+		if (capsChanged)
+			gst_caps_replace(&m_currentCaps, frame.m_caps);
+	}
+
+	// appsrc may emit enough-data from within these calls, which
+	// locks m_mutex. That is why the mutex is not held here.
+	if (capsChanged)
+		g_object_set(appsrc, "caps", frame.m_caps, nullptr);
+	gst_caps_unref(frame.m_caps);
+
+	gst_app_src_push_buffer(GST_APP_SRC(appsrc), frame.m_buffer);
+	gst_object_unref(GST_OBJECT(appsrc));
+}
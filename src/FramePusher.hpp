@@ -0,0 +1,94 @@
+#ifndef FRAME_PUSHER_HPP
+#define FRAME_PUSHER_HPP
+
+#include <deque>
+#include <functional>
+#include <mutex>
+
+#include <gst/gst.h>
+#include <gst/app/app.h>
+#include <gst/video/video.h>
+
+#include <QString>
+
+
+class Pipeline;
+
+
+// Displays frames that the application generates itself.
+//
+// Playing uri() makes the pipeline's playbin create an appsrc, which
+// this class feeds with the frames passed to pushFrame() (system memory)
+// or pushTexture() (GL textures). The frames go through the regular
+// glsinkbin and qmlglsink, so they are shown in the same GstGLVideoItem
+// as all other inputs.
+//
+// Frames are not copied: system memory frames are wrapped in buffers, and
+// textures are wrapped in GL memory. The release callback is called once
+// the frame is no longer used, after which the application may reuse or
+// free its memory or texture. The callback can be invoked in any thread.
+//
+// The push functions never block. Frames are queued until the appsrc
+// asks for data; if the queue is full, the oldest frame is dropped
+// (and released). The appsrc is a live source that timestamps frames
+// when they enter the pipeline.
+
+class FramePusher
+{
+public:
+	typedef std::function<void()> ReleaseCallback;
+
+	explicit FramePusher(std::size_t maxQueuedFrames = 2);
+	~FramePusher();
+
+	// The URI to pass to Pipeline::play().
+	static QString uri();
+
+	void attach(Pipeline &pipeline);
+
+	// Pushes a frame in system memory, laid out as described by videoInfo.
+	// The frame rate in videoInfo is ignored. data must stay valid and
+	// unmodified until release is called. Returns false (after calling
+	// release) if the frame could not be queued.
+	bool pushFrame(GstVideoInfo const &videoInfo, void *data, ReleaseCallback release);
+
+	// Pushes an RGBA GL_TEXTURE_2D texture. The texture must have been
+	// created in a GL context that shares its objects with the Qt scene
+	// graph, and rendering into it must have finished. This only works once
+	// the pipeline is running, since the GL context of the qmlglsink is
+	// needed to wrap the texture.
+	bool pushTexture(guint textureId, int width, int height, ReleaseCallback release);
+
+	// Number of frames dropped because the queue was full.
+	unsigned int numDroppedFrames() const;
+
+
+private:
+	struct QueuedFrame
+	{
+		GstBuffer *m_buffer;
+		GstCaps *m_caps;
+	};
+
+	static void staticOnNeedData(GstAppSrc *appsrc, guint length, gpointer userData);
+	static void staticOnEnoughData(GstAppSrc *appsrc, gpointer userData);
+	void setupAppsrc(GstElement *playbin, GstElement *appsrc);
+	bool enqueue(GstBuffer *buffer, GstCaps *caps);
+	void pushQueuedFrame();
+
+	std::size_t const m_maxQueuedFrames;
+	Pipeline *m_pipeline = nullptr;
+
+	// Held while frames are passed to the appsrc, to keep them in order.
+	// Must be locked before m_mutex if both are needed.
+	std::mutex m_pushMutex;
+	mutable std::mutex m_mutex;
+	GstElement *m_appsrc = nullptr;
+	GstCaps *m_currentCaps = nullptr;
+	bool m_needsData = false;
+	std::deque<QueuedFrame> m_queue;
+	unsigned int m_numDroppedFrames = 0;
+};
+
+
+#endif // FRAME_PUSHER_HPP
@@ -0,0 +1,218 @@
+#include <assert.h>
+#include <sys/resource.h>
+
+#include <QAbstractEventDispatcher>
+#include <QEvent>
+#include <QQuickWindow>
+
+#include "IdleController.hpp"
+#include "Log.hpp"
+#include "PlayerController.hpp"
+
+
+namespace
+{
+
+
+// How long nothing must change before the controller becomes idle.
+constexpr int IdleDelayInMs = 1000;
+
+
+qint64 getCpuTimeInUs()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) < 0)
+		return 0;
+
+	return
+		(qint64(usage.ru_utime.tv_sec) + qint64(usage.ru_stime.tv_sec)) * 1000000 +
+		qint64(usage.ru_utime.tv_usec) + qint64(usage.ru_stime.tv_usec);
+}
+
+
+bool isInputEvent(QEvent::Type type)
+{
+	switch (type)
+	{
+		case QEvent::MouseButtonPress:
+		case QEvent::MouseButtonRelease:
+		case QEvent::MouseMove:
+		case QEvent::Wheel:
+		case QEvent::KeyPress:
+		case QEvent::KeyRelease:
+		case QEvent::TouchBegin:
+		case QEvent::TouchUpdate:
+		case QEvent::TouchEnd:
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+} // unnamed namespace end
+
+
+IdleController::IdleController(QObject *parent)
+	: QObject(parent)
+	, m_numRenderedFrames(0)
+{
+	m_idleDelayTimer.setSingleShot(true);
+	m_idleDelayTimer.setInterval(IdleDelayInMs);
+	connect(&m_idleDelayTimer, &QTimer::timeout, this, [this]() {
+		setActive(true);
+	});
+}
+
+
+IdleController::~IdleController()
+{
+}
+
+
+void IdleController::start(PlayerController &playerController, QQuickWindow *window, bool enforce)
+{
+	assert(m_playerController == nullptr);
+	assert(window != nullptr);
+
+	m_playerController = &playerController;
+	m_enforce = enforce;
+
+	connect(m_playerController, &PlayerController::stateChanged, this, &IdleController::onPlayerStateChanged);
+	connect(m_playerController, &PlayerController::positionChanged, this, &IdleController::wakeUp);
+
+	// frameSwapped is emitted in the render thread.
+	connect(window, &QQuickWindow::frameSwapped, this, [this]() {
+		m_numRenderedFrames.fetch_add(1, std::memory_order_relaxed);
+	}, Qt::DirectConnection);
+
+	window->installEventFilter(this);
+
+	// Each time the GUI thread is about to sleep, it woke up before.
+	connect(QAbstractEventDispatcher::instance(), &QAbstractEventDispatcher::aboutToBlock, this, [this]() {
+		++m_numWakeups;
+	});
+
+	onPlayerStateChanged();
+}
+
+
+bool IdleController::isActive() const
+{
+	return m_active;
+}
+
+
+void IdleController::logReport()
+{
+	if (m_paused)
+	{
+		endPausedPeriod();
+		beginPausedPeriod();
+	}
+
+	if (m_totalTimeInMs == 0)
+		return;
+
+	double seconds = m_totalTimeInMs / 1000.0;
+	LOG_INFO(
+		"Not playing for %.1f s in total (idle mode %s): %.1f%% CPU, %.1f wakeups/s, %.1f frames/s rendered",
+		seconds,
+		m_enforce ? "on" : "off",
+		m_totalCpuTimeInUs / 10.0 / m_totalTimeInMs,
+		m_totalWakeups / seconds,
+		m_totalRenderedFrames / seconds
+	);
+}
+
+
+bool IdleController::eventFilter(QObject *watched, QEvent *event)
+{
+	if (isInputEvent(event->type()))
+		wakeUp();
+
+	return QObject::eventFilter(watched, event);
+}
+
+
+void IdleController::onPlayerStateChanged()
+{
+	bool paused = (m_playerController->state() != PlayerController::Playing);
+	if (paused == m_paused)
+		return;
+
+	m_paused = paused;
+
+	if (m_paused)
+	{
+		beginPausedPeriod();
+		if (m_enforce)
+			m_idleDelayTimer.start();
+	}
+	else
+	{
+		endPausedPeriod();
+		m_idleDelayTimer.stop();
+		setActive(false);
+	}
+}
+
+
+void IdleController::wakeUp()
+{
+	if (!m_enforce)
+		return;
+
+	setActive(false);
+
+	// Go back to idle once nothing happened for a while.
+	if (m_paused)
+		m_idleDelayTimer.start();
+}
+
+
+void IdleController::setActive(bool active)
+{
+	if (active == m_active)
+		return;
+
+	m_active = active;
+	LOG_DEBUG("Idle mode %s", m_active ? "entered" : "left");
+	emit activeChanged(m_active);
+}
+
+
+void IdleController::beginPausedPeriod()
+{
+	m_periodTimer.start();
+	m_periodStartCpuTimeInUs = getCpuTimeInUs();
+	m_periodStartRenderedFrames = m_numRenderedFrames.load(std::memory_order_relaxed);
+	m_periodStartWakeups = m_numWakeups;
+}
+
+
+void IdleController::endPausedPeriod()
+{
+	qint64 timeInMs = m_periodTimer.elapsed();
+	qint64 cpuTimeInUs = getCpuTimeInUs() - m_periodStartCpuTimeInUs;
+	quint64 renderedFrames = m_numRenderedFrames.load(std::memory_order_relaxed) - m_periodStartRenderedFrames;
+	quint64 wakeups = m_numWakeups - m_periodStartWakeups;
+
+	// Very short pauses (like between playlist entries) say nothing.
+	if (timeInMs < IdleDelayInMs)
+		return;
+
+	double seconds = timeInMs / 1000.0;
+	LOG_INFO(
+		"Not playing for %.1f s: %.1f%% CPU, %.1f wakeups/s, %llu frames rendered",
+		seconds,
+		cpuTimeInUs / 10.0 / timeInMs,
+		wakeups / seconds,
+		(unsigned long long)(renderedFrames)
+	);
+
+	m_totalTimeInMs += timeInMs;
+	m_totalCpuTimeInUs += cpuTimeInUs;
+	m_totalRenderedFrames += renderedFrames;
+	m_totalWakeups += wakeups;
+}
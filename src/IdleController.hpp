@@ -0,0 +1,96 @@
+#ifndef IDLE_CONTROLLER_HPP
+#define IDLE_CONTROLLER_HPP
+
+#include <atomic>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+
+class QQuickWindow;
+class PlayerController;
+
+
+// Detects when nothing on screen changes, and reports what the
+// application costs while playback is paused or stopped.
+//
+// The controller is idle once playback is not running (paused, or a
+// still image is shown), and neither the playback position changed nor
+// the user gave any input for a moment. Input events, position changes
+// (seeks while paused, which show a new frame), resuming playback, and
+// explicit wakeUp() calls wake it up again. Rendered frames do not, since
+// the reaction to becoming idle may render one last frame itself.
+//
+// The scenegraph only renders when something in the scene changes, so
+// while idle, the components that would change it or wake up threads
+// periodically are stopped: they follow activeChanged() (the stall
+// monitor, the pressure monitor, and the subtitle timer in QML, through
+// the "active" property). Without enforcement, the controller never
+// becomes active and only measures, which allows for comparing both.
+//
+// For each period in which playback is not running, the CPU usage of the
+// process, the number of GUI thread wakeups, and the number of frames the
+// scenegraph rendered (as a measure for the GPU work) are logged.
+
+class IdleController
+	: public QObject
+{
+	Q_OBJECT
+	Q_PROPERTY(bool active READ isActive NOTIFY activeChanged)
+
+public:
+	explicit IdleController(QObject *parent = nullptr);
+	~IdleController() override;
+
+	// If enforce is false, the controller never becomes
+	// active, and only measures the paused periods.
+	void start(PlayerController &playerController, QQuickWindow *window, bool enforce);
+
+	bool isActive() const;
+
+	// Leaves the idle state, for changes on screen that the
+	// controller does not notice itself (like a new still image).
+	void wakeUp();
+
+	void logReport();
+
+signals:
+	void activeChanged(bool active);
+
+
+protected:
+	bool eventFilter(QObject *watched, QEvent *event) override;
+
+
+private:
+	void onPlayerStateChanged();
+	void setActive(bool active);
+	void beginPausedPeriod();
+	void endPausedPeriod();
+
+	PlayerController *m_playerController = nullptr;
+	bool m_enforce = false;
+	bool m_active = false;
+	bool m_paused = false;
+	QTimer m_idleDelayTimer;
+
+	// Incremented in the render thread.
+	std::atomic<quint64> m_numRenderedFrames;
+	quint64 m_numWakeups = 0;
+
+	// Measurements of the current paused period.
+	QElapsedTimer m_periodTimer;
+	qint64 m_periodStartCpuTimeInUs = 0;
+	quint64 m_periodStartRenderedFrames = 0;
+	quint64 m_periodStartWakeups = 0;
+
+	// Totals over all paused periods.
+	qint64 m_totalTimeInMs = 0;
+	qint64 m_totalCpuTimeInUs = 0;
+	quint64 m_totalRenderedFrames = 0;
+	quint64 m_totalWakeups = 0;
+};
+
+
+#endif // IDLE_CONTROLLER_HPP
@@ -0,0 +1,584 @@
+#include <assert.h>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <gst/gst.h>
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_JOURNALD
+#include <systemd/sd-journal.h>
+
+// sd-journal.h includes syslog.h, whose LOG_DEBUG etc. priority
+// definitions clash with the logging macros from Log.hpp.
+namespace
+{
+constexpr int JournalPriorityError = LOG_ERR;
+constexpr int JournalPriorityWarning = LOG_WARNING;
+constexpr int JournalPriorityInfo = LOG_INFO;
+constexpr int JournalPriorityDebug = LOG_DEBUG;
+}
+#undef LOG_DEBUG
+#undef LOG_INFO
+#undef LOG_WARNING
+#endif
+
+#include "Log.hpp"
+
+
+namespace detail
+{
+
+
+std::atomic<int> currentLogLevel(int(LogLevel::Debug));
+
+
+} // namespace detail end
+
+
+namespace
+{
+
+
+// Messages longer than this are truncated.
+constexpr std::size_t MaxMessageLength = 512;
+// Must be a power of two.
+constexpr std::size_t QueueSize = 1024;
+
+
+std::int64_t monotonicTimeInUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+long currentThreadId()
+{
+	// gettid() is a system call, so cache the result per thread.
+	static thread_local long threadId = syscall(SYS_gettid);
+	return threadId;
+}
+
+
+char const * levelName(LogLevel level)
+{
+	switch (level)
+	{
+		case LogLevel::Trace: return "TRACE";
+		case LogLevel::Debug: return "DEBUG";
+		case LogLevel::Info: return "INFO";
+		case LogLevel::Warning: return "WARNING";
+		case LogLevel::Error: return "ERROR";
+		default: return "<unknown>";
+	}
+}
+
+
+char const * stripPath(char const *file)
+{
+	char const *lastSlash = std::strrchr(file, '/');
+	return (lastSlash != nullptr) ? (lastSlash + 1) : file;
+}
+
+
+struct LogRecord
+{
+	LogLevel m_level;
+	std::int64_t m_timestamp;
+	long m_threadId;
+	char m_text[MaxMessageLength];
+};
+
+
+// Bounded lock-free multi-producer single-consumer queue. This follows
+// Dmitry Vyukov's bounded MPMC queue design; every slot has a sequence
+// number that tells producers and the consumer whether the slot is free
+// or filled. Producers only contend on one atomic counter.
+
+class LogQueue
+{
+public:
+	LogQueue()
+	{
+		for (std::size_t i = 0; i < QueueSize; ++i)
+			m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+	}
+
+	// Claims a free slot. Returns nullptr if the queue is full.
+	// The slot must be handed back with commit() afterwards.
+	LogRecord * claim(std::size_t &position)
+	{
+		position = m_enqueuePosition.load(std::memory_order_relaxed);
+
+		while (true)
+		{
+			Slot &slot = m_slots[position & (QueueSize - 1)];
+			std::size_t sequence = slot.m_sequence.load(std::memory_order_acquire);
+			std::intptr_t difference = std::intptr_t(sequence) - std::intptr_t(position);
+
+			if (difference == 0)
+			{
+				if (m_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					return &(slot.m_record);
+			}
+			else if (difference < 0)
+				return nullptr;
+			else
+				position = m_enqueuePosition.load(std::memory_order_relaxed);
+		}
+	}
+
+	void commit(std::size_t position)
+	{
+		m_slots[position & (QueueSize - 1)].m_sequence.store(position + 1, std::memory_order_release);
+	}
+
+	// Only to be called by the single consumer. Slots that are claimed
+	// but not committed yet count as empty.
+	bool isEmpty() const
+	{
+		Slot const &slot = m_slots[m_dequeuePosition & (QueueSize - 1)];
+		return slot.m_sequence.load(std::memory_order_acquire) != (m_dequeuePosition + 1);
+	}
+
+	// Only to be called by the single consumer.
+	bool pop(LogRecord &record)
+	{
+		Slot &slot = m_slots[m_dequeuePosition & (QueueSize - 1)];
+		std::size_t sequence = slot.m_sequence.load(std::memory_order_acquire);
+		if (sequence != (m_dequeuePosition + 1))
+			return false;
+
+		record = slot.m_record;
+		slot.m_sequence.store(m_dequeuePosition + QueueSize, std::memory_order_release);
+		++m_dequeuePosition;
+
+		return true;
+	}
+
+private:
+	struct Slot
+	{
+		std::atomic<std::size_t> m_sequence;
+		LogRecord m_record;
+	};
+
+	Slot m_slots[QueueSize];
+	alignas(64) std::atomic<std::size_t> m_enqueuePosition{0};
+	alignas(64) std::size_t m_dequeuePosition = 0;
+};
+
+
+class LogWriter
+{
+public:
+	bool start(LogConfig const &config)
+	{
+		m_target = config.m_target;
+
+		if (m_target == LogTarget::File)
+		{
+			m_file = std::fopen(config.m_filename.toLocal8Bit().constData(), "a");
+			if (m_file == nullptr)
+			{
+				std::fprintf(stderr, "Could not open log file %s: %s\n", config.m_filename.toLocal8Bit().constData(), std::strerror(errno));
+				return false;
+			}
+		}
+
+#ifndef QMLGLSINK_EXAMPLE_HAVE_JOURNALD
+		if (m_target == LogTarget::Journald)
+		{
+			std::fprintf(stderr, "journald logging is not supported by this build\n");
+			return false;
+		}
+#endif
+
+		m_running = true;
+		m_thread = std::thread([this]() { writerLoop(); });
+		m_threadRunning = true;
+
+		return true;
+	}
+
+	void stop()
+	{
+		m_running = false;
+		wakeUp();
+		if (m_thread.joinable())
+			m_thread.join();
+		m_threadRunning = false;
+
+		if (m_file != nullptr)
+		{
+			std::fclose(m_file);
+			m_file = nullptr;
+		}
+	}
+
+	// Can be called from any thread, also while stop() is running.
+	bool isRunning() const
+	{
+		return m_threadRunning;
+	}
+
+	// Called after a record was committed to the queue. Producers only
+	// take the lock if the writer thread is about to sleep or sleeping,
+	// which is at most once per wakeup, not once per message.
+	void notifyRecordCommitted()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_sleeping.load(std::memory_order_relaxed))
+			wakeUp();
+	}
+
+	void write(LogRecord const &record)
+	{
+		switch (m_target)
+		{
+			case LogTarget::Journald:
+			{
+#ifdef QMLGLSINK_EXAMPLE_HAVE_JOURNALD
+				int priority;
+				switch (record.m_level)
+				{
+					case LogLevel::Error: priority = JournalPriorityError; break;
+					case LogLevel::Warning: priority = JournalPriorityWarning; break;
+					case LogLevel::Info: priority = JournalPriorityInfo; break;
+					default: priority = JournalPriorityDebug; break;
+				}
+				sd_journal_send("MESSAGE=%s", record.m_text, "PRIORITY=%i", priority, "TID=%ld", record.m_threadId, nullptr);
+#endif
+				break;
+			}
+
+			default:
+			{
+				std::int64_t relativeTimestamp = record.m_timestamp - m_startTimestamp;
+				std::fprintf(
+					(m_file != nullptr) ? m_file : stderr,
+					"%3d.%06d %6ld %-7s %s\n",
+					int(relativeTimestamp / 1000000), int(relativeTimestamp % 1000000),
+					record.m_threadId,
+					levelName(record.m_level),
+					record.m_text
+				);
+				break;
+			}
+		}
+	}
+
+	LogQueue m_queue;
+	std::atomic<unsigned int> m_droppedCount{0};
+
+private:
+	void writerLoop()
+	{
+		LogRecord record;
+
+		while (true)
+		{
+			// Read the flag before draining the queue to make sure
+			// that messages logged before stop() are not lost.
+			bool keepRunning = m_running;
+
+			bool wroteRecords = false;
+			while (m_queue.pop(record))
+			{
+				write(record);
+				wroteRecords = true;
+			}
+
+			unsigned int droppedCount = m_droppedCount.exchange(0);
+			if (droppedCount > 0)
+			{
+				record.m_level = LogLevel::Warning;
+				record.m_timestamp = monotonicTimeInUs();
+				record.m_threadId = currentThreadId();
+				std::snprintf(record.m_text, sizeof(record.m_text), "Log queue full; %u messages dropped", droppedCount);
+				write(record);
+				wroteRecords = true;
+			}
+
+			if (wroteRecords)
+				std::fflush((m_file != nullptr) ? m_file : stderr);
+
+			if (!keepRunning)
+				break;
+
+			waitForRecords();
+		}
+	}
+
+	void waitForRecords()
+	{
+		std::unique_lock<std::mutex> lock(m_wakeupMutex);
+
+		// Announce the sleep before checking the queue for the last time.
+		// Producers commit before checking m_sleeping, so either the check
+		// here sees their record, or they see m_sleeping and wake us up.
+		m_sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if (m_queue.isEmpty() && (m_droppedCount == 0) && m_running)
+			m_wakeupCondition.wait(lock, [this]() { return m_wakeupPending; });
+
+		m_wakeupPending = false;
+		m_sleeping.store(false, std::memory_order_relaxed);
+	}
+
+	void wakeUp()
+	{
+		std::lock_guard<std::mutex> lock(m_wakeupMutex);
+		m_wakeupPending = true;
+		m_wakeupCondition.notify_one();
+	}
+
+	LogTarget m_target = LogTarget::Stderr;
+	std::FILE *m_file = nullptr;
+	// Timestamps are printed relative to the application start.
+	std::int64_t m_startTimestamp = monotonicTimeInUs();
+	std::atomic<bool> m_running{false};
+	std::atomic<bool> m_threadRunning{false};
+	std::thread m_thread;
+
+	// The writer thread sleeps until records are committed.
+	std::mutex m_wakeupMutex;
+	std::condition_variable m_wakeupCondition;
+	bool m_wakeupPending = false;
+	std::atomic<bool> m_sleeping{false};
+};
+
+
+LogWriter logWriter;
+QtMessageHandler previousQtMessageHandler = nullptr;
+bool gstreamerDebugOutputRouted = false;
+
+
+void vlogMessage(LogLevel level, char const *file, int line, char const *format, va_list args)
+{
+	LogRecord *record;
+	LogRecord synchronousRecord;
+	std::size_t position = 0;
+	bool asynchronous = logWriter.isRunning();
+
+	if (asynchronous)
+	{
+		record = logWriter.m_queue.claim(position);
+		if (record == nullptr)
+		{
+			++logWriter.m_droppedCount;
+			return;
+		}
+	}
+	else
+		record = &synchronousRecord;
+
+	record->m_level = level;
+	record->m_timestamp = monotonicTimeInUs();
+	record->m_threadId = currentThreadId();
+
+	int prefixLength = 0;
+	if (file != nullptr)
+		prefixLength = std::snprintf(record->m_text, sizeof(record->m_text), "%s:%d: ", stripPath(file), line);
+	if ((prefixLength < 0) || (std::size_t(prefixLength) >= sizeof(record->m_text)))
+		prefixLength = 0;
+	std::vsnprintf(record->m_text + prefixLength, sizeof(record->m_text) - prefixLength, format, args);
+
+	if (asynchronous)
+	{
+		logWriter.m_queue.commit(position);
+		logWriter.notifyRecordCommitted();
+	}
+	else
+		logWriter.write(*record);
+}
+
+
+void qtMessageHandler(QtMsgType type, QMessageLogContext const &context, QString const &message)
+{
+	LogLevel level;
+	switch (type)
+	{
+		case QtDebugMsg: level = LogLevel::Debug; break;
+		case QtInfoMsg: level = LogLevel::Info; break;
+		case QtWarningMsg: level = LogLevel::Warning; break;
+		default: level = LogLevel::Error; break;
+	}
+
+	if (type == QtFatalMsg)
+	{
+		// Fatal messages abort the process, so write everything right away.
+		stopLogging();
+		std::fprintf(stderr, "FATAL: %s\n", message.toLocal8Bit().constData());
+		std::abort();
+	}
+
+	if (isLogLevelEnabled(level))
+		logMessage(level, context.file, context.line, "%s", message.toUtf8().constData());
+}
+
+
+void gstreamerLogFunction(GstDebugCategory *category, GstDebugLevel gstLevel, gchar const *file, gchar const *, gint line, GObject *object, GstDebugMessage *message, gpointer)
+{
+	LogLevel level;
+	switch (gstLevel)
+	{
+		case GST_LEVEL_ERROR: level = LogLevel::Error; break;
+		case GST_LEVEL_WARNING:
+		case GST_LEVEL_FIXME: level = LogLevel::Warning; break;
+		case GST_LEVEL_INFO: level = LogLevel::Info; break;
+		case GST_LEVEL_DEBUG: level = LogLevel::Debug; break;
+		default: level = LogLevel::Trace; break;
+	}
+
+	if (!isLogLevelEnabled(level))
+		return;
+
+	char const *objectName = "";
+	if ((object != nullptr) && GST_IS_OBJECT(object))
+		objectName = GST_OBJECT_NAME(object);
+
+	logMessage(
+		level, file, line,
+		"[%s] <%s> %s",
+		gst_debug_category_get_name(category),
+		(objectName != nullptr) ? objectName : "",
+		gst_debug_message_get(message)
+	);
+}
+
+
+} // unnamed namespace end
+
+
+bool parseLogLevel(QString const &name, LogLevel &level)
+{
+	static char const * const names[] = { "trace", "debug", "info", "warning", "error" };
+
+	for (int i = 0; i < int(sizeof(names) / sizeof(names[0])); ++i)
+	{
+		if (name == names[i])
+		{
+			level = LogLevel(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+bool parseLogTarget(QString const &name, LogConfig &config)
+{
+	if (name == "stderr")
+		config.m_target = LogTarget::Stderr;
+	else if (name == "journald")
+		config.m_target = LogTarget::Journald;
+	else if (name.startsWith("file:") && (name.size() > 5))
+	{
+		config.m_target = LogTarget::File;
+		config.m_filename = name.mid(5);
+	}
+	else
+		return false;
+
+	return true;
+}
+
+
+bool startLogging(LogConfig const &config)
+{
+	assert(!logWriter.isRunning());
+
+	setLogLevel(config.m_level);
+
+	if (!logWriter.start(config))
+		return false;
+
+	previousQtMessageHandler = qInstallMessageHandler(qtMessageHandler);
+
+	if (config.m_routeGStreamerDebugOutput)
+	{
+		gst_debug_remove_log_function(gst_debug_log_default);
+		gst_debug_add_log_function(gstreamerLogFunction, nullptr, nullptr);
+		gstreamerDebugOutputRouted = true;
+	}
+
+	return true;
+}
+
+
+void stopLogging()
+{
+	if (!logWriter.isRunning())
+		return;
+
+	if (gstreamerDebugOutputRouted)
+	{
+		gst_debug_remove_log_function(gstreamerLogFunction);
+		gst_debug_add_log_function(gst_debug_log_default, nullptr, nullptr);
+		gstreamerDebugOutputRouted = false;
+	}
+
+	qInstallMessageHandler(previousQtMessageHandler);
+	previousQtMessageHandler = nullptr;
+
+	logWriter.stop();
+}
+
+
+void setLogLevel(LogLevel level)
+{
+	detail::currentLogLevel = int(level);
+}
+
+
+void logMessage(LogLevel level, char const *file, int line, char const *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	vlogMessage(level, file, line, format, args);
+	va_end(args);
+}
+
+
+LogRateLimiter::LogRateLimiter(int maxMessagesPerInterval, int intervalInMs)
+	: m_maxMessagesPerInterval(maxMessagesPerInterval)
+	, m_intervalInUs(std::int64_t(intervalInMs) * 1000)
+	, m_intervalStart(monotonicTimeInUs())
+	, m_messageCount(0)
+	, m_suppressedCount(0)
+{
+}
+
+
+bool LogRateLimiter::allow(unsigned int &suppressedCount)
+{
+	std::int64_t now = monotonicTimeInUs();
+	std::int64_t intervalStart = m_intervalStart.load(std::memory_order_relaxed);
+
+	// Begin a new interval if the current one is over. Only one thread
+	// succeeds with the exchange; the others use the new interval then.
+	if (((now - intervalStart) >= m_intervalInUs) && m_intervalStart.compare_exchange_strong(intervalStart, now, std::memory_order_relaxed))
+		m_messageCount = 0;
+
+	if (m_messageCount.fetch_add(1, std::memory_order_relaxed) < m_maxMessagesPerInterval)
+	{
+		suppressedCount = m_suppressedCount.exchange(0, std::memory_order_relaxed);
+		return true;
+	}
+	else
+	{
+		m_suppressedCount.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+}
@@ -0,0 +1,158 @@
+#ifndef LOG_HPP
+#define LOG_HPP
+
+#include <atomic>
+#include <cstdint>
+
+#include <QString>
+
+
+// Asynchronous logging.
+//
+// Log calls only format the message into a slot of a lock-free queue.
+// The actual output (to stderr, journald, or a file) is done by a
+// background writer thread. This keeps the cost of logging in the
+// streaming and render threads low and predictable. If the queue is
+// full, messages are dropped instead of blocking the caller; the number
+// of dropped messages is reported by the writer thread. The writer thread
+// sleeps while the queue is empty; only the first message after such a
+// sleep takes a lock, for waking it up.
+//
+// Qt messages (qDebug(), qCritical() etc.) are routed through this
+// queue as well once startLogging() was called.
+//
+// Levels below QMLGLSINK_EXAMPLE_MIN_LOG_LEVEL are compiled out. The
+// runtime level can be set on top of that with setLogLevel().
+
+
+#ifndef QMLGLSINK_EXAMPLE_MIN_LOG_LEVEL
+#define QMLGLSINK_EXAMPLE_MIN_LOG_LEVEL 0
+#endif
+
+
+enum class LogLevel
+{
+	Trace = 0,
+	Debug,
+	Info,
+	Warning,
+	Error
+};
+
+
+enum class LogTarget
+{
+	Stderr,
+	Journald,
+	File
+};
+
+
+struct LogConfig
+{
+	LogLevel m_level = LogLevel::Debug;
+	LogTarget m_target = LogTarget::Stderr;
+	// Only used with LogTarget::File.
+	QString m_filename;
+	// If true, GStreamer debug output is routed through the log queue
+	// instead of being written synchronously by GStreamer itself.
+	bool m_routeGStreamerDebugOutput = false;
+};
+
+
+// Parses a log level name ("trace", "debug", "info", "warning", "error").
+bool parseLogLevel(QString const &name, LogLevel &level);
+
+// Parses a log target ("stderr", "journald", "file:<filename>").
+bool parseLogTarget(QString const &name, LogConfig &config);
+
+// Starts the background writer thread and installs the Qt message handler.
+// Before this is called, messages are written synchronously to stderr.
+bool startLogging(LogConfig const &config);
+
+// Writes all queued messages, stops the background writer thread, and
+// restores the previous Qt message handler.
+void stopLogging();
+
+void setLogLevel(LogLevel level);
+
+
+namespace detail
+{
+
+
+extern std::atomic<int> currentLogLevel;
+
+
+} // namespace detail end
+
+
+inline bool isLogLevelEnabled(LogLevel level)
+{
+	return (int(level) >= QMLGLSINK_EXAMPLE_MIN_LOG_LEVEL) && (int(level) >= detail::currentLogLevel.load(std::memory_order_relaxed));
+}
+
+void logMessage(LogLevel level, char const *file, int line, char const *format, ...)
+#ifdef __GNUC__
+	__attribute__((format(printf, 4, 5)))
+#endif
+	;
+
+
+// Limits the number of messages logged from one call site within
+// a time interval. Messages beyond that limit are suppressed, and the
+// number of suppressed messages is logged once the next interval begins.
+
+class LogRateLimiter
+{
+public:
+	explicit LogRateLimiter(int maxMessagesPerInterval, int intervalInMs);
+
+	// Returns true if the message may be logged. suppressedCount is set
+	// to the number of messages suppressed since the last allowed one.
+	bool allow(unsigned int &suppressedCount);
+
+private:
+	int const m_maxMessagesPerInterval;
+	std::int64_t const m_intervalInUs;
+	std::atomic<std::int64_t> m_intervalStart;
+	std::atomic<int> m_messageCount;
+	std::atomic<unsigned int> m_suppressedCount;
+};
+
+
+#define LOG_AT_LEVEL(LEVEL, ...) \
+	do \
+	{ \
+		if (isLogLevelEnabled(LEVEL)) \
+			logMessage((LEVEL), __FILE__, __LINE__, __VA_ARGS__); \
+	} \
+	while (false)
+
+#define LOG_TRACE(...) LOG_AT_LEVEL(LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT_LEVEL(LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT_LEVEL(LogLevel::Info, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT_LEVEL(LogLevel::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT_LEVEL(LogLevel::Error, __VA_ARGS__)
+
+// Rate limited variant. At most MAX_MESSAGES messages are logged from
+// the call site within INTERVAL_MS milliseconds.
+#define LOG_RATE_LIMITED(LEVEL, MAX_MESSAGES, INTERVAL_MS, ...) \
+	do \
+	{ \
+		if (isLogLevelEnabled(LEVEL)) \
+		{ \
+			static LogRateLimiter logRateLimiter((MAX_MESSAGES), (INTERVAL_MS)); \
+			unsigned int logSuppressedCount; \
+			if (logRateLimiter.allow(logSuppressedCount)) \
+			{ \
+				if (logSuppressedCount > 0) \
+					logMessage((LEVEL), __FILE__, __LINE__, "(%u similar messages suppressed)", logSuppressedCount); \
+				logMessage((LEVEL), __FILE__, __LINE__, __VA_ARGS__); \
+			} \
+		} \
+	} \
+	while (false)
+
+
+#endif // LOG_HPP
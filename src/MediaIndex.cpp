@@ -0,0 +1,360 @@
+#include <assert.h>
+
+#include <gst/pbutils/pbutils.h>
+
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "Log.hpp"
+#include "MediaIndex.hpp"
+#include "Pipeline.hpp"
+#include "ScopeGuard.hpp"
+#include "Utils.hpp"
+
+
+namespace
+{
+
+
+constexpr quint32 IndexMagic = 0x514d4958; // "QMIX"
+constexpr quint32 IndexVersion = 2;
+constexpr GstClockTime DiscoveryTimeout = 10 * GST_SECOND;
+
+
+QDataStream & operator << (QDataStream &stream, MediaInfo const &info)
+{
+	return stream
+		<< info.m_uri
+		<< info.m_modificationTime
+		<< info.m_fileSize
+		<< info.m_durationInMs
+		<< info.m_containerCaps;
+}
+
+
+QDataStream & operator >> (QDataStream &stream, MediaInfo &info)
+{
+	return stream
+		>> info.m_uri
+		>> info.m_modificationTime
+		>> info.m_fileSize
+		>> info.m_durationInMs
+		>> info.m_containerCaps;
+}
+
+
+QString capsToString(GstCaps *caps)
+{
+	if (caps == nullptr)
+		return QString();
+
+	gchar *string = gst_caps_to_string(caps);
+	QString result = string;
+	g_free(string);
+	gst_caps_unref(caps);
+
+	return result;
+}
+
+
+void fillMediaInfo(GstDiscovererInfo *discovererInfo, MediaInfo &info)
+{
+	GstClockTime duration = gst_discoverer_info_get_duration(discovererInfo);
+	info.m_durationInMs = GST_CLOCK_TIME_IS_VALID(duration) ? qint64(duration / GST_MSECOND) : -1;
+
+	// Only containers are cached. For elementary streams, the topology
+	// holds the caps the parser produced (with fields like "parsed" or
+	// "stream-format"), and forcing those on the typefinder would make
+	// decodebin skip the parser.
+	GstDiscovererStreamInfo *topologyInfo = gst_discoverer_info_get_stream_info(discovererInfo);
+	if (topologyInfo != nullptr)
+	{
+		if (GST_IS_DISCOVERER_CONTAINER_INFO(topologyInfo))
+			info.m_containerCaps = capsToString(gst_discoverer_stream_info_get_caps(topologyInfo));
+		gst_discoverer_stream_info_unref(topologyInfo);
+	}
+}
+
+
+} // unnamed namespace end
+
+
+// Helper class to discover one URI in a worker thread.
+
+class DiscoverJob
+	: public QRunnable
+{
+public:
+	explicit DiscoverJob(MediaIndex *index, MediaInfo info)
+		: m_index(index)
+		, m_info(std::move(info))
+	{
+	}
+
+	void run() override
+	{
+		bool succeeded = discover();
+
+		// m_index is guaranteed to be alive here, since its destructor
+		// waits for all jobs to finish. Pending queued calls are discarded
+		// once the index is destroyed.
+		MediaIndex *index = m_index;
+		MediaInfo info = m_info;
+		QMetaObject::invokeMethod(index, [index, info, succeeded]() {
+			index->onDiscovered(info, succeeded);
+		}, Qt::QueuedConnection);
+	}
+
+private:
+	bool discover()
+	{
+		// Each job uses its own discoverer in synchronous mode. The
+		// discoverers of the jobs then run in parallel, and no GLib
+		// mainloop is needed.
+		GError *error = nullptr;
+		GstDiscoverer *discoverer = gst_discoverer_new(DiscoveryTimeout, &error);
+		if (discoverer == nullptr)
+		{
+			LOG_ERROR("Could not create discoverer: %s", error->message);
+			g_error_free(error);
+			return false;
+		}
+		auto discovererGuard = makeScopeGuard([&]() {
+			g_object_unref(G_OBJECT(discoverer));
+		});
+
+		GstDiscovererInfo *discovererInfo = gst_discoverer_discover_uri(discoverer, m_info.m_uri.toStdString().c_str(), &error);
+		if (discovererInfo == nullptr)
+		{
+			LOG_WARNING("Could not discover %s: %s", m_info.m_uri.toStdString().c_str(), (error != nullptr) ? error->message : "unknown error");
+			g_clear_error(&error);
+			return false;
+		}
+		g_clear_error(&error);
+
+		bool succeeded = (gst_discoverer_info_get_result(discovererInfo) == GST_DISCOVERER_OK);
+		if (succeeded)
+			fillMediaInfo(discovererInfo, m_info);
+
+		gst_discoverer_info_unref(discovererInfo);
+		return succeeded;
+	}
+
+	MediaIndex *m_index;
+	MediaInfo m_info;
+};
+
+
+MediaIndex::MediaIndex(QString filename, QObject *parent)
+	: QObject(parent)
+	, m_filename(std::move(filename))
+{
+	gst_pb_utils_init();
+}
+
+
+MediaIndex::~MediaIndex()
+{
+	m_discoveryPool.clear();
+	m_discoveryPool.waitForDone();
+
+	if (m_modified)
+		save();
+}
+
+
+bool MediaIndex::load()
+{
+	QFile file(m_filename);
+	if (!file.exists())
+		return true;
+
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qCritical() << "Could not open media index" << m_filename << ":" << file.errorString();
+		return false;
+	}
+
+	QDataStream stream(&file);
+	quint32 magic, version, numEntries;
+	stream >> magic >> version >> numEntries;
+
+	// Outdated or broken indices are just rebuilt.
+	if ((stream.status() != QDataStream::Ok) || (magic != IndexMagic) || (version != IndexVersion))
+	{
+		LOG_WARNING("Ignoring invalid media index %s", m_filename.toStdString().c_str());
+		return true;
+	}
+
+	QHash<QString, MediaInfo> entries;
+	entries.reserve(int(numEntries));
+	for (quint32 i = 0; (i < numEntries) && (stream.status() == QDataStream::Ok); ++i)
+	{
+		MediaInfo info;
+		stream >> info;
+		entries.insert(info.m_uri, std::move(info));
+	}
+
+	if (stream.status() != QDataStream::Ok)
+	{
+		LOG_WARNING("Ignoring truncated media index %s", m_filename.toStdString().c_str());
+		return true;
+	}
+
+	std::lock_guard<std::mutex> lock(m_entriesMutex);
+	m_entries = std::move(entries);
+	LOG_DEBUG("Loaded media index with %d entries", m_entries.size());
+
+	return true;
+}
+
+
+bool MediaIndex::save()
+{
+	QDir().mkpath(QFileInfo(m_filename).absolutePath());
+
+	// QSaveFile makes sure a crash while saving does not corrupt the index.
+	QSaveFile file(m_filename);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		qCritical() << "Could not write media index" << m_filename << ":" << file.errorString();
+		return false;
+	}
+
+	QDataStream stream(&file);
+	{
+		std::lock_guard<std::mutex> lock(m_entriesMutex);
+
+		stream << IndexMagic << IndexVersion << quint32(m_entries.size());
+		for (MediaInfo const &info : m_entries)
+			stream << info;
+	}
+
+	if (!file.commit())
+	{
+		qCritical() << "Could not write media index" << m_filename << ":" << file.errorString();
+		return false;
+	}
+
+	m_modified = false;
+	return true;
+}
+
+
+void MediaIndex::scan(Playlist const &playlist)
+{
+	for (PlaylistEntry const &entry : playlist)
+	{
+		if (entry.m_type != PlaylistEntry::Type::Video)
+			continue;
+
+		MediaInfo info;
+		info.m_uri = entry.m_url;
+		if (!getLocalFileStamp(info.m_uri, info.m_modificationTime, info.m_fileSize))
+			continue;
+
+		MediaInfo existingInfo;
+		if (lookup(info.m_uri, existingInfo))
+			continue;
+
+		++m_numPendingDiscoveries;
+		m_discoveryPool.start(new DiscoverJob(this, std::move(info)));
+	}
+
+	LOG_INFO("Discovering %d playlist entries in the background", m_numPendingDiscoveries);
+
+	if (m_numPendingDiscoveries == 0)
+		emit scanFinished();
+}
+
+
+bool MediaIndex::lookup(QString const &uri, MediaInfo &info) const
+{
+	qint64 modificationTime, fileSize;
+	if (!getLocalFileStamp(uri, modificationTime, fileSize))
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_entriesMutex);
+
+	auto iter = m_entries.constFind(uri);
+	if ((iter == m_entries.constEnd()) || (iter->m_modificationTime != modificationTime) || (iter->m_fileSize != fileSize))
+		return false;
+
+	info = *iter;
+	return true;
+}
+
+
+void MediaIndex::attach(Pipeline &pipeline)
+{
+	assert(m_pipeline == nullptr);
+
+	m_pipeline = &pipeline;
+
+	m_pipeline->addElementSetupHandler([this](GstElement *element) {
+		onElementSetup(element);
+	});
+}
+
+
+QString MediaIndex::defaultFilename()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/media-index.bin";
+}
+
+
+void MediaIndex::onDiscovered(MediaInfo info, bool succeeded)
+{
+	--m_numPendingDiscoveries;
+
+	if (succeeded)
+	{
+		LOG_DEBUG(
+			"Discovered %s: %lld ms, %s",
+			info.m_uri.toStdString().c_str(),
+			(long long)(info.m_durationInMs),
+			info.m_containerCaps.isEmpty() ? "no container" : info.m_containerCaps.toStdString().c_str()
+		);
+
+		std::lock_guard<std::mutex> lock(m_entriesMutex);
+		m_entries.insert(info.m_uri, std::move(info));
+		m_modified = true;
+	}
+
+	if (m_numPendingDiscoveries == 0)
+	{
+		if (m_modified)
+			save();
+		emit scanFinished();
+	}
+}
+
+
+void MediaIndex::onElementSetup(GstElement *element)
+{
+	// This is called in whatever thread created the element.
+
+	GstElementFactory *factory = gst_element_get_factory(element);
+	if ((factory == nullptr) || (g_strcmp0(GST_OBJECT_NAME(factory), "typefind") != 0))
+		return;
+
+	gchar *uri = nullptr;
+	g_object_get(m_pipeline->playbin(), "uri", &uri, nullptr);
+	if (uri == nullptr)
+		return;
+
+	MediaInfo info;
+	bool found = lookup(uri, info);
+	g_free(uri);
+
+	if (!found || !forceTypefindCaps(element, info.m_containerCaps))
+		return;
+
+	LOG_DEBUG("Using cached caps for %s", info.m_uri.toStdString().c_str());
+}
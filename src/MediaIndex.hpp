@@ -0,0 +1,99 @@
+#ifndef MEDIA_INDEX_HPP
+#define MEDIA_INDEX_HPP
+
+#include <mutex>
+
+#include <gst/gst.h>
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QThreadPool>
+
+#include "Playlist.hpp"
+
+
+class Pipeline;
+
+
+struct MediaInfo
+{
+	QString m_uri;
+	// Modification time (ms since the epoch) and size of the file at the
+	// time it was discovered. Entries are only valid if these still match.
+	qint64 m_modificationTime = 0;
+	qint64 m_fileSize = 0;
+
+	// -1 if unknown.
+	qint64 m_durationInMs = -1;
+	// Caps of the container format. Empty if the file has no container
+	// (like an elementary H.264 stream), since the caps the discoverer
+	// reports for those are parsed stream caps, which are not what the
+	// typefinder would detect.
+	QString m_containerCaps;
+};
+
+
+// On-disk index of stream information about local playlist entries.
+//
+// scan() runs GstDiscoverer over all video entries of a playlist that are
+// not in the index yet (or whose files changed since), in parallel worker
+// threads. Playback does not wait for the scan. The index is one compact
+// binary file that is read once at startup, so the startup time does not
+// depend on the number of entries.
+//
+// Once attached to a pipeline, the index makes the typefinder of playbin
+// use the cached container caps instead of reading and typefinding the
+// file again, unless another cache (like AutoplugCache) forced its caps
+// already. Only local files are indexed, since their modification time
+// tells if the cached information is still valid.
+
+class MediaIndex
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit MediaIndex(QString filename = defaultFilename(), QObject *parent = nullptr);
+	~MediaIndex() override;
+
+	bool load();
+	bool save();
+
+	// Discovers all video entries of the playlist that are missing in
+	// the index, or whose information is outdated. Emits scanFinished()
+	// once done. The index is saved afterwards.
+	void scan(Playlist const &playlist);
+
+	// Returns false if there is no valid information for the URI.
+	// Can be called from any thread.
+	bool lookup(QString const &uri, MediaInfo &info) const;
+
+	void attach(Pipeline &pipeline);
+
+	static QString defaultFilename();
+
+signals:
+	void scanFinished();
+
+
+private:
+	friend class DiscoverJob;
+
+	void onDiscovered(MediaInfo info, bool succeeded);
+	void onElementSetup(GstElement *element);
+
+	QString m_filename;
+	Pipeline *m_pipeline = nullptr;
+
+	// The entries are read by the streaming threads (see onElementSetup()).
+	mutable std::mutex m_entriesMutex;
+	QHash<QString, MediaInfo> m_entries;
+	bool m_modified = false;
+
+	QThreadPool m_discoveryPool;
+	int m_numPendingDiscoveries = 0;
+};
+
+
+#endif // MEDIA_INDEX_HPP
@@ -0,0 +1,610 @@
+#include <assert.h>
+
+#include <QDebug>
+#include <QQuickItem>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "ScopeGuard.hpp"
+
+
+Pipeline::Pipeline()
+	: m_busMessageContext(new QObject)
+{
+}
+
+
+Pipeline::~Pipeline()
+{
+	// Filters that never made it into the video sink.
+	for (GstElement *filter : m_videoSinkFilters)
+		gst_object_unref(GST_OBJECT(filter));
+
+	if (m_playbin == nullptr)
+		return;
+
+	shutdown();
+
+	// Make sure the qmlglsink no longer uses the Qt widget
+	// before the QML UI is torn down.
+	if (m_qmlglsink != nullptr)
+		g_object_set(m_qmlglsink, "widget", gpointer(nullptr), nullptr);
+
+	// Remove the sync handler to make sure no new messages get queued
+	// for dispatching. Messages that were queued already are discarded
+	// once m_busMessageContext is destroyed.
+	{
+		GstBus *bus = gst_element_get_bus(m_playbin);
+		gst_bus_set_sync_handler(bus, nullptr, nullptr, nullptr);
+		gst_object_unref(GST_OBJECT(bus));
+	}
+
+	// Deallocate the pipeline. We are not explictly deallocating
+	// m_qmlglsink, since that one is taken care of by glsinkbin,
+	// which in turn is taken care of by m_playbin.
+	gst_object_unref(GST_OBJECT(m_playbin));
+}
+
+
+void Pipeline::shutdown()
+{
+	if (m_playbin == nullptr)
+		return;
+
+	// The video sink might still be frozen,
+	// so unfreeze it to let it follow.
+	unfreezeVideoSink();
+	gst_element_set_state(m_playbin, GST_STATE_NULL);
+}
+
+
+void Pipeline::setFixedVideoSize(int width, int height)
+{
+	assert(m_playbin == nullptr);
+
+	m_fixedVideoWidth = width;
+	m_fixedVideoHeight = height;
+}
+
+
+void Pipeline::addVideoSinkFilter(GstElement *filter)
+{
+	assert(m_playbin == nullptr);
+	assert(filter != nullptr);
+
+	m_videoSinkFilters.push_back(GST_ELEMENT(gst_object_ref_sink(filter)));
+}
+
+
+bool Pipeline::setup(QObject *qmlSubtitleItem)
+{
+	// Scope guard to cleanup the pipeline in case setup fails.
+	auto pipelineGuard = makeScopeGuard([&]() {
+		if (m_playbin != nullptr)
+		{
+			gst_object_unref(GST_OBJECT(m_playbin));
+			m_playbin = nullptr;
+		}
+	});
+
+
+	// Store the pointer to be able to set its subtitle property later.
+	m_qmlSubtitleItem = qmlSubtitleItem;
+
+
+	// Create the pipeline.
+
+	// Note that playbin is a fully featured pipeline element, and putting
+	// it in a dedicated additional pipeline element is unnecessary, which
+	// is why there's no gst_pipeline_new() call here.
+	m_playbin = gst_element_factory_make("playbin", nullptr);
+	if (m_playbin == nullptr)
+	{
+		qCritical() << "Could not create playbin element";
+		return false;
+	}
+
+	GstElement *glsinkbin = nullptr;
+	GstElement *subtitleAppsink = nullptr;
+
+	// Scope guard to make sure the elements above are always
+	// unref'd in case an error occurs. This guard is needed
+	// until these elements are transferred over to playbin.
+	auto elementUnrefGuard = makeScopeGuard([&]() {
+		if (glsinkbin != nullptr)
+			gst_object_unref(GST_OBJECT(glsinkbin));
+		if (subtitleAppsink != nullptr)
+			gst_object_unref(GST_OBJECT(subtitleAppsink));
+	});
+
+	// Create the glsinkbin. This will be used as the video sink by playbin.
+	glsinkbin = gst_element_factory_make("glsinkbin", nullptr);
+	if (glsinkbin == nullptr)
+	{
+		qCritical() << "Could not create glsinkbin element";
+		return false;
+	}
+
+	// Create the appsink that will be used for extracting subtitles.
+	subtitleAppsink = gst_element_factory_make("appsink", nullptr);
+	if (subtitleAppsink == nullptr)
+	{
+		qCritical() << "Could not create subtitle appsink element";
+		return false;
+	}
+
+	// Create the qmlglsink and assign it to the glsinkbin, which
+	// takes ownership over that qmlglsink.
+	m_qmlglsink = gst_element_factory_make("qmlglsink", nullptr);
+	if (m_qmlglsink == nullptr)
+	{
+		qCritical() << "Could not create qmlglsink element";
+		return false;
+	}
+
+	GstElement *videoSinkElement = m_qmlglsink;
+	if (((m_fixedVideoWidth > 0) && (m_fixedVideoHeight > 0)) || !m_videoSinkFilters.empty())
+	{
+		videoSinkElement = createVideoSinkBin(m_qmlglsink);
+		if (videoSinkElement == nullptr)
+		{
+			m_qmlglsink = nullptr;
+			return false;
+		}
+	}
+	g_object_set(glsinkbin, "sink", videoSinkElement, nullptr);
+
+	// Set the glsinkbin as the video sink to use for playback. The flags
+	// are set to 0x57, which disables all software based video postprocessing
+	// (color balancing, deinterlacing ...) but keeps software based audio
+	// postprocessing enabled. Disabling the video postprocessing is essential
+	// on embedded platforms to minimize stutter (which is cause by a saturated CPU).
+	// Also, set the subtitleAppsink as the "text sink" (aka the subtitle sink).
+	// The URI is not set here; it is set by play() instead.
+	g_object_set(
+		m_playbin,
+		"flags", gint(0x57),
+		"video-sink", glsinkbin,
+		"text-sink", subtitleAppsink,
+		nullptr
+	);
+
+	// playbin owns the glsinkbin and subtitle appsink now.
+	// The scope guard is no longer needed.
+	elementUnrefGuard.dismiss();
+	m_glsinkbin = glsinkbin;
+	m_subtitleAppsink = subtitleAppsink;
+
+	// Set the appsink callbacks to be informed whenever new subtitles are read.
+	// These subtitles can then be displayed in QML.
+	{
+		GstAppSinkCallbacks subtitleAppsinkCallbacks = {};
+		subtitleAppsinkCallbacks.new_sample = &staticOnNewSubtitle;
+
+		gst_app_sink_set_callbacks(
+			GST_APP_SINK(subtitleAppsink),
+			&subtitleAppsinkCallbacks,
+			gpointer(this),
+			nullptr
+		);
+
+		// Further refine appsink behavior:
+		// - Enable the drop property to make sure the appsink never blocks.
+		//   If subtitles are not shown in time, we anyway do not want to
+		//   show them anymore, so it is OK to drop stale subtitles.
+		// - Set max-buffers to 1 since we do not want a queue of subtitles.
+		g_object_set(
+			G_OBJECT(subtitleAppsink),
+			"drop", gboolean(TRUE),
+			"max-buffers", guint(1),
+			nullptr
+		);
+	}
+
+
+	// Let the source and element setup handlers configure source elements
+	// (like the read-ahead file source) and other elements (like adaptive
+	// demuxers) once playbin creates them.
+	g_signal_connect(m_playbin, "source-setup", G_CALLBACK(&staticOnSourceSetup), gpointer(this));
+	g_signal_connect(m_playbin, "element-setup", G_CALLBACK(&staticOnElementSetup), gpointer(this));
+
+
+	// Install a bus sync handler instead of a regular GStreamer bus watch.
+	// A bus watch hooks into the GLib mainloop. If Qt is built with Glib
+	// integration, then the Qt mainloop is built upon the mainloop one, and
+	// the bus watch will "just work". If not, then the bus watch would have
+	// to be attached to a dedicated mainloop that runs in a separate thread.
+	// The sync handler avoids this dependency by forwarding the messages to
+	// the Qt mainloop on its own (see staticOnBusSyncMessage()).
+	{
+		GstBus *bus = gst_element_get_bus(m_playbin);
+		gst_bus_set_sync_handler(bus, &staticOnBusSyncMessage, gpointer(this), nullptr);
+		gst_object_unref(GST_OBJECT(bus));
+	}
+
+
+	// Dismiss the pipeline guard since setup completed successfully.
+	pipelineGuard.dismiss();
+	return true;
+}
+
+
+void Pipeline::attachVideoItem(QQuickItem *videoItem)
+{
+	assert(m_qmlglsink != nullptr);
+
+	// We cast the videoItem pointer to gpointer to avoid compiler warnings
+	// and to make sure the GObject property system works properly.
+	g_object_set(m_qmlglsink, "widget", gpointer(videoItem), nullptr);
+}
+
+
+bool Pipeline::play(QString const &inputUrl)
+{
+	assert(m_playbin != nullptr);
+
+	// playbin only accepts a new URI in the READY or NULL states.
+	// Switching to READY (and not NULL) keeps the sinks and their
+	// GL resources around.
+	stop();
+
+	g_object_set(m_playbin, "uri", inputUrl.toStdString().c_str(), nullptr);
+
+	if (gst_element_set_state(m_playbin, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+	{
+		qCritical() << "Could not set pipeline state to PLAYING";
+		return false;
+	}
+
+	return true;
+}
+
+
+void Pipeline::stop()
+{
+	assert(m_playbin != nullptr);
+
+	// While an asynchronous READY->PAUSED change is still in progress,
+	// the current state is READY, but the input keeps prerolling, so the
+	// pending state has to be checked as well.
+	GstState currentState, pendingState;
+	gst_element_get_state(m_playbin, &currentState, &pendingState, 0);
+	if ((currentState > GST_STATE_READY) || (pendingState > GST_STATE_READY))
+		gst_element_set_state(m_playbin, GST_STATE_READY);
+
+	// The streaming threads are stopped now. Anything
+	// they posted before belongs to the stopped input.
+	++m_inputGeneration;
+}
+
+
+bool Pipeline::restart()
+{
+	assert(m_playbin != nullptr);
+
+	gchar *uri = nullptr;
+	g_object_get(m_playbin, "uri", &uri, nullptr);
+	if (uri == nullptr)
+		return false;
+
+	QString inputUrl = uri;
+	g_free(uri);
+
+	gst_element_set_state(m_playbin, GST_STATE_NULL);
+	return play(inputUrl);
+}
+
+
+bool Pipeline::setPaused(bool paused)
+{
+	assert(m_playbin != nullptr);
+
+	if (gst_element_set_state(m_playbin, paused ? GST_STATE_PAUSED : GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+	{
+		qCritical() << "Could not set pipeline state to" << (paused ? "PAUSED" : "PLAYING");
+		return false;
+	}
+
+	return true;
+}
+
+
+bool Pipeline::seek(gint64 position, double rate, GstSeekFlags extraFlags)
+{
+	assert(m_playbin != nullptr);
+
+	// With negative rates, the position is where playback stops,
+	// and the segment runs from the beginning to that position.
+	bool seekSucceeded;
+	GstSeekFlags flags = GstSeekFlags(GST_SEEK_FLAG_FLUSH | extraFlags);
+	if (rate >= 0)
+		seekSucceeded = gst_element_seek(m_playbin, rate, GST_FORMAT_TIME, flags, GST_SEEK_TYPE_SET, position, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+	else
+		seekSucceeded = gst_element_seek(m_playbin, rate, GST_FORMAT_TIME, flags, GST_SEEK_TYPE_SET, 0, GST_SEEK_TYPE_SET, position);
+
+	if (!seekSucceeded)
+	{
+		qCritical() << "Could not seek to" << (position / GST_MSECOND) << "ms with rate" << rate;
+		return false;
+	}
+
+	return true;
+}
+
+
+void Pipeline::freezeVideoSink()
+{
+	assert(m_glsinkbin != nullptr);
+
+	// With a locked state, state changes of playbin are not propagated
+	// to the glsinkbin. Pausing it makes it no longer synchronize to the
+	// clock, so it accepts the next prerolled frame, regardless of the
+	// base time that the pipeline will have once it runs again.
+	gst_element_set_locked_state(m_glsinkbin, TRUE);
+	gst_element_set_state(m_glsinkbin, GST_STATE_PAUSED);
+}
+
+
+void Pipeline::unfreezeVideoSink()
+{
+	assert(m_glsinkbin != nullptr);
+
+	gst_element_set_locked_state(m_glsinkbin, FALSE);
+	gst_element_sync_state_with_parent(m_glsinkbin);
+}
+
+
+void Pipeline::showSubtitle(QString const &subtitle)
+{
+	setQmlSubtitleItemProperty("subtitle", subtitle);
+}
+
+
+void Pipeline::showCaption(QString const &caption)
+{
+	setQmlSubtitleItemProperty("caption", caption);
+}
+
+
+void Pipeline::addBusMessageHandler(BusMessageHandler handler)
+{
+	m_busMessageHandlers.emplace_back(std::move(handler));
+}
+
+
+void Pipeline::addSourceSetupHandler(SourceSetupHandler handler)
+{
+	m_sourceSetupHandlers.emplace_back(std::move(handler));
+}
+
+
+void Pipeline::staticOnSourceSetup(GstElement *, GstElement *source, gpointer userData)
+{
+	Pipeline *self = reinterpret_cast<Pipeline *>(userData);
+
+	for (auto &handler : self->m_sourceSetupHandlers)
+		handler(source);
+}
+
+
+void Pipeline::addElementSetupHandler(ElementSetupHandler handler)
+{
+	m_elementSetupHandlers.emplace_back(std::move(handler));
+}
+
+
+void Pipeline::setSubpictureHandler(SubpictureHandler handler)
+{
+	m_subpictureHandler = std::move(handler);
+}
+
+
+void Pipeline::staticOnElementSetup(GstElement *, GstElement *element, gpointer userData)
+{
+	Pipeline *self = reinterpret_cast<Pipeline *>(userData);
+
+	for (auto &handler : self->m_elementSetupHandlers)
+		handler(element);
+}
+
+
+GstBusSyncReply Pipeline::staticOnBusSyncMessage(GstBus *, GstMessage *message, gpointer userData)
+{
+	Pipeline *self = reinterpret_cast<Pipeline *>(userData);
+
+	// This is called in whatever thread posted the message. Forward the
+	// message to the thread of m_busMessageContext. The shared_ptr takes
+	// care of unref'ing the message, even if the queued call is discarded.
+	std::shared_ptr<GstMessage> messagePtr(gst_message_ref(message), gst_message_unref);
+	unsigned int inputGeneration = self->m_inputGeneration;
+	QMetaObject::invokeMethod(self->m_busMessageContext.get(), [self, messagePtr, inputGeneration]() {
+		self->dispatchBusMessage(messagePtr.get(), inputGeneration);
+	}, Qt::QueuedConnection);
+
+	return GST_BUS_DROP;
+}
+
+
+void Pipeline::dispatchBusMessage(GstMessage *message, unsigned int inputGeneration)
+{
+	// An EOS or error of the previous input may still have been queued when
+	// the next input was started. Handlers would wrongly apply it to the
+	// new input (and for example skip it), so it is dropped here.
+	bool isEndOrError = (GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS) || (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR);
+	if (isEndOrError && (inputGeneration != m_inputGeneration))
+	{
+		LOG_DEBUG("Ignoring %s message of a stopped input", GST_MESSAGE_TYPE_NAME(message));
+		return;
+	}
+
+	switch (GST_MESSAGE_TYPE(message))
+	{
+		case GST_MESSAGE_ERROR:
+		{
+			GError *error = nullptr;
+			gchar *debugInfo = nullptr;
+			gst_message_parse_error(message, &error, &debugInfo);
+			qCritical() << "Error from" << GST_OBJECT_NAME(GST_MESSAGE_SRC(message)) << ":" << error->message;
+			if (debugInfo != nullptr)
+				qCritical() << "Debug info:" << debugInfo;
+			g_error_free(error);
+			g_free(debugInfo);
+			break;
+		}
+
+		case GST_MESSAGE_WARNING:
+		{
+			GError *warning = nullptr;
+			gst_message_parse_warning(message, &warning, nullptr);
+			qWarning() << "Warning from" << GST_OBJECT_NAME(GST_MESSAGE_SRC(message)) << ":" << warning->message;
+			g_error_free(warning);
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	for (auto &handler : m_busMessageHandlers)
+		handler(message);
+}
+
+
+void Pipeline::setQmlSubtitleItemProperty(char const *name, QString const &value)
+{
+	assert(m_qmlSubtitleItem != nullptr);
+
+	// QML objects must only be accessed by the GUI thread, so
+	// the property is set there. If the item is gone by then,
+	// the call is discarded.
+	QObject *qmlSubtitleItem = m_qmlSubtitleItem;
+	QMetaObject::invokeMethod(qmlSubtitleItem, [qmlSubtitleItem, name, value]() {
+		qmlSubtitleItem->setProperty(name, value);
+	}, Qt::QueuedConnection);
+}
+
+
+GstFlowReturn Pipeline::staticOnNewSubtitle(GstAppSink *subtitleAppsink, gpointer userData)
+{
+	Pipeline *self = reinterpret_cast<Pipeline *>(userData);
+
+	// Extract the subtitle text from the GstBuffer inside the newest GstSample.
+
+	GstSample *subtitleSample = gst_app_sink_pull_sample(subtitleAppsink);
+	if (subtitleSample == nullptr)
+		return GST_FLOW_OK;
+	auto sampleGuard = makeScopeGuard([&]() {
+		gst_sample_unref(subtitleSample);
+	});
+
+	// Bitmap subtitles are passed on as they are. The text
+	// subtitle path below cannot do anything with them.
+	GstCaps *caps = gst_sample_get_caps(subtitleSample);
+	if ((caps != nullptr) && (gst_caps_get_size(caps) > 0))
+	{
+		GstStructure const *structure = gst_caps_get_structure(caps, 0);
+		if (g_str_has_prefix(gst_structure_get_name(structure), "subpicture/"))
+		{
+			if (self->m_subpictureHandler)
+				self->m_subpictureHandler(subtitleSample);
+			return GST_FLOW_OK;
+		}
+	}
+
+	GstBuffer *subtitleBuffer = gst_sample_get_buffer(subtitleSample);
+
+	GstMapInfo mapInfo;
+	gst_buffer_map(subtitleBuffer, &mapInfo, GST_MAP_READ);
+	auto guard = makeScopeGuard([&]() {
+		gst_buffer_unmap(subtitleBuffer, &mapInfo);
+	});
+
+	// NOTE: Typically, the subtitle buffers do _not_ contain
+	// a trailing nullbyte.
+	QString subtitle = QString::fromUtf8(
+		reinterpret_cast<char const *>(mapInfo.data),
+		mapInfo.size
+	);
+
+	// This is called in the streaming thread, so use the asynchronous
+	// logger directly instead of going through qDebug().
+	LOG_DEBUG("Subtitle: %.*s", int(mapInfo.size), reinterpret_cast<char const *>(mapInfo.data));
+	self->showSubtitle(subtitle);
+
+	return GST_FLOW_OK;
+}
+
+
+GstElement * Pipeline::createVideoSinkBin(GstElement *qmlglsink)
+{
+	bool const useFixedSize = (m_fixedVideoWidth > 0) && (m_fixedVideoHeight > 0);
+
+	// The bin takes ownership over the qmlglsink and the filters. If
+	// anything fails, they are unref'd along with the bin.
+	GstElement *bin = gst_bin_new("videosinkbin");
+	std::vector<GstElement *> chain;
+
+	for (GstElement *filter : m_videoSinkFilters)
+	{
+		gst_bin_add(GST_BIN(bin), filter);
+		gst_object_unref(GST_OBJECT(filter));
+		chain.push_back(filter);
+	}
+	m_videoSinkFilters.clear();
+
+	if (useFixedSize)
+	{
+		GstElement *scale = gst_element_factory_make("glcolorscale", nullptr);
+		GstElement *capsfilter = gst_element_factory_make("capsfilter", nullptr);
+
+		if (scale != nullptr)
+			gst_bin_add(GST_BIN(bin), scale);
+		if (capsfilter != nullptr)
+			gst_bin_add(GST_BIN(bin), capsfilter);
+
+		if ((scale == nullptr) || (capsfilter == nullptr))
+		{
+			qCritical() << "Could not create glcolorscale and capsfilter elements for the fixed video size";
+			gst_object_unref(GST_OBJECT(qmlglsink));
+			gst_object_unref(GST_OBJECT(bin));
+			return nullptr;
+		}
+
+		// The pixel aspect ratio is deliberately left out of the caps, so
+		// glcolorscale picks one that keeps the display aspect ratio.
+		GstCaps *caps = gst_caps_new_simple(
+			"video/x-raw",
+			"width", G_TYPE_INT, gint(m_fixedVideoWidth),
+			"height", G_TYPE_INT, gint(m_fixedVideoHeight),
+			nullptr
+		);
+		gst_caps_set_features(caps, 0, gst_caps_features_new("memory:GLMemory", nullptr));
+		g_object_set(capsfilter, "caps", caps, nullptr);
+		gst_caps_unref(caps);
+
+		chain.push_back(scale);
+		chain.push_back(capsfilter);
+	}
+
+	gst_bin_add(GST_BIN(bin), qmlglsink);
+	chain.push_back(qmlglsink);
+
+	for (std::size_t index = 1; index < chain.size(); ++index)
+	{
+		if (!gst_element_link(chain[index - 1], chain[index]))
+		{
+			qCritical() << "Could not link the elements of the video sink";
+			gst_object_unref(GST_OBJECT(bin));
+			return nullptr;
+		}
+	}
+
+	GstPad *firstSinkPad = gst_element_get_static_pad(chain.front(), "sink");
+	gst_element_add_pad(bin, gst_ghost_pad_new("sink", firstSinkPad));
+	gst_object_unref(GST_OBJECT(firstSinkPad));
+
+	if (useFixedSize)
+		LOG_INFO("Scaling all video frames to %dx%d", m_fixedVideoWidth, m_fixedVideoHeight);
+
+	return bin;
+}
@@ -0,0 +1,179 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <gst/gst.h>
+#include <gst/app/app.h>
+
+#include <QObject>
+#include <QString>
+
+
+class QQuickItem;
+
+
+// Simple playbin based GStreamer pipeline.
+
+class Pipeline
+{
+public:
+	// Bus message handlers are always invoked in the thread the Pipeline
+	// was created in (typically the Qt GUI thread), never in a streaming thread.
+	// EOS and error messages that were posted before the last stop() (or
+	// play()) call are not passed to the handlers, since they belong to an
+	// input that is no longer playing.
+	typedef std::function<void(GstMessage *message)> BusMessageHandler;
+	// Source setup handlers are invoked whenever playbin created a new
+	// source element, before that element is started. They can be invoked
+	// in any thread, so they must not access the Qt UI.
+	typedef std::function<void(GstElement *source)> SourceSetupHandler;
+	// Element setup handlers are invoked for each element that playbin
+	// creates (including demuxers and decoders), in any thread.
+	typedef std::function<void(GstElement *element)> ElementSetupHandler;
+	// The subpicture handler receives the samples of bitmap subtitle streams
+	// (DVB, PGS, VobSub), which cannot be shown as text. It is invoked in
+	// the streaming thread of the subtitle sink, at the time the sample is
+	// to be presented.
+	typedef std::function<void(GstSample *sample)> SubpictureHandler;
+
+	Pipeline();
+	~Pipeline();
+
+	// Makes the qmlglsink always receive frames of this size. The frames
+	// are scaled on the GPU (with glcolorscale), and the pixel aspect ratio
+	// is adjusted to keep the display aspect ratio. Resolution changes of
+	// the input then no longer renegotiate the qmlglsink or reallocate its
+	// buffers, so the last frame stays on screen until the first frame of
+	// the new resolution is ready. Should be the largest expected video size
+	// (typically the display size). Must be called before setup().
+	void setFixedVideoSize(int width, int height);
+
+	// Adds a GL filter element (like glshader) in front of the qmlglsink.
+	// Filters are linked in the order they were added, and receive RGBA
+	// frames in GL memory. The pipeline takes ownership over the element.
+	// Must be called before setup().
+	void addVideoSinkFilter(GstElement *filter);
+
+	bool setup(QObject *qmlSubtitleItem);
+
+	// Assigns the GLVideoItem from the QML UI to the qmlglsink. This
+	// must be called after the scenegraph is up and running, and before
+	// the first play() call.
+	void attachVideoItem(QQuickItem *videoItem);
+
+	// Switches the pipeline to the given input and starts playback.
+	// If another input is currently playing, it is stopped first.
+	bool play(QString const &inputUrl);
+
+	// Stops playback by setting the pipeline to the READY state. This
+	// keeps the GL resources of the qmlglsink alive, making subsequent
+	// play() calls cheaper than a full pipeline restart.
+	void stop();
+
+	// Stops playback by setting the pipeline to the NULL state, which
+	// also ends all of its streaming threads. Afterwards, no handlers are
+	// called anymore. The destructor does this as well, but objects
+	// whose handlers the pipeline calls may be destroyed before it.
+	void shutdown();
+
+	// Fully restarts the current input by setting the pipeline to the NULL
+	// state and back to PLAYING. Unlike stop(), this releases all resources.
+	bool restart();
+
+	bool setPaused(bool paused);
+
+	// Issues a flushing seek to the given position (in nanoseconds),
+	// with the given playback rate. Negative rates play backwards.
+	bool seek(gint64 position, double rate = 1.0, GstSeekFlags extraFlags = GST_SEEK_FLAG_NONE);
+
+	// Detaches the video sink from the state of the pipeline and pauses it.
+	// The sink keeps its GL resources and the last frame stays on screen,
+	// even while the rest of the pipeline is stopped and restarted.
+	void freezeVideoSink();
+	// Makes the video sink follow the pipeline state again.
+	void unfreezeVideoSink();
+
+	// Shows the given text in the subtitle item of the QML UI. The text
+	// may contain the markup supported by QML's Text.StyledText. This can
+	// be called from any thread (typically a streaming thread); the text
+	// is shown asynchronously by the GUI thread.
+	void showSubtitle(QString const &subtitle);
+	// Like showSubtitle(), except that the text is not hidden after a
+	// while. It stays until it is replaced or cleared by another call.
+	// This is meant for closed captions, whose decoder decides when
+	// they are cleared.
+	void showCaption(QString const &caption);
+
+	void addBusMessageHandler(BusMessageHandler handler);
+	void addSourceSetupHandler(SourceSetupHandler handler);
+	void addElementSetupHandler(ElementSetupHandler handler);
+	// Must be set before the first play() call.
+	void setSubpictureHandler(SubpictureHandler handler);
+
+	GstElement * playbin() const
+	{
+		return m_playbin;
+	}
+
+	// The video sink that is set in playbin (the glsinkbin).
+	GstElement * videoSink() const
+	{
+		return m_glsinkbin;
+	}
+
+	// The appsink that is set as playbin's text sink.
+	GstElement * subtitleSink() const
+	{
+		return m_subtitleAppsink;
+	}
+
+	// The qmlglsink inside the video sink.
+	GstElement * qmlglsink() const
+	{
+		return m_qmlglsink;
+	}
+
+
+private:
+	static GstBusSyncReply staticOnBusSyncMessage(GstBus *bus, GstMessage *message, gpointer userData);
+	void dispatchBusMessage(GstMessage *message, unsigned int inputGeneration);
+
+	static void staticOnSourceSetup(GstElement *playbin, GstElement *source, gpointer userData);
+	static void staticOnElementSetup(GstElement *playbin, GstElement *element, gpointer userData);
+
+	void setQmlSubtitleItemProperty(char const *name, QString const &value);
+
+	static GstFlowReturn staticOnNewSubtitle(GstAppSink *subtitleAppsink, gpointer userData);
+
+	GstElement * createVideoSinkBin(GstElement *qmlglsink);
+
+	GstElement *m_playbin = nullptr;
+	GstElement *m_glsinkbin = nullptr;
+	GstElement *m_qmlglsink = nullptr;
+	GstElement *m_subtitleAppsink = nullptr;
+	QObject *m_qmlSubtitleItem = nullptr;
+	int m_fixedVideoWidth = 0;
+	int m_fixedVideoHeight = 0;
+	// Only used until setup() put them into the video sink.
+	std::vector<GstElement *> m_videoSinkFilters;
+
+	std::vector<BusMessageHandler> m_busMessageHandlers;
+	std::vector<SourceSetupHandler> m_sourceSetupHandlers;
+	std::vector<ElementSetupHandler> m_elementSetupHandlers;
+	SubpictureHandler m_subpictureHandler;
+
+	// Incremented by stop(). Messages are tagged with it when they are
+	// posted, which tells apart messages of inputs that were stopped.
+	std::atomic<unsigned int> m_inputGeneration{0};
+
+	// Context object for the queued bus message dispatch calls. Pending
+	// calls are discarded once this object is destroyed.
+	std::unique_ptr<QObject> m_busMessageContext;
+};
+
+
+#endif // PIPELINE_HPP
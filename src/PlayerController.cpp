@@ -0,0 +1,328 @@
+#include <assert.h>
+
+#include <QDebug>
+
+#include "Pipeline.hpp"
+#include "PlayerController.hpp"
+
+
+namespace
+{
+
+
+// How often QML is notified about position changes.
+constexpr int UiUpdateIntervalInMs = 100;
+
+
+} // unnamed namespace end
+
+
+PlayerController::PlayerController(QObject *parent)
+	: QObject(parent)
+	, m_streamTime(-1)
+	, m_segmentRate(1.0)
+	, m_videoBuffersSeen(false)
+{
+	gst_segment_init(&m_segment, GST_FORMAT_TIME);
+
+	m_uiUpdateTimer.setInterval(UiUpdateIntervalInMs);
+	connect(&m_uiUpdateTimer, &QTimer::timeout, this, &PlayerController::onUiUpdate);
+}
+
+
+PlayerController::~PlayerController()
+{
+	if (m_videoSinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_videoSinkPad, m_probeId);
+		gst_object_unref(GST_OBJECT(m_videoSinkPad));
+	}
+}
+
+
+void PlayerController::attach(Pipeline &pipeline)
+{
+	assert(m_pipeline == nullptr);
+	assert(pipeline.videoSink() != nullptr);
+
+	m_pipeline = &pipeline;
+
+	m_pipeline->addBusMessageHandler([this](GstMessage *message) {
+		onBusMessage(message);
+	});
+
+	// The probe is installed on the sink pad of the glsinkbin, which stays
+	// the same across input changes, so this needs to be done only once.
+	m_videoSinkPad = gst_element_get_static_pad(m_pipeline->videoSink(), "sink");
+	assert(m_videoSinkPad != nullptr);
+	m_probeId = gst_pad_add_probe(
+		m_videoSinkPad,
+		GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+		&staticOnVideoSinkProbe,
+		gpointer(this),
+		nullptr
+	);
+}
+
+
+qint64 PlayerController::position() const
+{
+	return m_position;
+}
+
+
+qint64 PlayerController::duration() const
+{
+	return m_duration;
+}
+
+
+PlayerController::State PlayerController::state() const
+{
+	return m_state;
+}
+
+
+int PlayerController::buffering() const
+{
+	return m_buffering;
+}
+
+
+double PlayerController::rate() const
+{
+	return m_rate;
+}
+
+
+void PlayerController::seek(qint64 positionInMs)
+{
+	if ((m_pipeline == nullptr) || (m_state == Stopped))
+		return;
+
+	m_pipeline->seek(positionInMs * GST_MSECOND, m_rate);
+}
+
+
+void PlayerController::setRate(double rate)
+{
+	if ((m_pipeline == nullptr) || (m_state == Stopped) || (rate == 0))
+		return;
+
+	// Seek to the current position with the new rate.
+	gint64 position = m_streamTime;
+	if (position < 0)
+		position = (m_position >= 0) ? (m_position * GST_MSECOND) : 0;
+
+	m_pipeline->seek(position, rate);
+}
+
+
+void PlayerController::pause()
+{
+	if ((m_pipeline != nullptr) && (m_state == Playing))
+		m_pipeline->setPaused(true);
+}
+
+
+void PlayerController::resume()
+{
+	if ((m_pipeline != nullptr) && (m_state == Paused))
+		m_pipeline->setPaused(false);
+}
+
+
+GstPadProbeReturn PlayerController::staticOnVideoSinkProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	PlayerController *self = reinterpret_cast<PlayerController *>(userData);
+
+	// NOTE: This is called in the streaming thread.
+
+	if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+	{
+		GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+		GstClockTime timestamp = GST_BUFFER_PTS(buffer);
+		if (!GST_CLOCK_TIME_IS_VALID(timestamp))
+			return GST_PAD_PROBE_OK;
+
+		guint64 streamTime = gst_segment_to_stream_time(&(self->m_segment), GST_FORMAT_TIME, timestamp);
+		if (streamTime != guint64(-1))
+		{
+			self->m_streamTime.store(gint64(streamTime), std::memory_order_relaxed);
+			self->m_videoBuffersSeen.store(true, std::memory_order_relaxed);
+		}
+	}
+	else
+	{
+		GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+		switch (GST_EVENT_TYPE(event))
+		{
+			case GST_EVENT_SEGMENT:
+			{
+				GstSegment const *segment;
+				gst_event_parse_segment(event, &segment);
+				if (segment->format == GST_FORMAT_TIME)
+				{
+					gst_segment_copy_into(segment, &(self->m_segment));
+					self->m_segmentRate.store(segment->rate * segment->applied_rate, std::memory_order_relaxed);
+				}
+				break;
+			}
+
+			case GST_EVENT_STREAM_START:
+			case GST_EVENT_FLUSH_STOP:
+				gst_segment_init(&(self->m_segment), GST_FORMAT_TIME);
+				break;
+
+			default:
+				break;
+		}
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+void PlayerController::onBusMessage(GstMessage *message)
+{
+	switch (GST_MESSAGE_TYPE(message))
+	{
+		case GST_MESSAGE_STATE_CHANGED:
+		{
+			if (GST_MESSAGE_SRC(message) != GST_OBJECT(m_pipeline->playbin()))
+				break;
+
+			GstState newState;
+			gst_message_parse_state_changed(message, nullptr, &newState, nullptr);
+
+			State state;
+			switch (newState)
+			{
+				case GST_STATE_PLAYING: state = Playing; break;
+				case GST_STATE_PAUSED: state = Paused; break;
+				default: state = Stopped; break;
+			}
+
+			if (state == Stopped)
+				reset();
+
+			// Only update the position regularly while it actually changes.
+			if (state == Playing)
+				m_uiUpdateTimer.start();
+			else
+				m_uiUpdateTimer.stop();
+
+			if (state != m_state)
+			{
+				m_state = state;
+				emit stateChanged();
+			}
+
+			// The duration might not have been queryable before.
+			if ((state != Stopped) && (m_duration < 0))
+				updateDuration();
+
+			// Make sure the final position is shown when pausing.
+			onUiUpdate();
+
+			break;
+		}
+
+		case GST_MESSAGE_DURATION_CHANGED:
+			updateDuration();
+			break;
+
+		case GST_MESSAGE_ASYNC_DONE:
+			// Seeks finish with an ASYNC_DONE message. Update the
+			// position right away, even if the pipeline is paused.
+			onUiUpdate();
+			break;
+
+		case GST_MESSAGE_BUFFERING:
+		{
+			gint percent;
+			gst_message_parse_buffering(message, &percent);
+			if (percent != m_buffering)
+			{
+				m_buffering = percent;
+				emit bufferingChanged();
+			}
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+
+void PlayerController::onUiUpdate()
+{
+	if (m_state == Stopped)
+		return;
+
+	gint64 streamTime = m_streamTime.load(std::memory_order_relaxed);
+
+	// Without video buffers, there is nothing to probe. Fall back to
+	// querying the position (at the UI rate, not per frame).
+	if (!m_videoBuffersSeen.exchange(false, std::memory_order_relaxed) && (m_state == Playing))
+	{
+		gint64 queriedPosition;
+		if (gst_element_query_position(m_pipeline->playbin(), GST_FORMAT_TIME, &queriedPosition))
+			streamTime = queriedPosition;
+	}
+
+	qint64 position = (streamTime >= 0) ? qint64(streamTime / GST_MSECOND) : -1;
+	if (position != m_position)
+	{
+		m_position = position;
+		emit positionChanged();
+	}
+
+	double rate = m_segmentRate.load(std::memory_order_relaxed);
+	if (rate != m_rate)
+	{
+		m_rate = rate;
+		emit rateChanged();
+	}
+}
+
+
+void PlayerController::updateDuration()
+{
+	gint64 duration;
+	qint64 durationInMs = -1;
+	if (gst_element_query_duration(m_pipeline->playbin(), GST_FORMAT_TIME, &duration) && (duration >= 0))
+		durationInMs = duration / GST_MSECOND;
+
+	if (durationInMs != m_duration)
+	{
+		m_duration = durationInMs;
+		emit durationChanged();
+	}
+}
+
+
+void PlayerController::reset()
+{
+	m_streamTime = -1;
+	m_videoBuffersSeen = false;
+
+	if (m_position != -1)
+	{
+		m_position = -1;
+		emit positionChanged();
+	}
+
+	if (m_duration != -1)
+	{
+		m_duration = -1;
+		emit durationChanged();
+	}
+
+	if (m_buffering != 100)
+	{
+		m_buffering = 100;
+		emit bufferingChanged();
+	}
+}
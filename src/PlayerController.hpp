@@ -0,0 +1,105 @@
+#ifndef PLAYER_CONTROLLER_HPP
+#define PLAYER_CONTROLLER_HPP
+
+#include <atomic>
+
+#include <gst/gst.h>
+
+#include <QObject>
+#include <QTimer>
+
+
+class Pipeline;
+
+
+// Exposes the playback status of a Pipeline to QML, and allows for
+// controlling playback from QML.
+//
+// The position is not queried from the pipeline. Instead, a probe at
+// the video sink computes the stream time of each buffer and writes it
+// into an atomic variable, which is cheap enough to do in the streaming
+// thread. A timer reads that variable at a fixed UI rate, so QML is
+// notified about position changes at most that often, no matter how
+// many frames are shown. All other properties are updated based on
+// bus messages.
+
+class PlayerController
+	: public QObject
+{
+	Q_OBJECT
+	Q_PROPERTY(qint64 position READ position NOTIFY positionChanged)
+	Q_PROPERTY(qint64 duration READ duration NOTIFY durationChanged)
+	Q_PROPERTY(State state READ state NOTIFY stateChanged)
+	Q_PROPERTY(int buffering READ buffering NOTIFY bufferingChanged)
+	Q_PROPERTY(double rate READ rate NOTIFY rateChanged)
+
+public:
+	enum State
+	{
+		Stopped,
+		Paused,
+		Playing
+	};
+	Q_ENUM(State)
+
+	explicit PlayerController(QObject *parent = nullptr);
+	~PlayerController() override;
+
+	// Attaches the controller to a pipeline. The pipeline must have been
+	// set up already. This can be done after the controller was made
+	// available to QML, so the QML UI can be loaded before the pipeline
+	// is created.
+	void attach(Pipeline &pipeline);
+
+	// Position and duration are in milliseconds. -1 means unknown.
+	qint64 position() const;
+	qint64 duration() const;
+	State state() const;
+	// Buffering level in percent.
+	int buffering() const;
+	double rate() const;
+
+	Q_INVOKABLE void seek(qint64 positionInMs);
+	Q_INVOKABLE void setRate(double rate);
+	Q_INVOKABLE void pause();
+	Q_INVOKABLE void resume();
+
+signals:
+	void positionChanged();
+	void durationChanged();
+	void stateChanged();
+	void bufferingChanged();
+	void rateChanged();
+
+
+private:
+	static GstPadProbeReturn staticOnVideoSinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	void onBusMessage(GstMessage *message);
+	void onUiUpdate();
+	void updateDuration();
+	void reset();
+
+	Pipeline *m_pipeline = nullptr;
+	GstPad *m_videoSinkPad = nullptr;
+	gulong m_probeId = 0;
+
+	QTimer m_uiUpdateTimer;
+
+	qint64 m_position = -1;
+	qint64 m_duration = -1;
+	State m_state = Stopped;
+	int m_buffering = 100;
+	double m_rate = 1.0;
+
+	// Streaming thread side state. The segment is only accessed
+	// in the streaming thread of the video sink pad.
+	GstSegment m_segment;
+	std::atomic<gint64> m_streamTime;
+	std::atomic<double> m_segmentRate;
+	// Set if video buffers arrived since the last UI update. If none did
+	// (for example with audio-only inputs), the position is queried instead.
+	std::atomic<bool> m_videoBuffersSeen;
+};
+
+
+#endif // PLAYER_CONTROLLER_HPP
@@ -0,0 +1,105 @@
+#include <gst/gst.h>
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QTextStream>
+#include <QUrl>
+
+#include "Playlist.hpp"
+
+
+QString inputToUri(QString const &input)
+{
+	if (gst_uri_is_valid(input.toStdString().c_str()))
+		return input;
+
+	GError *error = nullptr;
+	gchar *uri = gst_filename_to_uri(input.toStdString().c_str(), &error);
+	if (uri != nullptr)
+	{
+		qCritical() << "Input" << input << "is not a valid URI; treated it as a filename, and converted it to file URI" << uri;
+		QString result = uri;
+		g_free(uri);
+		return result;
+	}
+	else
+	{
+		qCritical() << "Input" << input << "is not a valid URI, and it could not be converted to a file URI: " << error->message;
+		g_error_free(error);
+		return QString();
+	}
+}
+
+
+bool makePlaylistEntry(QString const &input, PlaylistEntry &entry)
+{
+	QString uri = inputToUri(input);
+	if (uri.isEmpty())
+		return false;
+
+	QByteArray suffix = QFileInfo(QUrl(uri).path()).suffix().toLower().toUtf8();
+	bool isImage = !suffix.isEmpty() && QImageReader::supportedImageFormats().contains(suffix);
+
+	entry.m_type = isImage ? PlaylistEntry::Type::Image : PlaylistEntry::Type::Video;
+	entry.m_url = uri;
+	entry.m_durationInMs = 0;
+
+	return true;
+}
+
+
+bool loadPlaylist(QString const &filename, Playlist &playlist)
+{
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		qCritical() << "Could not open playlist" << filename << ":" << file.errorString();
+		return false;
+	}
+
+	QTextStream stream(&file);
+	stream.setCodec("UTF-8");
+
+	Playlist newPlaylist;
+	for (int lineNumber = 1; !stream.atEnd(); ++lineNumber)
+	{
+		QString line = stream.readLine().trimmed();
+		if (line.isEmpty() || line.startsWith('#'))
+			continue;
+
+		QStringList fields = line.split('\t', QString::SkipEmptyParts);
+
+		PlaylistEntry entry;
+		if (!makePlaylistEntry(fields[0].trimmed(), entry))
+		{
+			qCritical() << "Invalid entry in playlist" << filename << "line" << lineNumber;
+			return false;
+		}
+
+		if (fields.size() > 1)
+		{
+			bool ok;
+			double durationInSeconds = fields[1].trimmed().toDouble(&ok);
+			if (!ok || (durationInSeconds <= 0))
+			{
+				qCritical() << "Invalid duration in playlist" << filename << "line" << lineNumber;
+				return false;
+			}
+
+			entry.m_durationInMs = int(durationInSeconds * 1000);
+		}
+
+		newPlaylist.push_back(std::move(entry));
+	}
+
+	if (newPlaylist.empty())
+	{
+		qCritical() << "Playlist" << filename << "is empty";
+		return false;
+	}
+
+	playlist = std::move(newPlaylist);
+	return true;
+}
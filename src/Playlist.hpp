@@ -0,0 +1,42 @@
+#ifndef PLAYLIST_HPP
+#define PLAYLIST_HPP
+
+#include <vector>
+
+#include <QString>
+
+
+struct PlaylistEntry
+{
+	enum class Type
+	{
+		Video,
+		Image
+	};
+
+	Type m_type;
+	QString m_url;
+	// Only used by image entries. 0 means the default image duration.
+	int m_durationInMs;
+};
+
+typedef std::vector<PlaylistEntry> Playlist;
+
+
+// Converts an input filename to a URI. Inputs that already are valid
+// URIs are returned as-is. Returns an empty string if the conversion fails.
+QString inputToUri(QString const &input);
+
+// Creates a playlist entry for the given input (a URI or filename).
+// Inputs whose filename extensions belong to an image format that is
+// supported by Qt are considered images; everything else is a video.
+bool makePlaylistEntry(QString const &input, PlaylistEntry &entry);
+
+// Loads a playlist file. Each line contains one URI or filename. Images
+// can optionally be followed by a tab character and the time in seconds
+// the image shall be shown. Empty lines and lines starting with '#'
+// are ignored.
+bool loadPlaylist(QString const &filename, Playlist &playlist);
+
+
+#endif // PLAYLIST_HPP
@@ -0,0 +1,186 @@
+#include <assert.h>
+
+#include <QDebug>
+
+#include "Pipeline.hpp"
+#include "PlaylistPlayer.hpp"
+#include "ReconnectController.hpp"
+#include "StillImageItem.hpp"
+
+
+PlaylistPlayer::PlaylistPlayer(Pipeline &pipeline, QObject *qmlWindow, StillImageItem *stillImageItem, Playlist playlist, QObject *parent)
+	: QObject(parent)
+	, m_pipeline(pipeline)
+	, m_qmlWindow(qmlWindow)
+	, m_stillImageItem(stillImageItem)
+	, m_playlist(std::move(playlist))
+{
+	assert(!m_playlist.empty());
+
+	m_imageTimer.setSingleShot(true);
+	connect(&m_imageTimer, &QTimer::timeout, this, &PlaylistPlayer::next);
+
+	m_pipeline.addBusMessageHandler([this](GstMessage *message) {
+		onBusMessage(message);
+	});
+}
+
+
+void PlaylistPlayer::setLooping(bool looping)
+{
+	m_looping = looping;
+}
+
+
+void PlaylistPlayer::setDefaultImageDuration(int durationInMs)
+{
+	m_defaultImageDurationInMs = durationInMs;
+}
+
+
+void PlaylistPlayer::setReconnectController(ReconnectController *reconnectController)
+{
+	m_reconnectController = reconnectController;
+
+	// If the input could not be recovered, continue with the next entry.
+	connect(m_reconnectController, &ReconnectController::gaveUp, this, &PlaylistPlayer::next, Qt::QueuedConnection);
+}
+
+
+void PlaylistPlayer::start()
+{
+	playEntry(0);
+}
+
+
+void PlaylistPlayer::next()
+{
+	int nextIndex = m_currentIndex + 1;
+	if (nextIndex >= int(m_playlist.size()))
+	{
+		if (!m_looping)
+			return;
+		nextIndex = 0;
+	}
+
+	// A single image entry that loops does not need to be reloaded.
+	if ((nextIndex == m_currentIndex) && (m_playlist[nextIndex].m_type == PlaylistEntry::Type::Image))
+		return;
+
+	playEntry(nextIndex);
+}
+
+
+void PlaylistPlayer::playEntry(int index)
+{
+	m_imageTimer.stop();
+	m_currentIndex = index;
+
+	if (m_reconnectController != nullptr)
+		m_reconnectController->cancel();
+
+	PlaylistEntry const &entry = m_playlist[index];
+
+	qDebug() << "Playing playlist entry" << index << ":" << entry.m_url;
+
+	switch (entry.m_type)
+	{
+		case PlaylistEntry::Type::Video:
+			m_qmlWindow->setProperty("showImage", false);
+			if (!m_pipeline.play(entry.m_url))
+			{
+				qCritical() << "Could not play" << entry.m_url << "; skipping entry";
+				skipFailedEntry();
+				return;
+			}
+			break;
+
+		case PlaylistEntry::Type::Image:
+			// Images are shown without the pipeline, so stop it to
+			// not waste any resources on a video that isn't visible.
+			m_pipeline.stop();
+			m_numFailedEntriesInARow = 0;
+			m_stillImageItem->setSource(entry.m_url);
+			m_qmlWindow->setProperty("showImage", true);
+			m_imageTimer.start((entry.m_durationInMs > 0) ? entry.m_durationInMs : m_defaultImageDurationInMs);
+			break;
+	}
+
+	preloadNextImage(index);
+
+	emit entryStarted(index);
+}
+
+
+void PlaylistPlayer::preloadNextImage(int index)
+{
+	int numEntries = int(m_playlist.size());
+	for (int offset = 1; offset < numEntries; ++offset)
+	{
+		int nextIndex = index + offset;
+		if (nextIndex >= numEntries)
+		{
+			if (!m_looping)
+				return;
+			nextIndex -= numEntries;
+		}
+
+		PlaylistEntry const &entry = m_playlist[nextIndex];
+		if (entry.m_type == PlaylistEntry::Type::Image)
+		{
+			m_stillImageItem->preload(entry.m_url);
+			return;
+		}
+	}
+}
+
+
+void PlaylistPlayer::skipFailedEntry()
+{
+	if (++m_numFailedEntriesInARow >= int(m_playlist.size()))
+	{
+		qCritical() << "None of the playlist entries could be played; stopping";
+		return;
+	}
+
+	QMetaObject::invokeMethod(this, "next", Qt::QueuedConnection);
+}
+
+
+void PlaylistPlayer::onBusMessage(GstMessage *message)
+{
+	if ((m_currentIndex < 0) || (m_playlist[m_currentIndex].m_type != PlaylistEntry::Type::Video))
+		return;
+
+	// Let the reconnect controller deal with network interruptions.
+	bool isEndOrError = (GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS) || (GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR);
+	if (isEndOrError && (m_reconnectController != nullptr) && m_reconnectController->handleInterruption(message))
+		return;
+
+	switch (GST_MESSAGE_TYPE(message))
+	{
+		case GST_MESSAGE_EOS:
+			next();
+			break;
+
+		case GST_MESSAGE_ERROR:
+			// Skip entries that cannot be played instead of getting stuck.
+			skipFailedEntry();
+			break;
+
+		case GST_MESSAGE_STATE_CHANGED:
+		{
+			if (GST_MESSAGE_SRC(message) != GST_OBJECT(m_pipeline.playbin()))
+				break;
+
+			GstState newState;
+			gst_message_parse_state_changed(message, nullptr, &newState, nullptr);
+			if (newState == GST_STATE_PLAYING)
+				m_numFailedEntriesInARow = 0;
+			break;
+		}
+
+		default:
+			break;
+	}
+}
@@ -0,0 +1,81 @@
+#ifndef PLAYLIST_PLAYER_HPP
+#define PLAYLIST_PLAYER_HPP
+
+#include <QObject>
+#include <QTimer>
+
+#include <gst/gst.h>
+
+#include "Playlist.hpp"
+
+
+class Pipeline;
+class ReconnectController;
+class StillImageItem;
+
+
+// Plays the entries of a playlist one after the other.
+//
+// Video entries are played by the Pipeline. Image entries are shown by
+// the StillImageItem instead, without involving GStreamer at all. While
+// an image is shown, the pipeline is stopped. The next image entry is
+// always preloaded to make sure it can be shown right away.
+
+class PlaylistPlayer
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit PlaylistPlayer(Pipeline &pipeline, QObject *qmlWindow, StillImageItem *stillImageItem, Playlist playlist, QObject *parent = nullptr);
+
+	// If enabled, playback restarts from the first entry once the last
+	// entry ended. Otherwise, the last entry stays on screen.
+	void setLooping(bool looping);
+
+	void setDefaultImageDuration(int durationInMs);
+
+	// If set, network interruptions are left to the reconnect controller
+	// instead of skipping to the next entry.
+	void setReconnectController(ReconnectController *reconnectController);
+
+	Playlist const & playlist() const
+	{
+		return m_playlist;
+	}
+
+	int currentIndex() const
+	{
+		return m_currentIndex;
+	}
+
+public slots:
+	void start();
+	void next();
+	void playEntry(int index);
+
+signals:
+	void entryStarted(int index);
+
+
+private:
+	void preloadNextImage(int index);
+	void skipFailedEntry();
+	void onBusMessage(GstMessage *message);
+
+	Pipeline &m_pipeline;
+	QObject *m_qmlWindow;
+	StillImageItem *m_stillImageItem;
+	ReconnectController *m_reconnectController = nullptr;
+	Playlist m_playlist;
+	int m_currentIndex = -1;
+	bool m_looping = false;
+	int m_defaultImageDurationInMs = 10000;
+	// Entries that failed since the last one that played. Once every
+	// entry failed, playback stops instead of looping forever.
+	int m_numFailedEntriesInARow = 0;
+	QTimer m_imageTimer;
+};
+
+
+#endif // PLAYLIST_PLAYER_HPP
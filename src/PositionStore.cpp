@@ -0,0 +1,390 @@
+#include <assert.h>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "PlayerController.hpp"
+#include "PositionStore.hpp"
+
+
+namespace
+{
+
+
+// Positions within the first seconds are not worth resuming from.
+constexpr qint64 MinResumePositionInMs = 5000;
+// Inputs that are stopped this close to their end count as finished.
+constexpr qint64 EndMarginInMs = 10000;
+// Changes are collected for this long before they are written.
+constexpr int WriteDelayInMs = 10000;
+
+
+QString settingsGroup(QString const &uri)
+{
+	return QCryptographicHash::hash(uri.toUtf8(), QCryptographicHash::Md5).toHex();
+}
+
+
+} // unnamed namespace end
+
+
+PositionStore::PositionStore(QString filename, QObject *parent)
+	: QObject(parent)
+	, m_filename(std::move(filename))
+	, m_resumeState(NotResuming)
+	, m_resumePosition(0)
+	, m_startTime(0)
+	, m_asyncJobState(std::make_shared<AsyncJobState>())
+{
+	m_asyncJobState->store = this;
+
+	m_writeTimer.setSingleShot(true);
+	m_writeTimer.setInterval(WriteDelayInMs);
+	connect(&m_writeTimer, &QTimer::timeout, this, &PositionStore::writePendingChanges);
+}
+
+
+PositionStore::~PositionStore()
+{
+	if (m_videoSinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_videoSinkPad, m_probeId);
+		gst_object_unref(GST_OBJECT(m_videoSinkPad));
+	}
+
+	// Resume seeks that are still pending must not touch the store anymore.
+	{
+		std::lock_guard<std::mutex> lock(m_asyncJobState->mutex);
+		m_asyncJobState->store = nullptr;
+	}
+
+	writePendingChanges();
+}
+
+
+void PositionStore::load()
+{
+	QSettings settings(m_filename, QSettings::IniFormat);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (QString const &group : settings.childGroups())
+	{
+		settings.beginGroup(group);
+		QString uri = settings.value("uri").toString();
+		qint64 positionInMs = settings.value("position", -1).toLongLong();
+		settings.endGroup();
+
+		if (!uri.isEmpty() && (positionInMs >= 0))
+			m_positions.insert(uri, positionInMs);
+	}
+
+	LOG_DEBUG("Loaded %d playback positions from %s", m_positions.size(), m_filename.toStdString().c_str());
+}
+
+
+void PositionStore::setLaunchTime(gint64 launchTime)
+{
+	m_launchTime = launchTime;
+}
+
+
+void PositionStore::attach(Pipeline &pipeline, PlayerController &playerController)
+{
+	assert(m_pipeline == nullptr);
+	assert(pipeline.videoSink() != nullptr);
+
+	m_pipeline = &pipeline;
+	m_playerController = &playerController;
+
+	m_pipeline->addSourceSetupHandler([this](GstElement *) {
+		onSourceSetup();
+	});
+
+	m_pipeline->addBusMessageHandler([this](GstMessage *message) {
+		onBusMessage(message);
+	});
+
+	connect(m_playerController, &PlayerController::positionChanged, this, &PositionStore::onPositionChanged);
+
+	// The probe replaces the first frame of a resumed input with a seek.
+	m_videoSinkPad = gst_element_get_static_pad(m_pipeline->videoSink(), "sink");
+	assert(m_videoSinkPad != nullptr);
+	m_probeId = gst_pad_add_probe(
+		m_videoSinkPad,
+		GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_FLUSH),
+		&staticOnVideoSinkProbe,
+		gpointer(this),
+		nullptr
+	);
+}
+
+
+QString PositionStore::defaultFilename()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/playback-positions.ini";
+}
+
+
+GstPadProbeReturn PositionStore::staticOnVideoSinkProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	PositionStore *self = reinterpret_cast<PositionStore *>(userData);
+
+	// NOTE: This is called in the streaming thread, except for the
+	// flush events, which are sent by the thread that issues the seek.
+
+	int resumeState = self->m_resumeState;
+	if (resumeState == NotResuming)
+		return GST_PAD_PROBE_OK;
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_EVENT_FLUSH)
+	{
+		// Frames that arrive after the flush belong to the resume seek.
+		int expectedState = Seeking;
+		if (GST_EVENT_TYPE(GST_PAD_PROBE_INFO_EVENT(info)) == GST_EVENT_FLUSH_STOP)
+			self->m_resumeState.compare_exchange_strong(expectedState, WaitingForResumedFrame);
+		return GST_PAD_PROBE_OK;
+	}
+
+	switch (resumeState)
+	{
+		case WaitingForFirstFrame:
+		{
+			// Instead of prerolling with this frame, seek to the resume
+			// point. Seeks must not be issued in the streaming thread,
+			// so let a GStreamer worker thread do that.
+			int expectedState = WaitingForFirstFrame;
+			if (self->m_resumeState.compare_exchange_strong(expectedState, Seeking))
+			{
+				gst_element_call_async(
+					self->m_pipeline->playbin(),
+					&staticIssueResumeSeek,
+					gpointer(new std::shared_ptr<AsyncJobState>(self->m_asyncJobState)),
+					&staticDestroyAsyncJobState
+				);
+			}
+			return GST_PAD_PROBE_DROP;
+		}
+
+		case Seeking:
+			// Frames from before the resume point.
+			return GST_PAD_PROBE_DROP;
+
+		case WaitingForResumedFrame:
+		{
+			self->m_resumeState = NotResuming;
+
+			gint64 now = g_get_monotonic_time();
+			LOG_INFO(
+				"Resumed at %lld ms; first frame after %lld ms (%lld ms after launch)",
+				(long long)(self->m_resumePosition / GST_MSECOND),
+				(long long)((now - self->m_startTime) / 1000),
+				(long long)((now - self->m_launchTime) / 1000)
+			);
+			return GST_PAD_PROBE_OK;
+		}
+
+		default:
+			return GST_PAD_PROBE_OK;
+	}
+}
+
+
+void PositionStore::staticIssueResumeSeek(GstElement *playbin, gpointer userData)
+{
+	AsyncJobState &asyncJobState = **reinterpret_cast<std::shared_ptr<AsyncJobState> *>(userData);
+
+	std::lock_guard<std::mutex> lock(asyncJobState.mutex);
+	if (asyncJobState.store != nullptr)
+		asyncJobState.store->issueResumeSeek(playbin);
+}
+
+
+void PositionStore::staticDestroyAsyncJobState(gpointer userData)
+{
+	delete reinterpret_cast<std::shared_ptr<AsyncJobState> *>(userData);
+}
+
+
+bool PositionStore::issueResumeSeek(GstElement *playbin)
+{
+	gint64 position = m_resumePosition;
+
+	// Key unit seeks start at the preceding keyframe, so no frames
+	// between that keyframe and the exact position are decoded.
+	GstSeekFlags flags = GstSeekFlags(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE);
+	if (!gst_element_seek_simple(playbin, GST_FORMAT_TIME, flags, position))
+	{
+		LOG_WARNING("Could not resume at %lld ms; playing from the beginning", (long long)(position / GST_MSECOND));
+		m_resumeState = NotResuming;
+		return false;
+	}
+
+	return true;
+}
+
+
+void PositionStore::onSourceSetup()
+{
+	// This is called in whatever thread created the source,
+	// once at the beginning of each start of an input.
+
+	gchar *uriString = nullptr;
+	g_object_get(m_pipeline->playbin(), "uri", &uriString, nullptr);
+	QString uri = uriString;
+	g_free(uriString);
+
+	qint64 positionInMs = -1;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_currentUri = uri;
+		positionInMs = m_positions.value(uri, -1);
+	}
+
+	m_startTime = g_get_monotonic_time();
+
+	if (positionInMs >= 0)
+	{
+		LOG_DEBUG("Resuming %s at %lld ms", uri.toStdString().c_str(), (long long)(positionInMs));
+		m_resumePosition = positionInMs * GST_MSECOND;
+		m_resumeState = WaitingForFirstFrame;
+	}
+	else
+		m_resumeState = NotResuming;
+}
+
+
+void PositionStore::onBusMessage(GstMessage *message)
+{
+	switch (GST_MESSAGE_TYPE(message))
+	{
+		case GST_MESSAGE_STATE_CHANGED:
+		{
+			if (GST_MESSAGE_SRC(message) != GST_OBJECT(m_pipeline->playbin()))
+				break;
+
+			GstState newState;
+			gst_message_parse_state_changed(message, nullptr, &newState, nullptr);
+			if (newState <= GST_STATE_READY)
+				m_currentPrerolled = false;
+
+			break;
+		}
+
+		case GST_MESSAGE_ASYNC_DONE:
+		{
+			// If the input prerolled without a video frame, it has
+			// no video, and is resumed with a regular seek instead.
+			int expectedState = WaitingForFirstFrame;
+			if (m_resumeState.compare_exchange_strong(expectedState, NotResuming))
+			{
+				LOG_DEBUG("No video frame arrived during preroll; seeking after preroll");
+				issueResumeSeek(m_pipeline->playbin());
+				break;
+			}
+
+			if (m_resumeState == NotResuming)
+				m_currentPrerolled = true;
+
+			break;
+		}
+
+		case GST_MESSAGE_EOS:
+		{
+			QString uri;
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				uri = m_currentUri;
+			}
+
+			if (!uri.isEmpty())
+				setPosition(uri, -1);
+
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+
+void PositionStore::onPositionChanged()
+{
+	if (!m_currentPrerolled || (m_playerController->state() == PlayerController::Stopped))
+		return;
+
+	// Live inputs have no duration, and cannot be resumed.
+	qint64 positionInMs = m_playerController->position();
+	qint64 durationInMs = m_playerController->duration();
+	if ((positionInMs < 0) || (durationInMs <= 0))
+		return;
+
+	QString uri;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		uri = m_currentUri;
+	}
+	if (uri.isEmpty())
+		return;
+
+	bool resumable = (positionInMs >= MinResumePositionInMs) && (positionInMs < (durationInMs - EndMarginInMs));
+	setPosition(uri, resumable ? positionInMs : -1);
+}
+
+
+void PositionStore::setPosition(QString const &uri, qint64 positionInMs)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (positionInMs < 0)
+		{
+			if (m_positions.remove(uri) == 0)
+				return;
+		}
+		else
+			m_positions.insert(uri, positionInMs);
+	}
+
+	m_pendingChanges.insert(uri, positionInMs);
+	if (!m_writeTimer.isActive())
+		m_writeTimer.start();
+}
+
+
+void PositionStore::writePendingChanges()
+{
+	m_writeTimer.stop();
+
+	if (m_pendingChanges.isEmpty())
+		return;
+
+	QDir().mkpath(QFileInfo(m_filename).absolutePath());
+	QSettings settings(m_filename, QSettings::IniFormat);
+
+	for (auto iter = m_pendingChanges.constBegin(); iter != m_pendingChanges.constEnd(); ++iter)
+	{
+		QString group = settingsGroup(iter.key());
+		if (iter.value() < 0)
+		{
+			settings.remove(group);
+			continue;
+		}
+
+		settings.beginGroup(group);
+		settings.setValue("uri", iter.key());
+		settings.setValue("position", iter.value());
+		settings.endGroup();
+	}
+
+	settings.sync();
+
+	LOG_DEBUG("Wrote %d playback position change(s) to %s", m_pendingChanges.size(), m_filename.toStdString().c_str());
+	m_pendingChanges.clear();
+}
@@ -0,0 +1,119 @@
+#ifndef POSITION_STORE_HPP
+#define POSITION_STORE_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include <gst/gst.h>
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+
+class Pipeline;
+class PlayerController;
+
+
+// Remembers the playback position of each input, and resumes from there.
+//
+// The position reported by the PlayerController is recorded in memory
+// while an input plays. Changes are written to an INI file in batches,
+// a few seconds apart and once more when the store is destroyed, so the
+// periodic recording never touches the disk per update. Inputs that
+// played to (almost) the end, or not past the first seconds, are removed
+// from the store. Live inputs (without a duration) are never stored.
+//
+// When a stored input starts again, the position is restored while the
+// pipeline is still prerolling: the first decoded video frame is dropped
+// at the video sink instead of being shown, and a flushing key unit seek
+// to the stored position is issued right away. The pipeline then
+// prerolls at the resume point, so neither the first frame of the input
+// is shown nor is anything decoded from the beginning. Inputs without
+// video are resumed with a regular seek once they prerolled.
+//
+// For each resume, the time from the start of the input and from the
+// application launch to the first frame at the resume point is logged.
+
+class PositionStore
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit PositionStore(QString filename = defaultFilename(), QObject *parent = nullptr);
+	~PositionStore() override;
+
+	void load();
+
+	// Sets the monotonic time (see g_get_monotonic_time()) of the
+	// application launch, for measuring the time to the first frame.
+	void setLaunchTime(gint64 launchTime);
+
+	// Attaches the store to a pipeline that has been set up already.
+	void attach(Pipeline &pipeline, PlayerController &playerController);
+
+	static QString defaultFilename();
+
+
+private:
+	enum ResumeState
+	{
+		NotResuming,
+		WaitingForFirstFrame,
+		Seeking,
+		WaitingForResumedFrame
+	};
+
+	// The resume seek is issued by a GStreamer worker thread, which may
+	// only get to it after the store is destroyed. The job therefore does
+	// not refer to the store directly, but to this state, which it keeps
+	// alive. The destructor resets the store pointer, and the mutex makes
+	// sure that it does not do so while a job is still using the store.
+	struct AsyncJobState
+	{
+		std::mutex mutex;
+		PositionStore *store = nullptr;
+	};
+
+	static GstPadProbeReturn staticOnVideoSinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	static void staticIssueResumeSeek(GstElement *playbin, gpointer userData);
+	static void staticDestroyAsyncJobState(gpointer userData);
+	bool issueResumeSeek(GstElement *playbin);
+	void onSourceSetup();
+	void onBusMessage(GstMessage *message);
+	void onPositionChanged();
+	void setPosition(QString const &uri, qint64 positionInMs);
+	void writePendingChanges();
+
+	QString m_filename;
+	Pipeline *m_pipeline = nullptr;
+	PlayerController *m_playerController = nullptr;
+	GstPad *m_videoSinkPad = nullptr;
+	gulong m_probeId = 0;
+	gint64 m_launchTime = 0;
+
+	// URI -> position in milliseconds. Accessed from streaming threads as well.
+	mutable std::mutex m_mutex;
+	QHash<QString, qint64> m_positions;
+	QString m_currentUri;
+
+	// GUI thread side state. Positions are only recorded once the current
+	// input prerolled, so stale positions of the previous one are ignored.
+	bool m_currentPrerolled = false;
+	// URI -> position in milliseconds, -1 for removed entries.
+	QHash<QString, qint64> m_pendingChanges;
+	QTimer m_writeTimer;
+
+	// Resume state of the current input, shared with the streaming thread.
+	std::atomic<int> m_resumeState;
+	std::atomic<gint64> m_resumePosition;
+	std::atomic<gint64> m_startTime;
+
+	std::shared_ptr<AsyncJobState> m_asyncJobState;
+};
+
+
+#endif // POSITION_STORE_HPP
@@ -0,0 +1,224 @@
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <QFile>
+#include <QSocketNotifier>
+
+#include "Log.hpp"
+#include "PressureMonitor.hpp"
+
+
+namespace
+{
+
+
+struct ResourceInfo
+{
+	char const *m_name;
+	char const *m_filename;
+	// Stall time within the window that fires the trigger. Unprivileged
+	// triggers need windows that are multiples of 2 seconds.
+	int m_thresholdInMs;
+	int m_windowInMs;
+	// Threshold for the 10 second average in polling mode, in percent.
+	double m_avg10Threshold;
+};
+
+
+ResourceInfo const resourceInfos[PressureMonitor::NumResources] = {
+	// Some CPU contention is normal on devices shared with other
+	// services, so only react to considerable stalls.
+	{ "CPU", "/proc/pressure/cpu", 500, 2000, 25.0 },
+	{ "memory", "/proc/pressure/memory", 150, 2000, 7.5 },
+	{ "I/O", "/proc/pressure/io", 300, 2000, 15.0 }
+};
+
+
+// A resource is no longer under pressure once no trigger
+// event arrived (or the average stayed low) for this long.
+constexpr int ReleaseDelayInMs = 10000;
+constexpr int PollIntervalInMs = 2000;
+// The averages cover 10 seconds, so polling at that interval still sees all pressure.
+constexpr int IdlePollIntervalInMs = 10000;
+
+
+// Reads the avg10 value of the "some" line of a PSI file.
+double readAvg10(char const *filename)
+{
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly))
+		return -1;
+
+	// The first line looks like this:
+	// some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+	QByteArray line = file.readLine();
+	int avg10Start = line.indexOf("avg10=");
+	if (!line.startsWith("some") || (avg10Start < 0))
+		return -1;
+
+	avg10Start += 6;
+	int avg10End = line.indexOf(' ', avg10Start);
+	return line.mid(avg10Start, avg10End - avg10Start).toDouble();
+}
+
+
+} // unnamed namespace end
+
+
+PressureMonitor::PressureMonitor(QObject *parent)
+	: QObject(parent)
+{
+	m_pollTimer.setInterval(PollIntervalInMs);
+	connect(&m_pollTimer, &QTimer::timeout, this, &PressureMonitor::onPoll);
+}
+
+
+PressureMonitor::~PressureMonitor()
+{
+	stop();
+}
+
+
+bool PressureMonitor::start()
+{
+	if (!QFile::exists(resourceInfos[Cpu].m_filename))
+	{
+		LOG_WARNING("Pressure stall information is not available");
+		return false;
+	}
+
+	bool needsPolling = false;
+
+	for (int i = 0; i < NumResources; ++i)
+	{
+		Resource resource = Resource(i);
+		ResourceState &state = m_resources[i];
+
+		state.m_releaseTimer = new QTimer(this);
+		state.m_releaseTimer->setSingleShot(true);
+		state.m_releaseTimer->setInterval(ReleaseDelayInMs);
+		connect(state.m_releaseTimer, &QTimer::timeout, this, [this, resource]() {
+			setUnderPressure(resource, false);
+		});
+
+		if (!setupTrigger(resource))
+			needsPolling = true;
+	}
+
+	if (needsPolling)
+	{
+		LOG_INFO("Could not set up all PSI triggers; polling pressure averages instead");
+		m_pollTimer.start();
+	}
+
+	return true;
+}
+
+
+void PressureMonitor::stop()
+{
+	m_pollTimer.stop();
+
+	for (ResourceState &state : m_resources)
+	{
+		delete state.m_notifier;
+		state.m_notifier = nullptr;
+
+		delete state.m_releaseTimer;
+		state.m_releaseTimer = nullptr;
+
+		if (state.m_triggerFd >= 0)
+		{
+			close(state.m_triggerFd);
+			state.m_triggerFd = -1;
+		}
+	}
+}
+
+
+bool PressureMonitor::isUnderPressure(Resource resource) const
+{
+	return m_resources[resource].m_underPressure;
+}
+
+
+void PressureMonitor::setIdle(bool idle)
+{
+	m_pollTimer.setInterval(idle ? IdlePollIntervalInMs : PollIntervalInMs);
+}
+
+
+bool PressureMonitor::setupTrigger(Resource resource)
+{
+	ResourceInfo const &info = resourceInfos[resource];
+	ResourceState &state = m_resources[resource];
+
+	int fd = open(info.m_filename, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+	{
+		LOG_DEBUG("Could not open %s for writing: %s", info.m_filename, std::strerror(errno));
+		return false;
+	}
+
+	// The trigger is "some <stall time> <window>", both in microseconds.
+	// The kernel expects the terminating null byte to be written as well.
+	QByteArray trigger = QByteArray("some ") + QByteArray::number(info.m_thresholdInMs * 1000) + " " + QByteArray::number(info.m_windowInMs * 1000);
+	if (write(fd, trigger.constData(), trigger.size() + 1) < 0)
+	{
+		LOG_DEBUG("Could not set up %s PSI trigger: %s", info.m_name, std::strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	// Trigger events are signaled as POLLPRI, which
+	// QSocketNotifier reports as an exception.
+	state.m_triggerFd = fd;
+	state.m_notifier = new QSocketNotifier(fd, QSocketNotifier::Exception, this);
+	connect(state.m_notifier, &QSocketNotifier::activated, this, [this, resource]() {
+		onTrigger(resource);
+	});
+
+	return true;
+}
+
+
+void PressureMonitor::onTrigger(Resource resource)
+{
+	setUnderPressure(resource, true);
+	m_resources[resource].m_releaseTimer->start();
+}
+
+
+void PressureMonitor::onPoll()
+{
+	for (int i = 0; i < NumResources; ++i)
+	{
+		ResourceState &state = m_resources[i];
+		if (state.m_notifier != nullptr)
+			continue;
+
+		double avg10 = readAvg10(resourceInfos[i].m_filename);
+		if (avg10 >= resourceInfos[i].m_avg10Threshold)
+			onTrigger(Resource(i));
+	}
+}
+
+
+void PressureMonitor::setUnderPressure(Resource resource, bool underPressure)
+{
+	ResourceState &state = m_resources[resource];
+	if (state.m_underPressure == underPressure)
+		return;
+
+	state.m_underPressure = underPressure;
+
+	if (underPressure)
+		LOG_WARNING("%s pressure detected", resourceInfos[resource].m_name);
+	else
+		LOG_INFO("%s pressure is gone", resourceInfos[resource].m_name);
+
+	emit pressureChanged(resource, underPressure);
+}
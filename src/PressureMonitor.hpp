@@ -0,0 +1,77 @@
+#ifndef PRESSURE_MONITOR_HPP
+#define PRESSURE_MONITOR_HPP
+
+#include <array>
+
+#include <QObject>
+#include <QTimer>
+
+
+class QSocketNotifier;
+
+
+// Monitors the Linux pressure stall information (PSI) of CPU, memory, and I/O.
+//
+// For each resource, a PSI trigger is registered: the kernel wakes up the
+// monitor once tasks were stalled on that resource for longer than the
+// threshold within a time window. A resource counts as under pressure from
+// the first trigger event until no further events arrived for a while.
+// If triggers cannot be registered (PSI triggers require Linux 5.2, and
+// unprivileged triggers Linux 6.5), the 10 second averages are polled
+// instead.
+
+class PressureMonitor
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	enum Resource
+	{
+		Cpu,
+		Memory,
+		Io,
+
+		NumResources
+	};
+	Q_ENUM(Resource)
+
+	explicit PressureMonitor(QObject *parent = nullptr);
+	~PressureMonitor() override;
+
+	// Returns false if PSI is not available at all (kernel built
+	// without CONFIG_PSI, or booted with psi=0).
+	bool start();
+	void stop();
+
+	bool isUnderPressure(Resource resource) const;
+
+	// While idle, the pressure averages are polled less often.
+	// (PSI triggers are not affected, since they do not wake up
+	// the monitor unless there is pressure.)
+	void setIdle(bool idle);
+
+signals:
+	void pressureChanged(PressureMonitor::Resource resource, bool underPressure);
+
+
+private:
+	struct ResourceState
+	{
+		int m_triggerFd = -1;
+		QSocketNotifier *m_notifier = nullptr;
+		QTimer *m_releaseTimer = nullptr;
+		bool m_underPressure = false;
+	};
+
+	bool setupTrigger(Resource resource);
+	void onTrigger(Resource resource);
+	void onPoll();
+	void setUnderPressure(Resource resource, bool underPressure);
+
+	std::array<ResourceState, NumResources> m_resources;
+	QTimer m_pollTimer;
+};
+
+
+#endif // PRESSURE_MONITOR_HPP
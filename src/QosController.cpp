@@ -0,0 +1,267 @@
+#include <assert.h>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "QosController.hpp"
+#include "Utils.hpp"
+
+
+namespace
+{
+
+
+constexpr int EvaluationIntervalInMs = 1000;
+// An interval with more late frames than this is considered overloaded.
+constexpr double MaxLateFrameRatio = 0.05;
+// The quality is lowered after this many overloaded intervals in a row...
+constexpr int NumOverloadedIntervalsForDegrading = 2;
+// ... and raised after this many intervals without any late frames.
+// This is much longer to prevent flapping between levels.
+constexpr int NumIdleIntervalsForRestoring = 15;
+
+// Values of the avdec_* "skip-frame" property.
+constexpr gint SkipFrameNone = 0;
+constexpr gint SkipFrameNonReference = 1;
+
+
+bool isVideoDecoder(GstElement *element)
+{
+	GstElementFactory *factory = gst_element_get_factory(element);
+	return (factory != nullptr) && gst_element_factory_list_is_type(factory, GST_ELEMENT_FACTORY_TYPE_DECODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO);
+}
+
+
+char const * levelName(QosController::Level level)
+{
+	switch (level)
+	{
+		case QosController::FullQuality: return "full quality";
+		case QosController::SkipNonReferenceFrames: return "skip non-reference frames";
+		case QosController::LowResolution: return "low resolution";
+		case QosController::LowFrameRate: return "low frame rate";
+		default: return "<unknown>";
+	}
+}
+
+
+} // unnamed namespace end
+
+
+QosController::QosController(QObject *parent)
+	: QObject(parent)
+	, m_numShownFrames(0)
+	, m_halveFrameRate(false)
+{
+	m_evaluationTimer.setInterval(EvaluationIntervalInMs);
+	connect(&m_evaluationTimer, &QTimer::timeout, this, &QosController::onEvaluate);
+}
+
+
+QosController::~QosController()
+{
+	if (m_videoSinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_videoSinkPad, m_probeId);
+		gst_object_unref(GST_OBJECT(m_videoSinkPad));
+	}
+
+	for (GstElement *decoder : m_decoders)
+		gst_object_unref(GST_OBJECT(decoder));
+}
+
+
+void QosController::attach(Pipeline &pipeline)
+{
+	assert(m_pipeline == nullptr);
+	assert(pipeline.videoSink() != nullptr);
+
+	m_pipeline = &pipeline;
+
+	m_pipeline->addElementSetupHandler([this](GstElement *element) {
+		onElementSetup(element);
+	});
+
+	m_pipeline->addBusMessageHandler([this](GstMessage *message) {
+		onBusMessage(message);
+	});
+
+	m_videoSinkPad = gst_element_get_static_pad(m_pipeline->videoSink(), "sink");
+	assert(m_videoSinkPad != nullptr);
+	m_probeId = gst_pad_add_probe(m_videoSinkPad, GST_PAD_PROBE_TYPE_BUFFER, &staticOnVideoSinkProbe, gpointer(this), nullptr);
+}
+
+
+QosController::Level QosController::level() const
+{
+	return m_level;
+}
+
+
+double QosController::lateFrameRatio() const
+{
+	return m_lateFrameRatio;
+}
+
+
+void QosController::setMaxLevel(Level maxLevel)
+{
+	m_maxLevel = maxLevel;
+	if (m_level > m_maxLevel)
+		setLevel(m_maxLevel);
+}
+
+
+GstPadProbeReturn QosController::staticOnVideoSinkProbe(GstPad *, GstPadProbeInfo *, gpointer userData)
+{
+	QosController *self = reinterpret_cast<QosController *>(userData);
+
+	// NOTE: This is called in the streaming thread.
+
+	if (self->m_halveFrameRate.load(std::memory_order_relaxed) && ((self->m_frameCounter++ % 2) != 0))
+		return GST_PAD_PROBE_DROP;
+
+	self->m_numShownFrames.fetch_add(1, std::memory_order_relaxed);
+	return GST_PAD_PROBE_OK;
+}
+
+
+void QosController::onElementSetup(GstElement *element)
+{
+	// This is called in whatever thread created the element.
+
+	if (!isVideoDecoder(element))
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_decodersMutex);
+		m_decoders.push_back(GST_ELEMENT(gst_object_ref(GST_OBJECT(element))));
+	}
+
+	// Apply the current level to the new decoder as well.
+	QMetaObject::invokeMethod(this, [this]() {
+		applyToDecoders();
+	}, Qt::QueuedConnection);
+}
+
+
+void QosController::onBusMessage(GstMessage *message)
+{
+	switch (GST_MESSAGE_TYPE(message))
+	{
+		case GST_MESSAGE_QOS:
+		{
+			// Sinks and decoders post a QoS message for each buffer
+			// they drop because it arrived too late.
+			GstFormat format;
+			gst_message_parse_qos_stats(message, &format, nullptr, nullptr);
+			if (format == GST_FORMAT_BUFFERS)
+				++m_numLateFrames;
+			break;
+		}
+
+		case GST_MESSAGE_STATE_CHANGED:
+		{
+			if (GST_MESSAGE_SRC(message) != GST_OBJECT(m_pipeline->playbin()))
+				break;
+
+			GstState newState;
+			gst_message_parse_state_changed(message, nullptr, &newState, nullptr);
+
+			// Only evaluate while frames are supposed to be shown.
+			if (newState == GST_STATE_PLAYING)
+			{
+				m_numLateFrames = 0;
+				m_numShownFrames = 0;
+				m_evaluationTimer.start();
+			}
+			else
+				m_evaluationTimer.stop();
+
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+
+void QosController::onEvaluate()
+{
+	int numShownFrames = m_numShownFrames.exchange(0);
+	int numLateFrames = m_numLateFrames;
+	m_numLateFrames = 0;
+
+	int numFrames = numShownFrames + numLateFrames;
+	double lateFrameRatio = (numFrames > 0) ? (double(numLateFrames) / numFrames) : 0.0;
+	if (lateFrameRatio != m_lateFrameRatio)
+	{
+		m_lateFrameRatio = lateFrameRatio;
+		emit lateFrameRatioChanged();
+	}
+
+	if (lateFrameRatio > MaxLateFrameRatio)
+	{
+		m_numIdleIntervals = 0;
+		if ((++m_numOverloadedIntervals >= NumOverloadedIntervalsForDegrading) && (m_level < m_maxLevel))
+			setLevel(Level(m_level + 1));
+	}
+	else if (numLateFrames == 0)
+	{
+		m_numOverloadedIntervals = 0;
+		if ((++m_numIdleIntervals >= NumIdleIntervalsForRestoring) && (m_level > FullQuality))
+			setLevel(Level(m_level - 1));
+	}
+	else
+	{
+		m_numOverloadedIntervals = 0;
+		m_numIdleIntervals = 0;
+	}
+}
+
+
+void QosController::setLevel(Level level)
+{
+	if (level == m_level)
+		return;
+
+	LOG_INFO("Changing video quality level from \"%s\" to \"%s\" (late frame ratio: %.2f)", levelName(m_level), levelName(level), m_lateFrameRatio);
+
+	m_level = level;
+	// Give the new level some time to take effect before evaluating it.
+	m_numOverloadedIntervals = 0;
+	m_numIdleIntervals = 0;
+
+	m_halveFrameRate = (m_level >= LowFrameRate);
+	applyToDecoders();
+
+	emit levelChanged();
+}
+
+
+void QosController::applyToDecoders()
+{
+	std::lock_guard<std::mutex> lock(m_decodersMutex);
+
+	// Decoders that were removed from the pipeline (because the input
+	// changed) no longer have a parent and are not needed anymore.
+	for (auto iter = m_decoders.begin(); iter != m_decoders.end();)
+	{
+		GstObject *parent = gst_object_get_parent(GST_OBJECT(*iter));
+		if (parent == nullptr)
+		{
+			gst_object_unref(GST_OBJECT(*iter));
+			iter = m_decoders.erase(iter);
+			continue;
+		}
+		gst_object_unref(parent);
+
+		GstElement *decoder = *iter;
+		if (hasProperty(decoder, "skip-frame"))
+			g_object_set(decoder, "skip-frame", (m_level >= SkipNonReferenceFrames) ? SkipFrameNonReference : SkipFrameNone, nullptr);
+		if (hasProperty(decoder, "lowres"))
+			g_object_set(decoder, "lowres", (m_level >= LowResolution) ? gint(1) : gint(0), nullptr);
+
+		++iter;
+	}
+}
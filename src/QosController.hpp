@@ -0,0 +1,102 @@
+#ifndef QOS_CONTROLLER_HPP
+#define QOS_CONTROLLER_HPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <gst/gst.h>
+
+#include <QObject>
+#include <QTimer>
+
+
+class Pipeline;
+
+
+// Degrades the video quality step by step if the device cannot keep up.
+//
+// Without this, late frames are dropped by the decoders and the video sink
+// whenever they happen to be late, which results in stutter. Instead, the
+// controller watches the ratio of late (QoS) frames to shown frames, and
+// if it is too high for a while, it switches to the next lower quality
+// level. Each level includes the degradations of the previous ones:
+//
+// 1. SkipNonReferenceFrames: decoders skip frames that no other frame
+//    depends on (decoders with a "skip-frame" property, like avdec_*).
+// 2. LowResolution: decoders decode at half the resolution (decoders with
+//    a "lowres" property; only some codecs support this).
+// 3. LowFrameRate: only every second frame is passed to the video sink,
+//    which halves the upload and rendering load.
+//
+// Once no frames were late for a longer while, the quality is raised
+// again by one level. The current level is available as a property.
+
+class QosController
+	: public QObject
+{
+	Q_OBJECT
+	Q_PROPERTY(Level level READ level NOTIFY levelChanged)
+	Q_PROPERTY(double lateFrameRatio READ lateFrameRatio NOTIFY lateFrameRatioChanged)
+
+public:
+	enum Level
+	{
+		FullQuality,
+		SkipNonReferenceFrames,
+		LowResolution,
+		LowFrameRate
+	};
+	Q_ENUM(Level)
+
+	explicit QosController(QObject *parent = nullptr);
+	~QosController() override;
+
+	// Attaches the controller to a pipeline that has been set up already.
+	void attach(Pipeline &pipeline);
+
+	Level level() const;
+	// Ratio of late frames to all frames in the last evaluation interval.
+	double lateFrameRatio() const;
+
+	// Limits how far the quality can be degraded.
+	void setMaxLevel(Level maxLevel);
+
+signals:
+	void levelChanged();
+	void lateFrameRatioChanged();
+
+
+private:
+	static GstPadProbeReturn staticOnVideoSinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	void onElementSetup(GstElement *element);
+	void onBusMessage(GstMessage *message);
+	void onEvaluate();
+	void setLevel(Level level);
+	void applyToDecoders();
+
+	Pipeline *m_pipeline = nullptr;
+	GstPad *m_videoSinkPad = nullptr;
+	gulong m_probeId = 0;
+
+	QTimer m_evaluationTimer;
+	Level m_level = FullQuality;
+	Level m_maxLevel = LowFrameRate;
+	double m_lateFrameRatio = 0;
+	int m_numLateFrames = 0;
+	int m_numOverloadedIntervals = 0;
+	int m_numIdleIntervals = 0;
+
+	// Video decoders of the current input. Added in whatever thread
+	// playbin creates them in, so access is protected by the mutex.
+	std::mutex m_decodersMutex;
+	std::vector<GstElement *> m_decoders;
+
+	// Streaming thread side state.
+	std::atomic<int> m_numShownFrames;
+	std::atomic<bool> m_halveFrameRate;
+	unsigned int m_frameCounter = 0;
+};
+
+
+#endif // QOS_CONTROLLER_HPP
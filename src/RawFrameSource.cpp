@@ -0,0 +1,459 @@
+#include <algorithm>
+#include <assert.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <gst/app/app.h>
+
+#include <QRegularExpression>
+#include <QUrl>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "Playlist.hpp"
+#include "RawFrameSource.hpp"
+
+
+namespace
+{
+
+
+char const RawFrameProtocol[] = "appsrc";
+char const Y4mMagic[] = "YUV4MPEG2 ";
+char const Y4mFrameMagic[] = "FRAME";
+// Y4M stream headers are short; anything beyond this is not a Y4M file.
+constexpr gsize MaxY4mHeaderSize = 1024;
+
+
+class MappedFile
+{
+public:
+	~MappedFile()
+	{
+		if (m_data != nullptr)
+			munmap(m_data, m_size);
+	}
+
+	bool map(std::string const &filename)
+	{
+		int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+		{
+			LOG_ERROR("Could not open %s: %s", filename.c_str(), strerror(errno));
+			return false;
+		}
+
+		struct stat fileStat;
+		if ((fstat(fd, &fileStat) < 0) || (fileStat.st_size <= 0))
+		{
+			LOG_ERROR("Could not get the size of %s, or it is empty", filename.c_str());
+			close(fd);
+			return false;
+		}
+
+		void *data = mmap(nullptr, gsize(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping stays valid after the file descriptor is closed.
+		close(fd);
+		if (data == MAP_FAILED)
+		{
+			LOG_ERROR("Could not map %s: %s", filename.c_str(), strerror(errno));
+			return false;
+		}
+
+		m_data = static_cast<guint8 *>(data);
+		m_size = gsize(fileStat.st_size);
+
+		// Start paging in the frames right away, so the benchmark
+		// measures storage as little as possible.
+		madvise(m_data, m_size, MADV_WILLNEED);
+
+		return true;
+	}
+
+	guint8 *m_data = nullptr;
+	gsize m_size = 0;
+};
+
+
+// One playback of one file. Each appsrc gets its own stream, which also
+// stays alive as long as any of its buffers is still in use downstream.
+struct Stream
+{
+	std::shared_ptr<MappedFile> m_file;
+	GstVideoInfo m_videoInfo;
+	gsize m_firstFrameOffset = 0;
+	// Size of the "FRAME\n" header in front of each Y4M frame.
+	gsize m_frameHeaderSize = 0;
+	guint64 m_numFrames = 0;
+
+	std::mutex m_mutex;
+	guint64 m_nextFrame = 0;
+};
+
+
+bool parseY4mColorspace(std::string const &tag, GstVideoFormat &format)
+{
+	static struct
+	{
+		char const *m_tag;
+		GstVideoFormat m_format;
+	}
+	const colorspaces[] = {
+		{ "420jpeg", GST_VIDEO_FORMAT_I420 },
+		{ "420paldv", GST_VIDEO_FORMAT_I420 },
+		{ "420mpeg2", GST_VIDEO_FORMAT_I420 },
+		{ "420", GST_VIDEO_FORMAT_I420 },
+		{ "422", GST_VIDEO_FORMAT_Y42B },
+		{ "444", GST_VIDEO_FORMAT_Y444 },
+		{ "mono", GST_VIDEO_FORMAT_GRAY8 },
+		{ "420p10", GST_VIDEO_FORMAT_I420_10LE },
+		{ "422p10", GST_VIDEO_FORMAT_I422_10LE },
+		{ "444p10", GST_VIDEO_FORMAT_Y444_10LE }
+	};
+
+	for (auto const &colorspace : colorspaces)
+	{
+		if (tag == colorspace.m_tag)
+		{
+			format = colorspace.m_format;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+// Y4M planes are stored without any padding, unlike
+// the default layout of GstVideoInfo.
+void setTightlyPackedLayout(GstVideoInfo &videoInfo)
+{
+	gsize offset = 0;
+
+	// All Y4M formats are planar, so plane N holds component N.
+	for (guint plane = 0; plane < GST_VIDEO_INFO_N_PLANES(&videoInfo); ++plane)
+	{
+		gint stride = GST_VIDEO_INFO_COMP_WIDTH(&videoInfo, plane) * GST_VIDEO_INFO_COMP_PSTRIDE(&videoInfo, plane);
+		videoInfo.offset[plane] = offset;
+		videoInfo.stride[plane] = stride;
+		offset += gsize(stride) * GST_VIDEO_INFO_COMP_HEIGHT(&videoInfo, plane);
+	}
+
+	videoInfo.size = offset;
+}
+
+
+bool parseY4mHeader(MappedFile const &file, std::string const &filename, Stream &stream)
+{
+	gsize const magicLength = sizeof(Y4mMagic) - 1;
+
+	gsize searchLength = std::min(file.m_size, MaxY4mHeaderSize);
+	guint8 const *headerEnd = static_cast<guint8 const *>(memchr(file.m_data, '\n', searchLength));
+	if (headerEnd == nullptr)
+	{
+		LOG_ERROR("%s has no valid Y4M stream header", filename.c_str());
+		return false;
+	}
+
+	std::string header(reinterpret_cast<char const *>(file.m_data) + magicLength, headerEnd - file.m_data - magicLength);
+
+	gint width = 0, height = 0;
+	gint fpsN = 0, fpsD = 1;
+	gint parN = 1, parD = 1;
+	GstVideoFormat format = GST_VIDEO_FORMAT_I420;
+
+	gchar **tokens = g_strsplit(header.c_str(), " ", -1);
+	for (gchar **token = tokens; *token != nullptr; ++token)
+	{
+		gchar const *value = (*token) + 1;
+
+		switch ((*token)[0])
+		{
+			case 'W': width = atoi(value); break;
+			case 'H': height = atoi(value); break;
+			case 'F': sscanf(value, "%d:%d", &fpsN, &fpsD); break;
+			case 'A':
+				if ((sscanf(value, "%d:%d", &parN, &parD) != 2) || (parN <= 0) || (parD <= 0))
+					parN = parD = 1;
+				break;
+			case 'C':
+				if (!parseY4mColorspace(value, format))
+				{
+					LOG_ERROR("%s uses unsupported Y4M colorspace %s", filename.c_str(), value);
+					g_strfreev(tokens);
+					return false;
+				}
+				break;
+			case 'I':
+				if (value[0] != 'p')
+					LOG_WARNING("%s is interlaced; frames are shown as progressive frames", filename.c_str());
+				break;
+			default:
+				break;
+		}
+	}
+	g_strfreev(tokens);
+
+	if ((width <= 0) || (height <= 0) || (fpsN <= 0) || (fpsD <= 0))
+	{
+		LOG_ERROR("%s has an invalid Y4M stream header", filename.c_str());
+		return false;
+	}
+
+	gst_video_info_set_format(&(stream.m_videoInfo), format, guint(width), guint(height));
+	GST_VIDEO_INFO_FPS_N(&(stream.m_videoInfo)) = fpsN;
+	GST_VIDEO_INFO_FPS_D(&(stream.m_videoInfo)) = fpsD;
+	GST_VIDEO_INFO_PAR_N(&(stream.m_videoInfo)) = parN;
+	GST_VIDEO_INFO_PAR_D(&(stream.m_videoInfo)) = parD;
+	setTightlyPackedLayout(stream.m_videoInfo);
+
+	// Frame headers can contain parameters, but in practice, all of
+	// them are identical, so the first one defines the size of all.
+	// This makes the frame positions computable, which is needed for
+	// seeking. The headers are still checked while reading.
+	stream.m_firstFrameOffset = headerEnd - file.m_data + 1;
+	gsize remainingSize = file.m_size - stream.m_firstFrameOffset;
+	guint8 const *frameHeaderEnd = static_cast<guint8 const *>(memchr(file.m_data + stream.m_firstFrameOffset, '\n', std::min(remainingSize, MaxY4mHeaderSize)));
+	if (frameHeaderEnd == nullptr)
+	{
+		LOG_ERROR("%s contains no Y4M frames", filename.c_str());
+		return false;
+	}
+	stream.m_frameHeaderSize = frameHeaderEnd - (file.m_data + stream.m_firstFrameOffset) + 1;
+
+	return true;
+}
+
+
+bool setupStream(std::string const &filename, GstVideoInfo const *rawFormat, Stream &stream)
+{
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if (!file->map(filename))
+		return false;
+
+	bool isY4m = (file->m_size > sizeof(Y4mMagic)) && (memcmp(file->m_data, Y4mMagic, sizeof(Y4mMagic) - 1) == 0);
+	if (isY4m)
+	{
+		if (!parseY4mHeader(*file, filename, stream))
+			return false;
+	}
+	else if (rawFormat != nullptr)
+	{
+		stream.m_videoInfo = *rawFormat;
+	}
+	else
+	{
+		LOG_ERROR("%s is not a Y4M file, and no raw frame format is set", filename.c_str());
+		return false;
+	}
+
+	gsize frameStride = stream.m_frameHeaderSize + GST_VIDEO_INFO_SIZE(&(stream.m_videoInfo));
+	stream.m_numFrames = (file->m_size - stream.m_firstFrameOffset) / frameStride;
+	if (stream.m_numFrames == 0)
+	{
+		LOG_ERROR("%s is too small to contain a single frame", filename.c_str());
+		return false;
+	}
+
+	stream.m_file = std::move(file);
+
+	return true;
+}
+
+
+GstClockTime frameTimestamp(GstVideoInfo const &videoInfo, guint64 frameIndex)
+{
+	return gst_util_uint64_scale(frameIndex, GST_VIDEO_INFO_FPS_D(&videoInfo) * GST_SECOND, GST_VIDEO_INFO_FPS_N(&videoInfo));
+}
+
+
+void onNeedData(GstAppSrc *appsrc, guint, gpointer userData)
+{
+	Stream &stream = **static_cast<std::shared_ptr<Stream> *>(userData);
+	GstVideoInfo const &videoInfo = stream.m_videoInfo;
+
+	guint64 frameIndex;
+	{
+		std::lock_guard<std::mutex> lock(stream.m_mutex);
+		frameIndex = stream.m_nextFrame++;
+	}
+
+	if (frameIndex >= stream.m_numFrames)
+	{
+		gst_app_src_end_of_stream(appsrc);
+		return;
+	}
+
+	gsize frameSize = GST_VIDEO_INFO_SIZE(&videoInfo);
+	gsize headerOffset = stream.m_firstFrameOffset + frameIndex * (stream.m_frameHeaderSize + frameSize);
+	MappedFile &file = *(stream.m_file);
+
+	if ((stream.m_frameHeaderSize > 0) && (memcmp(file.m_data + headerOffset, Y4mFrameMagic, sizeof(Y4mFrameMagic) - 1) != 0))
+	{
+		GST_ELEMENT_ERROR(appsrc, STREAM, DECODE, ("Invalid Y4M frame header"), ("Frame %" G_GUINT64_FORMAT " has no valid header; frame headers of different sizes are not supported", frameIndex));
+		return;
+	}
+
+	// Wrap the frame without copying. The buffer keeps the
+	// mapping alive until it is released downstream.
+	GstBuffer *buffer = gst_buffer_new_wrapped_full(
+		GST_MEMORY_FLAG_READONLY,
+		file.m_data,
+		file.m_size,
+		headerOffset + stream.m_frameHeaderSize,
+		frameSize,
+		new std::shared_ptr<MappedFile>(stream.m_file),
+		[](gpointer mappedFile) { delete static_cast<std::shared_ptr<MappedFile> *>(mappedFile); }
+	);
+
+	GST_BUFFER_PTS(buffer) = frameTimestamp(videoInfo, frameIndex);
+	GST_BUFFER_DURATION(buffer) = frameTimestamp(videoInfo, frameIndex + 1) - GST_BUFFER_PTS(buffer);
+	GST_BUFFER_OFFSET(buffer) = frameIndex;
+
+	// The plane layout may differ from GStreamer's default one.
+	gst_buffer_add_video_meta_full(
+		buffer,
+		GST_VIDEO_FRAME_FLAG_NONE,
+		GST_VIDEO_INFO_FORMAT(&videoInfo),
+		GST_VIDEO_INFO_WIDTH(&videoInfo),
+		GST_VIDEO_INFO_HEIGHT(&videoInfo),
+		GST_VIDEO_INFO_N_PLANES(&videoInfo),
+		videoInfo.offset,
+		videoInfo.stride
+	);
+
+	gst_app_src_push_buffer(appsrc, buffer);
+}
+
+
+gboolean onSeekData(GstAppSrc *, guint64 position, gpointer userData)
+{
+	Stream &stream = **static_cast<std::shared_ptr<Stream> *>(userData);
+	GstVideoInfo const &videoInfo = stream.m_videoInfo;
+
+	std::lock_guard<std::mutex> lock(stream.m_mutex);
+	stream.m_nextFrame = gst_util_uint64_scale(position, GST_VIDEO_INFO_FPS_N(&videoInfo), GST_VIDEO_INFO_FPS_D(&videoInfo) * GST_SECOND);
+
+	return TRUE;
+}
+
+
+} // unnamed namespace end
+
+
+bool RawFrameSource::parseRawFormat(QString const &formatString, GstVideoInfo &videoInfo)
+{
+	QRegularExpression regex("^(\\d+)x(\\d+)@(\\d+)(?:/(\\d+))?:(\\w+)$");
+	QRegularExpressionMatch match = regex.match(formatString);
+	if (!match.hasMatch())
+		return false;
+
+	guint width = match.captured(1).toUInt();
+	guint height = match.captured(2).toUInt();
+	gint fpsN = match.captured(3).toInt();
+	gint fpsD = match.captured(4).isEmpty() ? 1 : match.captured(4).toInt();
+	GstVideoFormat format = gst_video_format_from_string(match.captured(5).toUpper().toStdString().c_str());
+
+	if ((width == 0) || (height == 0) || (fpsN <= 0) || (fpsD <= 0) || (format == GST_VIDEO_FORMAT_UNKNOWN))
+		return false;
+
+	if (!gst_video_info_set_format(&videoInfo, format, width, height))
+		return false;
+	GST_VIDEO_INFO_FPS_N(&videoInfo) = fpsN;
+	GST_VIDEO_INFO_FPS_D(&videoInfo) = fpsD;
+
+	return true;
+}
+
+
+QString RawFrameSource::toUri(QString const &input)
+{
+	QUrl url(inputToUri(input));
+	if (!url.isLocalFile())
+		return QString();
+
+	url.setScheme(RawFrameProtocol);
+	return url.toString();
+}
+
+
+void RawFrameSource::setRawFormat(GstVideoInfo const &videoInfo)
+{
+	m_rawFormat = videoInfo;
+	m_rawFormatSet = true;
+}
+
+
+void RawFrameSource::attach(Pipeline &pipeline)
+{
+	GstElement *playbin = pipeline.playbin();
+	assert(playbin != nullptr);
+
+	pipeline.addSourceSetupHandler([this, playbin](GstElement *source) {
+		if (GST_IS_APP_SRC(source))
+			setupAppsrc(playbin, source);
+	});
+}
+
+
+void RawFrameSource::setupAppsrc(GstElement *playbin, GstElement *appsrc)
+{
+	gchar *uri = nullptr;
+	g_object_get(playbin, "uri", &uri, nullptr);
+	QUrl url(uri);
+	g_free(uri);
+
+	// appsrc URIs with a host (like the FramePusher's) are not raw frame files.
+	if ((url.scheme() != RawFrameProtocol) || !url.host().isEmpty())
+		return;
+
+	url.setScheme("file");
+	std::string filename = url.toLocalFile().toStdString();
+
+	std::shared_ptr<Stream> stream = std::make_shared<Stream>();
+	if (!setupStream(filename, m_rawFormatSet ? &m_rawFormat : nullptr, *stream))
+	{
+		GST_ELEMENT_ERROR(appsrc, RESOURCE, OPEN_READ, ("Could not read frames from %s", filename.c_str()), (nullptr));
+		return;
+	}
+
+	GstVideoInfo const &videoInfo = stream->m_videoInfo;
+	LOG_INFO(
+		"Playing %" G_GUINT64_FORMAT " raw %s frames of %dx%d from %s",
+		stream->m_numFrames,
+		GST_VIDEO_INFO_NAME(&videoInfo),
+		GST_VIDEO_INFO_WIDTH(&videoInfo),
+		GST_VIDEO_INFO_HEIGHT(&videoInfo),
+		filename.c_str()
+	);
+
+	GstCaps *caps = gst_video_info_to_caps(&videoInfo);
+	g_object_set(
+		appsrc,
+		"caps", caps,
+		"format", GST_FORMAT_TIME,
+		"stream-type", GST_APP_STREAM_TYPE_SEEKABLE,
+		nullptr
+	);
+	gst_caps_unref(caps);
+	gst_app_src_set_duration(GST_APP_SRC(appsrc), frameTimestamp(videoInfo, stream->m_numFrames));
+
+	// Frames are pushed one at a time from the need-data callback, so
+	// no more than one frame is ever queued inside the appsrc.
+	GstAppSrcCallbacks callbacks = {};
+	callbacks.need_data = &onNeedData;
+	callbacks.seek_data = &onSeekData;
+	gst_app_src_set_callbacks(
+		GST_APP_SRC(appsrc),
+		&callbacks,
+		new std::shared_ptr<Stream>(std::move(stream)),
+		[](gpointer stream) { delete static_cast<std::shared_ptr<Stream> *>(stream); }
+	);
+}
@@ -0,0 +1,55 @@
+#ifndef RAW_FRAME_SOURCE_HPP
+#define RAW_FRAME_SOURCE_HPP
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include <QString>
+
+
+class Pipeline;
+
+
+// Feeds already decoded frames from a file into playbin.
+//
+// This isolates the upload and render performance from the decoder
+// performance in benchmarks. Inputs are YUV4MPEG2 (.y4m) files, or raw
+// frame files (for example written by filesink from video/x-raw caps)
+// whose format is set with setRawFormat().
+//
+// The file is memory-mapped, and each frame is passed downstream as a
+// buffer that wraps its region of the mapping, so no frame data is copied
+// before the GL upload. Frames are timestamped according to the frame
+// rate, and seeking is supported.
+//
+// Inputs are passed to playbin as appsrc:// URIs (see toUri()), which
+// makes it create an appsrc that is set up by this class. Since the caps
+// already are raw video, playbin links that appsrc directly to the video
+// sink without a decoder.
+
+class RawFrameSource
+{
+public:
+	// Parses "<width>x<height>@<fps>:<format>", for example "1920x1080@60:NV12".
+	// The frame rate can also be given as a fraction ("30000/1001").
+	static bool parseRawFormat(QString const &formatString, GstVideoInfo &videoInfo);
+
+	// Converts a file:// URI (or a filename) to the appsrc:// URI that
+	// makes playbin use this source. Returns an empty string on failure.
+	static QString toUri(QString const &input);
+
+	// Sets the frame format of files that are not Y4M files.
+	void setRawFormat(GstVideoInfo const &videoInfo);
+
+	void attach(Pipeline &pipeline);
+
+
+private:
+	void setupAppsrc(GstElement *playbin, GstElement *appsrc);
+
+	GstVideoInfo m_rawFormat;
+	bool m_rawFormatSet = false;
+};
+
+
+#endif // RAW_FRAME_SOURCE_HPP
@@ -0,0 +1,945 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <gst/base/gstbasesrc.h>
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "Log.hpp"
+#include "ReadAheadFileSrc.hpp"
+
+
+namespace
+{
+
+
+constexpr guint DefaultBlockSize = 1024 * 1024;
+constexpr guint64 DefaultReadaheadSize = 8 * 1024 * 1024;
+constexpr guint DefaultIoUringDepth = 0;
+// Block sizes are rounded up to multiples of this, and block
+// buffers are allocated with this alignment.
+constexpr guint Alignment = 4096;
+// Waits for storage shorter than this are not counted as stalls
+// in the statistics (they are still added to the stall time).
+constexpr gint64 StallThreshold = 1 * GST_MSECOND;
+
+
+enum
+{
+	PROP_0,
+	PROP_LOCATION,
+	PROP_BLOCK_SIZE,
+	PROP_READAHEAD_SIZE,
+	PROP_IO_URING_DEPTH,
+	PROP_STALL_TIME
+};
+
+
+gint64 monotonicTimeInNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+guint64 alignDown(guint64 value)
+{
+	return value - (value % Alignment);
+}
+
+
+guint64 alignUp(guint64 value)
+{
+	return alignDown(value + Alignment - 1);
+}
+
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBURING
+struct Block
+{
+	enum class State
+	{
+		Empty,
+		InFlight,
+		Ready
+	};
+
+	guint64 m_index = 0;
+	State m_state = State::Empty;
+	// Number of valid bytes, or a negative errno value if the read failed.
+	gssize m_length = 0;
+	void *m_data = nullptr;
+};
+#endif
+
+
+// C++ side state of the element, allocated in the instance init function.
+struct ReadAheadState
+{
+	// Properties. Protected by the object lock.
+	gchar *m_location = nullptr;
+	guint m_blockSize = DefaultBlockSize;
+	guint m_ioUringDepth = DefaultIoUringDepth;
+	// Can be changed while playing (by ResourceScaler, for example), and
+	// is read by the streaming thread without taking the object lock.
+	std::atomic<guint64> m_readaheadSize{DefaultReadaheadSize};
+
+	int m_fd = -1;
+	guint64 m_fileSize = 0;
+	// End of the range that was already passed to posix_fadvise().
+	guint64 m_advisedUpTo = 0;
+
+	// Block for serving requests that are smaller than a block, or not
+	// aligned to one (typically from demuxers in pull mode). Only used
+	// without io_uring.
+	void *m_cacheData = nullptr;
+	guint64 m_cacheOffset = 0;
+	gsize m_cacheLength = 0;
+
+	// Statistics.
+	std::atomic<gint64> m_stallTime{0};
+	gint64 m_maxStallTime = 0;
+	guint64 m_numStalls = 0;
+	guint64 m_bytesRead = 0;
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBURING
+	bool m_ioUringActive = false;
+	struct io_uring m_ring;
+	std::vector<Block> m_blocks;
+	guint m_numInFlight = 0;
+#endif
+};
+
+
+} // unnamed namespace end
+
+
+struct GstReadAheadFileSrc
+{
+	GstBaseSrc parent;
+	ReadAheadState *state;
+};
+
+
+struct GstReadAheadFileSrcClass
+{
+	GstBaseSrcClass parent_class;
+};
+
+
+static void gst_read_ahead_file_src_uri_handler_init(gpointer iface, gpointer ifaceData);
+
+G_DEFINE_TYPE_WITH_CODE(
+	GstReadAheadFileSrc, gst_read_ahead_file_src, GST_TYPE_BASE_SRC,
+	G_IMPLEMENT_INTERFACE(GST_TYPE_URI_HANDLER, gst_read_ahead_file_src_uri_handler_init)
+)
+
+
+namespace
+{
+
+
+GstStaticPadTemplate srcTemplate = GST_STATIC_PAD_TEMPLATE(
+	"src",
+	GST_PAD_SRC,
+	GST_PAD_ALWAYS,
+	GST_STATIC_CAPS_ANY
+);
+
+
+GstReadAheadFileSrc * toSelf(gpointer object)
+{
+	return reinterpret_cast<GstReadAheadFileSrc *>(object);
+}
+
+
+void recordWait(ReadAheadState &state, gint64 waitTime)
+{
+	state.m_stallTime += waitTime;
+	if (waitTime >= StallThreshold)
+	{
+		++state.m_numStalls;
+		state.m_maxStallTime = std::max(state.m_maxStallTime, waitTime);
+	}
+}
+
+
+// Hints the kernel to read the data following the given position. This
+// is done in large steps (half the read-ahead size) to keep the number
+// of system calls low and the reads large.
+void adviseReadAhead(ReadAheadState &state, guint64 position)
+{
+	guint64 readaheadSize = state.m_readaheadSize.load(std::memory_order_relaxed);
+	if (readaheadSize == 0)
+		return;
+
+	// Start over after seeks.
+	if ((position + readaheadSize < state.m_advisedUpTo) || (position > state.m_advisedUpTo))
+		state.m_advisedUpTo = alignDown(position);
+
+	if ((position + readaheadSize / 2) < state.m_advisedUpTo)
+		return;
+
+	guint64 end = std::min(alignUp(position + readaheadSize), alignUp(state.m_fileSize));
+	if (end <= state.m_advisedUpTo)
+		return;
+
+	posix_fadvise(state.m_fd, off_t(state.m_advisedUpTo), off_t(end - state.m_advisedUpTo), POSIX_FADV_WILLNEED);
+	state.m_advisedUpTo = end;
+}
+
+
+// Reads synchronously. Returns the number of bytes read,
+// or -1 in case of an error (errno is set then).
+gssize readFully(int fd, guint8 *data, gsize length, guint64 offset)
+{
+	gsize totalRead = 0;
+
+	while (totalRead < length)
+	{
+		ssize_t numRead = pread(fd, data + totalRead, length - totalRead, off_t(offset + totalRead));
+		if (numRead < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		else if (numRead == 0)
+			break;
+
+		totalRead += gsize(numRead);
+	}
+
+	return gssize(totalRead);
+}
+
+
+// Reads into the given buffer in whole, aligned blocks. Parts of a block
+// that the request does not cover are kept in the cache block and serve
+// the next requests. Returns the number of bytes read, or -1 in case of
+// an error (errno is set then).
+gssize readBlocks(ReadAheadState &state, guint8 *data, gsize length, guint64 offset)
+{
+	gsize totalCopied = 0;
+
+	while (totalCopied < length)
+	{
+		guint64 position = offset + totalCopied;
+		gsize remaining = length - totalCopied;
+
+		if ((position >= state.m_cacheOffset) && (position < state.m_cacheOffset + state.m_cacheLength))
+		{
+			gsize numToCopy = std::min<gsize>(remaining, state.m_cacheOffset + state.m_cacheLength - position);
+			std::memcpy(data + totalCopied, reinterpret_cast<guint8 *>(state.m_cacheData) + (position - state.m_cacheOffset), numToCopy);
+			totalCopied += numToCopy;
+			continue;
+		}
+
+		guint64 blockOffset = position - (position % state.m_blockSize);
+		gint64 waitStart;
+		gssize numRead;
+
+		if ((position == blockOffset) && (remaining >= state.m_blockSize))
+		{
+			// Whole blocks are read directly into the buffer.
+			gsize numToRead = remaining - (remaining % state.m_blockSize);
+			adviseReadAhead(state, position + numToRead);
+
+			waitStart = monotonicTimeInNs();
+			numRead = readFully(state.m_fd, data + totalCopied, numToRead, position);
+			recordWait(state, monotonicTimeInNs() - waitStart);
+
+			if (numRead < 0)
+				return -1;
+			totalCopied += gsize(numRead);
+			if (gsize(numRead) < numToRead)
+				break;
+			continue;
+		}
+
+		adviseReadAhead(state, blockOffset + state.m_blockSize);
+
+		waitStart = monotonicTimeInNs();
+		numRead = readFully(state.m_fd, reinterpret_cast<guint8 *>(state.m_cacheData), state.m_blockSize, blockOffset);
+		recordWait(state, monotonicTimeInNs() - waitStart);
+
+		if (numRead < 0)
+		{
+			state.m_cacheLength = 0;
+			return -1;
+		}
+
+		state.m_cacheOffset = blockOffset;
+		state.m_cacheLength = gsize(numRead);
+		if (position >= blockOffset + gsize(numRead))
+			break;
+	}
+
+	return gssize(totalCopied);
+}
+
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBURING
+
+// Number of bytes in the block with the given index. Only
+// the last block of the file may be shorter than a block.
+gsize blockLength(ReadAheadState const &state, guint64 index)
+{
+	guint64 offset = index * state.m_blockSize;
+	return gsize(std::min<guint64>(state.m_blockSize, state.m_fileSize - offset));
+}
+
+
+// Submits a read for the part of the block that was not read yet.
+bool submitRemainingRead(ReadAheadState &state, Block &block)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&(state.m_ring));
+	if (sqe == nullptr)
+		return false;
+
+	guint64 offset = block.m_index * state.m_blockSize + guint64(block.m_length);
+	unsigned int length = unsigned(blockLength(state, block.m_index) - gsize(block.m_length));
+
+	io_uring_prep_read(sqe, state.m_fd, reinterpret_cast<guint8 *>(block.m_data) + block.m_length, length, offset);
+	io_uring_sqe_set_data(sqe, &block);
+	io_uring_submit(&(state.m_ring));
+
+	return true;
+}
+
+
+void processCompletion(ReadAheadState &state, struct io_uring_cqe *cqe)
+{
+	Block *block = reinterpret_cast<Block *>(io_uring_cqe_get_data(cqe));
+	int result = cqe->res;
+	io_uring_cqe_seen(&(state.m_ring), cqe);
+
+	if (result > 0)
+	{
+		// Reads may complete only partially. Read the rest of the
+		// block, which keeps it in flight.
+		block->m_length += result;
+		if (gsize(block->m_length) < blockLength(state, block->m_index))
+		{
+			if (submitRemainingRead(state, *block))
+				return;
+			result = -EAGAIN;
+		}
+	}
+	else if (result == 0)
+	{
+		// All reads are within the file size determined at startup,
+		// so the file got shorter while it was being read.
+		result = -EIO;
+	}
+
+	if (result < 0)
+		block->m_length = result;
+
+	block->m_state = Block::State::Ready;
+	--state.m_numInFlight;
+}
+
+
+void reapCompletions(ReadAheadState &state, bool wait)
+{
+	struct io_uring_cqe *cqe;
+
+	if (wait && (state.m_numInFlight > 0))
+	{
+		int ret;
+		do
+		{
+			ret = io_uring_wait_cqe(&(state.m_ring), &cqe);
+		}
+		while (ret == -EINTR);
+
+		if (ret == 0)
+			processCompletion(state, cqe);
+	}
+
+	while ((state.m_numInFlight > 0) && (io_uring_peek_cqe(&(state.m_ring), &cqe) == 0))
+		processCompletion(state, cqe);
+}
+
+
+Block * findBlock(ReadAheadState &state, guint64 index)
+{
+	for (Block &block : state.m_blocks)
+	{
+		if ((block.m_state != Block::State::Empty) && (block.m_index == index))
+			return &block;
+	}
+	return nullptr;
+}
+
+
+// Finds a block that can be (re)used for reading the given block index.
+// Blocks that are in flight or that are inside the read-ahead window
+// starting at currentIndex are never reused.
+Block * findFreeBlock(ReadAheadState &state, guint64 currentIndex)
+{
+	guint64 windowEnd = currentIndex + state.m_blocks.size();
+	Block *candidate = nullptr;
+
+	for (Block &block : state.m_blocks)
+	{
+		if (block.m_state == Block::State::Empty)
+			return &block;
+		if ((block.m_state == Block::State::Ready) && ((block.m_index < currentIndex) || (block.m_index >= windowEnd)))
+			candidate = &block;
+	}
+
+	return candidate;
+}
+
+
+bool submitBlockRead(ReadAheadState &state, Block &block, guint64 index)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&(state.m_ring));
+	if (sqe == nullptr)
+		return false;
+
+	guint64 offset = index * state.m_blockSize;
+	unsigned int length = unsigned(blockLength(state, index));
+
+	io_uring_prep_read(sqe, state.m_fd, block.m_data, length, offset);
+	io_uring_sqe_set_data(sqe, &block);
+
+	block.m_index = index;
+	block.m_state = Block::State::InFlight;
+	block.m_length = 0;
+	++state.m_numInFlight;
+
+	io_uring_submit(&(state.m_ring));
+	return true;
+}
+
+
+// Makes sure reads for the blocks following currentIndex are in flight.
+void scheduleBlockReads(ReadAheadState &state, guint64 currentIndex)
+{
+	guint64 numBlocksInFile = (state.m_fileSize + state.m_blockSize - 1) / state.m_blockSize;
+	guint64 windowEnd = std::min<guint64>(currentIndex + state.m_blocks.size(), numBlocksInFile);
+
+	for (guint64 index = currentIndex; (index < windowEnd) && (state.m_numInFlight < state.m_ioUringDepth); ++index)
+	{
+		if (findBlock(state, index) != nullptr)
+			continue;
+
+		Block *block = findFreeBlock(state, currentIndex);
+		if ((block == nullptr) || !submitBlockRead(state, *block, index))
+			break;
+	}
+}
+
+
+GstFlowReturn fillFromBlocks(GstReadAheadFileSrc *self, ReadAheadState &state, guint8 *data, gsize length, guint64 offset)
+{
+	gsize totalCopied = 0;
+
+	while (totalCopied < length)
+	{
+		guint64 position = offset + totalCopied;
+		guint64 index = position / state.m_blockSize;
+
+		reapCompletions(state, false);
+
+		Block *block = findBlock(state, index);
+		if (block == nullptr)
+		{
+			// The block was not read ahead (for example right after a seek).
+			// Make room for it and read it now.
+			scheduleBlockReads(state, index);
+			block = findBlock(state, index);
+
+			while (block == nullptr)
+			{
+				if (state.m_numInFlight == 0)
+				{
+					GST_ELEMENT_ERROR(self, RESOURCE, READ, (nullptr), ("Could not schedule io_uring read"));
+					return GST_FLOW_ERROR;
+				}
+
+				gint64 waitStart = monotonicTimeInNs();
+				reapCompletions(state, true);
+				recordWait(state, monotonicTimeInNs() - waitStart);
+
+				scheduleBlockReads(state, index);
+				block = findBlock(state, index);
+			}
+		}
+
+		if (block->m_state == Block::State::InFlight)
+		{
+			gint64 waitStart = monotonicTimeInNs();
+			while (block->m_state == Block::State::InFlight)
+				reapCompletions(state, true);
+			recordWait(state, monotonicTimeInNs() - waitStart);
+		}
+
+		if (block->m_length < 0)
+		{
+			GST_ELEMENT_ERROR(self, RESOURCE, READ, (nullptr), ("Could not read from file: %s", std::strerror(int(-block->m_length))));
+			block->m_state = Block::State::Empty;
+			return GST_FLOW_ERROR;
+		}
+
+		// Blocks are always read completely (see processCompletion()),
+		// and fill() never asks for data beyond the end of the file.
+		guint64 blockOffset = position - index * state.m_blockSize;
+		if (blockOffset >= guint64(block->m_length))
+		{
+			GST_ELEMENT_ERROR(self, RESOURCE, READ, (nullptr), ("Block %" G_GUINT64_FORMAT " was read only partially", index));
+			return GST_FLOW_ERROR;
+		}
+
+		gsize numToCopy = std::min<gsize>(length - totalCopied, gsize(block->m_length) - blockOffset);
+		std::memcpy(data + totalCopied, reinterpret_cast<guint8 *>(block->m_data) + blockOffset, numToCopy);
+		totalCopied += numToCopy;
+
+		// Keep the pipeline of reads filled.
+		scheduleBlockReads(state, index + 1);
+	}
+
+	state.m_bytesRead += totalCopied;
+	return GST_FLOW_OK;
+}
+
+
+bool startIoUring(GstReadAheadFileSrc *self, ReadAheadState &state)
+{
+	int ret = io_uring_queue_init(state.m_ioUringDepth, &(state.m_ring), 0);
+	if (ret < 0)
+	{
+		GST_ELEMENT_WARNING(self, RESOURCE, SETTINGS, (nullptr), ("Could not set up io_uring: %s; falling back to regular reads", std::strerror(-ret)));
+		return false;
+	}
+
+	std::size_t numBlocks = std::max<std::size_t>(state.m_ioUringDepth, state.m_readaheadSize.load(std::memory_order_relaxed) / state.m_blockSize);
+	state.m_blocks.resize(numBlocks);
+	for (Block &block : state.m_blocks)
+	{
+		if (posix_memalign(&(block.m_data), Alignment, state.m_blockSize) != 0)
+		{
+			block.m_data = nullptr;
+			GST_ELEMENT_WARNING(self, RESOURCE, SETTINGS, (nullptr), ("Could not allocate io_uring block buffers; falling back to regular reads"));
+
+			// Blocks that were not allocated have nullptr data.
+			for (Block &allocatedBlock : state.m_blocks)
+				std::free(allocatedBlock.m_data);
+			state.m_blocks.clear();
+			io_uring_queue_exit(&(state.m_ring));
+			return false;
+		}
+	}
+
+	state.m_numInFlight = 0;
+	state.m_ioUringActive = true;
+	return true;
+}
+
+
+void stopIoUring(ReadAheadState &state)
+{
+	if (!state.m_ioUringActive)
+		return;
+
+	// The kernel might still write into the block buffers
+	// until the reads in flight are completed.
+	while (state.m_numInFlight > 0)
+		reapCompletions(state, true);
+
+	io_uring_queue_exit(&(state.m_ring));
+
+	for (Block &block : state.m_blocks)
+		std::free(block.m_data);
+	state.m_blocks.clear();
+
+	state.m_ioUringActive = false;
+}
+
+#endif
+
+
+void setProperty(GObject *object, guint propertyId, GValue const *value, GParamSpec *paramSpec)
+{
+	ReadAheadState &state = *(toSelf(object)->state);
+
+	GST_OBJECT_LOCK(object);
+
+	switch (propertyId)
+	{
+		case PROP_LOCATION:
+			g_free(state.m_location);
+			state.m_location = g_value_dup_string(value);
+			break;
+
+		case PROP_BLOCK_SIZE:
+			state.m_blockSize = guint(alignUp(std::max(g_value_get_uint(value), Alignment)));
+			break;
+
+		case PROP_READAHEAD_SIZE:
+			state.m_readaheadSize.store(g_value_get_uint64(value), std::memory_order_relaxed);
+			break;
+
+		case PROP_IO_URING_DEPTH:
+			state.m_ioUringDepth = g_value_get_uint(value);
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, propertyId, paramSpec);
+			break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+void getProperty(GObject *object, guint propertyId, GValue *value, GParamSpec *paramSpec)
+{
+	ReadAheadState &state = *(toSelf(object)->state);
+
+	GST_OBJECT_LOCK(object);
+
+	switch (propertyId)
+	{
+		case PROP_LOCATION:
+			g_value_set_string(value, state.m_location);
+			break;
+
+		case PROP_BLOCK_SIZE:
+			g_value_set_uint(value, state.m_blockSize);
+			break;
+
+		case PROP_READAHEAD_SIZE:
+			g_value_set_uint64(value, state.m_readaheadSize.load(std::memory_order_relaxed));
+			break;
+
+		case PROP_IO_URING_DEPTH:
+			g_value_set_uint(value, state.m_ioUringDepth);
+			break;
+
+		case PROP_STALL_TIME:
+			g_value_set_uint64(value, guint64(state.m_stallTime.load()));
+			break;
+
+		default:
+			G_OBJECT_WARN_INVALID_PROPERTY_ID(object, propertyId, paramSpec);
+			break;
+	}
+
+	GST_OBJECT_UNLOCK(object);
+}
+
+
+void finalize(GObject *object)
+{
+	GstReadAheadFileSrc *self = toSelf(object);
+
+	g_free(self->state->m_location);
+	delete self->state;
+	self->state = nullptr;
+
+	G_OBJECT_CLASS(gst_read_ahead_file_src_parent_class)->finalize(object);
+}
+
+
+gboolean start(GstBaseSrc *baseSrc)
+{
+	GstReadAheadFileSrc *self = toSelf(baseSrc);
+	ReadAheadState &state = *(self->state);
+
+	if (state.m_location == nullptr)
+	{
+		GST_ELEMENT_ERROR(self, RESOURCE, NOT_FOUND, ("No file name specified for reading"), (nullptr));
+		return FALSE;
+	}
+
+	state.m_fd = open(state.m_location, O_RDONLY | O_CLOEXEC);
+	if (state.m_fd < 0)
+	{
+		GST_ELEMENT_ERROR(self, RESOURCE, OPEN_READ, ("Could not open file \"%s\" for reading", state.m_location), ("%s", std::strerror(errno)));
+		return FALSE;
+	}
+
+	struct stat fileStat;
+	if ((fstat(state.m_fd, &fileStat) < 0) || !S_ISREG(fileStat.st_mode))
+	{
+		GST_ELEMENT_ERROR(self, RESOURCE, OPEN_READ, ("\"%s\" is not a regular file", state.m_location), (nullptr));
+		close(state.m_fd);
+		state.m_fd = -1;
+		return FALSE;
+	}
+
+	state.m_fileSize = guint64(fileStat.st_size);
+	state.m_advisedUpTo = 0;
+	state.m_stallTime = 0;
+	state.m_maxStallTime = 0;
+	state.m_numStalls = 0;
+	state.m_bytesRead = 0;
+
+	// Tell the kernel that the file is read sequentially, which
+	// doubles the size of the kernel's own read-ahead window.
+	if (state.m_readaheadSize.load(std::memory_order_relaxed) > 0)
+		posix_fadvise(state.m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	// Make downstream (in push mode) request data in large blocks.
+	gst_base_src_set_blocksize(baseSrc, state.m_blockSize);
+
+	if (posix_memalign(&(state.m_cacheData), Alignment, state.m_blockSize) != 0)
+	{
+		state.m_cacheData = nullptr;
+		GST_ELEMENT_ERROR(self, RESOURCE, OPEN_READ, (nullptr), ("Could not allocate a read buffer of %u bytes", state.m_blockSize));
+		close(state.m_fd);
+		state.m_fd = -1;
+		return FALSE;
+	}
+	state.m_cacheOffset = 0;
+	state.m_cacheLength = 0;
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBURING
+	if (state.m_ioUringDepth > 0)
+		startIoUring(self, state);
+#else
+	if (state.m_ioUringDepth > 0)
+		GST_ELEMENT_WARNING(self, RESOURCE, SETTINGS, (nullptr), ("io_uring is not supported by this build; using regular reads"));
+#endif
+
+	return TRUE;
+}
+
+
+gboolean stop(GstBaseSrc *baseSrc)
+{
+	ReadAheadState &state = *(toSelf(baseSrc)->state);
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBURING
+	stopIoUring(state);
+#endif
+
+	std::free(state.m_cacheData);
+	state.m_cacheData = nullptr;
+	state.m_cacheLength = 0;
+
+	if (state.m_fd >= 0)
+	{
+		close(state.m_fd);
+		state.m_fd = -1;
+
+		LOG_INFO(
+			"Read statistics of %s: %llu bytes read, read stall time: %.3f ms total, %llu stalls >= 1 ms, longest stall: %.3f ms",
+			state.m_location,
+			(unsigned long long)(state.m_bytesRead),
+			double(state.m_stallTime.load()) / GST_MSECOND,
+			(unsigned long long)(state.m_numStalls),
+			double(state.m_maxStallTime) / GST_MSECOND
+		);
+	}
+
+	return TRUE;
+}
+
+
+gboolean getSize(GstBaseSrc *baseSrc, guint64 *size)
+{
+	ReadAheadState &state = *(toSelf(baseSrc)->state);
+	if (state.m_fd < 0)
+		return FALSE;
+
+	*size = state.m_fileSize;
+	return TRUE;
+}
+
+
+gboolean isSeekable(GstBaseSrc *)
+{
+	return TRUE;
+}
+
+
+GstFlowReturn fill(GstBaseSrc *baseSrc, guint64 offset, guint length, GstBuffer *buffer)
+{
+	GstReadAheadFileSrc *self = toSelf(baseSrc);
+	ReadAheadState &state = *(self->state);
+
+	if (offset >= state.m_fileSize)
+		return GST_FLOW_EOS;
+
+	gsize lengthToRead = std::min<guint64>(length, state.m_fileSize - offset);
+
+	GstMapInfo mapInfo;
+	if (!gst_buffer_map(buffer, &mapInfo, GST_MAP_WRITE))
+	{
+		GST_ELEMENT_ERROR(self, RESOURCE, WRITE, (nullptr), ("Could not map buffer for writing"));
+		return GST_FLOW_ERROR;
+	}
+
+	gssize numRead;
+	GstFlowReturn flowReturn = GST_FLOW_OK;
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBURING
+	if (state.m_ioUringActive)
+	{
+		guint64 bytesReadBefore = state.m_bytesRead;
+		flowReturn = fillFromBlocks(self, state, mapInfo.data, lengthToRead, offset);
+		numRead = gssize(state.m_bytesRead - bytesReadBefore);
+	}
+	else
+#endif
+	{
+		numRead = readBlocks(state, mapInfo.data, lengthToRead, offset);
+
+		if (numRead < 0)
+		{
+			GST_ELEMENT_ERROR(self, RESOURCE, READ, (nullptr), ("Could not read from file: %s", std::strerror(errno)));
+			flowReturn = GST_FLOW_ERROR;
+		}
+		else if (numRead == 0)
+			flowReturn = GST_FLOW_EOS;
+		else
+			state.m_bytesRead += guint64(numRead);
+	}
+
+	gst_buffer_unmap(buffer, &mapInfo);
+
+	if (flowReturn != GST_FLOW_OK)
+		return flowReturn;
+
+	gst_buffer_resize(buffer, 0, numRead);
+	GST_BUFFER_OFFSET(buffer) = offset;
+	GST_BUFFER_OFFSET_END(buffer) = offset + numRead;
+
+	return GST_FLOW_OK;
+}
+
+
+GstURIType uriGetType(GType)
+{
+	return GST_URI_SRC;
+}
+
+
+gchar const * const * uriGetProtocols(GType)
+{
+	static gchar const *protocols[] = { "file", nullptr };
+	return protocols;
+}
+
+
+gchar * uriGetUri(GstURIHandler *handler)
+{
+	ReadAheadState &state = *(toSelf(handler)->state);
+
+	GST_OBJECT_LOCK(handler);
+	gchar *uri = (state.m_location != nullptr) ? gst_filename_to_uri(state.m_location, nullptr) : nullptr;
+	GST_OBJECT_UNLOCK(handler);
+
+	return uri;
+}
+
+
+gboolean uriSetUri(GstURIHandler *handler, gchar const *uri, GError **error)
+{
+	gchar *location = g_filename_from_uri(uri, nullptr, error);
+	if (location == nullptr)
+		return FALSE;
+
+	g_object_set(G_OBJECT(handler), "location", location, nullptr);
+	g_free(location);
+
+	return TRUE;
+}
+
+
+} // unnamed namespace end
+
+
+static void gst_read_ahead_file_src_class_init(GstReadAheadFileSrcClass *klass)
+{
+	GObjectClass *objectClass = G_OBJECT_CLASS(klass);
+	GstElementClass *elementClass = GST_ELEMENT_CLASS(klass);
+	GstBaseSrcClass *baseSrcClass = GST_BASE_SRC_CLASS(klass);
+
+	objectClass->set_property = setProperty;
+	objectClass->get_property = getProperty;
+	objectClass->finalize = finalize;
+
+	GParamFlags readWriteFlags = GParamFlags(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_READY);
+
+	g_object_class_install_property(
+		objectClass, PROP_LOCATION,
+		g_param_spec_string("location", "File location", "Location of the file to read", nullptr, readWriteFlags)
+	);
+	g_object_class_install_property(
+		objectClass, PROP_BLOCK_SIZE,
+		g_param_spec_uint("block-size", "Block size", "Size of the individual reads in bytes (rounded up to a multiple of 4096)", Alignment, G_MAXINT, DefaultBlockSize, readWriteFlags)
+	);
+	g_object_class_install_property(
+		objectClass, PROP_READAHEAD_SIZE,
+		g_param_spec_uint64("readahead-size", "Read-ahead size", "How many bytes to read ahead of the current position", 0, G_MAXUINT64, DefaultReadaheadSize, GParamFlags(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | GST_PARAM_MUTABLE_PLAYING))
+	);
+	g_object_class_install_property(
+		objectClass, PROP_IO_URING_DEPTH,
+		g_param_spec_uint("io-uring-depth", "io_uring depth", "Maximum number of io_uring reads in flight (0 = do not use io_uring)", 0, 256, DefaultIoUringDepth, readWriteFlags)
+	);
+	g_object_class_install_property(
+		objectClass, PROP_STALL_TIME,
+		g_param_spec_uint64("stall-time", "Stall time", "Total time in nanoseconds spent waiting for storage", 0, G_MAXUINT64, 0, GParamFlags(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS))
+	);
+
+	gst_element_class_add_static_pad_template(elementClass, &srcTemplate);
+	gst_element_class_set_static_metadata(
+		elementClass,
+		"Read-ahead file source",
+		"Source/File",
+		"Reads from a local file, keeping the storage busy ahead of the current position",
+		"qmlglsink-example"
+	);
+
+	baseSrcClass->start = start;
+	baseSrcClass->stop = stop;
+	baseSrcClass->get_size = getSize;
+	baseSrcClass->is_seekable = isSeekable;
+	baseSrcClass->fill = fill;
+}
+
+
+static void gst_read_ahead_file_src_init(GstReadAheadFileSrc *self)
+{
+	self->state = new ReadAheadState;
+	gst_base_src_set_blocksize(GST_BASE_SRC(self), DefaultBlockSize);
+}
+
+
+static void gst_read_ahead_file_src_uri_handler_init(gpointer iface, gpointer)
+{
+	GstURIHandlerInterface *uriHandlerInterface = reinterpret_cast<GstURIHandlerInterface *>(iface);
+
+	uriHandlerInterface->get_type = uriGetType;
+	uriHandlerInterface->get_protocols = uriGetProtocols;
+	uriHandlerInterface->get_uri = uriGetUri;
+	uriHandlerInterface->set_uri = uriSetUri;
+}
+
+
+bool registerReadAheadFileSrc(guint rank)
+{
+	if (!gst_element_register(nullptr, "readaheadfilesrc", rank, GST_TYPE_READ_AHEAD_FILE_SRC))
+	{
+		LOG_ERROR("Could not register readaheadfilesrc element");
+		return false;
+	}
+
+	return true;
+}
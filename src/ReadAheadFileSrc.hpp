@@ -0,0 +1,35 @@
+#ifndef READ_AHEAD_FILE_SRC_HPP
+#define READ_AHEAD_FILE_SRC_HPP
+
+#include <gst/gst.h>
+
+
+// File source element that keeps the storage busy ahead of the reader.
+//
+// Regular filesrc reads data only when downstream asks for it. On slow
+// storage (SD cards, for example), a demuxer that suddenly needs a lot of
+// data (like at GOP boundaries of high bitrate streams) then has to wait
+// for the storage. This element instead hints the kernel to read the
+// upcoming data ahead of time (posix_fadvise() with POSIX_FADV_WILLNEED),
+// and reads in large, aligned blocks. Requests that do not cover whole
+// blocks are served from the last block that was read. If built with liburing support and
+// enabled with the "io-uring-depth" property, it instead keeps several
+// block reads in flight with io_uring, and serves data from these blocks.
+//
+// The element measures how long it has to wait for storage ("read stall
+// time"). It is available as the read-only "stall-time" property and
+// logged when the element stops.
+//
+// The element is registered as "readaheadfilesrc", and handles file://
+// URIs, so playbin uses it instead of filesrc if its rank is higher.
+
+#define GST_TYPE_READ_AHEAD_FILE_SRC (gst_read_ahead_file_src_get_type())
+
+GType gst_read_ahead_file_src_get_type(void);
+
+// Registers the element with the given rank. GST_RANK_PRIMARY + 1 makes
+// sure it is preferred over filesrc.
+bool registerReadAheadFileSrc(guint rank);
+
+
+#endif // READ_AHEAD_FILE_SRC_HPP
@@ -0,0 +1,318 @@
+#include <algorithm>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "ReconnectController.hpp"
+
+
+namespace
+{
+
+
+constexpr int InitialBackoffInMs = 100;
+constexpr int MaxBackoffInMs = 5000;
+// An attempt that did not preroll (or start, with live inputs)
+// within this time counts as failed.
+constexpr int AttemptTimeoutInMs = 10000;
+
+// The network sources are configured to report connection losses
+// quickly instead of waiting for their (long) default timeouts.
+constexpr guint64 RtspTcpTimeoutInUs = 3 * G_USEC_PER_SEC;
+constexpr guint HttpTimeoutInSeconds = 5;
+
+
+bool isNetworkUri(gchar const *uri)
+{
+	static char const * const networkProtocols[] = {
+		"http", "https",
+		"rtsp", "rtsps", "rtspt", "rtspu",
+		"rtmp", "srt"
+	};
+
+	if ((uri == nullptr) || !gst_uri_is_valid(uri))
+		return false;
+
+	gchar *protocol = gst_uri_get_protocol(uri);
+	bool isNetwork = false;
+	for (char const *networkProtocol : networkProtocols)
+	{
+		if (g_ascii_strcasecmp(protocol, networkProtocol) == 0)
+		{
+			isNetwork = true;
+			break;
+		}
+	}
+	g_free(protocol);
+
+	return isNetwork;
+}
+
+
+void configureNetworkSource(GstElement *source)
+{
+	GstElementFactory *factory = gst_element_get_factory(source);
+	if (factory == nullptr)
+		return;
+
+	gchar const *factoryName = GST_OBJECT_NAME(factory);
+	if (g_strcmp0(factoryName, "rtspsrc") == 0)
+		g_object_set(source, "tcp-timeout", guint64(RtspTcpTimeoutInUs), nullptr);
+	else if (g_strcmp0(factoryName, "souphttpsrc") == 0)
+		g_object_set(source, "timeout", guint(HttpTimeoutInSeconds), nullptr);
+}
+
+
+} // unnamed namespace end
+
+
+ReconnectController::ReconnectController(Pipeline &pipeline, QObject *parent)
+	: QObject(parent)
+	, m_pipeline(pipeline)
+	, m_randomEngine(std::random_device()())
+{
+	m_retryTimer.setSingleShot(true);
+	connect(&m_retryTimer, &QTimer::timeout, this, &ReconnectController::retry);
+
+	m_attemptTimer.setSingleShot(true);
+	m_attemptTimer.setInterval(AttemptTimeoutInMs);
+	connect(&m_attemptTimer, &QTimer::timeout, this, [this]() {
+		LOG_WARNING("Reconnect attempt %d timed out", m_numAttempts);
+		failAttempt();
+	});
+
+	m_pipeline.addSourceSetupHandler([](GstElement *source) {
+		configureNetworkSource(source);
+	});
+
+	m_pipeline.addBusMessageHandler([this](GstMessage *message) {
+		onBusMessage(message);
+	});
+}
+
+
+void ReconnectController::setTimeout(int timeoutInMs)
+{
+	m_timeoutInMs = timeoutInMs;
+}
+
+
+bool ReconnectController::handleInterruption(GstMessage *message)
+{
+	if (m_reconnecting)
+	{
+		// The current reconnect attempt failed.
+		if ((GST_MESSAGE_TYPE(message) == GST_MESSAGE_ERROR) || (GST_MESSAGE_TYPE(message) == GST_MESSAGE_EOS))
+			failAttempt();
+		return true;
+	}
+
+	if (!isInterruption(message))
+		return false;
+
+	LOG_WARNING("Network input was interrupted; reconnecting");
+
+	m_reconnecting = true;
+	m_numAttempts = 0;
+	m_interruptionTimer.start();
+
+	gint64 duration = -1;
+	m_resumePosition = -1;
+	if (gst_element_query_duration(m_pipeline.playbin(), GST_FORMAT_TIME, &duration) && (duration > 0))
+		gst_element_query_position(m_pipeline.playbin(), GST_FORMAT_TIME, &m_resumePosition);
+
+	// Stop the pipeline first, then freeze the sink. This way, the
+	// sink keeps showing the last frame until the input is back.
+	m_pipeline.stop();
+	m_pipeline.freezeVideoSink();
+
+	emit interrupted();
+
+	scheduleRetry();
+	return true;
+}
+
+
+void ReconnectController::cancel()
+{
+	if (!m_reconnecting)
+		return;
+
+	m_retryTimer.stop();
+	m_attemptTimer.stop();
+	m_attemptPhase = AttemptPhase::None;
+	m_reconnecting = false;
+	m_pipeline.unfreezeVideoSink();
+
+	LOG_INFO("Reconnect canceled after %d attempt(s)", m_numAttempts);
+}
+
+
+bool ReconnectController::isInterruption(GstMessage *message) const
+{
+	GstElement *playbin = m_pipeline.playbin();
+
+	gchar *uri = nullptr;
+	g_object_get(playbin, "current-uri", &uri, nullptr);
+	bool isNetwork = isNetworkUri(uri);
+	g_free(uri);
+
+	if (!isNetwork)
+		return false;
+
+	switch (GST_MESSAGE_TYPE(message))
+	{
+		case GST_MESSAGE_ERROR:
+		{
+			// Connection losses, refused connections, and timeouts are
+			// reported as resource errors. Authorization failures will
+			// not go away by retrying, so these are not handled.
+			GError *error = nullptr;
+			gst_message_parse_error(message, &error, nullptr);
+			bool isResourceError = (error->domain == GST_RESOURCE_ERROR) && (error->code != GST_RESOURCE_ERROR_NOT_AUTHORIZED);
+			g_error_free(error);
+			return isResourceError;
+		}
+
+		case GST_MESSAGE_EOS:
+		{
+			// Live inputs do not end on their own. Inputs with a known
+			// duration only end once the end was actually reached.
+			gint64 duration = -1;
+			gint64 position = -1;
+			if (!gst_element_query_duration(playbin, GST_FORMAT_TIME, &duration) || (duration <= 0))
+				return true;
+			if (gst_element_query_position(playbin, GST_FORMAT_TIME, &position) && (position >= 0))
+				return (position + GST_SECOND) < duration;
+			return false;
+		}
+
+		default:
+			return false;
+	}
+}
+
+
+void ReconnectController::onBusMessage(GstMessage *message)
+{
+	if (!m_reconnecting || (GST_MESSAGE_SRC(message) != GST_OBJECT(m_pipeline.playbin())))
+		return;
+
+	switch (m_attemptPhase)
+	{
+		case AttemptPhase::Prerolling:
+			// The retry prerolled, so the input is back.
+			if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_ASYNC_DONE)
+				return;
+
+			m_pipeline.unfreezeVideoSink();
+			if (m_resumePosition > 0)
+				m_pipeline.seek(m_resumePosition);
+			m_pipeline.setPaused(false);
+			finishRecovery();
+			break;
+
+		case AttemptPhase::Starting:
+		{
+			// The pipeline only reaches PLAYING once the sinks got data.
+			if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_STATE_CHANGED)
+				return;
+
+			GstState newState;
+			gst_message_parse_state_changed(message, nullptr, &newState, nullptr);
+			if (newState == GST_STATE_PLAYING)
+				finishRecovery();
+			break;
+		}
+
+		default:
+			break;
+	}
+}
+
+
+void ReconnectController::finishRecovery()
+{
+	m_attemptTimer.stop();
+	m_attemptPhase = AttemptPhase::None;
+	m_reconnecting = false;
+	qint64 timeToRecoverInMs = m_interruptionTimer.elapsed();
+
+	LOG_INFO("Recovered from network interruption after %lld ms and %d attempt(s)", (long long)(timeToRecoverInMs), m_numAttempts);
+	emit recovered(timeToRecoverInMs);
+}
+
+
+void ReconnectController::scheduleRetry()
+{
+	if (m_retryTimer.isActive())
+		return;
+
+	if ((m_timeoutInMs > 0) && (m_interruptionTimer.elapsed() >= m_timeoutInMs))
+	{
+		LOG_ERROR("Could not reconnect within %d ms; giving up after %d attempt(s)", m_timeoutInMs, m_numAttempts);
+		m_reconnecting = false;
+		m_pipeline.unfreezeVideoSink();
+		emit gaveUp();
+		return;
+	}
+
+	// Exponential backoff with jitter. The delay is picked randomly
+	// between half the current backoff and the full backoff.
+	int backoffInMs = std::min(MaxBackoffInMs, InitialBackoffInMs << std::min(m_numAttempts, 16));
+	std::uniform_int_distribution<int> delayDistribution(backoffInMs / 2, backoffInMs);
+	int delayInMs = delayDistribution(m_randomEngine);
+
+	LOG_DEBUG("Next reconnect attempt in %d ms", delayInMs);
+	m_retryTimer.start(delayInMs);
+}
+
+
+void ReconnectController::retry()
+{
+	++m_numAttempts;
+	LOG_DEBUG("Reconnect attempt %d", m_numAttempts);
+
+	// Only preroll for now. Once that worked (see onBusMessage()),
+	// the sink is unfrozen and the pipeline is set to PLAYING.
+	switch (gst_element_set_state(m_pipeline.playbin(), GST_STATE_PAUSED))
+	{
+		case GST_STATE_CHANGE_FAILURE:
+			failAttempt();
+			return;
+
+		case GST_STATE_CHANGE_ASYNC:
+			m_attemptPhase = AttemptPhase::Prerolling;
+			break;
+
+		default:
+			// Live inputs return NO_PREROLL. They produce data only in
+			// PLAYING, and never post ASYNC_DONE in PAUSED, so waiting for
+			// that would hang. Go to PLAYING right away instead.
+			LOG_DEBUG("Input does not preroll; starting it right away");
+			m_attemptPhase = AttemptPhase::Starting;
+			m_pipeline.unfreezeVideoSink();
+			if (m_resumePosition > 0)
+				m_pipeline.seek(m_resumePosition);
+			if (!m_pipeline.setPaused(false))
+			{
+				failAttempt();
+				return;
+			}
+			break;
+	}
+
+	m_attemptTimer.start();
+}
+
+
+void ReconnectController::failAttempt()
+{
+	m_attemptTimer.stop();
+	m_attemptPhase = AttemptPhase::None;
+
+	// The sink is unfrozen if the attempt went to PLAYING already.
+	m_pipeline.stop();
+	m_pipeline.freezeVideoSink();
+
+	scheduleRetry();
+}
@@ -0,0 +1,97 @@
+#ifndef RECONNECT_CONTROLLER_HPP
+#define RECONNECT_CONTROLLER_HPP
+
+#include <random>
+
+#include <gst/gst.h>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+
+class Pipeline;
+
+
+// Recovers network inputs (RTSP, HTTP ...) from connection losses.
+//
+// If a network input stops with a resource error, or ends with an EOS
+// although it is live or has not reached its end yet, the controller
+// takes over: it freezes the video sink (which keeps its GL resources,
+// and the last frame stays on screen), stops the rest of the pipeline,
+// and retries with exponential backoff. The backoff delays are jittered
+// to avoid many devices reconnecting to the same server in lockstep.
+// Once the input prerolls again, the sink is unfrozen and playback
+// resumes (non-live inputs from where they were interrupted). Live
+// inputs do not preroll, so they are set to PLAYING right away, and are
+// back once the pipeline reached PLAYING. Attempts that do not get there
+// within a timeout count as failed. The time to recover is logged.
+
+class ReconnectController
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit ReconnectController(Pipeline &pipeline, QObject *parent = nullptr);
+
+	// Maximum time to try reconnecting before giving up. 0 means no limit.
+	void setTimeout(int timeoutInMs);
+
+	// Called for EOS and error messages. Returns true if the message is
+	// caused by a network interruption (or by a failed reconnect attempt),
+	// and the controller takes care of it. The caller must then not
+	// react to the message on its own.
+	bool handleInterruption(GstMessage *message);
+
+	// Stops an ongoing reconnect, for example because a different
+	// input is about to be played.
+	void cancel();
+
+	bool isReconnecting() const
+	{
+		return m_reconnecting;
+	}
+
+signals:
+	void interrupted();
+	void recovered(qint64 timeToRecoverInMs);
+	// Emitted if the timeout expired before the input could be recovered.
+	void gaveUp();
+
+
+private:
+	enum class AttemptPhase
+	{
+		None,
+		// Waiting for ASYNC_DONE in PAUSED.
+		Prerolling,
+		// Waiting for PLAYING (inputs that do not preroll).
+		Starting
+	};
+
+	bool isInterruption(GstMessage *message) const;
+	void onBusMessage(GstMessage *message);
+	void scheduleRetry();
+	void retry();
+	void failAttempt();
+	void finishRecovery();
+
+	Pipeline &m_pipeline;
+	int m_timeoutInMs = 0;
+
+	bool m_reconnecting = false;
+	int m_numAttempts = 0;
+	// Position at the time of the interruption, in nanoseconds. Inputs with
+	// a known duration are resumed from there. -1 if unknown.
+	gint64 m_resumePosition = -1;
+	AttemptPhase m_attemptPhase = AttemptPhase::None;
+	QTimer m_retryTimer;
+	QTimer m_attemptTimer;
+	QElapsedTimer m_interruptionTimer;
+
+	std::mt19937 m_randomEngine;
+};
+
+
+#endif // RECONNECT_CONTROLLER_HPP
@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <assert.h>
+
+#include <gst/video/video.h>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "ResolutionChangeMonitor.hpp"
+
+
+ResolutionChangeMonitor::~ResolutionChangeMonitor()
+{
+	if (m_videoSinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_videoSinkPad, m_capsProbeId);
+		gst_object_unref(GST_OBJECT(m_videoSinkPad));
+	}
+
+	if (m_qmlglsinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_qmlglsinkPad, m_frameProbeId);
+		gst_object_unref(GST_OBJECT(m_qmlglsinkPad));
+	}
+}
+
+
+void ResolutionChangeMonitor::attach(Pipeline &pipeline)
+{
+	assert(m_videoSinkPad == nullptr);
+	assert(pipeline.videoSink() != nullptr);
+	assert(pipeline.qmlglsink() != nullptr);
+
+	// The caps are watched at the glsinkbin, since with a fixed video
+	// size, the qmlglsink itself does not see resolution changes.
+	m_videoSinkPad = gst_element_get_static_pad(pipeline.videoSink(), "sink");
+	m_qmlglsinkPad = gst_element_get_static_pad(pipeline.qmlglsink(), "sink");
+	assert(m_videoSinkPad != nullptr);
+	assert(m_qmlglsinkPad != nullptr);
+
+	// Flush events are not part of GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+	// so they have to be requested explicitly.
+	m_capsProbeId = gst_pad_add_probe(m_videoSinkPad, GstPadProbeType(GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_EVENT_FLUSH), &staticOnCapsProbe, gpointer(this), nullptr);
+	m_frameProbeId = gst_pad_add_probe(m_qmlglsinkPad, GST_PAD_PROBE_TYPE_BUFFER, &staticOnFrameProbe, gpointer(this), nullptr);
+}
+
+
+void ResolutionChangeMonitor::logReport() const
+{
+	std::lock_guard<std::mutex> lock(m_statsMutex);
+
+	if (m_numChanges == 0)
+		return;
+
+	LOG_INFO(
+		"%u resolution change(s), frame gap: %.1f ms average, %.1f ms max",
+		m_numChanges,
+		double(m_totalGap) / m_numChanges / 1000.0,
+		m_maxGap / 1000.0
+	);
+}
+
+
+GstPadProbeReturn ResolutionChangeMonitor::staticOnCapsProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	ResolutionChangeMonitor *self = reinterpret_cast<ResolutionChangeMonitor *>(userData);
+
+	// NOTE: This is called in the streaming thread.
+
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+	switch (GST_EVENT_TYPE(event))
+	{
+		case GST_EVENT_CAPS:
+		{
+			GstCaps *caps;
+			gst_event_parse_caps(event, &caps);
+
+			GstVideoInfo videoInfo;
+			if (!gst_video_info_from_caps(&videoInfo, caps))
+				break;
+
+			gint width = GST_VIDEO_INFO_WIDTH(&videoInfo);
+			gint height = GST_VIDEO_INFO_HEIGHT(&videoInfo);
+
+			// The first caps of a stream are no resolution change.
+			if ((self->m_width != 0) && (self->m_lastFrameTime != 0) && ((width != self->m_width) || (height != self->m_height)))
+			{
+				self->m_previousWidth = self->m_width;
+				self->m_previousHeight = self->m_height;
+				self->m_changePending = true;
+			}
+
+			self->m_width = width;
+			self->m_height = height;
+			break;
+		}
+
+		case GST_EVENT_STREAM_START:
+			// A new input, or a restart; gaps due to these are not of interest.
+			self->m_width = self->m_height = 0;
+			self->m_lastFrameTime = 0;
+			self->m_changePending = false;
+			break;
+
+		case GST_EVENT_FLUSH_STOP:
+			// Seeks cause gaps of their own.
+			self->m_lastFrameTime = 0;
+			self->m_changePending = false;
+			break;
+
+		default:
+			break;
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+GstPadProbeReturn ResolutionChangeMonitor::staticOnFrameProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	ResolutionChangeMonitor *self = reinterpret_cast<ResolutionChangeMonitor *>(userData);
+
+	// NOTE: This is called in the streaming thread.
+
+	gint64 now = g_get_monotonic_time();
+
+	if (self->m_changePending)
+	{
+		self->m_changePending = false;
+
+		gint64 gap = now - self->m_lastFrameTime;
+		GstClockTime frameDuration = GST_BUFFER_DURATION(GST_PAD_PROBE_INFO_BUFFER(info));
+
+		LOG_INFO(
+			"Resolution change %dx%d -> %dx%d: %.1f ms between frames (frame duration %.1f ms)",
+			self->m_previousWidth,
+			self->m_previousHeight,
+			self->m_width,
+			self->m_height,
+			gap / 1000.0,
+			GST_CLOCK_TIME_IS_VALID(frameDuration) ? (double(frameDuration) / GST_MSECOND) : 0.0
+		);
+
+		std::lock_guard<std::mutex> lock(self->m_statsMutex);
+		++self->m_numChanges;
+		self->m_totalGap += gap;
+		self->m_maxGap = std::max(self->m_maxGap, gap);
+	}
+
+	self->m_lastFrameTime = now;
+
+	return GST_PAD_PROBE_OK;
+}
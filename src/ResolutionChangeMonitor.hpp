@@ -0,0 +1,59 @@
+#ifndef RESOLUTION_CHANGE_MONITOR_HPP
+#define RESOLUTION_CHANGE_MONITOR_HPP
+
+#include <mutex>
+
+#include <gst/gst.h>
+
+
+class Pipeline;
+
+
+// Measures the gap in the video output around resolution changes.
+//
+// Adaptive streams switch resolution when they switch variants, and
+// cameras can be reconfigured while streaming. Each such change makes the
+// video sink renegotiate and reallocate its buffers, which shows up as a
+// stall or flash. The monitor watches the caps arriving at the video sink,
+// and when the resolution changes, measures the time between the last frame
+// of the old resolution and the first frame of the new one reaching the
+// qmlglsink. Each change is logged with its gap and the regular frame
+// duration; logReport() summarizes all changes.
+
+class ResolutionChangeMonitor
+{
+public:
+	~ResolutionChangeMonitor();
+
+	void attach(Pipeline &pipeline);
+
+	void logReport() const;
+
+
+private:
+	static GstPadProbeReturn staticOnCapsProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	static GstPadProbeReturn staticOnFrameProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+
+	GstPad *m_videoSinkPad = nullptr;
+	GstPad *m_qmlglsinkPad = nullptr;
+	gulong m_capsProbeId = 0;
+	gulong m_frameProbeId = 0;
+
+	// Streaming thread side state. Both probes are called in the
+	// same streaming thread, since glsinkbin has no queues inside.
+	gint m_width = 0;
+	gint m_height = 0;
+	gint m_previousWidth = 0;
+	gint m_previousHeight = 0;
+	bool m_changePending = false;
+	// Monotonic time of the last frame, in microseconds.
+	gint64 m_lastFrameTime = 0;
+
+	mutable std::mutex m_statsMutex;
+	unsigned int m_numChanges = 0;
+	gint64 m_totalGap = 0;
+	gint64 m_maxGap = 0;
+};
+
+
+#endif // RESOLUTION_CHANGE_MONITOR_HPP
@@ -0,0 +1,173 @@
+#include <algorithm>
+#include <thread>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "ReadAheadFileSrc.hpp"
+#include "ResourceScaler.hpp"
+#include "StillImageItem.hpp"
+#include "Utils.hpp"
+
+
+namespace
+{
+
+
+// Under memory pressure, the texture cache gets a quarter of its budget.
+constexpr std::size_t ImageCacheBudgetDivisor = 4;
+// playbin network buffering limits under memory pressure
+// (by default, queue2 buffers up to 2 MB and 2 seconds).
+constexpr gint LowBufferSizeInBytes = 512 * 1024;
+constexpr gint64 LowBufferDuration = 500 * GST_MSECOND;
+// Under I/O pressure, the read-ahead file source reads this much further ahead.
+constexpr guint64 ReadaheadSizeFactor = 4;
+
+
+} // unnamed namespace end
+
+
+ResourceScaler::ResourceScaler(Pipeline &pipeline, StillImageItem *stillImageItem, PressureMonitor &pressureMonitor, QObject *parent)
+	: QObject(parent)
+	, m_pipeline(pipeline)
+	, m_stillImageItem(stillImageItem)
+	, m_pressureMonitor(pressureMonitor)
+	, m_normalImageCacheBudget(64 * 1024 * 1024)
+{
+	connect(&m_pressureMonitor, &PressureMonitor::pressureChanged, this, &ResourceScaler::onPressureChanged);
+
+	m_pipeline.addSourceSetupHandler([this](GstElement *source) {
+		onSourceSetup(source);
+	});
+
+	m_pipeline.addElementSetupHandler([this](GstElement *element) {
+		onElementSetup(element);
+	});
+}
+
+
+ResourceScaler::~ResourceScaler()
+{
+	if (m_readAheadSource != nullptr)
+		gst_object_unref(GST_OBJECT(m_readAheadSource));
+}
+
+
+void ResourceScaler::setNormalImageCacheBudget(std::size_t budgetInBytes)
+{
+	m_normalImageCacheBudget = budgetInBytes;
+}
+
+
+void ResourceScaler::onPressureChanged(PressureMonitor::Resource resource, bool underPressure)
+{
+	switch (resource)
+	{
+		case PressureMonitor::Memory:
+			applyMemoryPressure(underPressure);
+			break;
+
+		case PressureMonitor::Cpu:
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_cpuUnderPressure = underPressure;
+			break;
+		}
+
+		case PressureMonitor::Io:
+			applyIoPressure(underPressure);
+			break;
+
+		default:
+			break;
+	}
+}
+
+
+void ResourceScaler::onSourceSetup(GstElement *source)
+{
+	if (!G_TYPE_CHECK_INSTANCE_TYPE(source, GST_TYPE_READ_AHEAD_FILE_SRC))
+		return;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_readAheadSource != nullptr)
+		gst_object_unref(GST_OBJECT(m_readAheadSource));
+	m_readAheadSource = GST_ELEMENT(gst_object_ref(GST_OBJECT(source)));
+
+	g_object_get(source, "readahead-size", &m_normalReadaheadSize, nullptr);
+	if (m_ioUnderPressure)
+		g_object_set(source, "readahead-size", guint64(m_normalReadaheadSize * ReadaheadSizeFactor), nullptr);
+}
+
+
+void ResourceScaler::onElementSetup(GstElement *element)
+{
+	GstElementFactory *factory = gst_element_get_factory(element);
+	if ((factory == nullptr) || !gst_element_factory_list_is_type(factory, GST_ELEMENT_FACTORY_TYPE_DECODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO))
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_cpuUnderPressure)
+			return;
+	}
+
+	// Use half of the cores, leaving the rest to the other services.
+	gint numThreads = gint(std::max(1u, std::thread::hardware_concurrency() / 2));
+
+	// avdec_* calls it max-threads, dav1ddec n-threads.
+	if (hasProperty(element, "max-threads"))
+		g_object_set(element, "max-threads", numThreads, nullptr);
+	else if (hasProperty(element, "n-threads"))
+		g_object_set(element, "n-threads", guint(numThreads), nullptr);
+	else
+		return;
+
+	LOG_INFO("CPU pressure: limiting %s to %d decoding threads", GST_OBJECT_NAME(factory), numThreads);
+}
+
+
+void ResourceScaler::applyMemoryPressure(bool underPressure)
+{
+	std::size_t imageCacheBudget = underPressure ? (m_normalImageCacheBudget / ImageCacheBudgetDivisor) : m_normalImageCacheBudget;
+	m_stillImageItem->setCacheBudget(imageCacheBudget);
+
+	// -1 selects the playbin defaults. The new limits apply to
+	// the queues that playbin creates for the next input.
+	g_object_set(
+		m_pipeline.playbin(),
+		"buffer-size", underPressure ? LowBufferSizeInBytes : gint(-1),
+		"buffer-duration", underPressure ? LowBufferDuration : gint64(-1),
+		nullptr
+	);
+
+#ifdef __GLIBC__
+	// glibc keeps freed memory around for later allocations. Return it
+	// to the system, so it is available to the other processes.
+	if (underPressure)
+		malloc_trim(0);
+#endif
+
+	LOG_INFO("Memory pressure %s: image cache budget is now %zu kB", underPressure ? "detected" : "gone", imageCacheBudget / 1024);
+}
+
+
+void ResourceScaler::applyIoPressure(bool underPressure)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	m_ioUnderPressure = underPressure;
+
+	// The read-ahead size can be changed while playing.
+	if ((m_readAheadSource == nullptr) || (m_normalReadaheadSize == 0))
+		return;
+
+	guint64 readaheadSize = underPressure ? (m_normalReadaheadSize * ReadaheadSizeFactor) : m_normalReadaheadSize;
+	g_object_set(m_readAheadSource, "readahead-size", readaheadSize, nullptr);
+
+	LOG_INFO("I/O pressure %s: read-ahead size is now %llu kB", underPressure ? "detected" : "gone", (unsigned long long)(readaheadSize / 1024));
+}
@@ -0,0 +1,65 @@
+#ifndef RESOURCE_SCALER_HPP
+#define RESOURCE_SCALER_HPP
+
+#include <cstddef>
+#include <mutex>
+
+#include <gst/gst.h>
+
+#include <QObject>
+
+#include "PressureMonitor.hpp"
+
+
+class Pipeline;
+class StillImageItem;
+
+
+// Adapts the resource usage of the player to the pressure reported by
+// a PressureMonitor, to avoid getting OOM-killed or starved on devices
+// that are shared with other services:
+//
+// - Memory pressure: the texture cache of still images and the network
+//   buffering limits of playbin are shrunk, and freed heap memory is
+//   returned to the system.
+// - CPU pressure: decoders are created with fewer threads. (Decoders set
+//   up their threads when they start, so this affects the next input.)
+// - I/O pressure: the read-ahead file source reads further ahead.
+//
+// Everything is restored once the pressure is gone.
+
+class ResourceScaler
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit ResourceScaler(Pipeline &pipeline, StillImageItem *stillImageItem, PressureMonitor &pressureMonitor, QObject *parent = nullptr);
+	~ResourceScaler() override;
+
+	// The texture cache budget to use while there is no memory pressure.
+	void setNormalImageCacheBudget(std::size_t budgetInBytes);
+
+
+private:
+	void onPressureChanged(PressureMonitor::Resource resource, bool underPressure);
+	void onSourceSetup(GstElement *source);
+	void onElementSetup(GstElement *element);
+	void applyMemoryPressure(bool underPressure);
+	void applyIoPressure(bool underPressure);
+
+	Pipeline &m_pipeline;
+	StillImageItem *m_stillImageItem;
+	PressureMonitor &m_pressureMonitor;
+	std::size_t m_normalImageCacheBudget;
+
+	// Accessed by setup handlers, which may run in streaming threads.
+	std::mutex m_mutex;
+	bool m_cpuUnderPressure = false;
+	bool m_ioUnderPressure = false;
+	GstElement *m_readAheadSource = nullptr;
+	guint64 m_normalReadaheadSize = 0;
+};
+
+
+#endif // RESOURCE_SCALER_HPP
@@ -0,0 +1,352 @@
+#include <algorithm>
+
+#include <unistd.h>
+
+#include <gst/gst.h>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "PlayerController.hpp"
+#include "PlaylistPlayer.hpp"
+#include "SoakTest.hpp"
+
+
+namespace
+{
+
+
+// The baseline is sampled after this warmup phase, or after
+// a fifth of the total duration, whichever is shorter.
+constexpr int MaxWarmupInSeconds = 60;
+
+
+qint64 readRssInKB()
+{
+	// The second field in statm is the resident set size in pages.
+	QFile file("/proc/self/statm");
+	if (!file.open(QIODevice::ReadOnly))
+		return -1;
+
+	QList<QByteArray> fields = file.readAll().split(' ');
+	if (fields.size() < 2)
+		return -1;
+
+	return fields[1].toLongLong() * sysconf(_SC_PAGESIZE) / 1024;
+}
+
+
+int readNumThreads()
+{
+	QFile file("/proc/self/status");
+	if (!file.open(QIODevice::ReadOnly))
+		return -1;
+
+	while (!file.atEnd())
+	{
+		QByteArray line = file.readLine();
+		if (line.startsWith("Threads:"))
+			return line.mid(8).trimmed().toInt();
+	}
+
+	return -1;
+}
+
+
+int readNumFds()
+{
+	return int(QDir("/proc/self/fd").entryList(QDir::NoDotAndDotDot | QDir::AllEntries | QDir::System).size());
+}
+
+
+void readNumGstObjects(int &numGstObjects, int &numGLObjects)
+{
+	numGstObjects = -1;
+	numGLObjects = -1;
+
+#if GST_CHECK_VERSION(1, 18, 0)
+	GList *tracers = gst_tracing_get_active_tracers();
+
+	for (GList *tracerIter = tracers; tracerIter != nullptr; tracerIter = tracerIter->next)
+	{
+		GstTracer *tracer = GST_TRACER(tracerIter->data);
+		if (g_strcmp0(G_OBJECT_TYPE_NAME(tracer), "GstLeaksTracer") != 0)
+			continue;
+
+		GstStructure *liveObjects = nullptr;
+		g_signal_emit_by_name(tracer, "get-live-objects", &liveObjects);
+		if (liveObjects == nullptr)
+			break;
+
+		GValue const *list = gst_structure_get_value(liveObjects, "live-objects-list");
+		if (list != nullptr)
+		{
+			numGstObjects = int(gst_value_list_get_size(list));
+			numGLObjects = 0;
+
+			for (guint i = 0; i < gst_value_list_get_size(list); ++i)
+			{
+				GstStructure const *objectInfo = gst_value_get_structure(gst_value_list_get_value(list, i));
+				gchar const *typeName = gst_structure_get_string(objectInfo, "type-name");
+				if ((typeName != nullptr) && g_str_has_prefix(typeName, "GstGL"))
+					++numGLObjects;
+			}
+		}
+
+		gst_structure_free(liveObjects);
+		break;
+	}
+
+	g_list_free_full(tracers, gst_object_unref);
+#endif
+}
+
+
+} // unnamed namespace end
+
+
+SoakTest::SoakTest(Pipeline &pipeline, PlaylistPlayer &playlistPlayer, PlayerController &playerController, QObject *parent)
+	: QObject(parent)
+	, m_pipeline(pipeline)
+	, m_playlistPlayer(playlistPlayer)
+	, m_playerController(playerController)
+	, m_randomEngine(std::random_device()())
+{
+	m_actionTimer.setInterval(2000);
+	connect(&m_actionTimer, &QTimer::timeout, this, &SoakTest::onAction);
+
+	m_sampleTimer.setInterval(SampleIntervalInMs);
+	connect(&m_sampleTimer, &QTimer::timeout, this, &SoakTest::onSample);
+}
+
+
+void SoakTest::setDuration(int durationInSeconds)
+{
+	m_durationInSeconds = durationInSeconds;
+}
+
+
+void SoakTest::setActionInterval(int intervalInMs)
+{
+	m_actionTimer.setInterval(intervalInMs);
+}
+
+
+void SoakTest::setBounds(Bounds const &bounds)
+{
+	m_bounds = bounds;
+}
+
+
+bool SoakTest::parseBounds(QString const &string, Bounds &bounds)
+{
+	Bounds newBounds = bounds;
+
+	for (QString const &item : string.split(',', QString::SkipEmptyParts))
+	{
+		QStringList keyValue = item.split('=');
+		if (keyValue.size() != 2)
+			return false;
+
+		bool ok;
+		int value = keyValue[1].trimmed().toInt(&ok);
+		if (!ok || (value < 0))
+			return false;
+
+		QString key = keyValue[0].trimmed();
+		if (key == "rss")
+			newBounds.m_rssInKB = qint64(value) * 1024;
+		else if (key == "fds")
+			newBounds.m_numFds = value;
+		else if (key == "threads")
+			newBounds.m_numThreads = value;
+		else if (key == "gstobjects")
+			newBounds.m_numGstObjects = value;
+		else if (key == "globjects")
+			newBounds.m_numGLObjects = value;
+		else
+			return false;
+	}
+
+	bounds = newBounds;
+	return true;
+}
+
+
+SoakTest::Sample SoakTest::takeSample()
+{
+	Sample sample;
+	sample.m_rssInKB = readRssInKB();
+	sample.m_numFds = readNumFds();
+	sample.m_numThreads = readNumThreads();
+	readNumGstObjects(sample.m_numGstObjects, sample.m_numGLObjects);
+	return sample;
+}
+
+
+void SoakTest::start()
+{
+	LOG_INFO("Starting soak test; duration: %d s, action interval: %d ms", m_durationInSeconds, m_actionTimer.interval());
+
+	m_lastSample = takeSample();
+	if (m_lastSample.m_numGstObjects < 0)
+		LOG_WARNING("GStreamer leaks tracer is not active; GStreamer and GL objects are not sampled");
+
+	m_elapsedTimer.start();
+	m_actionTimer.start();
+	m_sampleTimer.start();
+}
+
+
+void SoakTest::onAction()
+{
+	++m_numActions;
+
+	std::uniform_int_distribution<int> actionDistribution(0, 4);
+	int action = actionDistribution(m_randomEngine);
+
+	switch (action)
+	{
+		case 0:
+		{
+			// Seek to a random position.
+			qint64 duration = m_playerController.duration();
+			if (duration > 0)
+			{
+				std::uniform_int_distribution<qint64> positionDistribution(0, duration - 1);
+				qint64 position = positionDistribution(m_randomEngine);
+				LOG_DEBUG("Soak test action: seek to %lld ms", (long long)(position));
+				m_playerController.seek(position);
+			}
+			break;
+		}
+
+		case 1:
+			LOG_DEBUG("Soak test action: toggle pause");
+			if (m_playerController.state() == PlayerController::Playing)
+				m_playerController.pause();
+			else
+				m_playerController.resume();
+			break;
+
+		case 2:
+		{
+			// Switch to a random playlist entry.
+			std::uniform_int_distribution<int> indexDistribution(0, int(m_playlistPlayer.playlist().size()) - 1);
+			int index = indexDistribution(m_randomEngine);
+			LOG_DEBUG("Soak test action: switch to playlist entry %d", index);
+			m_playlistPlayer.playEntry(index);
+			break;
+		}
+
+		case 3:
+		{
+			// While an image is shown, the pipeline is stopped, but still
+			// has the URI of the previous video, which restart() would play
+			// again. Restart the image entry instead.
+			int index = m_playlistPlayer.currentIndex();
+			if ((index >= 0) && (m_playlistPlayer.playlist()[index].m_type == PlaylistEntry::Type::Image))
+			{
+				LOG_DEBUG("Soak test action: restart image entry %d", index);
+				m_playlistPlayer.playEntry(index);
+			}
+			else
+			{
+				LOG_DEBUG("Soak test action: restart pipeline");
+				m_pipeline.restart();
+			}
+			break;
+		}
+
+		default:
+			LOG_DEBUG("Soak test action: next playlist entry");
+			m_playlistPlayer.next();
+			break;
+	}
+}
+
+
+void SoakTest::onSample()
+{
+	m_lastSample = takeSample();
+
+	LOG_INFO(
+		"Soak test sample at %lld s: RSS %lld kB, %d fds, %d threads, %d GStreamer objects, %d GL objects, %d actions",
+		(long long)(m_elapsedTimer.elapsed() / 1000),
+		(long long)(m_lastSample.m_rssInKB),
+		m_lastSample.m_numFds,
+		m_lastSample.m_numThreads,
+		m_lastSample.m_numGstObjects,
+		m_lastSample.m_numGLObjects,
+		m_numActions
+	);
+
+	qint64 elapsedInSeconds = m_elapsedTimer.elapsed() / 1000;
+	int warmupInSeconds = std::min(MaxWarmupInSeconds, m_durationInSeconds / 5);
+
+	if (!m_haveBaseline)
+	{
+		if (elapsedInSeconds >= warmupInSeconds)
+		{
+			m_baseline = m_lastSample;
+			m_haveBaseline = true;
+			LOG_INFO("Soak test baseline taken");
+		}
+	}
+	else
+		checkBounds(m_lastSample, false);
+
+	if (elapsedInSeconds >= m_durationInSeconds)
+		finish();
+}
+
+
+void SoakTest::finish()
+{
+	m_actionTimer.stop();
+	m_sampleTimer.stop();
+
+	bool success = m_haveBaseline && checkBounds(m_lastSample, true);
+	if (!m_haveBaseline)
+		LOG_ERROR("Soak test finished before a baseline could be taken");
+
+	LOG_INFO("Soak test %s after %d actions", success ? "PASSED" : "FAILED", m_numActions);
+
+	emit finished(success);
+	QCoreApplication::exit(success ? 0 : 1);
+}
+
+
+bool SoakTest::checkBounds(Sample const &sample, bool isFinalCheck) const
+{
+	bool withinBounds = true;
+
+	auto check = [&](char const *name, qint64 baselineValue, qint64 value, qint64 bound) {
+		// Resources that could not be sampled are not checked.
+		if ((baselineValue < 0) || (value < 0))
+			return;
+
+		qint64 growth = value - baselineValue;
+		if (growth > bound)
+		{
+			withinBounds = false;
+			if (isFinalCheck)
+				LOG_ERROR("%s grew by %lld (from %lld to %lld), which exceeds the bound of %lld", name, (long long)(growth), (long long)(baselineValue), (long long)(value), (long long)(bound));
+			else
+				LOG_WARNING("%s currently exceeds its bound (growth: %lld, bound: %lld)", name, (long long)(growth), (long long)(bound));
+		}
+	};
+
+	check("RSS (kB)", m_baseline.m_rssInKB, sample.m_rssInKB, m_bounds.m_rssInKB);
+	check("Number of file descriptors", m_baseline.m_numFds, sample.m_numFds, m_bounds.m_numFds);
+	check("Number of threads", m_baseline.m_numThreads, sample.m_numThreads, m_bounds.m_numThreads);
+	check("Number of GStreamer objects", m_baseline.m_numGstObjects, sample.m_numGstObjects, m_bounds.m_numGstObjects);
+	check("Number of GL objects", m_baseline.m_numGLObjects, sample.m_numGLObjects, m_bounds.m_numGLObjects);
+
+	return withinBounds;
+}
@@ -0,0 +1,103 @@
+#ifndef SOAK_TEST_HPP
+#define SOAK_TEST_HPP
+
+#include <random>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+
+class Pipeline;
+class PlayerController;
+class PlaylistPlayer;
+
+
+// Long-running stress test for finding resource leaks.
+//
+// The soak test repeatedly pauses, resumes, seeks, switches inputs, and
+// restarts the pipeline at a pace that is much faster than regular use.
+// Meanwhile, it periodically samples the process' resource usage. After
+// a warmup phase, the first sample becomes the baseline; if any resource
+// grows beyond its bound relative to the baseline, the test fails.
+//
+// If the GStreamer leaks tracer is active (GST_TRACERS=leaks), the number
+// of live GStreamer objects (and, among them, GL objects) is sampled too.
+
+class SoakTest
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	// Resource usage is sampled in this interval.
+	static constexpr int SampleIntervalInMs = 5000;
+
+	struct Bounds
+	{
+		// Maximum allowed growth relative to the baseline.
+		qint64 m_rssInKB = 32 * 1024;
+		int m_numFds = 8;
+		int m_numThreads = 8;
+		int m_numGstObjects = 200;
+		int m_numGLObjects = 20;
+	};
+
+	struct Sample
+	{
+		qint64 m_rssInKB = -1;
+		int m_numFds = -1;
+		int m_numThreads = -1;
+		// -1 if the leaks tracer is not active.
+		int m_numGstObjects = -1;
+		int m_numGLObjects = -1;
+	};
+
+	explicit SoakTest(Pipeline &pipeline, PlaylistPlayer &playlistPlayer, PlayerController &playerController, QObject *parent = nullptr);
+
+	void setDuration(int durationInSeconds);
+	void setActionInterval(int intervalInMs);
+	void setBounds(Bounds const &bounds);
+
+	// Parses bounds in the form "rss=<MB>,fds=<n>,threads=<n>,gstobjects=<n>,globjects=<n>".
+	// Keys that are not present keep their value.
+	static bool parseBounds(QString const &string, Bounds &bounds);
+
+	static Sample takeSample();
+
+	// Starts the test. Once it is finished, the application
+	// quits with exit code 0 on success, or 1 on failure.
+	void start();
+
+signals:
+	void finished(bool success);
+
+
+private:
+	void onAction();
+	void onSample();
+	void finish();
+	bool checkBounds(Sample const &sample, bool isFinalCheck) const;
+
+	Pipeline &m_pipeline;
+	PlaylistPlayer &m_playlistPlayer;
+	PlayerController &m_playerController;
+
+	int m_durationInSeconds = 3600;
+	Bounds m_bounds;
+
+	QTimer m_actionTimer;
+	QTimer m_sampleTimer;
+	QElapsedTimer m_elapsedTimer;
+
+	bool m_haveBaseline = false;
+	Sample m_baseline;
+	Sample m_lastSample;
+	int m_numActions = 0;
+
+	std::mt19937 m_randomEngine;
+};
+
+
+#endif // SOAK_TEST_HPP
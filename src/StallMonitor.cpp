@@ -0,0 +1,412 @@
+#include <assert.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+
+#include <execinfo.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <QDebug>
+#include <QQuickWindow>
+#include <QScreen>
+#include <QVariantList>
+
+#include "Log.hpp"
+#include "StallMonitor.hpp"
+
+
+namespace
+{
+
+
+// Interval of the GUI thread heartbeat timer.
+constexpr int HeartbeatIntervalInMs = 20;
+// How often the watchdog checks for stalled threads.
+constexpr std::chrono::milliseconds WatchdogInterval(10);
+// Signal used for interrupting a stalled thread to sample its stack.
+int const StackSampleSignal = SIGUSR2;
+
+
+// Stack sample written by the signal handler. Only one sample
+// is taken at a time (by the watchdog thread).
+void *stackSampleFrames[StallMonitor::MaxStackDepth];
+std::atomic<int> stackSampleDepth(-1);
+
+
+void stackSampleSignalHandler(int)
+{
+	// backtrace() is not formally async-signal-safe, but it is in practice
+	// once it was called at least once (the first call may load libgcc).
+	// This is ensured in StallMonitor::start().
+	int depth = backtrace(stackSampleFrames, StallMonitor::MaxStackDepth);
+	stackSampleDepth.store(depth, std::memory_order_release);
+}
+
+
+int histogramBucket(std::int64_t latenessInMs)
+{
+	int bucket = 0;
+	while ((latenessInMs > 0) && (bucket < (StallMonitor::NumHistogramBuckets - 1)))
+	{
+		latenessInMs >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+
+
+char const * threadName(StallMonitor::MonitoredThread thread)
+{
+	return (thread == StallMonitor::MonitoredThread::Gui) ? "GUI" : "render";
+}
+
+
+} // unnamed namespace end
+
+
+StallMonitor::StallMonitor(int thresholdInMs, bool sampleStacks, QObject *parent)
+	: QObject(parent)
+	, m_thresholdInMs(thresholdInMs)
+	, m_sampleStacks(sampleStacks)
+	, m_watchdogRunning(false)
+{
+	for (auto &threadState : m_threadStates)
+	{
+		for (auto &bucket : threadState.m_histogram)
+			bucket = 0;
+		threadState.m_activityStart = -1;
+		threadState.m_stackSampled = false;
+		threadState.m_threadHandleValid = false;
+	}
+
+	m_heartbeatTimer.setTimerType(Qt::PreciseTimer);
+	m_heartbeatTimer.setInterval(HeartbeatIntervalInMs);
+	connect(&m_heartbeatTimer, &QTimer::timeout, this, &StallMonitor::onGuiHeartbeat);
+}
+
+
+StallMonitor::~StallMonitor()
+{
+	stop();
+}
+
+
+bool StallMonitor::start(QQuickWindow *window)
+{
+	assert(window != nullptr);
+
+	m_window = window;
+	m_clock.start();
+
+	if (window->screen() != nullptr)
+	{
+		qreal refreshRate = window->screen()->refreshRate();
+		if (refreshRate > 0)
+			m_refreshIntervalInMs = std::int64_t(1000.0 / refreshRate + 0.5);
+	}
+
+	ThreadState &guiState = m_threadStates[int(MonitoredThread::Gui)];
+	guiState.m_threadHandle = pthread_self();
+	guiState.m_threadHandleValid = true;
+	m_lastHeartbeat = 0;
+	guiState.m_activityStart = 0;
+	m_heartbeatTimer.start();
+
+	// These signals are emitted in the render thread. The direct
+	// connection ensures that the slots are called in that thread.
+	connect(window, &QQuickWindow::beforeSynchronizing, this, &StallMonitor::onRenderFrameStart, Qt::DirectConnection);
+	connect(window, &QQuickWindow::frameSwapped, this, &StallMonitor::onRenderFrameSwapped, Qt::DirectConnection);
+
+	if (m_sampleStacks)
+	{
+		struct sigaction newSigaction;
+		sigemptyset(&newSigaction.sa_mask);
+		newSigaction.sa_handler = stackSampleSignalHandler;
+		newSigaction.sa_flags = SA_RESTART;
+
+		if (sigaction(StackSampleSignal, &newSigaction, nullptr) < 0)
+		{
+			qCritical() << "Could not set up stack sample signal handler:" << std::strerror(errno);
+			return false;
+		}
+
+		// Call backtrace() once to make sure it is fully
+		// initialized before it is used in the signal handler.
+		void *dummyFrames[1];
+		backtrace(dummyFrames, 1);
+
+		m_watchdogRunning = true;
+		m_watchdogThread = std::thread([this]() { watchdogLoop(); });
+	}
+
+	LOG_INFO("Stall monitor started; threshold: %d ms, refresh interval: %d ms", m_thresholdInMs, int(m_refreshIntervalInMs));
+
+	return true;
+}
+
+
+void StallMonitor::stop()
+{
+	m_heartbeatTimer.stop();
+
+	if (m_window != nullptr)
+	{
+		disconnect(m_window, nullptr, this, nullptr);
+		m_window = nullptr;
+	}
+
+	if (m_watchdogThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_watchdogMutex);
+			m_watchdogRunning = false;
+		}
+		m_watchdogCondition.notify_one();
+		m_watchdogThread.join();
+		signal(StackSampleSignal, SIG_DFL);
+	}
+}
+
+
+void StallMonitor::setIdle(bool idle)
+{
+	if (m_window == nullptr)
+		return;
+
+	ThreadState &guiState = m_threadStates[int(MonitoredThread::Gui)];
+	if (idle)
+	{
+		m_heartbeatTimer.stop();
+		guiState.m_activityStart = -1;
+	}
+	else
+	{
+		m_lastHeartbeat = m_clock.elapsed();
+		guiState.m_activityStart = m_lastHeartbeat;
+		m_heartbeatTimer.start();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_watchdogMutex);
+		m_idle = idle;
+	}
+	m_watchdogCondition.notify_one();
+}
+
+
+std::array<std::uint64_t, StallMonitor::NumHistogramBuckets> StallMonitor::histogram(MonitoredThread thread) const
+{
+	std::array<std::uint64_t, NumHistogramBuckets> result;
+	auto const &threadState = m_threadStates[int(thread)];
+	for (int i = 0; i < NumHistogramBuckets; ++i)
+		result[i] = threadState.m_histogram[i].load(std::memory_order_relaxed);
+	return result;
+}
+
+
+std::vector<StallMonitor::Stall> StallMonitor::stalls() const
+{
+	std::lock_guard<std::mutex> lock(m_stallsMutex);
+	return m_stalls;
+}
+
+
+QVariantMap StallMonitor::report() const
+{
+	QVariantMap result;
+
+	for (MonitoredThread thread : { MonitoredThread::Gui, MonitoredThread::Render })
+	{
+		QVariantList buckets;
+		for (std::uint64_t count : histogram(thread))
+			buckets << QVariant::fromValue(quint64(count));
+		result[QString(threadName(thread)) + "Histogram"] = buckets;
+	}
+
+	std::lock_guard<std::mutex> lock(m_stallsMutex);
+	result["numStalls"] = int(m_stalls.size());
+
+	return result;
+}
+
+
+void StallMonitor::logReport() const
+{
+	for (MonitoredThread thread : { MonitoredThread::Gui, MonitoredThread::Render })
+	{
+		LOG_INFO("Lateness histogram of the %s thread:", threadName(thread));
+
+		auto threadHistogram = histogram(thread);
+		for (int i = 0; i < NumHistogramBuckets; ++i)
+		{
+			if (threadHistogram[i] == 0)
+				continue;
+
+			int lowerLimit = (i == 0) ? 0 : (1 << (i - 1));
+			if (i == (NumHistogramBuckets - 1))
+				LOG_INFO("  >= %5d ms: %llu", lowerLimit, (unsigned long long)(threadHistogram[i]));
+			else
+				LOG_INFO("  %5d - %5d ms: %llu", lowerLimit, 1 << i, (unsigned long long)(threadHistogram[i]));
+		}
+	}
+
+	std::vector<Stall> recordedStalls = stalls();
+	LOG_INFO("%d stall(s) above %d ms recorded", int(recordedStalls.size()), m_thresholdInMs);
+
+	for (Stall const &stall : recordedStalls)
+	{
+		LOG_INFO("  %s thread stalled for %lld ms at %lld ms", threadName(stall.m_thread), (long long)(stall.m_latenessInMs), (long long)(stall.m_timestamp));
+
+		if (stall.m_stack.empty())
+			continue;
+
+		char **symbols = backtrace_symbols(stall.m_stack.data(), int(stall.m_stack.size()));
+		if (symbols == nullptr)
+			continue;
+		for (std::size_t i = 0; i < stall.m_stack.size(); ++i)
+			LOG_INFO("    #%d %s", int(i), symbols[i]);
+		free(symbols);
+	}
+}
+
+
+void StallMonitor::onGuiHeartbeat()
+{
+	std::int64_t now = m_clock.elapsed();
+	std::int64_t lateness = now - m_lastHeartbeat - HeartbeatIntervalInMs;
+	m_lastHeartbeat = now;
+	m_threadStates[int(MonitoredThread::Gui)].m_activityStart = now;
+
+	record(MonitoredThread::Gui, std::max(lateness, std::int64_t(0)));
+}
+
+
+void StallMonitor::onRenderFrameStart()
+{
+	ThreadState &renderState = m_threadStates[int(MonitoredThread::Render)];
+	if (!renderState.m_threadHandleValid)
+	{
+		renderState.m_threadHandle = pthread_self();
+		renderState.m_threadHandleValid = true;
+	}
+
+	m_frameStart = m_clock.elapsed();
+	renderState.m_activityStart = m_frameStart;
+}
+
+
+void StallMonitor::onRenderFrameSwapped()
+{
+	ThreadState &renderState = m_threadStates[int(MonitoredThread::Render)];
+	if (renderState.m_activityStart < 0)
+		return;
+
+	std::int64_t frameDuration = m_clock.elapsed() - m_frameStart;
+	renderState.m_activityStart = -1;
+
+	// The swap may block until the next vsync, so anything
+	// up to one refresh interval is not considered late.
+	record(MonitoredThread::Render, std::max(frameDuration - m_refreshIntervalInMs, std::int64_t(0)));
+}
+
+
+void StallMonitor::record(MonitoredThread thread, std::int64_t latenessInMs)
+{
+	ThreadState &threadState = m_threadStates[int(thread)];
+
+	threadState.m_histogram[histogramBucket(latenessInMs)].fetch_add(1, std::memory_order_relaxed);
+
+	if (latenessInMs >= m_thresholdInMs)
+	{
+		Stall stall;
+		stall.m_thread = thread;
+		stall.m_timestamp = m_clock.elapsed() - latenessInMs;
+		stall.m_latenessInMs = latenessInMs;
+
+		{
+			std::lock_guard<std::mutex> lock(m_stallsMutex);
+			stall.m_stack = std::move(threadState.m_pendingStack);
+			threadState.m_pendingStack.clear();
+			m_stalls.push_back(std::move(stall));
+		}
+
+		LOG_RATE_LIMITED(LogLevel::Warning, 5, 1000, "%s thread stalled for %lld ms", threadName(thread), (long long)(latenessInMs));
+		emit stallDetected(int(thread), latenessInMs);
+	}
+	else if (threadState.m_stackSampled)
+	{
+		// The thread recovered before reaching the threshold
+		// after all; discard the stack that was sampled meanwhile.
+		std::lock_guard<std::mutex> lock(m_stallsMutex);
+		threadState.m_pendingStack.clear();
+	}
+
+	threadState.m_stackSampled = false;
+}
+
+
+void StallMonitor::watchdogLoop()
+{
+	while (m_watchdogRunning)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_watchdogMutex);
+			m_watchdogCondition.wait_for(lock, WatchdogInterval);
+			m_watchdogCondition.wait(lock, [this]() { return !m_idle || !m_watchdogRunning; });
+		}
+
+		if (!m_watchdogRunning)
+			break;
+
+		std::int64_t now = m_clock.elapsed();
+
+		for (MonitoredThread thread : { MonitoredThread::Gui, MonitoredThread::Render })
+		{
+			ThreadState &threadState = m_threadStates[int(thread)];
+			std::int64_t activityStart = threadState.m_activityStart;
+			if ((activityStart < 0) || !threadState.m_threadHandleValid || threadState.m_stackSampled)
+				continue;
+
+			// The GUI thread is expected to wake up once per heartbeat interval.
+			// The render thread is expected to finish a frame within one refresh interval.
+			std::int64_t expectedDuration = (thread == MonitoredThread::Gui) ? HeartbeatIntervalInMs : m_refreshIntervalInMs;
+			if ((now - activityStart - expectedDuration) >= m_thresholdInMs)
+			{
+				threadState.m_stackSampled = true;
+				sampleStack(thread);
+			}
+		}
+	}
+}
+
+
+void StallMonitor::sampleStack(MonitoredThread thread)
+{
+	ThreadState &threadState = m_threadStates[int(thread)];
+
+	stackSampleDepth.store(-1, std::memory_order_relaxed);
+	if (pthread_kill(threadState.m_threadHandle, StackSampleSignal) != 0)
+		return;
+
+	// Wait for the signal handler to finish. If the thread does not react
+	// within a reasonable time (for example because it is blocked with all
+	// signals masked), give up on this sample.
+	int depth = -1;
+	for (int i = 0; i < 100; ++i)
+	{
+		depth = stackSampleDepth.load(std::memory_order_acquire);
+		if (depth >= 0)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	if (depth <= 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_stallsMutex);
+	threadState.m_pendingStack.assign(stackSampleFrames, stackSampleFrames + depth);
+}
@@ -0,0 +1,141 @@
+#ifndef STALL_MONITOR_HPP
+#define STALL_MONITOR_HPP
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <QVariantMap>
+
+
+class QQuickWindow;
+
+
+// Monitors the Qt GUI thread and the scenegraph render thread for stalls.
+//
+// The GUI thread is monitored with a heartbeat timer. The difference
+// between the expected and the actual timer expiration (the scheduling
+// lateness) tells how long the GUI thread was busy with other things.
+// The render thread is monitored by measuring how long each frame takes,
+// from the beginning of the synchronization to the buffer swap, minus
+// the refresh interval of the screen (the swap may block until vsync).
+//
+// Latenesses are recorded in a histogram. Latenesses above a threshold
+// are recorded as stalls. Optionally, a watchdog thread samples the
+// stack of a thread that is stalled, which helps with finding out what
+// the thread is busy with.
+//
+// This is useful for finding out whether missed frames are caused by
+// the QML side instead of the GStreamer pipeline.
+
+class StallMonitor
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	enum class MonitoredThread
+	{
+		Gui = 0,
+		Render = 1
+	};
+
+	// Histogram bucket N covers latenesses in the range [2^(N-1), 2^N) ms;
+	// bucket 0 covers latenesses below 1 ms. The last bucket covers
+	// everything above its lower limit.
+	static constexpr int NumHistogramBuckets = 12;
+	static constexpr int MaxStackDepth = 32;
+
+	struct Stall
+	{
+		MonitoredThread m_thread;
+		// Milliseconds since the monitor was started.
+		std::int64_t m_timestamp;
+		std::int64_t m_latenessInMs;
+		std::vector<void *> m_stack;
+	};
+
+	explicit StallMonitor(int thresholdInMs, bool sampleStacks, QObject *parent = nullptr);
+	~StallMonitor() override;
+
+	// Starts monitoring the GUI thread (the thread this is called from)
+	// and the render thread of the given window.
+	bool start(QQuickWindow *window);
+	void stop();
+
+	// While idle, the GUI thread heartbeat is stopped, and the watchdog
+	// sleeps, since neither thread has work that could stall. Time spent
+	// idle is not counted as lateness.
+	void setIdle(bool idle);
+
+	std::array<std::uint64_t, NumHistogramBuckets> histogram(MonitoredThread thread) const;
+	std::vector<Stall> stalls() const;
+
+	// Returns the histograms and the number of stalls in a form
+	// that is accessible from QML.
+	Q_INVOKABLE QVariantMap report() const;
+
+	// Logs the histograms and all recorded stalls.
+	void logReport() const;
+
+signals:
+	void stallDetected(int thread, qint64 latenessInMs);
+
+
+private:
+	struct ThreadState
+	{
+		std::array<std::atomic<std::uint64_t>, NumHistogramBuckets> m_histogram;
+		// Time (in ms since start) of the last heartbeat, or of the start
+		// of the current frame. -1 if the thread is currently idle.
+		std::atomic<std::int64_t> m_activityStart;
+		std::atomic<bool> m_stackSampled;
+		pthread_t m_threadHandle;
+		std::atomic<bool> m_threadHandleValid;
+		// Stack sampled by the watchdog during the ongoing stall.
+		// Protected by m_stallsMutex.
+		std::vector<void *> m_pendingStack;
+	};
+
+	void onGuiHeartbeat();
+	void onRenderFrameStart();
+	void onRenderFrameSwapped();
+	void record(MonitoredThread thread, std::int64_t latenessInMs);
+	void watchdogLoop();
+	void sampleStack(MonitoredThread thread);
+
+	int const m_thresholdInMs;
+	bool const m_sampleStacks;
+
+	QElapsedTimer m_clock;
+	QTimer m_heartbeatTimer;
+	std::int64_t m_lastHeartbeat = 0;
+	std::int64_t m_frameStart = 0;
+	std::int64_t m_refreshIntervalInMs = 16;
+	QQuickWindow *m_window = nullptr;
+
+	std::array<ThreadState, 2> m_threadStates;
+
+	mutable std::mutex m_stallsMutex;
+	std::vector<Stall> m_stalls;
+
+	std::atomic<bool> m_watchdogRunning;
+	std::thread m_watchdogThread;
+	// Wakes up the watchdog when leaving the idle state or stopping.
+	std::mutex m_watchdogMutex;
+	std::condition_variable m_watchdogCondition;
+	// Protected by m_watchdogMutex.
+	bool m_idle = false;
+};
+
+
+#endif // STALL_MONITOR_HPP
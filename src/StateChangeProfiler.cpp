@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <assert.h>
+
+// The tracer API is still marked as unstable, even though
+// it has not changed in an incompatible way since 1.8.
+#define GST_USE_UNSTABLE_API
+#include <gst/gst.h>
+#include <gst/gsttracer.h>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "StateChangeProfiler.hpp"
+
+
+// Minimal tracer that forwards the hooks to a StateChangeProfiler.
+// Tracer hooks cannot be unregistered, so the tracer stays alive until
+// gst_deinit() is called, and the profiler detaches itself from it once
+// it is destroyed.
+
+struct GstStateChangeProfilerTracer
+{
+	GstTracer parent;
+	GMutex lock;
+	StateChangeProfiler *profiler;
+};
+
+
+struct GstStateChangeProfilerTracerClass
+{
+	GstTracerClass parent_class;
+};
+
+
+G_DEFINE_TYPE(GstStateChangeProfilerTracer, gst_state_change_profiler_tracer, GST_TYPE_TRACER)
+
+
+static void gst_state_change_profiler_tracer_finalize(GObject *object)
+{
+	GstStateChangeProfilerTracer *self = reinterpret_cast<GstStateChangeProfilerTracer *>(object);
+	g_mutex_clear(&(self->lock));
+
+	G_OBJECT_CLASS(gst_state_change_profiler_tracer_parent_class)->finalize(object);
+}
+
+
+static void gst_state_change_profiler_tracer_class_init(GstStateChangeProfilerTracerClass *klass)
+{
+	G_OBJECT_CLASS(klass)->finalize = gst_state_change_profiler_tracer_finalize;
+}
+
+
+static void gst_state_change_profiler_tracer_init(GstStateChangeProfilerTracer *self)
+{
+	g_mutex_init(&(self->lock));
+	self->profiler = nullptr;
+}
+
+
+namespace
+{
+
+
+// Calls the function with the profiler of the tracer, if it is still attached.
+template<typename Func>
+void withProfiler(GObject *tracerObject, Func func)
+{
+	GstStateChangeProfilerTracer *tracer = reinterpret_cast<GstStateChangeProfilerTracer *>(tracerObject);
+
+	g_mutex_lock(&(tracer->lock));
+	if (tracer->profiler != nullptr)
+		func(*(tracer->profiler));
+	g_mutex_unlock(&(tracer->lock));
+}
+
+
+std::string describeElement(GstElement *element)
+{
+	GstElementFactory *factory = gst_element_get_factory(element);
+	std::string description = (factory != nullptr) ? GST_OBJECT_NAME(factory) : G_OBJECT_TYPE_NAME(element);
+	description += " (";
+	description += GST_OBJECT_NAME(element);
+	description += ")";
+	return description;
+}
+
+
+char const * phaseName(StateChangeProfiler::Phase phase)
+{
+	switch (phase)
+	{
+		case StateChangeProfiler::Phase::Startup: return "startup";
+		case StateChangeProfiler::Phase::Seek: return "seek";
+		case StateChangeProfiler::Phase::Teardown: return "teardown";
+		default: return "<unknown>";
+	}
+}
+
+
+} // unnamed namespace end
+
+
+StateChangeProfiler::StateChangeProfiler()
+{
+	m_tracer = G_OBJECT(g_object_new(gst_state_change_profiler_tracer_get_type(), nullptr));
+	reinterpret_cast<GstStateChangeProfilerTracer *>(m_tracer)->profiler = this;
+
+	GstTracer *tracer = GST_TRACER(m_tracer);
+	gst_tracing_register_hook(tracer, "element-change-state-pre", G_CALLBACK(&staticOnChangeStatePre));
+	gst_tracing_register_hook(tracer, "element-change-state-post", G_CALLBACK(&staticOnChangeStatePost));
+	gst_tracing_register_hook(tracer, "element-post-message-pre", G_CALLBACK(&staticOnPostMessagePre));
+}
+
+
+StateChangeProfiler::~StateChangeProfiler()
+{
+	// The tracer itself is not unref'd, since the
+	// tracing subsystem might still call its hooks.
+	GstStateChangeProfilerTracer *tracer = reinterpret_cast<GstStateChangeProfilerTracer *>(m_tracer);
+	g_mutex_lock(&(tracer->lock));
+	tracer->profiler = nullptr;
+	g_mutex_unlock(&(tracer->lock));
+}
+
+
+void StateChangeProfiler::attach(Pipeline &pipeline)
+{
+	assert(pipeline.playbin() != nullptr);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_playbin = pipeline.playbin();
+}
+
+
+std::vector<StateChangeProfiler::Entry> StateChangeProfiler::slowest(Phase phase, std::size_t maxNumEntries) const
+{
+	std::vector<Entry> entries;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto const &item : m_entries)
+		{
+			if (item.second.m_phase == phase)
+				entries.push_back(item.second);
+		}
+	}
+
+	std::sort(entries.begin(), entries.end(), [](Entry const &first, Entry const &second) {
+		return first.m_maxTime > second.m_maxTime;
+	});
+
+	if (entries.size() > maxNumEntries)
+		entries.resize(maxNumEntries);
+
+	return entries;
+}
+
+
+void StateChangeProfiler::logReport(std::size_t maxNumEntriesPerPhase) const
+{
+	for (Phase phase : { Phase::Startup, Phase::Seek, Phase::Teardown })
+	{
+		std::vector<Entry> entries = slowest(phase, maxNumEntriesPerPhase);
+		if (entries.empty())
+			continue;
+
+		LOG_INFO("Slowest state changes during %s:", phaseName(phase));
+		for (Entry const &entry : entries)
+		{
+			LOG_INFO(
+				"  %8.2f ms max, %8.2f ms avg, %4u x  %-14s %s",
+				double(entry.m_maxTime) / GST_MSECOND,
+				double(entry.m_totalTime) / GST_MSECOND / entry.m_count,
+				entry.m_count,
+				entry.m_transition.c_str(),
+				entry.m_element.c_str()
+			);
+		}
+	}
+}
+
+
+void StateChangeProfiler::staticOnChangeStatePre(GObject *tracer, GstClockTime timestamp, GstElement *element, GstStateChange transition)
+{
+	withProfiler(tracer, [&](StateChangeProfiler &self) {
+		if (!self.isInPlaybin(element) || (GST_STATE_TRANSITION_CURRENT(transition) == GST_STATE_TRANSITION_NEXT(transition)))
+			return;
+
+		std::lock_guard<std::mutex> lock(self.m_mutex);
+		self.m_stateChangeStarts[element] = timestamp;
+	});
+}
+
+
+void StateChangeProfiler::staticOnChangeStatePost(GObject *tracer, GstClockTime timestamp, GstElement *element, GstStateChange transition, GstStateChangeReturn result)
+{
+	withProfiler(tracer, [&](StateChangeProfiler &self) {
+		std::unique_lock<std::mutex> lock(self.m_mutex);
+
+		auto iter = self.m_stateChangeStarts.find(element);
+		if (iter == self.m_stateChangeStarts.end())
+			return;
+
+		GstClockTime startTime = iter->second;
+		self.m_stateChangeStarts.erase(iter);
+
+		// Asynchronous state changes are finished once the element
+		// posts its state-changed message (see staticOnPostMessagePre()).
+		if (result == GST_STATE_CHANGE_ASYNC)
+		{
+			self.m_asyncStateChangeStarts[element] = std::make_pair(transition, startTime);
+			return;
+		}
+
+		// Prerolls that are still in progress are canceled by going down.
+		if (GST_STATE_TRANSITION_NEXT(transition) <= GST_STATE_READY)
+		{
+			self.m_asyncStateChangeStarts.erase(element);
+			self.m_prerollStarts.erase(element);
+		}
+
+		lock.unlock();
+		self.record(element, transition, timestamp - startTime);
+	});
+}
+
+
+void StateChangeProfiler::staticOnPostMessagePre(GObject *tracer, GstClockTime timestamp, GstElement *element, GstMessage *message)
+{
+	GstMessageType type = GST_MESSAGE_TYPE(message);
+	if ((type != GST_MESSAGE_STATE_CHANGED) && (type != GST_MESSAGE_ASYNC_START) && (type != GST_MESSAGE_ASYNC_DONE))
+		return;
+	if (GST_MESSAGE_SRC(message) != GST_OBJECT(element))
+		return;
+
+	withProfiler(tracer, [&](StateChangeProfiler &self) {
+		if (!self.isInPlaybin(element))
+			return;
+
+		std::unique_lock<std::mutex> lock(self.m_mutex);
+
+		switch (type)
+		{
+			case GST_MESSAGE_STATE_CHANGED:
+			{
+				auto iter = self.m_asyncStateChangeStarts.find(element);
+				if (iter == self.m_asyncStateChangeStarts.end())
+					break;
+
+				GstState newState;
+				gst_message_parse_state_changed(message, nullptr, &newState, nullptr);
+
+				GstStateChange transition = iter->second.first;
+				if (newState != GST_STATE_TRANSITION_NEXT(transition))
+					break;
+
+				GstClockTime startTime = iter->second.second;
+				self.m_asyncStateChangeStarts.erase(iter);
+
+				lock.unlock();
+				self.record(element, transition, timestamp - startTime);
+				break;
+			}
+
+			case GST_MESSAGE_ASYNC_START:
+				// Elements that are already PAUSED or PLAYING lost their
+				// preroll because of a flushing seek, and now preroll again.
+				if ((GST_STATE(element) >= GST_STATE_PAUSED) && (self.m_asyncStateChangeStarts.count(element) == 0))
+					self.m_prerollStarts[element] = timestamp;
+				break;
+
+			case GST_MESSAGE_ASYNC_DONE:
+			{
+				auto iter = self.m_prerollStarts.find(element);
+				if (iter == self.m_prerollStarts.end())
+					break;
+
+				GstClockTime startTime = iter->second;
+				self.m_prerollStarts.erase(iter);
+
+				lock.unlock();
+				self.record(element, Phase::Seek, "preroll", timestamp - startTime);
+				break;
+			}
+
+			default:
+				break;
+		}
+	});
+}
+
+
+bool StateChangeProfiler::isInPlaybin(GstElement *element) const
+{
+	GstElement *playbin;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		playbin = m_playbin;
+	}
+
+	if (playbin == nullptr)
+		return false;
+
+	return (element == playbin) || gst_object_has_as_ancestor(GST_OBJECT(element), GST_OBJECT(playbin));
+}
+
+
+void StateChangeProfiler::record(GstElement *element, GstStateChange transition, GstClockTime duration)
+{
+	Phase phase = (GST_STATE_TRANSITION_NEXT(transition) > GST_STATE_TRANSITION_CURRENT(transition)) ? Phase::Startup : Phase::Teardown;
+	record(element, phase, gst_state_change_get_name(transition), duration);
+}
+
+
+void StateChangeProfiler::record(GstElement *element, Phase phase, std::string const &transition, GstClockTime duration)
+{
+	std::string description = describeElement(element);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Entry &entry = m_entries[std::make_tuple(phase, description, transition)];
+	if (entry.m_count == 0)
+	{
+		entry.m_phase = phase;
+		entry.m_element = description;
+		entry.m_transition = transition;
+	}
+
+	++entry.m_count;
+	entry.m_totalTime += duration;
+	entry.m_maxTime = std::max(entry.m_maxTime, duration);
+}
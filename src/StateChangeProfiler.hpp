@@ -0,0 +1,88 @@
+#ifndef STATE_CHANGE_PROFILER_HPP
+#define STATE_CHANGE_PROFILER_HPP
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <gst/gst.h>
+
+
+class Pipeline;
+
+
+// Records how long each element inside playbin spends in each state change.
+//
+// The profiler installs GStreamer tracer hooks that are called before and
+// after each state change of each element. Asynchronous state changes
+// (typically sinks, which only finish changing to PAUSED once they got
+// their first frame) are measured until the element posts its final
+// state-changed message. The time between ASYNC_START and ASYNC_DONE of
+// elements that are already PAUSED or PLAYING (that is, re-prerolling
+// after a flushing seek) is recorded as well.
+//
+// Measurements are grouped into phases: upwards state changes belong to
+// the startup, downwards ones to the teardown, and re-prerolling to seeks.
+// The report lists the slowest elements of each phase.
+//
+// This requires GStreamer to be built with tracer hooks (the default).
+
+class StateChangeProfiler
+{
+public:
+	enum class Phase
+	{
+		Startup,
+		Seek,
+		Teardown
+	};
+
+	struct Entry
+	{
+		Phase m_phase;
+		// "<factory name> (<element name>)".
+		std::string m_element;
+		// "NULL->READY", ..., or "preroll" for re-prerolling.
+		std::string m_transition;
+		unsigned int m_count = 0;
+		GstClockTime m_totalTime = 0;
+		GstClockTime m_maxTime = 0;
+	};
+
+	StateChangeProfiler();
+	~StateChangeProfiler();
+
+	// Only elements inside the playbin of this pipeline are recorded.
+	void attach(Pipeline &pipeline);
+
+	// Returns the entries of the given phase, sorted by their maximum
+	// time, slowest first.
+	std::vector<Entry> slowest(Phase phase, std::size_t maxNumEntries) const;
+
+	void logReport(std::size_t maxNumEntriesPerPhase = 10) const;
+
+
+private:
+	static void staticOnChangeStatePre(GObject *tracer, GstClockTime timestamp, GstElement *element, GstStateChange transition);
+	static void staticOnChangeStatePost(GObject *tracer, GstClockTime timestamp, GstElement *element, GstStateChange transition, GstStateChangeReturn result);
+	static void staticOnPostMessagePre(GObject *tracer, GstClockTime timestamp, GstElement *element, GstMessage *message);
+
+	bool isInPlaybin(GstElement *element) const;
+	void record(GstElement *element, GstStateChange transition, GstClockTime duration);
+	void record(GstElement *element, Phase phase, std::string const &transition, GstClockTime duration);
+
+	GstElement *m_playbin = nullptr;
+	GObject *m_tracer = nullptr;
+
+	mutable std::mutex m_mutex;
+	// Start times of state changes and prerolls that are in progress.
+	std::map<GstElement *, GstClockTime> m_stateChangeStarts;
+	std::map<GstElement *, std::pair<GstStateChange, GstClockTime>> m_asyncStateChangeStarts;
+	std::map<GstElement *, GstClockTime> m_prerollStarts;
+	std::map<std::tuple<Phase, std::string, std::string>, Entry> m_entries;
+};
+
+
+#endif // STATE_CHANGE_PROFILER_HPP
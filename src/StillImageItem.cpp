@@ -0,0 +1,276 @@
+#include <QDebug>
+#include <QImageReader>
+#include <QQuickWindow>
+#include <QRunnable>
+#include <QScreen>
+#include <QSGSimpleTextureNode>
+#include <QUrl>
+
+#include "StillImageItem.hpp"
+#include "TextureCache.hpp"
+
+
+namespace
+{
+
+
+// 64 MB are enough for a handful of fullscreen 1080p images.
+constexpr std::size_t DefaultCacheBudget = 64 * 1024 * 1024;
+
+
+// Helper class to destroy the texture cache in the render thread.
+
+class DeleteTextureCacheJob
+	: public QRunnable
+{
+public:
+	explicit DeleteTextureCacheJob(TextureCache *textureCache)
+		: m_textureCache(textureCache)
+	{
+	}
+
+	void run() override
+	{
+		delete m_textureCache;
+	}
+
+private:
+	TextureCache *m_textureCache;
+};
+
+
+} // unnamed namespace end
+
+
+// Helper class to decode an image in a worker thread.
+
+class ImageDecodeJob
+	: public QRunnable
+{
+public:
+	explicit ImageDecodeJob(StillImageItem *item, QString source, QSize maxSize)
+		: m_item(item)
+		, m_source(std::move(source))
+		, m_maxSize(maxSize)
+	{
+	}
+
+	void run() override
+	{
+		QUrl url(m_source);
+		QImageReader reader(url.isLocalFile() ? url.toLocalFile() : m_source);
+		reader.setAutoTransform(true);
+
+		// Let the reader scale down images that are larger than the screen.
+		// Several formats (JPEG in particular) can do this during decoding,
+		// which is much faster than decoding at full size and scaling after.
+		QSize size = reader.size();
+		if (size.isValid() && m_maxSize.isValid() && ((size.width() > m_maxSize.width()) || (size.height() > m_maxSize.height())))
+		{
+			size.scale(m_maxSize, Qt::KeepAspectRatio);
+			reader.setScaledSize(size);
+		}
+
+		QImage image = reader.read();
+		if (image.isNull())
+			qWarning() << "Could not decode image" << m_source << ":" << reader.errorString();
+		else
+			// This is the format the scenegraph can upload without further conversion.
+			image = image.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+
+		// m_item is guaranteed to be alive here, since its destructor waits
+		// for all decoding jobs to finish. Pending queued calls are discarded
+		// once the item is destroyed.
+		StillImageItem *item = m_item;
+		QString source = m_source;
+		QMetaObject::invokeMethod(item, [item, source, image]() {
+			item->onImageDecoded(source, image);
+		}, Qt::QueuedConnection);
+	}
+
+private:
+	StillImageItem *m_item;
+	QString m_source;
+	QSize m_maxSize;
+};
+
+
+StillImageItem::StillImageItem(QQuickItem *parent)
+	: QQuickItem(parent)
+	, m_cacheBudget(DefaultCacheBudget)
+{
+	setFlag(ItemHasContents, true);
+	m_decodePool.setMaxThreadCount(1);
+}
+
+
+StillImageItem::~StillImageItem()
+{
+	m_decodePool.clear();
+	m_decodePool.waitForDone();
+}
+
+
+QString StillImageItem::source() const
+{
+	return m_source;
+}
+
+
+void StillImageItem::setSource(QString const &source)
+{
+	if (source == m_source)
+		return;
+
+	bool wasReady = isReady();
+
+	m_source = source;
+	if (!m_source.isEmpty())
+		requestDecoding(m_source);
+
+	emit sourceChanged();
+	if (wasReady != isReady())
+		emit readyChanged();
+
+	update();
+}
+
+
+bool StillImageItem::isReady() const
+{
+	return !m_source.isEmpty() && m_knownSources.contains(m_source) && !m_pendingDecodes.contains(m_source);
+}
+
+
+void StillImageItem::setCacheBudget(std::size_t budgetInBytes)
+{
+	m_cacheBudget = budgetInBytes;
+	update();
+}
+
+
+void StillImageItem::preload(QString const &source)
+{
+	if (!source.isEmpty())
+		requestDecoding(source);
+}
+
+
+QSGNode * StillImageItem::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+	// NOTE: This is called in the render thread while the GUI thread
+	// is blocked, so accessing the GUI thread side members is safe.
+
+	QStringList evictedSources;
+
+	// Neither the displayed image nor the one that is about to be shown
+	// may be evicted by the budget change or the uploads below. Otherwise,
+	// a preloaded image could push out the current one, which then would
+	// never be shown.
+	QSet<QString> pinnedSources;
+	if (!m_displayedSource.isEmpty())
+		pinnedSources.insert(m_displayedSource);
+	if (!m_source.isEmpty())
+		pinnedSources.insert(m_source);
+
+	if (m_textureCache == nullptr)
+		m_textureCache = new TextureCache(m_cacheBudget);
+	m_textureCache->setPinnedKeys(pinnedSources);
+	if (m_textureCache->budget() != m_cacheBudget)
+		evictedSources << m_textureCache->setBudget(m_cacheBudget);
+
+	// Upload newly decoded images. The CPU side copies are
+	// released afterwards; from now on, only the textures exist.
+	for (auto pendingIter = m_pendingUploads.begin(); pendingIter != m_pendingUploads.end(); ++pendingIter)
+	{
+		QSGTexture *texture = window()->createTextureFromImage(pendingIter.value());
+		evictedSources << m_textureCache->insert(pendingIter.key(), texture);
+	}
+	m_pendingUploads.clear();
+
+	// Keep displaying the previous image until the new one is available.
+	// This avoids flickering while switching between images.
+	if (m_source.isEmpty())
+		m_displayedSource.clear();
+	else if (m_textureCache->contains(m_source))
+		m_displayedSource = m_source;
+
+	for (QString const &evictedSource : evictedSources)
+		m_knownSources.remove(evictedSource);
+
+	QSGTexture *texture = m_displayedSource.isEmpty() ? nullptr : m_textureCache->find(m_displayedSource);
+	if (texture == nullptr)
+	{
+		delete oldNode;
+		return nullptr;
+	}
+
+	QSGSimpleTextureNode *node = static_cast<QSGSimpleTextureNode *>(oldNode);
+	if (node == nullptr)
+	{
+		node = new QSGSimpleTextureNode;
+		node->setFiltering(QSGTexture::Linear);
+	}
+
+	// Fit the image into the item, preserving its aspect ratio.
+	QSizeF imageSize = texture->textureSize();
+	imageSize.scale(boundingRect().size(), Qt::KeepAspectRatio);
+	QRectF rect(QPointF(0, 0), imageSize);
+	rect.moveCenter(boundingRect().center());
+
+	node->setTexture(texture);
+	node->setRect(rect);
+
+	return node;
+}
+
+
+void StillImageItem::releaseResources()
+{
+	// Textures must be destroyed in the render thread.
+	if (m_textureCache != nullptr)
+	{
+		window()->scheduleRenderJob(new DeleteTextureCacheJob(m_textureCache), QQuickWindow::NoStage);
+		m_textureCache = nullptr;
+	}
+
+	m_displayedSource.clear();
+	m_knownSources.clear();
+	m_pendingUploads.clear();
+}
+
+
+void StillImageItem::requestDecoding(QString const &source)
+{
+	if (m_knownSources.contains(source))
+		return;
+
+	QSize maxSize;
+	if ((window() != nullptr) && (window()->screen() != nullptr))
+		maxSize = window()->screen()->size() * window()->screen()->devicePixelRatio();
+
+	m_knownSources.insert(source);
+	m_pendingDecodes.insert(source);
+	m_decodePool.start(new ImageDecodeJob(this, source, maxSize));
+}
+
+
+void StillImageItem::onImageDecoded(QString const &source, QImage image)
+{
+	m_pendingDecodes.remove(source);
+
+	if (image.isNull())
+	{
+		// Decoding failed. Forget about the source
+		// to allow for retrying later.
+		m_knownSources.remove(source);
+		return;
+	}
+
+	m_pendingUploads.insert(source, std::move(image));
+
+	if (source == m_source)
+		emit readyChanged();
+
+	update();
+}
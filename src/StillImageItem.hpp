@@ -0,0 +1,87 @@
+#ifndef STILL_IMAGE_ITEM_HPP
+#define STILL_IMAGE_ITEM_HPP
+
+#include <cstddef>
+
+#include <QHash>
+#include <QImage>
+#include <QQuickItem>
+#include <QSet>
+#include <QString>
+#include <QThreadPool>
+
+
+class TextureCache;
+
+
+// QML item for displaying still images without a GStreamer pipeline.
+//
+// Images are decoded once in a worker thread and then uploaded into
+// textures, which are kept in an LRU TextureCache that lives in the
+// scenegraph render thread. Showing an image that is still cached
+// therefore costs neither decoding nor uploading. preload() can be
+// used for decoding and uploading images before they are shown.
+//
+// Sources are file URIs or local filenames.
+
+class StillImageItem
+	: public QQuickItem
+{
+	Q_OBJECT
+	Q_PROPERTY(QString source READ source WRITE setSource NOTIFY sourceChanged)
+	Q_PROPERTY(bool ready READ isReady NOTIFY readyChanged)
+
+public:
+	explicit StillImageItem(QQuickItem *parent = nullptr);
+	~StillImageItem() override;
+
+	QString source() const;
+	void setSource(QString const &source);
+
+	// true if the current source is decoded and can be displayed.
+	bool isReady() const;
+
+	// Sets the budget of the texture cache. Can be called at any time;
+	// if the budget shrinks, the cache evicts textures the next time
+	// the item is synchronized with the render thread.
+	void setCacheBudget(std::size_t budgetInBytes);
+
+	Q_INVOKABLE void preload(QString const &source);
+
+signals:
+	void sourceChanged();
+	void readyChanged();
+
+
+protected:
+	QSGNode * updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *updatePaintNodeData) override;
+	void releaseResources() override;
+
+
+private:
+	friend class ImageDecodeJob;
+
+	void requestDecoding(QString const &source);
+	void onImageDecoded(QString const &source, QImage image);
+
+	QString m_source;
+	std::size_t m_cacheBudget;
+
+	// Sources that are either being decoded or are present in the
+	// texture cache. Accessed by the GUI thread, and by the render
+	// thread during updatePaintNode(), when the GUI thread is blocked.
+	QSet<QString> m_knownSources;
+	QSet<QString> m_pendingDecodes;
+	QHash<QString, QImage> m_pendingUploads;
+
+	// Render thread side state.
+	TextureCache *m_textureCache = nullptr;
+	QString m_displayedSource;
+
+	// A single decoding thread is enough, and keeps the
+	// decoding from competing with the streaming threads.
+	QThreadPool m_decodePool;
+};
+
+
+#endif // STILL_IMAGE_ITEM_HPP
@@ -0,0 +1,101 @@
+#include <QSGTexture>
+#include <QStringList>
+
+#include "TextureCache.hpp"
+
+
+namespace
+{
+
+
+std::size_t textureSizeInBytes(QSGTexture *texture)
+{
+	// Textures are uploaded as 32-bit RGBA. Mipmaps and driver
+	// specific padding are not taken into account.
+	QSize size = texture->textureSize();
+	return std::size_t(size.width()) * std::size_t(size.height()) * 4;
+}
+
+
+} // unnamed namespace end
+
+
+TextureCache::TextureCache(std::size_t budgetInBytes)
+	: m_budget(budgetInBytes)
+{
+}
+
+
+TextureCache::~TextureCache()
+{
+	for (auto &entry : m_entries)
+		delete entry.m_texture;
+}
+
+
+QSGTexture * TextureCache::find(QString const &key)
+{
+	auto indexIter = m_index.find(key);
+	if (indexIter == m_index.end())
+		return nullptr;
+
+	// Move the entry to the front to mark it as the most recently used one.
+	m_entries.splice(m_entries.begin(), m_entries, indexIter.value());
+	return m_entries.front().m_texture;
+}
+
+
+QStringList TextureCache::insert(QString const &key, QSGTexture *texture)
+{
+	auto indexIter = m_index.find(key);
+	if (indexIter != m_index.end())
+	{
+		Entries::iterator entryIter = indexIter.value();
+		m_usedBytes -= entryIter->m_sizeInBytes;
+		delete entryIter->m_texture;
+		m_entries.erase(entryIter);
+		m_index.erase(indexIter);
+	}
+
+	Entry entry = { key, texture, textureSizeInBytes(texture) };
+	m_entries.push_front(entry);
+	m_index.insert(key, m_entries.begin());
+	m_usedBytes += entry.m_sizeInBytes;
+
+	return evict(key);
+}
+
+
+bool TextureCache::contains(QString const &key) const
+{
+	return m_index.contains(key);
+}
+
+
+QStringList TextureCache::setBudget(std::size_t budgetInBytes)
+{
+	m_budget = budgetInBytes;
+	return evict(QString());
+}
+
+
+QStringList TextureCache::evict(QString const &keyToKeep)
+{
+	QStringList evictedKeys;
+
+	auto entryIter = m_entries.end();
+	while ((m_usedBytes > m_budget) && (entryIter != m_entries.begin()))
+	{
+		--entryIter;
+		if ((entryIter->m_key == keyToKeep) || m_pinnedKeys.contains(entryIter->m_key))
+			continue;
+
+		evictedKeys << entryIter->m_key;
+		m_usedBytes -= entryIter->m_sizeInBytes;
+		delete entryIter->m_texture;
+		m_index.remove(entryIter->m_key);
+		entryIter = m_entries.erase(entryIter);
+	}
+
+	return evictedKeys;
+}
@@ -0,0 +1,86 @@
+#ifndef TEXTURE_CACHE_HPP
+#define TEXTURE_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+
+
+class QSGTexture;
+
+
+// LRU cache for scenegraph textures, limited by a budget in bytes.
+//
+// The cache owns the textures stored in it. It is not thread safe and
+// must only be used in the scenegraph render thread, since that is the
+// only thread where textures can be safely created and destroyed.
+
+class TextureCache
+{
+public:
+	explicit TextureCache(std::size_t budgetInBytes);
+	~TextureCache();
+
+	// Returns the texture for the given key, or nullptr if no such texture
+	// is cached. A successful lookup marks the texture as the most recently
+	// used one.
+	QSGTexture * find(QString const &key);
+
+	// Inserts a texture into the cache, evicting least recently used
+	// textures if the budget is exceeded. Neither the newly inserted
+	// texture nor the pinned ones are evicted by this call, even if they
+	// alone exceed the budget. Returns the keys of evicted textures.
+	QStringList insert(QString const &key, QSGTexture *texture);
+
+	bool contains(QString const &key) const;
+
+	// Pins the textures with the given keys, which excludes them from
+	// eviction. This is meant for the texture that is currently being
+	// displayed, and the one that is about to be displayed. Replaces the
+	// previously pinned keys; pass an empty set to unpin.
+	void setPinnedKeys(QSet<QString> const &keys)
+	{
+		m_pinnedKeys = keys;
+	}
+
+	// Changes the budget. If the new budget is smaller, textures are
+	// evicted right away. Returns the keys of evicted textures.
+	QStringList setBudget(std::size_t budgetInBytes);
+
+	std::size_t budget() const
+	{
+		return m_budget;
+	}
+
+	std::size_t usedBytes() const
+	{
+		return m_usedBytes;
+	}
+
+
+private:
+	struct Entry
+	{
+		QString m_key;
+		QSGTexture *m_texture;
+		std::size_t m_sizeInBytes;
+	};
+	typedef std::list<Entry> Entries;
+
+	QStringList evict(QString const &keyToKeep);
+
+	std::size_t m_budget;
+	std::size_t m_usedBytes = 0;
+	QSet<QString> m_pinnedKeys;
+
+	// Most recently used entries are at the front.
+	Entries m_entries;
+	QHash<QString, Entries::iterator> m_index;
+};
+
+
+#endif // TEXTURE_CACHE_HPP
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <assert.h>
+
+#include <QQuickWindow>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "ThroughputBenchmark.hpp"
+
+
+namespace
+{
+
+
+constexpr int MeasureIntervalInMs = 1000;
+// playbin's GST_PLAY_FLAG_AUDIO.
+constexpr gint PlayFlagAudio = 0x02;
+
+
+} // unnamed namespace end
+
+
+ThroughputBenchmark::ThroughputBenchmark(QObject *parent)
+	: QObject(parent)
+	, m_numUploadedFrames(0)
+	, m_numDisplayedFrames(0)
+	, m_streamTime(0)
+{
+	m_measureTimer.setInterval(MeasureIntervalInMs);
+	connect(&m_measureTimer, &QTimer::timeout, this, &ThroughputBenchmark::onMeasure);
+}
+
+
+ThroughputBenchmark::~ThroughputBenchmark()
+{
+	if (m_videoSinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_videoSinkPad, m_probeId);
+		gst_object_unref(GST_OBJECT(m_videoSinkPad));
+	}
+
+	if (m_qmlglsink != nullptr)
+		gst_object_unref(GST_OBJECT(m_qmlglsink));
+}
+
+
+bool ThroughputBenchmark::start(Pipeline &pipeline, QQuickWindow *window)
+{
+	assert(m_videoSinkPad == nullptr);
+	assert(pipeline.playbin() != nullptr);
+	assert(window != nullptr);
+
+	// Frames are counted at the qmlglsink itself (and not at the glsinkbin),
+	// so the GL upload and color conversion are part of the measurement.
+	m_qmlglsink = GST_ELEMENT(gst_object_ref(GST_OBJECT(pipeline.qmlglsink())));
+
+	g_object_set(m_qmlglsink, "sync", gboolean(FALSE), "qos", gboolean(FALSE), nullptr);
+	m_videoSinkPad = gst_element_get_static_pad(m_qmlglsink, "sink");
+	assert(m_videoSinkPad != nullptr);
+
+	gint flags;
+	g_object_get(pipeline.playbin(), "flags", &flags, nullptr);
+	g_object_set(pipeline.playbin(), "flags", gint(flags & ~PlayFlagAudio), nullptr);
+
+	m_probeId = gst_pad_add_probe(m_videoSinkPad, GST_PAD_PROBE_TYPE_BUFFER, &staticOnVideoSinkProbe, gpointer(this), nullptr);
+
+	connect(window, &QQuickWindow::afterSynchronizing, this, &ThroughputBenchmark::onAfterSynchronizing, Qt::DirectConnection);
+
+	pipeline.addBusMessageHandler([this](GstMessage *message) {
+		onBusMessage(message);
+	});
+
+	if (window->format().swapInterval() != 0)
+		LOG_WARNING("Swap interval is %d; rendering is throttled to the display refresh rate", window->format().swapInterval());
+
+	m_intervalTimer.start();
+	m_measureTimer.start();
+
+	LOG_INFO("Unthrottled playback enabled");
+
+	return true;
+}
+
+
+void ThroughputBenchmark::logReport()
+{
+	if (m_totalTimeInMs == 0)
+		return;
+
+	double seconds = m_totalTimeInMs / 1000.0;
+	bool isDisplayBound = (m_totalDisplayedFrames < m_totalUploadedFrames);
+	LOG_INFO(
+		"Throughput over %.1f s: %.1f fps end to end (peak %.1f, limited by %s), %.1f fps uploaded (peak %.1f), %.1f fps displayed (peak %.1f), %.2fx realtime (peak %.2fx)",
+		seconds,
+		std::min(m_totalUploadedFrames, m_totalDisplayedFrames) / seconds,
+		m_peakEndToEndRate,
+		isDisplayBound ? "rendering" : "decoding and upload",
+		m_totalUploadedFrames / seconds,
+		m_peakUploadRate,
+		m_totalDisplayedFrames / seconds,
+		m_peakDisplayRate,
+		double(m_totalStreamTime) / GST_MSECOND / m_totalTimeInMs,
+		m_peakRealtimeFactor
+	);
+}
+
+
+GstPadProbeReturn ThroughputBenchmark::staticOnVideoSinkProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	ThroughputBenchmark *self = reinterpret_cast<ThroughputBenchmark *>(userData);
+
+	// NOTE: This is called in the streaming thread.
+
+	GstClockTime pts = GST_BUFFER_PTS(GST_PAD_PROBE_INFO_BUFFER(info));
+	if (GST_CLOCK_TIME_IS_VALID(pts))
+	{
+		if (GST_CLOCK_TIME_IS_VALID(self->m_lastPts) && (pts > self->m_lastPts))
+			self->m_streamTime.fetch_add(pts - self->m_lastPts, std::memory_order_relaxed);
+		self->m_lastPts = pts;
+	}
+
+	self->m_numUploadedFrames.fetch_add(1, std::memory_order_relaxed);
+	return GST_PAD_PROBE_OK;
+}
+
+
+void ThroughputBenchmark::onAfterSynchronizing()
+{
+	// NOTE: This is called in the render thread, after the scenegraph
+	// synchronized with the items, and so with the qmlglsink's latest frame.
+
+	GstSample *sample = nullptr;
+	g_object_get(m_qmlglsink, "last-sample", &sample, nullptr);
+	if (sample == nullptr)
+		return;
+
+	GstBuffer *buffer = gst_sample_get_buffer(sample);
+	GstClockTime pts = (buffer != nullptr) ? GST_BUFFER_PTS(buffer) : GST_CLOCK_TIME_NONE;
+	gst_sample_unref(sample);
+
+	// Swaps without a new frame (or of frames without timestamps)
+	// do not show anything new.
+	if (!GST_CLOCK_TIME_IS_VALID(pts) || (pts == m_lastDisplayedPts))
+		return;
+
+	m_lastDisplayedPts = pts;
+	m_numDisplayedFrames.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+void ThroughputBenchmark::onBusMessage(GstMessage *message)
+{
+	if (GST_MESSAGE_TYPE(message) != GST_MESSAGE_EOS)
+		return;
+
+	// Include the frames of the last partial interval.
+	onMeasure();
+	logReport();
+	reset();
+}
+
+
+void ThroughputBenchmark::onMeasure()
+{
+	qint64 elapsedInMs = m_intervalTimer.restart();
+	if (elapsedInMs <= 0)
+		return;
+
+	quint64 numUploadedFrames = m_numUploadedFrames.load(std::memory_order_relaxed);
+	quint64 numDisplayedFrames = m_numDisplayedFrames.load(std::memory_order_relaxed);
+	quint64 streamTime = m_streamTime.load(std::memory_order_relaxed);
+
+	quint64 uploadedFrames = numUploadedFrames - m_lastNumUploadedFrames;
+	quint64 displayedFrames = numDisplayedFrames - m_lastNumDisplayedFrames;
+	quint64 streamTimeDelta = streamTime - m_lastStreamTime;
+
+	m_lastNumUploadedFrames = numUploadedFrames;
+	m_lastNumDisplayedFrames = numDisplayedFrames;
+	m_lastStreamTime = streamTime;
+
+	// Intervals without frames (prerolling, paused, images shown)
+	// would only dilute the result.
+	if (uploadedFrames == 0)
+		return;
+
+	double uploadRate = uploadedFrames * 1000.0 / elapsedInMs;
+	double displayRate = displayedFrames * 1000.0 / elapsedInMs;
+	double endToEndRate = std::min(uploadRate, displayRate);
+	double realtimeFactor = double(streamTimeDelta) / GST_MSECOND / elapsedInMs;
+
+	LOG_DEBUG("Throughput: %.1f fps end to end, %.1f fps uploaded, %.1f fps displayed, %.2fx realtime", endToEndRate, uploadRate, displayRate, realtimeFactor);
+
+	m_totalTimeInMs += elapsedInMs;
+	m_totalUploadedFrames += uploadedFrames;
+	m_totalDisplayedFrames += displayedFrames;
+	m_totalStreamTime += streamTimeDelta;
+	m_peakUploadRate = std::max(m_peakUploadRate, uploadRate);
+	m_peakDisplayRate = std::max(m_peakDisplayRate, displayRate);
+	m_peakEndToEndRate = std::max(m_peakEndToEndRate, endToEndRate);
+	m_peakRealtimeFactor = std::max(m_peakRealtimeFactor, realtimeFactor);
+}
+
+
+void ThroughputBenchmark::reset()
+{
+	m_totalTimeInMs = 0;
+	m_totalUploadedFrames = 0;
+	m_totalDisplayedFrames = 0;
+	m_totalStreamTime = 0;
+	m_peakUploadRate = 0;
+	m_peakDisplayRate = 0;
+	m_peakEndToEndRate = 0;
+	m_peakRealtimeFactor = 0;
+}
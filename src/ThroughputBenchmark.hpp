@@ -0,0 +1,93 @@
+#ifndef THROUGHPUT_BENCHMARK_HPP
+#define THROUGHPUT_BENCHMARK_HPP
+
+#include <atomic>
+
+#include <gst/gst.h>
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+
+class QQuickWindow;
+class Pipeline;
+
+
+// Measures how far above realtime the device can play an input.
+//
+// Realtime playback only shows whether a device keeps up, not how much
+// headroom it has. In unthrottled mode, the video sink does not wait for
+// the clock (sync=false), audio is disabled (an audio sink would pace the
+// pipeline), and the scenegraph is expected to render without waiting for
+// vsync (the swap interval must be set to 0 before the window is created).
+// Frames then flow as fast as the decoder, upload, and renderer allow.
+//
+// Each second, the benchmark measures the number of frames that reached
+// the qmlglsink (decoded and uploaded), the number of distinct frames the
+// scenegraph displayed, and the realtime factor (how much stream time
+// passed per wall clock time). A frame counts as displayed once the
+// scenegraph synchronized with a new last sample of the qmlglsink, so
+// swaps that show the same frame again are not counted. The end to end
+// rate is the lower of the two, and the stage it comes from is reported
+// as the bottleneck. The sustained and peak rates are logged at the end
+// of each input and when the benchmark is destroyed.
+
+class ThroughputBenchmark
+	: public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit ThroughputBenchmark(QObject *parent = nullptr);
+	~ThroughputBenchmark() override;
+
+	// Switches the pipeline to unthrottled playback and starts measuring.
+	// This must be called before playback starts.
+	bool start(Pipeline &pipeline, QQuickWindow *window);
+
+	void logReport();
+
+
+private:
+	static GstPadProbeReturn staticOnVideoSinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	void onBusMessage(GstMessage *message);
+	void onAfterSynchronizing();
+	void onMeasure();
+	void reset();
+
+	GstElement *m_qmlglsink = nullptr;
+	GstPad *m_videoSinkPad = nullptr;
+	gulong m_probeId = 0;
+
+	QTimer m_measureTimer;
+	QElapsedTimer m_intervalTimer;
+
+	// Streaming / render thread side counters.
+	std::atomic<quint64> m_numUploadedFrames;
+	std::atomic<quint64> m_numDisplayedFrames;
+	// Stream time covered by the frames, in nanoseconds. Jumps
+	// backwards (seeks, new inputs) are not counted.
+	std::atomic<quint64> m_streamTime;
+	GstClockTime m_lastPts = GST_CLOCK_TIME_NONE;
+	// Only accessed by the render thread.
+	GstClockTime m_lastDisplayedPts = GST_CLOCK_TIME_NONE;
+
+	// Values at the start of the current interval.
+	quint64 m_lastNumUploadedFrames = 0;
+	quint64 m_lastNumDisplayedFrames = 0;
+	quint64 m_lastStreamTime = 0;
+
+	// Totals of the intervals in which frames were uploaded.
+	qint64 m_totalTimeInMs = 0;
+	quint64 m_totalUploadedFrames = 0;
+	quint64 m_totalDisplayedFrames = 0;
+	quint64 m_totalStreamTime = 0;
+	double m_peakUploadRate = 0;
+	double m_peakDisplayRate = 0;
+	double m_peakEndToEndRate = 0;
+	double m_peakRealtimeFactor = 0;
+};
+
+
+#endif // THROUGHPUT_BENCHMARK_HPP
@@ -0,0 +1,53 @@
+#include <QDateTime>
+#include <QFileInfo>
+#include <QUrl>
+
+#include "Utils.hpp"
+
+
+bool hasProperty(GstElement *element, char const *propertyName)
+{
+	return g_object_class_find_property(G_OBJECT_GET_CLASS(element), propertyName) != nullptr;
+}
+
+
+bool getLocalFileStamp(QString const &uri, qint64 &modificationTime, qint64 &fileSize)
+{
+	QUrl url(uri);
+	if (!url.isLocalFile())
+		return false;
+
+	QFileInfo fileInfo(url.toLocalFile());
+	if (!fileInfo.exists())
+		return false;
+
+	modificationTime = fileInfo.lastModified().toMSecsSinceEpoch();
+	fileSize = fileInfo.size();
+	return true;
+}
+
+
+bool forceTypefindCaps(GstElement *typefind, QString const &caps)
+{
+	if (caps.isEmpty())
+		return false;
+
+	GstCaps *forcedCaps = nullptr;
+	g_object_get(typefind, "force-caps", &forcedCaps, nullptr);
+	if (forcedCaps != nullptr)
+	{
+		gst_caps_unref(forcedCaps);
+		return false;
+	}
+
+	// With forced caps, the typefinder does not read and analyze
+	// the beginning of the file anymore.
+	forcedCaps = gst_caps_from_string(caps.toStdString().c_str());
+	if (forcedCaps == nullptr)
+		return false;
+
+	g_object_set(typefind, "force-caps", forcedCaps, nullptr);
+	gst_caps_unref(forcedCaps);
+
+	return true;
+}
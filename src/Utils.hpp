@@ -0,0 +1,28 @@
+#ifndef UTILS_HPP
+#define UTILS_HPP
+
+#include <gst/gst.h>
+
+#include <QString>
+
+
+// Helpers shared by several components.
+
+
+// Returns true if the element has a property with the given name. Many
+// properties only exist in some versions or implementations of an element.
+bool hasProperty(GstElement *element, char const *propertyName);
+
+// Gets the modification time and size of a file URI. Cached information
+// about the file is only valid as long as these do not change.
+// Returns false if the URI is not a local file.
+bool getLocalFileStamp(QString const &uri, qint64 &modificationTime, qint64 &fileSize);
+
+// Makes a typefind element use the given caps instead of reading and
+// analyzing the beginning of the stream. Does nothing and returns false
+// if the caps are invalid, or if the typefinder already has forced caps,
+// so that the first cache that knows the input wins.
+bool forceTypefindCaps(GstElement *typefind, QString const &caps);
+
+
+#endif // UTILS_HPP
@@ -0,0 +1,355 @@
+#include <assert.h>
+#include <sys/resource.h>
+
+#include <gst/video/video.h>
+
+#include <QDebug>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "VideoConversion.hpp"
+
+
+namespace
+{
+
+
+// Assumed peak luminance of HDR content without metadata, in nits.
+constexpr float DefaultPeakLuminance = 1000.0f;
+
+
+// Values of the "transfer" uniform of the tone mapping shader.
+enum Transfer
+{
+	TransferSdr = 0,
+	TransferPq = 1,
+	TransferHlg = 2
+};
+
+
+// GLSL 1.00 / 1.10, so it works with both GLES 2 and desktop GL.
+// glshader's default vertex shader provides v_texcoord and tex.
+char const toneMappingFragmentShader[] = R"glsl(
+#ifdef GL_ES
+#ifdef GL_FRAGMENT_PRECISION_HIGH
+precision highp float;
+#else
+precision mediump float;
+#endif
+#endif
+
+varying vec2 v_texcoord;
+uniform sampler2D tex;
+
+// 0 = SDR (passed through), 1 = PQ (SMPTE ST 2084), 2 = HLG (ARIB STD-B67)
+uniform int transfer;
+// 1 if the input uses BT.2020 primaries
+uniform int bt2020;
+// Peak luminance of the content in nits
+uniform float peak_luminance;
+
+// Luminance of SDR reference white in nits (ITU-R BT.2408).
+const float sdr_white = 203.0;
+
+vec3 pq_to_nits(vec3 e)
+{
+	const float m1 = 0.1593017578125;
+	const float m2 = 78.84375;
+	const float c1 = 0.8359375;
+	const float c2 = 18.8515625;
+	const float c3 = 18.6875;
+
+	vec3 p = pow(max(e, 0.0), vec3(1.0 / m2));
+	return pow(max(p - c1, 0.0) / (c2 - c3 * p), vec3(1.0 / m1)) * 10000.0;
+}
+
+vec3 hlg_to_nits(vec3 e)
+{
+	const float a = 0.17883277;
+	const float b = 0.28466892;
+	const float c = 0.55991073;
+
+	// Inverse OETF to scene light, then the OOTF of a 1000 nits display.
+	vec3 low = e * e / 3.0;
+	vec3 high = (exp((e - c) / a) + b) / 12.0;
+	vec3 scene = mix(low, high, step(0.5, e));
+	float y = dot(scene, vec3(0.2627, 0.6780, 0.0593));
+	return scene * pow(max(y, 1e-6), 0.2) * 1000.0;
+}
+
+void main()
+{
+	vec4 color = texture2D(tex, v_texcoord);
+	if (transfer == 0)
+	{
+		gl_FragColor = color;
+		return;
+	}
+
+	vec3 nits = (transfer == 1) ? pq_to_nits(color.rgb) : hlg_to_nits(color.rgb);
+
+	// BT.2020 to BT.709 primaries (the matrix is given column by column).
+	if (bt2020 != 0)
+	{
+		nits = mat3(
+			1.6605, -0.1246, -0.0182,
+			-0.5876, 1.1329, -0.1006,
+			-0.0728, -0.0083, 1.1187
+		) * nits;
+	}
+
+	// Extended Reinhard curve on the luminance, in units of SDR white,
+	// which maps the peak luminance of the content to SDR white.
+	vec3 linear = max(nits / sdr_white, 0.0);
+	float l = dot(linear, vec3(0.2126, 0.7152, 0.0722));
+	float white = max(peak_luminance / sdr_white, 1.0);
+	float mapped = l * (1.0 + l / (white * white)) / (1.0 + l);
+	linear = clamp(linear * (mapped / max(l, 1e-6)), 0.0, 1.0);
+
+	gl_FragColor = vec4(pow(linear, vec3(1.0 / 2.2)), color.a);
+}
+)glsl";
+
+
+qint64 getCpuTimeInUs()
+{
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) < 0)
+		return 0;
+
+	return
+		(qint64(usage.ru_utime.tv_sec) + qint64(usage.ru_stime.tv_sec)) * 1000000 +
+		qint64(usage.ru_utime.tv_usec) + qint64(usage.ru_stime.tv_usec);
+}
+
+
+} // unnamed namespace end
+
+
+VideoConversion::VideoConversion(Mode mode, bool toneMapping)
+	: m_mode(mode)
+	, m_toneMapping(toneMapping)
+	, m_videoFormat(GST_VIDEO_FORMAT_UNKNOWN)
+{
+}
+
+
+VideoConversion::~VideoConversion()
+{
+	if (m_decodedVideoPad != nullptr)
+	{
+		gst_pad_remove_probe(m_decodedVideoPad, m_probeId);
+		gst_object_unref(GST_OBJECT(m_decodedVideoPad));
+	}
+
+	if (m_toneMappingShader != nullptr)
+		gst_object_unref(GST_OBJECT(m_toneMappingShader));
+}
+
+
+bool VideoConversion::setup(Pipeline &pipeline)
+{
+	if (!m_toneMapping)
+		return true;
+
+	m_toneMappingShader = gst_element_factory_make("glshader", nullptr);
+	if (m_toneMappingShader == nullptr)
+	{
+		qCritical() << "Could not create glshader element for tone mapping";
+		return false;
+	}
+
+	// Keep a reference for updating the uniforms later.
+	gst_object_ref_sink(m_toneMappingShader);
+
+	GstStructure *uniforms = gst_structure_new(
+		"uniforms",
+		"transfer", G_TYPE_INT, gint(TransferSdr),
+		"bt2020", G_TYPE_INT, gint(0),
+		"peak_luminance", G_TYPE_FLOAT, DefaultPeakLuminance,
+		nullptr
+	);
+	g_object_set(
+		m_toneMappingShader,
+		"fragment", toneMappingFragmentShader,
+		"uniforms", uniforms,
+		nullptr
+	);
+	gst_structure_free(uniforms);
+
+	pipeline.addVideoSinkFilter(m_toneMappingShader);
+
+	return true;
+}
+
+
+void VideoConversion::attach(Pipeline &pipeline)
+{
+	assert(m_pipeline == nullptr);
+	assert(pipeline.videoSink() != nullptr);
+
+	m_pipeline = &pipeline;
+
+	if (m_mode == Mode::Cpu)
+	{
+		GError *error = nullptr;
+		GstElement *convertBin = gst_parse_bin_from_description("videoconvert ! video/x-raw,format=RGBA", TRUE, &error);
+		if (convertBin == nullptr)
+		{
+			LOG_ERROR("Could not create videoconvert bin: %s", (error != nullptr) ? error->message : "unknown error");
+			g_clear_error(&error);
+		}
+		else
+		{
+			g_object_set(m_pipeline->playbin(), "video-filter", convertBin, nullptr);
+			m_decodedVideoPad = gst_element_get_static_pad(convertBin, "sink");
+		}
+	}
+
+	if (m_decodedVideoPad == nullptr)
+		m_decodedVideoPad = gst_element_get_static_pad(m_pipeline->videoSink(), "sink");
+	assert(m_decodedVideoPad != nullptr);
+
+	m_probeId = gst_pad_add_probe(
+		m_decodedVideoPad,
+		GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+		&staticOnDecodedVideoProbe,
+		gpointer(this),
+		nullptr
+	);
+
+	m_pipeline->addBusMessageHandler([this](GstMessage *message) {
+		onBusMessage(message);
+	});
+}
+
+
+void VideoConversion::logReport()
+{
+	if (m_playing)
+	{
+		endPlayingPeriod();
+		beginPlayingPeriod();
+	}
+
+	if (m_totalTimeInMs == 0)
+		return;
+
+	GstVideoFormat videoFormat = GstVideoFormat(m_videoFormat.load());
+	LOG_INFO(
+		"Played %.1f s of %s video with conversion %s%s: %.1f%% CPU",
+		m_totalTimeInMs / 1000.0,
+		(videoFormat != GST_VIDEO_FORMAT_UNKNOWN) ? gst_video_format_to_string(videoFormat) : "unknown",
+		(m_mode == Mode::Shader) ? "in shaders" : "on the CPU",
+		m_toneMapping ? " and tone mapping" : "",
+		m_totalCpuTimeInUs / 10.0 / m_totalTimeInMs
+	);
+}
+
+
+GstPadProbeReturn VideoConversion::staticOnDecodedVideoProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	VideoConversion *self = reinterpret_cast<VideoConversion *>(userData);
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+	// NOTE: This is called in the streaming thread.
+
+	if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS)
+	{
+		GstCaps *caps;
+		gst_event_parse_caps(event, &caps);
+		self->onCapsChanged(caps);
+	}
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+void VideoConversion::onCapsChanged(GstCaps *caps)
+{
+	// NOTE: This is called in the streaming thread.
+
+	GstVideoInfo videoInfo;
+	if (!gst_video_info_from_caps(&videoInfo, caps))
+		return;
+
+	m_videoFormat = GST_VIDEO_INFO_FORMAT(&videoInfo);
+
+	GstVideoColorimetry const &colorimetry = GST_VIDEO_INFO_COLORIMETRY(&videoInfo);
+	Transfer transfer = TransferSdr;
+	if (colorimetry.transfer == GST_VIDEO_TRANSFER_SMPTE2084)
+		transfer = TransferPq;
+	else if (colorimetry.transfer == GST_VIDEO_TRANSFER_ARIB_STD_B67)
+		transfer = TransferHlg;
+	bool bt2020 = (colorimetry.primaries == GST_VIDEO_COLOR_PRIMARIES_BT2020);
+
+	gchar *colorimetryString = gst_video_colorimetry_to_string(&colorimetry);
+	LOG_INFO(
+		"Video format %s (%u bit, colorimetry %s); converting %s",
+		GST_VIDEO_INFO_NAME(&videoInfo),
+		GST_VIDEO_FORMAT_INFO_DEPTH(videoInfo.finfo, 0),
+		(colorimetryString != nullptr) ? colorimetryString : "unknown",
+		(m_mode == Mode::Shader) ? "in shaders after uploading the frames as they are" : "on the CPU before the upload"
+	);
+	g_free(colorimetryString);
+
+	if (m_toneMappingShader == nullptr)
+		return;
+
+	// Prefer the actual content light level over the capabilities of the
+	// mastering display (whose luminance is in units of 0.0001 nits).
+	float peakLuminance = DefaultPeakLuminance;
+	GstVideoContentLightLevel contentLightLevel;
+	GstVideoMasteringDisplayInfo masteringDisplayInfo;
+	if (gst_video_content_light_level_from_caps(&contentLightLevel, caps) && (contentLightLevel.max_content_light_level > 0))
+		peakLuminance = contentLightLevel.max_content_light_level;
+	else if (gst_video_mastering_display_info_from_caps(&masteringDisplayInfo, caps) && (masteringDisplayInfo.max_display_mastering_luminance > 0))
+		peakLuminance = masteringDisplayInfo.max_display_mastering_luminance / 10000.0f;
+
+	if (transfer != TransferSdr)
+		LOG_INFO("Tone mapping %s video with a peak luminance of %.0f nits to SDR (preview quality, from 8 bit RGBA)", (transfer == TransferPq) ? "PQ" : "HLG", peakLuminance);
+
+	GstStructure *uniforms = gst_structure_new(
+		"uniforms",
+		"transfer", G_TYPE_INT, gint(transfer),
+		"bt2020", G_TYPE_INT, gint(bt2020 ? 1 : 0),
+		"peak_luminance", G_TYPE_FLOAT, peakLuminance,
+		nullptr
+	);
+	g_object_set(m_toneMappingShader, "uniforms", uniforms, nullptr);
+	gst_structure_free(uniforms);
+}
+
+
+void VideoConversion::onBusMessage(GstMessage *message)
+{
+	if ((GST_MESSAGE_TYPE(message) != GST_MESSAGE_STATE_CHANGED) || (GST_MESSAGE_SRC(message) != GST_OBJECT(m_pipeline->playbin())))
+		return;
+
+	GstState newState;
+	gst_message_parse_state_changed(message, nullptr, &newState, nullptr);
+
+	bool playing = (newState == GST_STATE_PLAYING);
+	if (playing == m_playing)
+		return;
+
+	m_playing = playing;
+	if (m_playing)
+		beginPlayingPeriod();
+	else
+		endPlayingPeriod();
+}
+
+
+void VideoConversion::beginPlayingPeriod()
+{
+	m_periodTimer.start();
+	m_periodStartCpuTimeInUs = getCpuTimeInUs();
+}
+
+
+void VideoConversion::endPlayingPeriod()
+{
+	m_totalTimeInMs += m_periodTimer.elapsed();
+	m_totalCpuTimeInUs += getCpuTimeInUs() - m_periodStartCpuTimeInUs;
+}
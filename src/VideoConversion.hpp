@@ -0,0 +1,86 @@
+#ifndef VIDEO_CONVERSION_HPP
+#define VIDEO_CONVERSION_HPP
+
+#include <atomic>
+
+#include <gst/gst.h>
+
+#include <QElapsedTimer>
+
+
+class Pipeline;
+
+
+// Controls where decoded frames are converted for display, and measures
+// what that costs.
+//
+// By default (Shader mode), frames are uploaded into GL in the format the
+// decoder produced, including 10 bit formats like P010_10LE and I420_10LE,
+// and the conversion to RGB happens in glcolorconvert's shaders. Since
+// playbin's native video flag is set, no videoconvert is involved. Cpu
+// mode instead converts the frames to 8 bit RGBA with videoconvert before
+// the upload, which is what playbin does without the native video flag.
+// It exists for comparison.
+//
+// Optionally, HDR video (PQ and HLG) is tone mapped to SDR by a glshader
+// in front of the qmlglsink. The shader linearizes the signal, converts
+// BT.2020 primaries to BT.709, compresses the highlights according to the
+// peak luminance of the content (from the content light level or the
+// mastering display info, if present), and encodes the result for an SDR
+// display. SDR video passes the shader unchanged. This is a preview
+// quality mode: GStreamer's GL filters only negotiate 8 bit RGBA, so the
+// shader gets the still nonlinear signal already quantized to 8 bits, and
+// linearizing it spreads the dark codes apart, which shows as banding.
+//
+// The CPU usage of the process while playing is measured, so both modes
+// can be compared on the same content.
+
+class VideoConversion
+{
+public:
+	enum class Mode
+	{
+		Shader,
+		Cpu
+	};
+
+	explicit VideoConversion(Mode mode, bool toneMapping);
+	~VideoConversion();
+
+	// Adds the tone mapping shader (if enabled) to the pipeline.
+	// Must be called before Pipeline::setup().
+	bool setup(Pipeline &pipeline);
+
+	// Must be called after Pipeline::setup().
+	void attach(Pipeline &pipeline);
+
+	void logReport();
+
+
+private:
+	static GstPadProbeReturn staticOnDecodedVideoProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	void onCapsChanged(GstCaps *caps);
+	void onBusMessage(GstMessage *message);
+	void beginPlayingPeriod();
+	void endPlayingPeriod();
+
+	Mode m_mode;
+	bool m_toneMapping;
+	Pipeline *m_pipeline = nullptr;
+	GstElement *m_toneMappingShader = nullptr;
+	// The pad where the decoded frames enter the video path.
+	GstPad *m_decodedVideoPad = nullptr;
+	gulong m_probeId = 0;
+
+	// Format of the frames that arrive at the video sink.
+	std::atomic<int> m_videoFormat;
+
+	bool m_playing = false;
+	QElapsedTimer m_periodTimer;
+	qint64 m_periodStartCpuTimeInUs = 0;
+	qint64 m_totalTimeInMs = 0;
+	qint64 m_totalCpuTimeInUs = 0;
+};
+
+
+#endif // VIDEO_CONVERSION_HPP
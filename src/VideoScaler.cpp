@@ -0,0 +1,512 @@
+#include <assert.h>
+#include <algorithm>
+
+#include <gst/gl/gl.h>
+#include <gst/video/video.h>
+
+#include <QDebug>
+#include <QMetaEnum>
+#include <QQuickItem>
+#include <QQuickWindow>
+
+#include "Log.hpp"
+#include "Pipeline.hpp"
+#include "VideoScaler.hpp"
+
+
+namespace
+{
+
+
+// Delay before reacting to size changes of the video item, so
+// interactive resizing does not renegotiate for every step.
+constexpr int ResizeDelayInMs = 100;
+
+
+// GLSL 1.00 / 1.10, so it works with both GLES 2 and desktop GL.
+// glshader's default vertex shader provides v_texcoord and tex.
+char const shaderHeader[] = R"glsl(
+#ifdef GL_ES
+#ifdef GL_FRAGMENT_PRECISION_HIGH
+precision highp float;
+#else
+precision mediump float;
+#endif
+#endif
+
+varying vec2 v_texcoord;
+uniform sampler2D tex;
+uniform float source_width;
+uniform float source_height;
+uniform float output_width;
+uniform float output_height;
+)glsl";
+
+
+char const nearestShader[] = R"glsl(
+void main()
+{
+	// Sample at the center of the texel, where bilinear
+	// filtering returns the texel itself.
+	vec2 size = vec2(source_width, source_height);
+	gl_FragColor = texture2D(tex, (floor(v_texcoord * size) + 0.5) / size);
+}
+)glsl";
+
+
+char const bilinearShader[] = R"glsl(
+void main()
+{
+	gl_FragColor = texture2D(tex, v_texcoord);
+}
+)glsl";
+
+
+char const bicubicShader[] = R"glsl(
+float catmull_rom(float x)
+{
+	x = abs(x);
+	if (x < 1.0)
+		return (1.5 * x - 2.5) * x * x + 1.0;
+	if (x < 2.0)
+		return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+	return 0.0;
+}
+
+void main()
+{
+	vec2 size = vec2(source_width, source_height);
+	vec2 position = v_texcoord * size - 0.5;
+	vec2 base = floor(position);
+	vec2 fraction = position - base;
+
+	vec4 sum = vec4(0.0);
+	float weight_sum = 0.0;
+	for (int y = -1; y <= 2; ++y)
+	{
+		float weight_y = catmull_rom(float(y) - fraction.y);
+		for (int x = -1; x <= 2; ++x)
+		{
+			float weight = catmull_rom(float(x) - fraction.x) * weight_y;
+			sum += texture2D(tex, (base + vec2(float(x), float(y)) + 0.5) / size) * weight;
+			weight_sum += weight;
+		}
+	}
+
+	gl_FragColor = sum / weight_sum;
+}
+)glsl";
+
+
+char const lanczosShader[] = R"glsl(
+const float pi = 3.14159265;
+
+float lanczos3(float x)
+{
+	x = abs(x);
+	if (x < 1e-5)
+		return 1.0;
+	if (x >= 3.0)
+		return 0.0;
+	return 3.0 * sin(pi * x) * sin(pi * x / 3.0) / (pi * pi * x * x);
+}
+
+void main()
+{
+	vec2 size = vec2(source_width, source_height);
+	vec2 position = v_texcoord * size - 0.5;
+	vec2 base = floor(position);
+	vec2 fraction = position - base;
+
+	vec4 sum = vec4(0.0);
+	float weight_sum = 0.0;
+	for (int y = -2; y <= 3; ++y)
+	{
+		float weight_y = lanczos3(float(y) - fraction.y);
+		for (int x = -2; x <= 3; ++x)
+		{
+			float weight = lanczos3(float(x) - fraction.x) * weight_y;
+			sum += texture2D(tex, (base + vec2(float(x), float(y)) + 0.5) / size) * weight;
+			weight_sum += weight;
+		}
+	}
+
+	// The negative lobes can overshoot.
+	gl_FragColor = clamp(sum / weight_sum, 0.0, 1.0);
+}
+)glsl";
+
+
+char const areaShader[] = R"glsl(
+void main()
+{
+	// Average evenly spread bilinear fetches over the texels
+	// that are covered by this pixel. When upscaling, this is
+	// a single bilinear fetch.
+	vec2 size = vec2(source_width, source_height);
+	vec2 footprint = max(size / vec2(output_width, output_height), vec2(1.0));
+	vec2 count = min(ceil(footprint), vec2(8.0));
+	vec2 step_size = footprint / count;
+	vec2 start = v_texcoord * size - footprint * 0.5;
+
+	vec4 sum = vec4(0.0);
+	for (int y = 0; y < 8; ++y)
+	{
+		if (float(y) >= count.y)
+			break;
+		for (int x = 0; x < 8; ++x)
+		{
+			if (float(x) >= count.x)
+				break;
+			sum += texture2D(tex, (start + (vec2(float(x), float(y)) + 0.5) * step_size) / size);
+		}
+	}
+
+	gl_FragColor = sum / (count.x * count.y);
+}
+)glsl";
+
+
+QByteArray fragmentShader(VideoScaler::Mode mode)
+{
+	QByteArray source = shaderHeader;
+
+	switch (mode)
+	{
+		case VideoScaler::Nearest: source += nearestShader; break;
+		case VideoScaler::Bilinear: source += bilinearShader; break;
+		case VideoScaler::Bicubic: source += bicubicShader; break;
+		case VideoScaler::Lanczos: source += lanczosShader; break;
+		case VideoScaler::Area: source += areaShader; break;
+	}
+
+	return source;
+}
+
+
+} // unnamed namespace end
+
+
+VideoScaler::VideoScaler(QObject *parent)
+	: QObject(parent)
+	, m_mode(Bilinear)
+{
+	m_resizeTimer.setSingleShot(true);
+	m_resizeTimer.setInterval(ResizeDelayInMs);
+	connect(&m_resizeTimer, &QTimer::timeout, this, &VideoScaler::updateOutputSize);
+}
+
+
+VideoScaler::~VideoScaler()
+{
+	if (m_shaderSinkPad != nullptr)
+	{
+		gst_pad_remove_probe(m_shaderSinkPad, m_sinkProbeId);
+		gst_object_unref(GST_OBJECT(m_shaderSinkPad));
+	}
+
+	if (m_shaderSrcPad != nullptr)
+	{
+		gst_pad_remove_probe(m_shaderSrcPad, m_srcProbeId);
+		gst_object_unref(GST_OBJECT(m_shaderSrcPad));
+	}
+
+	if (m_shader != nullptr)
+		gst_object_unref(GST_OBJECT(m_shader));
+	if (m_capsfilter != nullptr)
+		gst_object_unref(GST_OBJECT(m_capsfilter));
+}
+
+
+bool VideoScaler::parseMode(QString const &name, Mode &mode)
+{
+	QMetaEnum metaEnum = QMetaEnum::fromType<Mode>();
+	for (int index = 0; index < metaEnum.keyCount(); ++index)
+	{
+		if (name.compare(metaEnum.key(index), Qt::CaseInsensitive) == 0)
+		{
+			mode = Mode(metaEnum.value(index));
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+VideoScaler::Mode VideoScaler::mode() const
+{
+	return Mode(m_mode.load());
+}
+
+
+void VideoScaler::setMode(Mode mode)
+{
+	if (mode == m_mode)
+		return;
+
+	m_mode = mode;
+
+	// glshader compiles the new shader before it renders the next frame.
+	// The uniforms are set again, so they are applied to that shader.
+	if (m_shader != nullptr)
+	{
+		g_object_set(m_shader, "fragment", fragmentShader(mode).constData(), nullptr);
+		updateUniforms();
+	}
+
+	LOG_DEBUG("Video scaling mode: %s", QMetaEnum::fromType<Mode>().valueToKey(mode));
+
+	emit modeChanged();
+}
+
+
+void VideoScaler::setMeasuring(bool measuring)
+{
+	m_measuring = measuring;
+}
+
+
+bool VideoScaler::setup(Pipeline &pipeline)
+{
+	assert(m_shader == nullptr);
+
+	m_shader = gst_element_factory_make("glshader", nullptr);
+	m_capsfilter = gst_element_factory_make("capsfilter", nullptr);
+	if ((m_shader == nullptr) || (m_capsfilter == nullptr))
+	{
+		qCritical() << "Could not create glshader and capsfilter elements for scaling the video";
+		return false;
+	}
+
+	// Keep references for changing the shader and the size later.
+	gst_object_ref_sink(m_shader);
+	gst_object_ref_sink(m_capsfilter);
+
+	g_object_set(m_shader, "fragment", fragmentShader(mode()).constData(), nullptr);
+
+	m_shaderSinkPad = gst_element_get_static_pad(m_shader, "sink");
+	m_shaderSrcPad = gst_element_get_static_pad(m_shader, "src");
+	m_sinkProbeId = gst_pad_add_probe(
+		m_shaderSinkPad,
+		GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+		&staticOnShaderSinkProbe,
+		gpointer(this),
+		nullptr
+	);
+	m_srcProbeId = gst_pad_add_probe(
+		m_shaderSrcPad,
+		GstPadProbeType(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM),
+		&staticOnShaderSrcProbe,
+		gpointer(this),
+		nullptr
+	);
+
+	pipeline.addVideoSinkFilter(m_shader);
+	pipeline.addVideoSinkFilter(m_capsfilter);
+
+	return true;
+}
+
+
+void VideoScaler::attach(QQuickItem *videoItem)
+{
+	assert(m_videoItem == nullptr);
+	assert(videoItem != nullptr);
+
+	m_videoItem = videoItem;
+
+	connect(m_videoItem, &QQuickItem::widthChanged, &m_resizeTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+	connect(m_videoItem, &QQuickItem::heightChanged, &m_resizeTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+	updateOutputSize();
+}
+
+
+void VideoScaler::logReport()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	QMetaEnum metaEnum = QMetaEnum::fromType<Mode>();
+	for (int mode = Nearest; mode <= Area; ++mode)
+	{
+		Statistics const &statistics = m_statistics[mode];
+		if (statistics.m_numFrames == 0)
+			continue;
+
+		LOG_INFO(
+			"Scaling with %s: %llu frames, %.2f ms on average and %.2f ms at most per frame",
+			metaEnum.valueToKey(mode),
+			(unsigned long long)(statistics.m_numFrames),
+			statistics.m_totalTimeInUs / 1000.0 / statistics.m_numFrames,
+			statistics.m_maxTimeInUs / 1000.0
+		);
+	}
+}
+
+
+GstPadProbeReturn VideoScaler::staticOnShaderSinkProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	VideoScaler *self = reinterpret_cast<VideoScaler *>(userData);
+
+	// NOTE: This is called in the streaming thread.
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER)
+	{
+		if (self->m_measuring)
+			self->m_frameStartTime = g_get_monotonic_time();
+		return GST_PAD_PROBE_OK;
+	}
+
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+	if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS)
+		return GST_PAD_PROBE_OK;
+
+	GstCaps *caps;
+	gst_event_parse_caps(event, &caps);
+	GstVideoInfo videoInfo;
+	if (!gst_video_info_from_caps(&videoInfo, caps))
+		return GST_PAD_PROBE_OK;
+
+	double videoAspectRatio = double(GST_VIDEO_INFO_WIDTH(&videoInfo)) * GST_VIDEO_INFO_PAR_N(&videoInfo)
+	                        / (double(GST_VIDEO_INFO_HEIGHT(&videoInfo)) * GST_VIDEO_INFO_PAR_D(&videoInfo));
+
+	bool aspectRatioChanged;
+	{
+		std::lock_guard<std::mutex> lock(self->m_mutex);
+		self->m_negotiatedInputSize = QSize(GST_VIDEO_INFO_WIDTH(&videoInfo), GST_VIDEO_INFO_HEIGHT(&videoInfo));
+		aspectRatioChanged = !qFuzzyCompare(videoAspectRatio, self->m_videoAspectRatio);
+		self->m_videoAspectRatio = videoAspectRatio;
+	}
+
+	self->updateUniforms();
+
+	// The output size follows from the aspect ratio.
+	if (aspectRatioChanged)
+		QMetaObject::invokeMethod(self, &VideoScaler::updateOutputSize, Qt::QueuedConnection);
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+GstPadProbeReturn VideoScaler::staticOnShaderSrcProbe(GstPad *, GstPadProbeInfo *info, gpointer userData)
+{
+	VideoScaler *self = reinterpret_cast<VideoScaler *>(userData);
+
+	// NOTE: This is called in the streaming thread.
+
+	if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER)
+	{
+		if (!self->m_measuring || (self->m_frameStartTime == 0))
+			return GST_PAD_PROBE_OK;
+
+		// Wait for the GPU to finish the frame, so the
+		// measurement includes the actual rendering.
+		GstGLSyncMeta *syncMeta = gst_buffer_get_gl_sync_meta(GST_PAD_PROBE_INFO_BUFFER(info));
+		if (syncMeta != nullptr)
+			gst_gl_sync_meta_wait_cpu(syncMeta, syncMeta->context);
+
+		gint64 timeInUs = g_get_monotonic_time() - self->m_frameStartTime;
+		self->m_frameStartTime = 0;
+
+		std::lock_guard<std::mutex> lock(self->m_mutex);
+		Statistics &statistics = self->m_statistics[self->m_mode.load()];
+		++statistics.m_numFrames;
+		statistics.m_totalTimeInUs += timeInUs;
+		statistics.m_maxTimeInUs = std::max(statistics.m_maxTimeInUs, timeInUs);
+
+		return GST_PAD_PROBE_OK;
+	}
+
+	GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+	if (GST_EVENT_TYPE(event) != GST_EVENT_CAPS)
+		return GST_PAD_PROBE_OK;
+
+	GstCaps *caps;
+	gst_event_parse_caps(event, &caps);
+	GstVideoInfo videoInfo;
+	if (!gst_video_info_from_caps(&videoInfo, caps))
+		return GST_PAD_PROBE_OK;
+
+	{
+		std::lock_guard<std::mutex> lock(self->m_mutex);
+		self->m_negotiatedOutputSize = QSize(GST_VIDEO_INFO_WIDTH(&videoInfo), GST_VIDEO_INFO_HEIGHT(&videoInfo));
+	}
+
+	self->updateUniforms();
+
+	return GST_PAD_PROBE_OK;
+}
+
+
+void VideoScaler::updateUniforms()
+{
+	// NOTE: This is called in the GUI thread and in the streaming thread.
+
+	QSize inputSize, outputSize;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		inputSize = m_negotiatedInputSize;
+		outputSize = m_negotiatedOutputSize;
+	}
+
+	if (inputSize.isEmpty())
+		return;
+	if (outputSize.isEmpty())
+		outputSize = inputSize;
+
+	GstStructure *uniforms = gst_structure_new(
+		"uniforms",
+		"source_width", G_TYPE_FLOAT, float(inputSize.width()),
+		"source_height", G_TYPE_FLOAT, float(inputSize.height()),
+		"output_width", G_TYPE_FLOAT, float(outputSize.width()),
+		"output_height", G_TYPE_FLOAT, float(outputSize.height()),
+		nullptr
+	);
+	g_object_set(m_shader, "uniforms", uniforms, nullptr);
+	gst_structure_free(uniforms);
+}
+
+
+void VideoScaler::updateOutputSize()
+{
+	double videoAspectRatio;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		videoAspectRatio = m_videoAspectRatio;
+	}
+
+	// Fit the video into the item, like the item itself does.
+	QSize outputSize;
+	if ((m_videoItem != nullptr) && (m_videoItem->window() != nullptr) && (videoAspectRatio > 0.0))
+	{
+		QSizeF itemSize = QSizeF(m_videoItem->width(), m_videoItem->height()) * m_videoItem->window()->effectiveDevicePixelRatio();
+		QSizeF videoSize(videoAspectRatio, 1.0);
+		videoSize.scale(itemSize, Qt::KeepAspectRatio);
+		outputSize = QSize(qRound(videoSize.width()), qRound(videoSize.height()));
+	}
+
+	if (outputSize == m_outputSize)
+		return;
+	m_outputSize = outputSize;
+
+	// Until the size is known, the shader renders at the input size.
+	GstCaps *caps;
+	if (m_outputSize.isEmpty())
+		caps = gst_caps_new_any();
+	else
+	{
+		caps = gst_caps_new_simple(
+			"video/x-raw",
+			"width", G_TYPE_INT, gint(m_outputSize.width()),
+			"height", G_TYPE_INT, gint(m_outputSize.height()),
+			"pixel-aspect-ratio", GST_TYPE_FRACTION, 1, 1,
+			nullptr
+		);
+		gst_caps_set_features(caps, 0, gst_caps_features_new("memory:GLMemory", nullptr));
+		LOG_DEBUG("Scaling the video to %dx%d", m_outputSize.width(), m_outputSize.height());
+	}
+
+	g_object_set(m_capsfilter, "caps", caps, nullptr);
+	gst_caps_unref(caps);
+}
@@ -0,0 +1,123 @@
+#ifndef VIDEO_SCALER_HPP
+#define VIDEO_SCALER_HPP
+
+#include <atomic>
+#include <mutex>
+
+#include <gst/gst.h>
+
+#include <QObject>
+#include <QSize>
+#include <QString>
+#include <QTimer>
+
+
+class QQuickItem;
+class Pipeline;
+
+
+// Scales the video to the size it is displayed at, with a selectable filter.
+//
+// GstGLVideoItem always samples the video texture bilinearly, which looks
+// blurry when upscaling and aliases when downscaling by large factors. The
+// scaler therefore renders each frame with a glshader in front of the
+// qmlglsink, directly at the pixel size of the video area in the item, so
+// the item then draws it 1:1. The filter is selected with the "mode"
+// property, which can be changed from QML at any time:
+//
+// - Nearest: one texel per pixel; the cheapest mode.
+// - Bilinear: one bilinear fetch per pixel, like the video item itself.
+// - Bicubic: Catmull-Rom filter over 4x4 texels.
+// - Lanczos: three-lobed Lanczos filter over 6x6 texels; the sharpest mode.
+// - Area: averages all texels under each pixel (up to 8x8 bilinear
+//   fetches), which gives the quality of a mipmapped downscale.
+//
+// Optionally, the time each frame spends in the scaler, including the
+// GPU work (the streaming thread waits for the GPU to finish it), is
+// measured, and logged per mode at exit.
+
+class VideoScaler
+	: public QObject
+{
+	Q_OBJECT
+	Q_PROPERTY(Mode mode READ mode WRITE setMode NOTIFY modeChanged)
+
+public:
+	enum Mode
+	{
+		Nearest,
+		Bilinear,
+		Bicubic,
+		Lanczos,
+		Area
+	};
+	Q_ENUM(Mode)
+
+	explicit VideoScaler(QObject *parent = nullptr);
+	~VideoScaler() override;
+
+	// Parses a mode name ("nearest", "bilinear", ...). Returns false
+	// if the name is unknown.
+	static bool parseMode(QString const &name, Mode &mode);
+
+	Mode mode() const;
+	void setMode(Mode mode);
+
+	void setMeasuring(bool measuring);
+
+	// Adds the scaler to the pipeline. Must be called before Pipeline::setup().
+	bool setup(Pipeline &pipeline);
+
+	// Makes the scaler follow the size of the video item. Must be called
+	// after Pipeline::setup(), and before playback starts.
+	void attach(QQuickItem *videoItem);
+
+	void logReport();
+
+signals:
+	void modeChanged();
+
+
+private:
+	struct Statistics
+	{
+		quint64 m_numFrames = 0;
+		gint64 m_totalTimeInUs = 0;
+		gint64 m_maxTimeInUs = 0;
+	};
+
+	static GstPadProbeReturn staticOnShaderSinkProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	static GstPadProbeReturn staticOnShaderSrcProbe(GstPad *pad, GstPadProbeInfo *info, gpointer userData);
+	void updateUniforms();
+	void updateOutputSize();
+
+	std::atomic<int> m_mode;
+	bool m_measuring = false;
+
+	GstElement *m_shader = nullptr;
+	GstElement *m_capsfilter = nullptr;
+	GstPad *m_shaderSinkPad = nullptr;
+	GstPad *m_shaderSrcPad = nullptr;
+	gulong m_sinkProbeId = 0;
+	gulong m_srcProbeId = 0;
+
+	QQuickItem *m_videoItem = nullptr;
+	QTimer m_resizeTimer;
+	QSize m_outputSize;
+
+	// Negotiated sizes, and the display aspect ratio of the input.
+	// Written in the streaming thread, read in the GUI thread as well.
+	std::mutex m_mutex;
+	QSize m_negotiatedInputSize;
+	QSize m_negotiatedOutputSize;
+	double m_videoAspectRatio = 0.0;
+
+	// Only accessed in the streaming thread.
+	gint64 m_frameStartTime = 0;
+
+	// Per mode. Protected by m_mutex.
+	Statistics m_statistics[Area + 1];
+};
+
+
+#endif // VIDEO_SCALER_HPP
@@ -2,10 +2,13 @@
 #include <array>
 #include <cstring>
 #include <cerrno>
+#include <cstdlib>
 #include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <gst/gst.h>
-#include <gst/app/app.h>
 
 #include <signal.h>
 #include <unistd.h>
@@ -15,11 +18,49 @@
 #include <QQuickItem>
 #include <QQuickWindow>
 #include <QQmlApplicationEngine>
+#include <QQmlContext>
 #include <QCommandLineParser>
 #include <QSocketNotifier>
 #include <QString>
-
+#include <QQmlEngine>
+#include <QScreen>
+#include <QSurfaceFormat>
+#include <QTimer>
+
+#include "AdaptiveStreamingTuner.hpp"
+#include "AutoplugCache.hpp"
+#include "ClosedCaptions.hpp"
+#include "DecoderAutotune.hpp"
+#include "FrameMetadataController.hpp"
+#include "FramePusher.hpp"
+#include "IdleController.hpp"
+#include "Log.hpp"
+#include "MediaIndex.hpp"
+#include "Pipeline.hpp"
+#include "PlayerController.hpp"
+#include "Playlist.hpp"
+#include "PlaylistPlayer.hpp"
+#include "PositionStore.hpp"
+#include "PressureMonitor.hpp"
+#include "QosController.hpp"
+#include "RawFrameSource.hpp"
+#include "ReadAheadFileSrc.hpp"
+#include "ReconnectController.hpp"
+#include "ResolutionChangeMonitor.hpp"
+#include "ResourceScaler.hpp"
 #include "ScopeGuard.hpp"
+#include "SoakTest.hpp"
+#include "StallMonitor.hpp"
+#include "StateChangeProfiler.hpp"
+#include "StillImageItem.hpp"
+#include "ThroughputBenchmark.hpp"
+#include "VideoConversion.hpp"
+#include "VideoScaler.hpp"
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBAVCODEC
+#include "BitmapSubtitleDecoder.hpp"
+#include "BitmapSubtitleItem.hpp"
+#endif
 
 
 // Utility code to set up signal handlers to gracefully quit
@@ -144,217 +185,35 @@ private:
 };
 
 
-// Simple playbin based GStreamer pipeline.
+// Adds the leaks tracer to the tracers in GST_TRACERS, unless it is
+// already listed there. GST_TRACERS is a semicolon separated list, and
+// each tracer can have parameters in parentheses.
 
-class Pipeline
+void enableLeaksTracer()
 {
-public:
-	Pipeline()
-	{
-	}
-
-	~Pipeline()
-	{
-		if (m_playbin == nullptr)
-			return;
-
-		// Stop playback by setting the pipeline to the NULL state.
-		gst_element_set_state(m_playbin, GST_STATE_NULL);
-
-		// Make sure the qmlglsink no longer uses the Qt widget
-		// before the QML UI is torn down.
-		if (m_qmlglsink != nullptr)
-			g_object_set(m_qmlglsink, "widget", gpointer(nullptr), nullptr);
-
-		// Deallocate the pipeline. We are not explictly deallocating
-		// m_qmlglsink, since that one is taken care of by glsinkbin,
-		// which in turn is taken care of by m_playbin.
-		gst_object_unref(GST_OBJECT(m_playbin));
-	}
-
-
-	bool setup(QString inputUrl, QObject *qmlSubtitleItem)
-	{
-		// Scope guard to cleanup the pipeline in case setup fails.
-		auto pipelineGuard = makeScopeGuard([&]() {
-			if (m_playbin != nullptr)
-			{
-				gst_object_unref(GST_OBJECT(m_playbin));
-				m_playbin = nullptr;
-			}
-		});
-
-
-		// Store the pointer to be able to set its subtitle property later.
-		m_qmlSubtitleItem = qmlSubtitleItem;
-
-
-		// Create the pipeline.
-
-		// Note that playbin is a fully featured pipeline element, and putting
-		// it in a dedicated additional pipeline element is unnecessary, which
-		// is why there's no gst_pipeline_new() call here.
-		m_playbin = gst_element_factory_make("playbin", nullptr);
-		if (m_playbin == nullptr)
-		{
-			qCritical() << "Could not create playbin element";
-			return false;
-		}
-
-		GstElement *glsinkbin = nullptr;
-		GstElement *subtitleAppsink = nullptr;
-
-		// Scope guard to make sure the elements above are always
-		// unref'd in case an error occurs. This guard is needed
-		// until these elements are transferred over to playbin.
-		auto elementUnrefGuard = makeScopeGuard([&]() {
-			if (glsinkbin != nullptr)
-				gst_object_unref(GST_OBJECT(glsinkbin));
-			if (subtitleAppsink != nullptr)
-				gst_object_unref(GST_OBJECT(subtitleAppsink));
-		});
-
-		// Create the glsinkbin. This will be used as the video sink by playbin.
-		glsinkbin = gst_element_factory_make("glsinkbin", nullptr);
-		if (glsinkbin == nullptr)
-		{
-			qCritical() << "Could not create glsinkbin element";
-			return false;
-		}
-
-		// Create the appsink that will be used for extracting subtitles.
-		subtitleAppsink = gst_element_factory_make("appsink", nullptr);
-		if (subtitleAppsink == nullptr)
-		{
-			qCritical() << "Could not create subtitle appsink element";
-			return false;
-		}
-
-		// Create the qmlglsink and assign it to the glsinkbin, which
-		// takes ownership over that qmlglsink.
-		m_qmlglsink = gst_element_factory_make("qmlglsink", nullptr);
-		if (m_qmlglsink == nullptr)
-		{
-			qCritical() << "Could not create qmlglsink element";
-			return false;
-		}
-		g_object_set(glsinkbin, "sink", m_qmlglsink, nullptr);
-
-		// Set the glsinkbin as the video sink to use for playback. The flags
-		// are set to 0x57, which disables all software based video postprocessing
-		// (color balancing, deinterlacing ...) but keeps software based audio
-		// postprocessing enabled. Disabling the video postprocessing is essential
-		// on embedded platforms to minimize stutter (which is cause by a saturated CPU).
-		// Also, set the subtitleAppsink as the "text sink" (aka the subtitle sink).
-		g_object_set(
-			m_playbin,
-			"uri", inputUrl.toStdString().c_str(),
-			"flags", gint(0x57),
-			"video-sink", glsinkbin,
-			"text-sink", subtitleAppsink,
-			nullptr
-		);
-
-		// playbin owns the glsinkbin and subtitle appsink now.
-		// The scope guard is no longer needed.
-		elementUnrefGuard.dismiss();
-
-		// Set the appsink callbacks to be informed whenever new subtitles are read.
-		// These subtitles can then be displayed in QML.
-		{
-			GstAppSinkCallbacks subtitleAppsinkCallbacks = {};
-			subtitleAppsinkCallbacks.new_sample = &staticOnNewSubtitle;
+	std::string tracers;
+	if (char const *configuredTracers = std::getenv("GST_TRACERS"))
+		tracers = configuredTracers;
 
-			gst_app_sink_set_callbacks(
-				GST_APP_SINK(subtitleAppsink),
-				&subtitleAppsinkCallbacks,
-				gpointer(this),
-				nullptr
-			);
-
-			// Further refine appsink behavior:
-			// - Enable the drop property to make sure the appsink never blocks.
-			//   If subtitles are not shown in time, we anyway do not want to
-			//   show them anymore, so it is OK to drop stale subtitles.
-			// - Set max-buffers to 1 since we do not want a queue of subtitles.
-			g_object_set(
-				G_OBJECT(subtitleAppsink),
-				"drop", gboolean(TRUE),
-				"max-buffers", guint(1),
-				nullptr
-			);
-		}
-
-
-		// Note that a proper application would also install a GStreamer bus watch
-		// into the pipeline. And, that bus watch hooks into the GLib mainloop.
-		// If Qt is built with Glib integration, then the Qt mainloop is built
-		// upon the mainloop one, and the bus watch will "just work". If not,
-		// then the bus watch would have to be attached to a dedicated mainloop
-		// that runs in a separate thread. For sake of simplicity, this example
-		// does not use a bus watch.
-
-
-		// Dismiss the pipeline guard since setup completed successfully.
-		pipelineGuard.dismiss();
-		return true;
-	}
-
-
-	bool start(QQuickItem *videoItem)
+	std::size_t start = 0;
+	while (start < tracers.size())
 	{
-		assert(m_playbin != nullptr);
-		assert(m_qmlglsink != nullptr);
-
-		// Assign the GLVideoItem from the QML UI to the qmlglsink before the
-		// pipeline is started.
-		// We cast the videoItem pointer to gpointer to avoid compiler warnings
-		// and to make sure the GObject property system works properly.
-		g_object_set(m_qmlglsink, "widget", gpointer(videoItem), nullptr);
-
-		if (gst_element_set_state(m_playbin, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
-		{
-			qCritical() << "Could not set pipeline state to PLAYING";
-			return false;
-		}
+		std::size_t end = tracers.find(';', start);
+		if (end == std::string::npos)
+			end = tracers.size();
 
-		return true;
-	}
-
-
-private:
-	static GstFlowReturn staticOnNewSubtitle(GstAppSink *subtitleAppsink, gpointer userData)
-	{
-		Pipeline *self = reinterpret_cast<Pipeline *>(userData);
-
-		// Extract the subtitle text from the GstBuffer inside the newest GstSample.
-
-		GstSample *subtitleSample = gst_app_sink_pull_sample(subtitleAppsink);
-		GstBuffer *subtitleBuffer = gst_sample_get_buffer(subtitleSample);
-
-		GstMapInfo mapInfo;
-		gst_buffer_map(subtitleBuffer, &mapInfo, GST_MAP_READ);
-		auto guard = makeScopeGuard([&]() {
-			gst_buffer_unmap(subtitleBuffer, &mapInfo);
-		});
-
-		// NOTE: Typically, the subtitle buffers do _not_ contain
-		// a trailing nullbyte.
-		QString subtitle = QString::fromUtf8(
-			reinterpret_cast<char const *>(mapInfo.data),
-			mapInfo.size
-		);
-
-		qDebug() << "Subtitle:" << subtitle;
-		self->m_qmlSubtitleItem->setProperty("subtitle", subtitle);
+		std::string tracer = tracers.substr(start, end - start);
+		if ((tracer == "leaks") || (tracer.compare(0, 6, "leaks(") == 0))
+			return;
 
-		return GST_FLOW_OK;
+		start = end + 1;
 	}
 
-	GstElement *m_playbin = nullptr;
-	GstElement *m_qmlglsink = nullptr;
-	QObject *m_qmlSubtitleItem = nullptr;
-};
+	if (!tracers.empty())
+		tracers += ';';
+	tracers += "leaks";
+	setenv("GST_TRACERS", tracers.c_str(), 1);
+}
 
 
 // Helper class to start the pipeline once the scenegraph is up and running.
@@ -363,31 +222,49 @@ class SetPlayingJob
 	: public QRunnable
 {
 public:
-	explicit SetPlayingJob(Pipeline &pipeline, QQuickItem *qmlVideoItem, QCoreApplication &application)
+	explicit SetPlayingJob(Pipeline &pipeline, QQuickItem *qmlVideoItem, PlaylistPlayer &playlistPlayer)
 		: m_pipeline(pipeline)
 		, m_qmlVideoItem(qmlVideoItem)
-		, m_application(application)
+		, m_playlistPlayer(playlistPlayer)
 	{
 	}
 
 	void run() override
 	{
-		if (!m_pipeline.start(m_qmlVideoItem))
-		{
-			qCritical() << "Could not start pipeline; quitting";
-			m_application.quit();
-		}
+		// Assign the GLVideoItem from the QML UI to the qmlglsink before the
+		// pipeline is started. Then, start the playlist playback in the
+		// thread of the playlist player (the GUI thread).
+		m_pipeline.attachVideoItem(m_qmlVideoItem);
+		QMetaObject::invokeMethod(&m_playlistPlayer, "start", Qt::QueuedConnection);
 	}
 
 private:
 	Pipeline &m_pipeline;
 	QQuickItem *m_qmlVideoItem;
-	QCoreApplication &m_application;
+	PlaylistPlayer &m_playlistPlayer;
 };
 
 
 int main(int argc, char *argv[])
 {
+	// Used for measuring the time from launch to the first resumed frame.
+	gint64 const launchTime = g_get_monotonic_time();
+
+	// The soak test uses the GStreamer leaks tracer for sampling the number
+	// of live GStreamer objects. Tracers are instantiated by gst_init(),
+	// so the environment variable has to be set before that call, which
+	// is before the command line is parsed by QCommandLineParser.
+	for (int i = 1; i < argc; ++i)
+	{
+		// QCommandLineParser accepts "--soak-test <seconds>" as
+		// well as "--soak-test=<seconds>".
+		if ((std::strcmp(argv[i], "--soak-test") == 0) || (std::strncmp(argv[i], "--soak-test=", 12) == 0))
+		{
+			enableLeaksTracer();
+			break;
+		}
+	}
+
 	{
 		GError *error = nullptr;
 		if (!gst_init_check(&argc, &argv, &error))
@@ -423,8 +300,94 @@ int main(int argc, char *argv[])
 	QCommandLineOption helpOption = cmdlineParser.addHelpOption();
 	QCommandLineOption inputFileOrUrlOption(QStringList() << "i" << "input", "Input file/URL to play", "input");
 	cmdlineParser.addOption(inputFileOrUrlOption);
+	QCommandLineOption playlistOption(QStringList() << "p" << "playlist", "Playlist file with one input file/URL per line; images can be followed by a tab and the duration in seconds", "playlist");
+	cmdlineParser.addOption(playlistOption);
+	QCommandLineOption loopOption(QStringList() << "l" << "loop", "Restart the playlist once its end is reached");
+	cmdlineParser.addOption(loopOption);
+	QCommandLineOption imageDurationOption(QStringList() << "image-duration", "Default duration in seconds for showing images", "seconds", "10");
+	cmdlineParser.addOption(imageDurationOption);
+	QCommandLineOption imageCacheSizeOption(QStringList() << "image-cache-size", "Budget in MB for cached image textures", "megabytes", "64");
+	cmdlineParser.addOption(imageCacheSizeOption);
 	QCommandLineOption runInFullScreenOption(QStringList() << "f" << "fullscreen", "Run application in fullscreen mode");
 	cmdlineParser.addOption(runInFullScreenOption);
+	QCommandLineOption logLevelOption(QStringList() << "log-level", "Minimum level of logged messages (trace, debug, info, warning, error)", "level", "debug");
+	cmdlineParser.addOption(logLevelOption);
+	QCommandLineOption logTargetOption(QStringList() << "log-target", "Where to write log messages to (stderr, journald, file:<filename>)", "target", "stderr");
+	cmdlineParser.addOption(logTargetOption);
+	QCommandLineOption gstDebugToLogOption(QStringList() << "gst-debug-to-log", "Route GStreamer debug output through the asynchronous logger");
+	cmdlineParser.addOption(gstDebugToLogOption);
+	QCommandLineOption stallThresholdOption(QStringList() << "stall-threshold", "Monitor the GUI and render threads, and record stalls longer than this many milliseconds", "milliseconds");
+	cmdlineParser.addOption(stallThresholdOption);
+	QCommandLineOption stallStackSamplesOption(QStringList() << "stall-stack-samples", "Sample the stack of stalled threads (requires --stall-threshold)");
+	cmdlineParser.addOption(stallStackSamplesOption);
+	QCommandLineOption soakTestOption(QStringList() << "soak-test", "Run a soak test for this many seconds, and fail if resource usage grows beyond the soak test bounds", "seconds");
+	cmdlineParser.addOption(soakTestOption);
+	QCommandLineOption soakActionIntervalOption(QStringList() << "soak-action-interval", "Interval between soak test actions (seek, pause, switch input, restart)", "milliseconds", "2000");
+	cmdlineParser.addOption(soakActionIntervalOption);
+	QCommandLineOption soakBoundsOption(QStringList() << "soak-bounds", "Allowed growth during the soak test: rss=<MB>,fds=<n>,threads=<n>,gstobjects=<n>,globjects=<n>", "bounds");
+	cmdlineParser.addOption(soakBoundsOption);
+	QCommandLineOption readaheadOption(QStringList() << "readahead", "Read local files with the read-ahead file source, reading this many MB ahead (0 = no read-ahead hints)", "megabytes");
+	cmdlineParser.addOption(readaheadOption);
+	QCommandLineOption readaheadBlockSizeOption(QStringList() << "readahead-block-size", "Size in kB of the individual reads of the read-ahead file source", "kilobytes", "1024");
+	cmdlineParser.addOption(readaheadBlockSizeOption);
+	QCommandLineOption ioUringDepthOption(QStringList() << "io-uring-depth", "Number of io_uring reads the read-ahead file source keeps in flight (0 = no io_uring)", "count", "0");
+	cmdlineParser.addOption(ioUringDepthOption);
+	QCommandLineOption abrStartLowestOption(QStringList() << "abr-start-lowest", "Start HLS/DASH streams with the lowest variant");
+	cmdlineParser.addOption(abrStartLowestOption);
+	QCommandLineOption abrBandwidthRatioOption(QStringList() << "abr-bandwidth-ratio", "Fraction (0-1) of the measured bandwidth HLS/DASH variants may use", "ratio");
+	cmdlineParser.addOption(abrBandwidthRatioOption);
+	QCommandLineOption abrCapResolutionOption(QStringList() << "abr-cap-resolution", "Do not select HLS/DASH variants with a resolution larger than the display");
+	cmdlineParser.addOption(abrCapResolutionOption);
+	QCommandLineOption reconnectOption(QStringList() << "reconnect", "Reconnect network inputs after connection losses, for up to this many seconds (0 = no limit)", "seconds");
+	cmdlineParser.addOption(reconnectOption);
+	QCommandLineOption decoderAutotuneOption(QStringList() << "decoder-autotune", "Prefer the decoders that --decoder-autotune-run found to be fastest on this device");
+	cmdlineParser.addOption(decoderAutotuneOption);
+	QCommandLineOption decoderAutotuneRunOption(QStringList() << "decoder-autotune-run", "Benchmark the video decoders that were not benchmarked before, store the results for --decoder-autotune, and exit (takes minutes)");
+	cmdlineParser.addOption(decoderAutotuneRunOption);
+	QCommandLineOption decoderAutotuneRerunOption(QStringList() << "decoder-autotune-rerun", "Like --decoder-autotune-run, but benchmark all decoders again");
+	cmdlineParser.addOption(decoderAutotuneRerunOption);
+	QCommandLineOption rankOverridesOption(QStringList() << "ranks", "Override plugin feature ranks: <feature>=<rank>[,...]; rank is a number or none/marginal/secondary/primary", "overrides");
+	cmdlineParser.addOption(rankOverridesOption);
+	QCommandLineOption qosMaxLevelOption(QStringList() << "qos-max-level", "How far the video quality may be degraded if the device cannot keep up (0 = never, 1 = skip non-reference frames, 2 = also lower the decode resolution, 3 = also halve the frame rate)", "level", "3");
+	cmdlineParser.addOption(qosMaxLevelOption);
+	QCommandLineOption pressureMonitorOption(QStringList() << "pressure-monitor", "Adapt caches, buffers, decoder threads, and read-ahead to CPU, memory, and I/O pressure (Linux PSI)");
+	cmdlineParser.addOption(pressureMonitorOption);
+	QCommandLineOption mediaIndexOption(QStringList() << "media-index", "Discover local playlist entries in the background, and cache their stream information on disk to start them faster");
+	cmdlineParser.addOption(mediaIndexOption);
+	QCommandLineOption profileStateChangesOption(QStringList() << "profile-state-changes", "Measure how long each element spends in each state change, and log the slowest ones for startup, seeks, and teardown at exit");
+	cmdlineParser.addOption(profileStateChangesOption);
+	QCommandLineOption rawFramesOption(QStringList() << "raw-frames", "Play video inputs as already decoded frames (Y4M files, or raw frame files with --raw-frame-format) to benchmark upload and rendering without decoding");
+	cmdlineParser.addOption(rawFramesOption);
+	QCommandLineOption rawFrameFormatOption(QStringList() << "raw-frame-format", "Frame format of raw frame files that are not Y4M files, for example 1920x1080@60:NV12", "format");
+	cmdlineParser.addOption(rawFrameFormatOption);
+	QCommandLineOption unthrottledOption(QStringList() << "unthrottled", "Play and render as fast as possible instead of in realtime (no clock synchronization, no vsync, no audio), and log the achieved frame rates");
+	cmdlineParser.addOption(unthrottledOption);
+	QCommandLineOption autoplugCacheOption(QStringList() << "autoplug-cache", "Remember the detected container format and the chosen demuxers, parsers, and decoders of local inputs, and reuse them at their next start");
+	cmdlineParser.addOption(autoplugCacheOption);
+	QCommandLineOption resumeOption(QStringList() << "resume", "Remember the playback position of each input, and resume from there at its next start");
+	cmdlineParser.addOption(resumeOption);
+	QCommandLineOption fixedVideoSizeOption(QStringList() << "fixed-video-size", "Scale all video frames to this size (<width>x<height>, or \"screen\" for the display size) on the GPU, so resolution changes of the input do not reconfigure the video sink", "size");
+	cmdlineParser.addOption(fixedVideoSizeOption);
+	QCommandLineOption videoConversionOption(QStringList() << "video-conversion", "Convert video frames to RGB in GL shaders after uploading them in their native format (\"shader\"), or on the CPU before the upload (\"cpu\", for comparison); the CPU usage while playing is logged at exit", "where");
+	cmdlineParser.addOption(videoConversionOption);
+	QCommandLineOption hdrToneMappingOption(QStringList() << "hdr-tone-mapping", "Tone map HDR video (PQ and HLG) to SDR in a shader in front of the video item. Preview quality: the shader gets the video as 8 bit RGBA, so the 10 bit signal is quantized before it is linearized, which causes banding in dark gradients");
+	cmdlineParser.addOption(hdrToneMappingOption);
+	QCommandLineOption videoScalingOption(QStringList() << "video-scaling", "Scale the video to its displayed size in a shader with this filter (nearest, bilinear, bicubic, lanczos, or area); QML can change it later through \"videoScaler.mode\"", "filter");
+	cmdlineParser.addOption(videoScalingOption);
+	QCommandLineOption measureVideoScalingOption(QStringList() << "measure-video-scaling", "Measure the render time of each frame in the video scaler, and log it per filter at exit (requires --video-scaling)");
+	cmdlineParser.addOption(measureVideoScalingOption);
+	QCommandLineOption measureResolutionChangesOption(QStringList() << "measure-resolution-changes", "Log the gap between frames at each resolution change of the video");
+	cmdlineParser.addOption(measureResolutionChangesOption);
+	QCommandLineOption closedCaptionsOption(QStringList() << "closed-captions", "Show CEA-608/708 closed captions that are embedded in the video stream");
+	cmdlineParser.addOption(closedCaptionsOption);
+	QCommandLineOption frameMetadataOption(QStringList() << "frame-metadata", "Extract time codes, regions of interest, SEI user data, and KLV packets, and deliver them to QML (as \"frameMetadata\") together with the frame they belong to");
+	cmdlineParser.addOption(frameMetadataOption);
+	QCommandLineOption idleModeOption(QStringList() << "idle-mode", "Stop or throttle periodic work (stall monitor, pressure polling, subtitle timer) while playback is paused or a still image is shown, and nothing on screen changes; log the CPU usage, wakeups, and rendered frames while not playing");
+	cmdlineParser.addOption(idleModeOption);
+	QCommandLineOption idleReportOption(QStringList() << "idle-report", "Only log the CPU usage, wakeups, and rendered frames while not playing, without throttling anything (for comparison with --idle-mode)");
+	cmdlineParser.addOption(idleReportOption);
+	QCommandLineOption pushTestPatternOption(QStringList() << "push-test-pattern", "Generate a test pattern in the application and push it into the pipeline; play it with -i " + FramePusher::uri());
+	cmdlineParser.addOption(pushTestPatternOption);
 
 	if (!cmdlineParser.parse(app.arguments()))
 	{
@@ -440,38 +403,281 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
-	if (!cmdlineParser.isSet(inputFileOrUrlOption))
+	// Set up logging as early as possible, but after the command line
+	// was parsed, since the logging configuration is read from it.
 	{
-		qCritical() << "Input file/URL (-i) must be set!";
+		LogConfig logConfig;
+
+		if (!parseLogLevel(cmdlineParser.value(logLevelOption), logConfig.m_level))
+		{
+			qCritical() << "Invalid log level" << cmdlineParser.value(logLevelOption);
+			return -1;
+		}
+
+		if (!parseLogTarget(cmdlineParser.value(logTargetOption), logConfig))
+		{
+			qCritical() << "Invalid log target" << cmdlineParser.value(logTargetOption);
+			return -1;
+		}
+
+		logConfig.m_routeGStreamerDebugOutput = cmdlineParser.isSet(gstDebugToLogOption);
+
+		if (!startLogging(logConfig))
+			return -1;
+	}
+
+	// Scope guard to write out all queued log messages before quitting.
+	auto logGuard = makeScopeGuard([]() {
+		stopLogging();
+	});
+
+	// Benchmarking the decoders takes minutes (many encodes and decodes up
+	// to 2160p), so it is a separate command instead of a startup step.
+	if (cmdlineParser.isSet(decoderAutotuneRunOption) || cmdlineParser.isSet(decoderAutotuneRerunOption))
+	{
+		DecoderAutotune decoderAutotune;
+		decoderAutotune.run(cmdlineParser.isSet(decoderAutotuneRerunOption));
+		decoderAutotune.applyRanks();
+		return 0;
+	}
+
+	if (cmdlineParser.isSet(inputFileOrUrlOption) == cmdlineParser.isSet(playlistOption))
+	{
+		qCritical() << "Either input file/URL (-i) or playlist (-p) must be set!";
 		return -1;
 	}
 
-	QString inputUrl = cmdlineParser.value(inputFileOrUrlOption);
+	Playlist playlist;
+	if (cmdlineParser.isSet(playlistOption))
+	{
+		if (!loadPlaylist(cmdlineParser.value(playlistOption), playlist))
+			return -1;
+	}
+	else
+	{
+		PlaylistEntry entry;
+		if (!makePlaylistEntry(cmdlineParser.value(inputFileOrUrlOption), entry))
+			return -1;
+		playlist.push_back(std::move(entry));
+	}
+
+	// Raw frame inputs are played through playbin's appsrc, which is
+	// set up by the RawFrameSource once the pipeline exists.
+	bool useRawFrames = cmdlineParser.isSet(rawFramesOption);
+	GstVideoInfo rawFrameFormat;
+	if (useRawFrames)
+	{
+		for (PlaylistEntry &entry : playlist)
+		{
+			if (entry.m_type != PlaylistEntry::Type::Video)
+				continue;
+
+			QString uri = RawFrameSource::toUri(entry.m_url);
+			if (uri.isEmpty())
+			{
+				qCritical() << "Raw frame inputs must be local files:" << entry.m_url;
+				return -1;
+			}
+			entry.m_url = uri;
+		}
+
+		if (cmdlineParser.isSet(rawFrameFormatOption) && !RawFrameSource::parseRawFormat(cmdlineParser.value(rawFrameFormatOption), rawFrameFormat))
+		{
+			qCritical() << "Invalid raw frame format" << cmdlineParser.value(rawFrameFormatOption);
+			return -1;
+		}
+	}
+
 	bool runInFullscreen = cmdlineParser.isSet(runInFullScreenOption);
+	bool loopPlaylist = cmdlineParser.isSet(loopOption);
 
-	if (!gst_uri_is_valid(inputUrl.toStdString().c_str()))
+	bool ok;
+	double imageDurationInSeconds = cmdlineParser.value(imageDurationOption).toDouble(&ok);
+	if (!ok || (imageDurationInSeconds <= 0))
 	{
-		GError *error = nullptr;
-		gchar *uri = gst_filename_to_uri(inputUrl.toStdString().c_str(), &error);
-		if (uri != nullptr)
+		qCritical() << "Invalid image duration" << cmdlineParser.value(imageDurationOption);
+		return -1;
+	}
+
+	unsigned int imageCacheSizeInMB = cmdlineParser.value(imageCacheSizeOption).toUInt(&ok);
+	if (!ok)
+	{
+		qCritical() << "Invalid image cache size" << cmdlineParser.value(imageCacheSizeOption);
+		return -1;
+	}
+
+	int soakTestDurationInSeconds = 0;
+	int soakActionIntervalInMs = 0;
+	SoakTest::Bounds soakTestBounds;
+	if (cmdlineParser.isSet(soakTestOption))
+	{
+		// Anything shorter would end with the baseline as the only sample.
+		soakTestDurationInSeconds = cmdlineParser.value(soakTestOption).toInt(&ok);
+		if (!ok || (qint64(soakTestDurationInSeconds) * 1000 <= SoakTest::SampleIntervalInMs))
 		{
-			qCritical() << "Input is not a valid URI; treated it as a filename, and converted it to file URI" << uri;
-			inputUrl = uri;
-			g_free(uri);
+			qCritical() << "Invalid soak test duration" << cmdlineParser.value(soakTestOption) << "(must be longer than" << (SoakTest::SampleIntervalInMs / 1000) << "s)";
+			return -1;
 		}
-		else
+
+		soakActionIntervalInMs = cmdlineParser.value(soakActionIntervalOption).toInt(&ok);
+		if (!ok || (soakActionIntervalInMs <= 0))
 		{
-			qCritical() << "Input is not a valid URI, and it could not be converted to a file URI: " << error->message;
-			g_error_free(error);
+			qCritical() << "Invalid soak test action interval" << cmdlineParser.value(soakActionIntervalOption);
+			return -1;
+		}
+
+		if (cmdlineParser.isSet(soakBoundsOption) && !SoakTest::parseBounds(cmdlineParser.value(soakBoundsOption), soakTestBounds))
+		{
+			qCritical() << "Invalid soak test bounds" << cmdlineParser.value(soakBoundsOption);
+			return -1;
+		}
+	}
+
+	bool useReadaheadFileSrc = cmdlineParser.isSet(readaheadOption);
+	unsigned int readaheadSizeInMB = 0;
+	unsigned int readaheadBlockSizeInKB = 0;
+	unsigned int ioUringDepth = 0;
+	if (useReadaheadFileSrc)
+	{
+		readaheadSizeInMB = cmdlineParser.value(readaheadOption).toUInt(&ok);
+		if (!ok)
+		{
+			qCritical() << "Invalid read-ahead size" << cmdlineParser.value(readaheadOption);
+			return -1;
+		}
+
+		readaheadBlockSizeInKB = cmdlineParser.value(readaheadBlockSizeOption).toUInt(&ok);
+		if (!ok || (readaheadBlockSizeInKB < 4))
+		{
+			qCritical() << "Invalid read-ahead block size" << cmdlineParser.value(readaheadBlockSizeOption);
+			return -1;
+		}
+
+		ioUringDepth = cmdlineParser.value(ioUringDepthOption).toUInt(&ok);
+		if (!ok || (ioUringDepth > 256))
+		{
+			qCritical() << "Invalid io_uring depth" << cmdlineParser.value(ioUringDepthOption);
 			return -1;
 		}
 	}
 
+	AdaptiveStreamingTuner::Config adaptiveStreamingConfig;
+	adaptiveStreamingConfig.m_startOnLowestVariant = cmdlineParser.isSet(abrStartLowestOption);
+	if (cmdlineParser.isSet(abrBandwidthRatioOption))
+	{
+		adaptiveStreamingConfig.m_bandwidthTargetRatio = cmdlineParser.value(abrBandwidthRatioOption).toDouble(&ok);
+		if (!ok || (adaptiveStreamingConfig.m_bandwidthTargetRatio <= 0) || (adaptiveStreamingConfig.m_bandwidthTargetRatio > 1))
+		{
+			qCritical() << "Invalid bandwidth ratio" << cmdlineParser.value(abrBandwidthRatioOption);
+			return -1;
+		}
+	}
 
-	qDebug() << "Playing media from URL:" << inputUrl;
+	int reconnectTimeoutInSeconds = -1;
+	if (cmdlineParser.isSet(reconnectOption))
+	{
+		reconnectTimeoutInSeconds = cmdlineParser.value(reconnectOption).toInt(&ok);
+		if (!ok || (reconnectTimeoutInSeconds < 0))
+		{
+			qCritical() << "Invalid reconnect timeout" << cmdlineParser.value(reconnectOption);
+			return -1;
+		}
+	}
+
+	int qosMaxLevel = cmdlineParser.value(qosMaxLevelOption).toInt(&ok);
+	if (!ok || (qosMaxLevel < QosController::FullQuality) || (qosMaxLevel > QosController::LowFrameRate))
+	{
+		qCritical() << "Invalid QoS level" << cmdlineParser.value(qosMaxLevelOption);
+		return -1;
+	}
+
+	// A fixed video size of 0x0 stands for the display size, which is
+	// only known once the main window exists.
+	bool useFixedVideoSize = cmdlineParser.isSet(fixedVideoSizeOption);
+	int fixedVideoWidth = 0, fixedVideoHeight = 0;
+	if (useFixedVideoSize && (cmdlineParser.value(fixedVideoSizeOption) != "screen"))
+	{
+		QStringList sizeParts = cmdlineParser.value(fixedVideoSizeOption).split('x');
+		bool widthOk = false, heightOk = false;
+		if (sizeParts.size() == 2)
+		{
+			fixedVideoWidth = sizeParts[0].toInt(&widthOk);
+			fixedVideoHeight = sizeParts[1].toInt(&heightOk);
+		}
+		if (!widthOk || !heightOk || (fixedVideoWidth <= 0) || (fixedVideoHeight <= 0))
+		{
+			qCritical() << "Invalid fixed video size" << cmdlineParser.value(fixedVideoSizeOption);
+			return -1;
+		}
+	}
+
+	VideoConversion::Mode videoConversionMode = VideoConversion::Mode::Shader;
+	if (cmdlineParser.isSet(videoConversionOption))
+	{
+		QString videoConversionValue = cmdlineParser.value(videoConversionOption);
+		if (videoConversionValue == "cpu")
+			videoConversionMode = VideoConversion::Mode::Cpu;
+		else if (videoConversionValue != "shader")
+		{
+			qCritical() << "Invalid video conversion" << videoConversionValue;
+			return -1;
+		}
+	}
+
+	// The scaler renders at the size of the video item, which
+	// contradicts a fixed video size.
+	VideoScaler::Mode videoScalingMode = VideoScaler::Bilinear;
+	if (cmdlineParser.isSet(videoScalingOption))
+	{
+		if (!VideoScaler::parseMode(cmdlineParser.value(videoScalingOption), videoScalingMode))
+		{
+			qCritical() << "Invalid video scaling mode" << cmdlineParser.value(videoScalingOption);
+			return -1;
+		}
+		if (useFixedVideoSize)
+		{
+			qCritical() << "Video scaling cannot be combined with a fixed video size";
+			return -1;
+		}
+	}
+	else if (cmdlineParser.isSet(measureVideoScalingOption))
+	{
+		qCritical() << "Measuring the video scaling requires --video-scaling";
+		return -1;
+	}
+
+	int stallThresholdInMs = 0;
+	if (cmdlineParser.isSet(stallThresholdOption))
+	{
+		stallThresholdInMs = cmdlineParser.value(stallThresholdOption).toInt(&ok);
+		if (!ok || (stallThresholdInMs <= 0))
+		{
+			qCritical() << "Invalid stall threshold" << cmdlineParser.value(stallThresholdOption);
+			return -1;
+		}
+	}
+
+
+	for (PlaylistEntry const &entry : playlist)
+		qDebug() << "Playlist entry:" << entry.m_url << ((entry.m_type == PlaylistEntry::Type::Image) ? "(image)" : "(video)");
 	qDebug() << "Running in fullscreen:" << runInFullscreen;
 
 
+	// Adjust the decoder ranks before any pipeline is built. Explicit
+	// overrides are applied last to take precedence over the autotune.
+	if (cmdlineParser.isSet(decoderAutotuneOption))
+	{
+		DecoderAutotune decoderAutotune;
+		decoderAutotune.load();
+		if (decoderAutotune.results().empty())
+			LOG_WARNING("No decoder benchmark results found; run with --decoder-autotune-run first");
+		decoderAutotune.applyRanks();
+	}
+
+	if (cmdlineParser.isSet(rankOverridesOption) && !applyRankOverrides(cmdlineParser.value(rankOverridesOption)))
+		return -1;
+
+
 	// Create a dummy QML GL sink element to force the
 	// Gst Qt plugin to initialize and register the
 	// GstGLVideoItem QML element. (Subsequent instantiations
@@ -487,7 +693,55 @@ int main(int argc, char *argv[])
 		gst_object_unref(GST_OBJECT(dummy_qmlglsink));
 
 
+	qmlRegisterType<StillImageItem>("org.qmlglsinkexample", 1, 0, "StillImage");
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBAVCODEC
+	qmlRegisterType<BitmapSubtitleItem>("org.qmlglsinkexample", 1, 0, "BitmapSubtitle");
+#else
+	// Without libavcodec, bitmap subtitles are not shown. The QML UI
+	// still refers to the item, so an empty one is registered instead.
+	qmlRegisterType<QQuickItem>("org.qmlglsinkexample", 1, 0, "BitmapSubtitle");
+#endif
+	qmlRegisterUncreatableType<PlayerController>("org.qmlglsinkexample", 1, 0, "PlayerController", "PlayerController is provided by the application");
+	qmlRegisterUncreatableType<QosController>("org.qmlglsinkexample", 1, 0, "QosController", "QosController is provided by the application");
+	qmlRegisterUncreatableType<VideoScaler>("org.qmlglsinkexample", 1, 0, "VideoScaler", "VideoScaler is provided by the application");
+
+	// The player controller must be available to QML before the QML UI is
+	// loaded. It is attached to the pipeline once that one is set up.
+	PlayerController playerController;
+	QosController qosController;
+	qosController.setMaxLevel(QosController::Level(qosMaxLevel));
+	IdleController idleController;
+	// The frame metadata controller is called by the pipeline until
+	// it is shut down, which this declaration order makes sure of.
+	FrameMetadataController frameMetadataController;
+	// Same for the video scaler. Its mode can be changed from QML
+	// even if scaling is disabled, but then it has no effect.
+	VideoScaler videoScaler;
+	videoScaler.setMode(videoScalingMode);
+	videoScaler.setMeasuring(cmdlineParser.isSet(measureVideoScalingOption));
+	auto videoScalerReportGuard = makeScopeGuard([&]() {
+		videoScaler.logReport();
+	});
+
+
+	// Unthrottled playback must not wait for vsync. The swap interval
+	// has to be set before the window and its GL context are created.
+	bool unthrottled = cmdlineParser.isSet(unthrottledOption);
+	if (unthrottled)
+	{
+		QSurfaceFormat surfaceFormat = QSurfaceFormat::defaultFormat();
+		surfaceFormat.setSwapInterval(0);
+		QSurfaceFormat::setDefaultFormat(surfaceFormat);
+	}
+
+
 	QQmlApplicationEngine qml_engine;
+	qml_engine.rootContext()->setContextProperty("player", &playerController);
+	qml_engine.rootContext()->setContextProperty("qos", &qosController);
+	qml_engine.rootContext()->setContextProperty("idle", &idleController);
+	qml_engine.rootContext()->setContextProperty("frameMetadata", &frameMetadataController);
+	qml_engine.rootContext()->setContextProperty("videoScaler", &videoScaler);
+	qml_engine.rootContext()->setContextProperty("videoScalingEnabled", cmdlineParser.isSet(videoScalingOption));
 	qml_engine.load(QUrl("qrc:/main.qml"));
 	if (qml_engine.rootObjects().empty())
 	{
@@ -501,9 +755,186 @@ int main(int argc, char *argv[])
 	QQuickWindow *mainWindow = qobject_cast<QQuickWindow*>(qml_engine.rootObjects().value(0));
 
 
+	// Register the read-ahead file source with a rank above the one of
+	// filesrc, so playbin picks it for file:// URIs.
+	if (useReadaheadFileSrc && !registerReadAheadFileSrc(GST_RANK_PRIMARY + 1))
+		return -1;
+
+
+	// The profiler is created before the pipeline, and reports after the
+	// pipeline is destroyed, so the teardown is included in the report.
+	std::unique_ptr<StateChangeProfiler> stateChangeProfiler;
+	if (cmdlineParser.isSet(profileStateChangesOption))
+		stateChangeProfiler.reset(new StateChangeProfiler);
+	auto stateChangeReportGuard = makeScopeGuard([&]() {
+		if (stateChangeProfiler)
+			stateChangeProfiler->logReport();
+	});
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBAVCODEC
+	// The pipeline hands bitmap subtitles to this decoder until it is
+	// shut down, so the decoder must outlive it.
+	BitmapSubtitleDecoder bitmapSubtitleDecoder;
+#endif
+
+	// The video conversion updates the tone mapping shader from the
+	// streaming thread, so it must outlive the pipeline as well.
+	std::unique_ptr<VideoConversion> videoConversion;
+	if (cmdlineParser.isSet(videoConversionOption) || cmdlineParser.isSet(hdrToneMappingOption))
+		videoConversion.reset(new VideoConversion(videoConversionMode, cmdlineParser.isSet(hdrToneMappingOption)));
+	auto videoConversionReportGuard = makeScopeGuard([&]() {
+		if (videoConversion)
+			videoConversion->logReport();
+	});
+
+
 	Pipeline pipeline;
-	if (!pipeline.setup(inputUrl, mainWindow))
+	if (useFixedVideoSize)
+	{
+		if ((fixedVideoWidth == 0) && (mainWindow->screen() != nullptr))
+		{
+			QSize screenSize = mainWindow->screen()->size() * mainWindow->screen()->devicePixelRatio();
+			fixedVideoWidth = screenSize.width();
+			fixedVideoHeight = screenSize.height();
+		}
+		if (fixedVideoWidth > 0)
+			pipeline.setFixedVideoSize(fixedVideoWidth, fixedVideoHeight);
+	}
+	if (videoConversion && !videoConversion->setup(pipeline))
+		return -1;
+	// Added after the tone mapping, so that it scales its output.
+	if (cmdlineParser.isSet(videoScalingOption) && !videoScaler.setup(pipeline))
 		return -1;
+	if (!pipeline.setup(mainWindow))
+		return -1;
+	if (videoConversion)
+		videoConversion->attach(pipeline);
+	if (stateChangeProfiler)
+		stateChangeProfiler->attach(pipeline);
+	playerController.attach(pipeline);
+	// Without clock synchronization, there are no late frames to react to.
+	if ((qosMaxLevel > QosController::FullQuality) && !unthrottled)
+		qosController.attach(pipeline);
+
+	std::unique_ptr<ResolutionChangeMonitor> resolutionChangeMonitor;
+	if (cmdlineParser.isSet(measureResolutionChangesOption))
+	{
+		resolutionChangeMonitor.reset(new ResolutionChangeMonitor);
+		resolutionChangeMonitor->attach(pipeline);
+	}
+	auto resolutionChangeReportGuard = makeScopeGuard([&]() {
+		if (resolutionChangeMonitor)
+			resolutionChangeMonitor->logReport();
+	});
+
+	std::unique_ptr<ClosedCaptionExtractor> closedCaptionExtractor;
+	if (cmdlineParser.isSet(closedCaptionsOption))
+	{
+		closedCaptionExtractor.reset(new ClosedCaptionExtractor);
+		closedCaptionExtractor->attach(pipeline);
+	}
+
+	std::unique_ptr<ThroughputBenchmark> throughputBenchmark;
+	if (unthrottled)
+	{
+		throughputBenchmark.reset(new ThroughputBenchmark);
+		if (!throughputBenchmark->start(pipeline, mainWindow))
+			return -1;
+	}
+	auto throughputReportGuard = makeScopeGuard([&]() {
+		if (throughputBenchmark)
+			throughputBenchmark->logReport();
+	});
+
+	if (useReadaheadFileSrc)
+	{
+		pipeline.addSourceSetupHandler([=](GstElement *source) {
+			if (!G_TYPE_CHECK_INSTANCE_TYPE(source, GST_TYPE_READ_AHEAD_FILE_SRC))
+				return;
+
+			g_object_set(
+				source,
+				"readahead-size", guint64(readaheadSizeInMB) * 1024 * 1024,
+				"block-size", guint(readaheadBlockSizeInKB * 1024),
+				"io-uring-depth", guint(ioUringDepth),
+				nullptr
+			);
+		});
+	}
+
+	RawFrameSource rawFrameSource;
+	if (useRawFrames)
+	{
+		if (cmdlineParser.isSet(rawFrameFormatOption))
+			rawFrameSource.setRawFormat(rawFrameFormat);
+		rawFrameSource.attach(pipeline);
+	}
+
+	// Frames generated by the application itself are shown by playing
+	// FramePusher::uri(). The test pattern demonstrates this.
+	FramePusher framePusher;
+	QTimer testPatternTimer;
+	if (cmdlineParser.isSet(pushTestPatternOption))
+	{
+		framePusher.attach(pipeline);
+
+		testPatternTimer.setInterval(1000 / 30);
+		QObject::connect(&testPatternTimer, &QTimer::timeout, [&framePusher]() {
+			static unsigned int frameCounter = 0;
+			constexpr int width = 640, height = 360, barWidth = 32;
+
+			GstVideoInfo videoInfo;
+			gst_video_info_set_format(&videoInfo, GST_VIDEO_FORMAT_BGRx, width, height);
+
+			// A vertical bar that moves across a gray gradient. The frame
+			// memory is owned by the pipeline until it is released.
+			std::vector<guint8> *frame = new std::vector<guint8>(GST_VIDEO_INFO_SIZE(&videoInfo));
+			int barX = (frameCounter++ * 4) % width;
+			for (int y = 0; y < height; ++y)
+			{
+				guint32 *row = reinterpret_cast<guint32 *>(frame->data() + y * GST_VIDEO_INFO_PLANE_STRIDE(&videoInfo, 0));
+				for (int x = 0; x < width; ++x)
+				{
+					guint32 gray = guint32(x * 255 / width);
+					row[x] = ((x >= barX) && (x < barX + barWidth)) ? 0xFFFF8000u : (0xFF000000u | (gray << 16) | (gray << 8) | gray);
+				}
+			}
+
+			framePusher.pushFrame(videoInfo, frame->data(), [frame]() { delete frame; });
+		});
+		testPatternTimer.start();
+	}
+
+	// Cap the resolution of adaptive streams to the physical display size.
+	if (cmdlineParser.isSet(abrCapResolutionOption) && (mainWindow->screen() != nullptr))
+	{
+		QSize screenSize = mainWindow->screen()->size() * mainWindow->screen()->devicePixelRatio();
+		adaptiveStreamingConfig.m_maxVideoWidth = screenSize.width();
+		adaptiveStreamingConfig.m_maxVideoHeight = screenSize.height();
+	}
+	AdaptiveStreamingTuner adaptiveStreamingTuner(adaptiveStreamingConfig);
+	adaptiveStreamingTuner.attach(pipeline);
+
+	// The autoplug cache must see start failures before the playlist
+	// player reacts to them by starting the next entry.
+	std::unique_ptr<AutoplugCache> autoplugCache;
+	if (cmdlineParser.isSet(autoplugCacheOption))
+	{
+		autoplugCache.reset(new AutoplugCache);
+		autoplugCache->load();
+		autoplugCache->attach(pipeline);
+	}
+
+	// The position store must see the end of an input before the
+	// playlist player reacts to it by starting the next entry.
+	std::unique_ptr<PositionStore> positionStore;
+	if (cmdlineParser.isSet(resumeOption))
+	{
+		positionStore.reset(new PositionStore);
+		positionStore->setLaunchTime(launchTime);
+		positionStore->load();
+		positionStore->attach(pipeline, playerController);
+	}
 
 	// Install the signal handlers. They will call the main window's
 	// quit() application when these handlers catch a signal.
@@ -517,7 +948,8 @@ int main(int argc, char *argv[])
 		mainWindow->show();
 
 
-	// Get the GLVideoItem from the QML user interface.
+	// Get the GLVideoItem, the still image item, and the bitmap
+	// subtitle item from the QML user interface.
 
 	QQuickItem *videoItem = mainWindow->findChild<QQuickItem *>("videoItem");
 	if (videoItem == nullptr)
@@ -525,6 +957,118 @@ int main(int argc, char *argv[])
 		qCritical() << "Could not find video item";
 		return -1;
 	}
+	if (cmdlineParser.isSet(videoScalingOption))
+		videoScaler.attach(videoItem);
+
+	StillImageItem *stillImageItem = mainWindow->findChild<StillImageItem *>("stillImageItem");
+	if (stillImageItem == nullptr)
+	{
+		qCritical() << "Could not find still image item";
+		return -1;
+	}
+	stillImageItem->setCacheBudget(std::size_t(imageCacheSizeInMB) * 1024 * 1024);
+
+#ifdef QMLGLSINK_EXAMPLE_HAVE_LIBAVCODEC
+	BitmapSubtitleItem *bitmapSubtitleItem = mainWindow->findChild<BitmapSubtitleItem *>("bitmapSubtitleItem");
+	if (bitmapSubtitleItem == nullptr)
+	{
+		qCritical() << "Could not find bitmap subtitle item";
+		return -1;
+	}
+	bitmapSubtitleDecoder.attach(pipeline, bitmapSubtitleItem);
+#endif
+
+
+	// Set up the pressure monitoring (if enabled).
+	PressureMonitor pressureMonitor;
+	std::unique_ptr<ResourceScaler> resourceScaler;
+	if (cmdlineParser.isSet(pressureMonitorOption) && pressureMonitor.start())
+	{
+		resourceScaler.reset(new ResourceScaler(pipeline, stillImageItem, pressureMonitor));
+		resourceScaler->setNormalImageCacheBudget(std::size_t(imageCacheSizeInMB) * 1024 * 1024);
+	}
+
+
+	// Set up the idle mode (if enabled). Components with periodic
+	// work are stopped or throttled while the controller is active.
+	if (cmdlineParser.isSet(idleModeOption) || cmdlineParser.isSet(idleReportOption))
+	{
+		idleController.start(playerController, mainWindow, cmdlineParser.isSet(idleModeOption));
+		QObject::connect(&idleController, &IdleController::activeChanged, &pressureMonitor, &PressureMonitor::setIdle);
+		// A new still image changes the screen without any playback.
+		QObject::connect(stillImageItem, &StillImageItem::sourceChanged, &idleController, &IdleController::wakeUp);
+	}
+	auto idleReportGuard = makeScopeGuard([&]() {
+		idleController.logReport();
+	});
+
+
+	// Set up the frame metadata extraction (if enabled).
+	if (cmdlineParser.isSet(frameMetadataOption))
+		frameMetadataController.start(pipeline, mainWindow);
+
+
+	// Start the stall monitor (if enabled) now that the window exists.
+	// The report is logged once the application quits.
+	std::unique_ptr<StallMonitor> stallMonitor;
+	if (stallThresholdInMs > 0)
+	{
+		stallMonitor.reset(new StallMonitor(stallThresholdInMs, cmdlineParser.isSet(stallStackSamplesOption)));
+		if (!stallMonitor->start(mainWindow))
+			return -1;
+
+		// Make the histograms accessible from QML via stallMonitor.report().
+		qml_engine.rootContext()->setContextProperty("stallMonitor", stallMonitor.get());
+
+		QObject::connect(&idleController, &IdleController::activeChanged, stallMonitor.get(), &StallMonitor::setIdle);
+	}
+	auto stallReportGuard = makeScopeGuard([&]() {
+		if (stallMonitor)
+		{
+			stallMonitor->stop();
+			stallMonitor->logReport();
+		}
+	});
+
+
+	PlaylistPlayer playlistPlayer(pipeline, mainWindow, stillImageItem, std::move(playlist));
+	playlistPlayer.setLooping(loopPlaylist);
+	playlistPlayer.setDefaultImageDuration(int(imageDurationInSeconds * 1000));
+
+	// Load the media index, and discover the entries that are missing
+	// in it in the background, while the playlist is already playing.
+	std::unique_ptr<MediaIndex> mediaIndex;
+	if (cmdlineParser.isSet(mediaIndexOption))
+	{
+		mediaIndex.reset(new MediaIndex);
+		if (!mediaIndex->load())
+			return -1;
+		mediaIndex->attach(pipeline);
+		mediaIndex->scan(playlistPlayer.playlist());
+	}
+
+	std::unique_ptr<ReconnectController> reconnectController;
+	if (reconnectTimeoutInSeconds >= 0)
+	{
+		reconnectController.reset(new ReconnectController(pipeline));
+		reconnectController->setTimeout(reconnectTimeoutInSeconds * 1000);
+		playlistPlayer.setReconnectController(reconnectController.get());
+	}
+
+
+	// Set up the soak test if requested. The playlist is always looped
+	// during the soak test to keep the pipeline busy until the end.
+	std::unique_ptr<SoakTest> soakTest;
+	if (soakTestDurationInSeconds > 0)
+	{
+		playlistPlayer.setLooping(true);
+
+		soakTest.reset(new SoakTest(pipeline, playlistPlayer, playerController));
+		soakTest->setDuration(soakTestDurationInSeconds);
+		soakTest->setActionInterval(soakActionIntervalInMs);
+		soakTest->setBounds(soakTestBounds);
+		soakTest->start();
+	}
 
 
 	// NOTE: On Wayland and X11, both of these approaches work.
@@ -537,11 +1081,8 @@ int main(int argc, char *argv[])
 	QObject::connect(mainWindow, &QQuickWindow::sceneGraphInitialized, [&]() {
 		qDebug() << "Starting pipeline";
 
-		if (!pipeline.start(videoItem))
-		{
-			qCritical() << "Could not start pipeline; quitting";
-			app.quit();
-		}
+		pipeline.attachVideoItem(videoItem);
+		QMetaObject::invokeMethod(&playlistPlayer, "start", Qt::QueuedConnection);
 	});
 #else
 	// Create an instance of the SetPlayingJob helper class and schedule it
@@ -550,11 +1091,18 @@ int main(int argc, char *argv[])
 	// _after_ the scenegraph is up and running, implying that the EGL context
 	// is initialized and valid (this is required by qmlglsink).
 	mainWindow->scheduleRenderJob(
-		new SetPlayingJob(pipeline, videoItem, app),
+		new SetPlayingJob(pipeline, videoItem, playlistPlayer),
 		QQuickWindow::BeforeSynchronizingStage
 	);
 #endif
 
 
-	return app.exec();
+	int exitCode = app.exec();
+
+	// Many of the objects above are declared after the pipeline, and would
+	// be destroyed while its streaming threads still call them. Shutting it
+	// down here ends those threads first.
+	pipeline.shutdown();
+
+	return exitCode;
 }
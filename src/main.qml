@@ -2,6 +2,7 @@ import QtQuick 2.0
 import QtQuick.Layouts 1.3
 import QtQuick.Window 2.0
 import org.freedesktop.gstreamer.GLVideoItem 1.0
+import org.qmlglsinkexample 1.0
 
 
 Window {
@@ -10,6 +11,7 @@ Window {
 	width: 1280
 	height: 720
 	property var subtitle: ""
+	property bool showImage: false
 	onSubtitleChanged: {
 		subtitleTimer.stop();
 		subtitleTimer.interval = Math.max(subtitle.length * 80, 1000);
@@ -17,6 +19,13 @@ Window {
 		subtitleTimer.start();
 
 	}
+	// Closed captions are not cleared by the timer. The caption
+	// decoder clears them itself, and they take precedence over
+	// regular subtitles while they are shown.
+	property string caption: ""
+	onCaptionChanged: {
+		subtitleItem.visible = true;
+	}
 
 	GstGLVideoItem {
 		objectName: "videoItem"
@@ -24,6 +33,25 @@ Window {
 		z: 1 // Set z to 1 to keep the video item below the subtitle item
 	}
 
+	Rectangle {
+		anchors.fill: parent
+		color: "black"
+		visible: window.showImage
+		z: 1.5 // Set z to 1.5 to hide the video item while images are shown
+
+		StillImage {
+			objectName: "stillImageItem"
+			anchors.fill: parent
+		}
+	}
+
+	BitmapSubtitle {
+		objectName: "bitmapSubtitleItem"
+		anchors.fill: parent
+		visible: !window.showImage
+		z: 2 // Set z to 2 to keep the subtitles above the video item
+	}
+
 	Timer {
 		id: subtitleTimer
 		interval: 300
@@ -35,11 +63,79 @@ Window {
 		}
 	}
 
+	// While idle, the subtitle stays until playback continues, instead of
+	// the timer waking up the GUI thread and rendering a frame without it.
+	Connections {
+		target: idle
+		onActiveChanged: {
+			if (idle.active)
+				subtitleTimer.stop();
+			else if (subtitle !== "")
+				subtitleTimer.restart();
+		}
+	}
+
+	Rectangle {
+		id: progressBar
+		visible: !window.showImage && (player.duration > 0) && (player.position >= 0)
+		color: "#80000000"
+		height: Math.max(parent.height / 100, 4)
+		anchors.left: parent.left
+		anchors.right: parent.right
+		anchors.bottom: parent.bottom
+		z: 3 // Set z to 3 to keep the progress bar above everything else
+
+		Rectangle {
+			color: (player.buffering < 100) ? "orange" : "white"
+			width: parent.width * Math.min(player.position / player.duration, 1.0)
+			anchors.top: parent.top
+			anchors.bottom: parent.bottom
+			anchors.left: parent.left
+		}
+
+		MouseArea {
+			anchors.fill: parent
+			onClicked: player.seek(player.duration * mouse.x / width)
+		}
+	}
+
+	// Small marker in the top right corner while the video quality is degraded.
+	Rectangle {
+		visible: !window.showImage && (qos.level !== QosController.FullQuality)
+		color: (qos.level === QosController.LowFrameRate) ? "red" : "orange"
+		width: Math.max(parent.height / 60, 6)
+		height: width
+		radius: width / 2
+		anchors.top: parent.top
+		anchors.right: parent.right
+		anchors.margins: width
+		z: 3
+	}
+
+	// Shows the filter of the video scaler; clicking it selects the next one.
+	Text {
+		visible: videoScalingEnabled && !window.showImage
+		text: "Scaling: " + ["nearest", "bilinear", "bicubic", "lanczos", "area"][videoScaler.mode]
+		color: "white"
+		style: Text.Outline
+		styleColor: "black"
+		font.pixelSize: Math.max(parent.height / 40, 10)
+		anchors.top: parent.top
+		anchors.left: parent.left
+		anchors.margins: font.pixelSize
+		z: 3
+
+		MouseArea {
+			anchors.fill: parent
+			onClicked: videoScaler.mode = (videoScaler.mode + 1) % (VideoScaler.Area + 1)
+		}
+	}
+
 	Text {
 		id: subtitleItem
 		objectName: "subtitleItem"
 		visible: false
-		text: window.subtitle
+		text: (window.caption !== "") ? window.caption : window.subtitle
 		textFormat: Text.StyledText
 		height: parent.height / 5
 		color: "white"